@@ -24,19 +24,25 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
 
 // open ssl related includes
 #include <openssl/crypto.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/engine.h>
+#include <openssl/pem.h>
 
 // Socket related includes
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 
 
@@ -62,6 +68,14 @@
 //#define SECURE_COMM		TLS_client_method()
 #define SECURE_COMM		DTLS_client_method()
 
+// Load generator
+#define MAX_THREADS		256
+// Histogram of 64 sub-buckets per power of two, values are kept to about 1.5%
+#define HIST_SUB_BITS		6
+#define HIST_SUB		(1 << HIST_SUB_BITS)
+#define HIST_MAGNITUDES		32
+#define HIST_BUCKETS		(2 * HIST_SUB + (HIST_MAGNITUDES - 1) * HIST_SUB)
+
 
 //typedef
 // For Socket
@@ -73,19 +87,128 @@ typedef enum {
 	SOCKET_OPERATION_OK
 } timeout_state;
 
+// Latency histogram in usec, HdrHistogram style
+typedef struct {
+	uint64_t	count;
+	uint64_t	sum;
+	uint64_t	min;
+	uint64_t	max;
+	uint64_t	bucket[HIST_BUCKETS];
+} histogram_t;
+
+typedef enum {
+	PHASE_CONNECT,
+	PHASE_HANDSHAKE,
+	PHASE_FIRST_BYTE,
+	PHASE_COUNT
+} phase_t;
+
+typedef struct {
+	pthread_t	thread;
+	SSL_SESSION	*session;	// resumed by the next connection of the thread
+	uint64_t	connections;
+	uint64_t	failures;
+	uint64_t	resumed;
+	histogram_t	phase[PHASE_COUNT];
+} loadThread_t;
+
+typedef struct {
+	const char	*ip;
+	short int	port;
+	int		threads;
+	uint64_t	total;		// connections, 0 to run for duration
+	int		duration;	// seconds
+	int		tls;
+	int		resume;
+	const char	*key;		// 0x... for a key on the chip, otherwise a PEM file
+	const char	*cert;
+} loadConfig_t;
+
 //extern
 extern	int waitpid();
 
 // Function Protoyping
 void doClientConnect(void);
+static int doLoadTest(const loadConfig_t *config);
+
+static void _helpmenu(void)
+{
+	printf("\nHelp menu: simpleTest_Client <option> ...<option>\n");
+	printf("Without -n or -d a single connection counts to 100 with the server.\n");
+	printf("option:- \n");
+	printf("-n <count>    : Load generator, make <count> connections\n");
+	printf("-d <seconds>  : Load generator, make connections for <seconds>\n");
+	printf("-c <count>    : Concurrent connections (default 1)\n");
+	printf("-i <ip>       : Server IP (default %s)\n", DEFAULT_IP);
+	printf("-p <port>     : Server port (default %d)\n", DEFAULT_PORT);
+	printf("-t            : Use TLS instead of DTLS\n");
+	printf("-r            : Resume the previous session instead of full handshakes\n");
+	printf("-k <key>      : Client key, 0x<OID> on the chip or a PEM file\n");
+	printf("-e <cert>     : Client certificate for -k, PEM file\n");
+	printf("-h            : Print this help \n");
+}
 
 
 int main (int argc, char *argv[])
 {
+	loadConfig_t config;
+	int option;
+
+	memset(&config, 0, sizeof(config));
+	config.ip = DEFAULT_IP;
+	config.port = DEFAULT_PORT;
+	config.threads = 1;
+
+	opterr = 0; // Disable getopt error messages in case of unknown parameters
+	while (-1 != (option = getopt(argc, argv, "n:d:c:i:p:trk:e:h")))
+	{
+		switch (option)
+		{
+			case 'n':
+				config.total = strtoull(optarg, NULL, 0);
+				break;
+			case 'd':
+				config.duration = atoi(optarg);
+				break;
+			case 'c':
+				config.threads = atoi(optarg);
+				if ((config.threads < 1) || (config.threads > MAX_THREADS))
+				{
+					printf("Concurrency must be 1 to %d\n", MAX_THREADS);
+					exit(1);
+				}
+				break;
+			case 'i':
+				config.ip = optarg;
+				break;
+			case 'p':
+				config.port = (short int)atoi(optarg);
+				break;
+			case 't':
+				config.tls = 1;
+				break;
+			case 'r':
+				config.resume = 1;
+				break;
+			case 'k':
+				config.key = optarg;
+				break;
+			case 'e':
+				config.cert = optarg;
+				break;
+			case 'h':
+			default:
+				_helpmenu();
+				exit(0);
+		}
+	}
 
 	//Print Heading
 	DEBUGPRINT("*****************************************");
 	
+	if ((config.total != 0) || (config.duration != 0))
+		return doLoadTest(&config);
+
 	doClientConnect();
 
 	return 0;
@@ -246,3 +369,326 @@ void doClientConnect(void)
 	DEBUGPRINT("it works!!!!");
 }
 
+
+/**********************************************************************/
+// Load generator
+
+static const loadConfig_t	*loadConfig;
+static SSL_CTX			*loadCtx;
+static uint64_t			loadStarted;
+static struct timespec		loadDeadline;
+
+static uint64_t elapsedUsec(const struct timespec *from, const struct timespec *to)
+{
+	return (uint64_t)(to->tv_sec - from->tv_sec) * 1000000 + (to->tv_nsec - from->tv_nsec) / 1000;
+}
+
+static int histIndex(uint64_t value)
+{
+	int magnitude = 0;
+
+	while ((value >> magnitude) >= 2 * HIST_SUB)
+		magnitude++;
+	if (magnitude == 0)
+		return (int)value;
+	if (magnitude >= HIST_MAGNITUDES)
+		return HIST_BUCKETS - 1;
+	return 2 * HIST_SUB + (magnitude - 1) * HIST_SUB + (int)((value >> magnitude) - HIST_SUB);
+}
+
+// Highest value counted in the bucket
+static uint64_t histValue(int index)
+{
+	int magnitude;
+	uint64_t sub;
+
+	if (index < 2 * HIST_SUB)
+		return (uint64_t)index;
+	magnitude = (index - 2 * HIST_SUB) / HIST_SUB + 1;
+	sub = (uint64_t)((index - 2 * HIST_SUB) % HIST_SUB + HIST_SUB);
+	return ((sub + 1) << magnitude) - 1;
+}
+
+static void histRecord(histogram_t *h, uint64_t value)
+{
+	if ((h->count == 0) || (value < h->min))
+		h->min = value;
+	if (value > h->max)
+		h->max = value;
+	h->count++;
+	h->sum += value;
+	h->bucket[histIndex(value)]++;
+}
+
+static void histMerge(histogram_t *to, const histogram_t *from)
+{
+	int i;
+
+	if (from->count == 0)
+		return;
+	if ((to->count == 0) || (from->min < to->min))
+		to->min = from->min;
+	if (from->max > to->max)
+		to->max = from->max;
+	to->count += from->count;
+	to->sum += from->sum;
+	for (i = 0; i < HIST_BUCKETS; i++)
+		to->bucket[i] += from->bucket[i];
+}
+
+// Prints the percentile distribution, each line halves the distance to 100%
+static void histPrint(const char *name, const histogram_t *h)
+{
+	uint64_t seen = 0;
+	uint64_t target, value;
+	double percentile = 50.0;
+	int i = 0;
+
+	printf("\n%s [ms]: count %llu, min %.3f, mean %.3f, max %.3f\n", name,
+	       (unsigned long long)h->count, h->min / 1000.0,
+	       h->count ? (double)h->sum / h->count / 1000.0 : 0.0, h->max / 1000.0);
+	if (h->count == 0)
+		return;
+	printf("%12s %14s %10s\n", "Value", "Percentile", "TotalCount");
+	while (1)
+	{
+		target = (uint64_t)(percentile / 100.0 * h->count + 0.999999);
+		if (target == 0)
+			target = 1;
+		while ((seen + h->bucket[i]) < target)
+			seen += h->bucket[i++];
+		value = histValue(i);
+		if (value > h->max)
+			value = h->max;
+		printf("%12.3f %14.6f %10llu\n", value / 1000.0, percentile / 100.0,
+		       (unsigned long long)(seen + h->bucket[i]));
+		if (percentile >= 100.0)
+			break;
+		if ((seen + h->bucket[i]) >= h->count)
+		{
+			printf("%12.3f %14.6f %10llu\n", h->max / 1000.0, 1.0, (unsigned long long)h->count);
+			break;
+		}
+		percentile += (100.0 - percentile) / 2;
+		if (percentile > 99.99)
+			percentile = 100.0;
+	}
+}
+
+// One connection: TCP connect, handshake, one echo, then asks the server to close
+static int loadConnect(loadThread_t *t)
+{
+	struct sockaddr_in	server_addr;
+	struct timeval		timeout = {10, 0};
+	struct timespec		t0, t1, t2, t3;
+	SSL			*ssl = NULL;
+	uint8_t			buf[256];
+	uint8_t			count = 1;
+	int			sock;
+	int			on = 1;
+	int			ret = -1;
+
+	sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sock == -1)
+		return -1;
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	// Small records go out at once, otherwise delayed acks end up in the timings
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+	memset(&server_addr, '\0', sizeof(server_addr));
+	server_addr.sin_family = AF_INET;
+	server_addr.sin_port = htons(loadConfig->port);
+	server_addr.sin_addr.s_addr = inet_addr(loadConfig->ip);
+
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (connect(sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) == -1)
+			break;
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+
+		ssl = SSL_new(loadCtx);
+		if (ssl == NULL)
+			break;
+		SSL_set_fd(ssl, sock);
+		if (loadConfig->resume && (t->session != NULL))
+			SSL_set_session(ssl, t->session);
+		if (SSL_connect(ssl) != 1)
+			break;
+		clock_gettime(CLOCK_MONOTONIC, &t2);
+
+		if ((SSL_write(ssl, &count, 1) != 1) || (SSL_read(ssl, buf, sizeof(buf)) <= 0))
+			break;
+		clock_gettime(CLOCK_MONOTONIC, &t3);
+
+		histRecord(&t->phase[PHASE_CONNECT], elapsedUsec(&t0, &t1));
+		histRecord(&t->phase[PHASE_HANDSHAKE], elapsedUsec(&t1, &t2));
+		histRecord(&t->phase[PHASE_FIRST_BYTE], elapsedUsec(&t2, &t3));
+		if (SSL_session_reused(ssl))
+			t->resumed++;
+
+		// Taken after the echo, TLS 1.3 tickets arrive after the handshake
+		if (loadConfig->resume)
+		{
+			SSL_SESSION_free(t->session);
+			t->session = SSL_get1_session(ssl);
+		}
+
+		// Above 100 ends the session on the server
+		count = 101;
+		SSL_write(ssl, &count, 1);
+		SSL_shutdown(ssl);
+		ret = 0;
+	} while (0);
+
+	if (ret != 0)
+		ERR_print_errors_fp(stderr);
+	SSL_free(ssl);
+	close(sock);
+	return ret;
+}
+
+static void *loadThread(void *arg)
+{
+	loadThread_t *t = (loadThread_t *)arg;
+	struct timespec now;
+
+	while (1)
+	{
+		if (loadConfig->total != 0)
+		{
+			if (__atomic_fetch_add(&loadStarted, 1, __ATOMIC_RELAXED) >= loadConfig->total)
+				break;
+		}
+		else
+		{
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if ((now.tv_sec > loadDeadline.tv_sec) ||
+			    ((now.tv_sec == loadDeadline.tv_sec) && (now.tv_nsec >= loadDeadline.tv_nsec)))
+				break;
+		}
+
+		t->connections++;
+		if (loadConnect(t) != 0)
+			t->failures++;
+	}
+	SSL_SESSION_free(t->session);
+	return NULL;
+}
+
+static int loadSetup(const loadConfig_t *config)
+{
+	ENGINE		*e;
+	EVP_PKEY	*pkey = NULL;
+	FILE		*fp;
+
+	SSL_library_init();
+	SSL_load_error_strings();
+
+	loadCtx = SSL_CTX_new(config->tls ? TLS_client_method() : SECURE_COMM);
+	if (!loadCtx)
+	{
+		ERR_print_errors_fp(stderr);
+		return -1;
+	}
+	if(!SSL_CTX_load_verify_locations(loadCtx, CA_CERT, NULL))
+	{
+		ERR_print_errors_fp(stderr);
+		return -1;
+	}
+	SSL_CTX_set_verify(loadCtx, SSL_VERIFY_PEER, NULL);
+	SSL_CTX_set_verify_depth(loadCtx, 1);
+	SSL_CTX_set_session_cache_mode(loadCtx, SSL_SESS_CACHE_CLIENT);
+
+	if (config->key == NULL)
+		return 0;
+
+	if (strncmp(config->key, "0x", 2) == 0)
+	{
+		// Only the key is on the chip, the engine is not made the default
+		ENGINE_load_builtin_engines();
+		e = ENGINE_by_id(ENGINE_NAME);
+		if ((e == NULL) || !ENGINE_init(e))
+		{
+			DEBUGPRINT("Cannot Init Trustx Engine!!");
+			return -1;
+		}
+		pkey = ENGINE_load_private_key(e, config->key, UI_OpenSSL(), NULL);
+		ENGINE_free(e);
+	}
+	else
+	{
+		fp = fopen(config->key, "r");
+		if (fp != NULL)
+		{
+			pkey = PEM_read_PrivateKey(fp, NULL, NULL, NULL);
+			fclose(fp);
+		}
+	}
+
+	if ((pkey == NULL) || (config->cert == NULL) ||
+	    (SSL_CTX_use_certificate_file(loadCtx, config->cert, SSL_FILETYPE_PEM) <= 0) ||
+	    !SSL_CTX_use_PrivateKey(loadCtx, pkey) ||
+	    !SSL_CTX_check_private_key(loadCtx))
+	{
+		DEBUGPRINT("Cannot use the client key %s with certificate %s", config->key,
+			   config->cert ? config->cert : "(none)");
+		ERR_print_errors_fp(stderr);
+		EVP_PKEY_free(pkey);
+		return -1;
+	}
+	EVP_PKEY_free(pkey);
+	return 0;
+}
+
+static int doLoadTest(const loadConfig_t *config)
+{
+	static loadThread_t	threads[MAX_THREADS];
+	static histogram_t	total[PHASE_COUNT];
+	static const char	*phaseName[PHASE_COUNT] = {"connect", "handshake", "first byte"};
+	struct timespec		start, end;
+	uint64_t		connections = 0, failures = 0, resumed = 0;
+	double			seconds;
+	int			i, p;
+
+	loadConfig = config;
+	signal(SIGPIPE, SIG_IGN);
+	if (loadSetup(config) != 0)
+		return 1;
+
+	DEBUGPRINT("%s to %s:%d, %d concurrent, %s%s", config->tls ? "TLS" : "DTLS", config->ip, config->port,
+		   config->threads, config->resume ? "resumed sessions" : "full handshakes",
+		   (config->key == NULL) ? "" : ", client key");
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	loadDeadline = start;
+	loadDeadline.tv_sec += config->duration;
+	for (i = 0; i < config->threads; i++)
+	{
+		if (pthread_create(&threads[i].thread, NULL, loadThread, &threads[i]) != 0)
+		{
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < config->threads; i++)
+	{
+		pthread_join(threads[i].thread, NULL);
+		connections += threads[i].connections;
+		failures += threads[i].failures;
+		resumed += threads[i].resumed;
+		for (p = 0; p < PHASE_COUNT; p++)
+			histMerge(&total[p], &threads[i].phase[p]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	seconds = elapsedUsec(&start, &end) / 1e6;
+
+	printf("%llu connections, %llu failed, %llu resumed in %.2f s: %.2f handshakes/s\n",
+	       (unsigned long long)connections, (unsigned long long)failures, (unsigned long long)resumed,
+	       seconds, (seconds > 0) ? (connections - failures) / seconds : 0.0);
+	for (p = 0; p < PHASE_COUNT; p++)
+		histPrint(phaseName[p], &total[p]);
+
+	SSL_CTX_free(loadCtx);
+	return (failures == 0) ? 0 : 1;
+}
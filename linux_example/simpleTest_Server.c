@@ -23,21 +23,33 @@
 
 */
 
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <signal.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <time.h>
+#include <poll.h>
+#include <pthread.h>
 
 // open ssl related includes
 #include <openssl/crypto.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/engine.h>
+#include <openssl/async.h>
+#include <openssl/rand.h>
+#include <openssl/hmac.h>
 
 // Socket related includes
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 
 
@@ -62,293 +74,855 @@
 // Default IP/PORT
 #define DEFAULT_IP              "127.0.0.1"
 #define DEFAULT_PORT            5000
+#define DEFAULT_STATS_PORT      5001
 //#define SECURE_COMM		TLS_server_method()
 #define SECURE_COMM		DTLS_server_method()
 
+// Server settings
+#define DEFAULT_WORKERS		4
+#define MAX_WORKERS		64
+#define MAX_EVENTS		64
+#define IDLE_TIMEOUT		5	// seconds without a message before a client is dropped
+#define LATENCY_SAMPLES		4096	// handshakes the latency percentiles are taken over
+#define DEFAULT_CACHE_SIZE	20480	// sessions
+#define DEFAULT_TICKET_LIFETIME	3600	// seconds a ticket key issues tickets, it decrypts them for as long again
+
 //typedef
-// For Socket
-typedef enum {
-	SOCKET_IS_NONBLOCKING,
-	SOCKET_IS_BLOCKING,
-	SOCKET_HAS_TIMED_OUT,
-	SOCKET_HAS_BEEN_CLOSED,
-	SOCKET_OPERATION_OK
-} timeout_state;
-
-//extern
-extern  int waitpid();
+// Connection handed from the accept loop to a worker
+typedef struct {
+	int			sock;
+	struct timespec		accepted;
+} newConn_t;
+
+typedef struct _tag_conn {
+	struct _tag_conn	*next;
+	struct _tag_conn	*prev;
+	int			sock;
+	int			id;
+	SSL			*ssl;
+	uint8_t			connected;	// handshake done
+	uint8_t			paused;		// handshake waits for the chip in an async job
+	uint8_t			closed;		// freed at the end of the event batch
+	struct timespec		accepted;
+	time_t			lastActive;
+} conn_t;
+
+typedef struct {
+	pthread_t		thread;
+	int			index;
+	int			epfd;
+	int			pipefd[2];	// new connections from the accept loop
+	conn_t			*conns;
+	conn_t			*dead;
+} worker_t;
+
+typedef struct {
+	pthread_mutex_t		mutex;
+	uint64_t		accepted;
+	uint64_t		handshakes;
+	uint64_t		resumed;
+	uint64_t		ticketKeyRotations;
+	uint64_t		failures;
+	uint64_t		active;
+	uint32_t		latency[LATENCY_SAMPLES];	// usec
+	uint32_t		latencyCount;
+	uint32_t		latencyNext;
+	struct timespec		start;
+	struct timespec		lastReport;
+	uint64_t		lastHandshakes;
+} stats_t;
+
+// Session ticket key, drawn from the chip TRNG
+typedef struct {
+	unsigned char		name[16];
+	unsigned char		aesKey[32];
+	unsigned char		hmacKey[32];
+	uint8_t			valid;
+} ticketKey_t;
 
 // Function Protoyping
-void serverListen(void);
-void doServerConnected(int,int);
+static int serverListen(short int port, uint32_t addr);
+static int serverSetup(int async, int queueDepth, int tls, long cacheSize, int ticketLifetime);
+static int ticketKeyRotate(void);
+static void *serverWorker(void *arg);
+static void serverStats(int sock);
+
+// Globals
+static SSL_CTX		*ctx;
+static ENGINE		*e;
+static worker_t		workers[MAX_WORKERS];
+static stats_t		stats = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+static volatile sig_atomic_t	running = 1;
+static int		nextId = 0;
+// Tickets are issued with the current key and accepted with both
+static ticketKey_t	ticketKey[2];
+static pthread_rwlock_t	ticketLock = PTHREAD_RWLOCK_INITIALIZER;
+
+static void _helpmenu(void)
+{
+	printf("\nHelp menu: simpleTest_Server <option> ...<option>\n");
+	printf("option:- \n");
+	printf("-p <port>     : Port to listen on (default %d)\n", DEFAULT_PORT);
+	printf("-w <workers>  : Number of worker threads (default %d)\n", DEFAULT_WORKERS);
+	printf("-a            : Use SSL_MODE_ASYNC, handshakes wait for the chip without blocking the worker\n");
+	printf("-q <depth>    : Engine sign queue depth for async handshakes\n");
+	printf("-s <port>     : Stats port on 127.0.0.1, 0 to disable (default %d)\n", DEFAULT_STATS_PORT);
+	printf("-t            : Use TLS instead of DTLS\n");
+	printf("-c <size>     : Session cache size, 0 disables resumption (default %d)\n", DEFAULT_CACHE_SIZE);
+	printf("-k <seconds>  : Session ticket key lifetime, 0 disables tickets (default %d)\n", DEFAULT_TICKET_LIFETIME);
+	printf("-h            : Print this help \n");
+}
 
-int main (int argc, char *argv[])
+static void signalHandler(int sig)
 {
+	running = 0;
+}
 
-	//Print Heading
-	DEBUGPRINT("*****************************************");
+static uint64_t elapsedUsec(const struct timespec *from, const struct timespec *to)
+{
+	return (uint64_t)(to->tv_sec - from->tv_sec) * 1000000 + (to->tv_nsec - from->tv_nsec) / 1000;
+}
 
-	serverListen();
+static int compareU32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
 
-	return 0;
+	return (x > y) - (x < y);
 }
 
-void serverListen(void)
+int main (int argc, char *argv[])
 {
-	int                     err;
-	int                     error=0;
-	int                     pid;
-	int                     listen_sock;
-	int                     sock;
-	struct sockaddr_in      sa_serv;
-	struct sockaddr_in      sa_cli;
-	size_t                  client_len;
-	short int               s_port = DEFAULT_PORT;
+	struct epoll_event	ev, events[2];
+	struct sigaction	sa;
+	struct sockaddr_in	sa_cli;
+	socklen_t		client_len;
+	newConn_t		newConn;
+	short int		s_port = DEFAULT_PORT;
+	short int		statsPort = DEFAULT_STATS_PORT;
+	int			nWorkers = DEFAULT_WORKERS;
+	int			async = 0;
+	int			queueDepth = 0;
+	int			tls = 0;
+	long			cacheSize = DEFAULT_CACHE_SIZE;
+	int			ticketLifetime = DEFAULT_TICKET_LIFETIME;
+	time_t			ticketRotated;
+	int			listen_sock;
+	int			stats_sock = -1;
+	int			epfd;
+	int			option;
+	int			next = 0;
+	int			n, i;
+
+	opterr = 0; // Disable getopt error messages in case of unknown parameters
+	while (-1 != (option = getopt(argc, argv, "p:w:aq:s:tc:k:h")))
+	{
+		switch (option)
+		{
+			case 'p':
+				s_port = (short int)atoi(optarg);
+				break;
+			case 'w':
+				nWorkers = atoi(optarg);
+				if ((nWorkers < 1) || (nWorkers > MAX_WORKERS))
+				{
+					DEBUGPRINT("Workers must be 1 to %d", MAX_WORKERS);
+					exit(1);
+				}
+				break;
+			case 'a':
+				async = 1;
+				break;
+			case 'q':
+				queueDepth = atoi(optarg);
+				break;
+			case 's':
+				statsPort = (short int)atoi(optarg);
+				break;
+			case 't':
+				tls = 1;
+				break;
+			case 'c':
+				cacheSize = atol(optarg);
+				break;
+			case 'k':
+				ticketLifetime = atoi(optarg);
+				break;
+			case 'h':
+			default:
+				_helpmenu();
+				exit(0);
+		}
+	}
 
-	int                     connect=0;
+	//Print Heading
+	DEBUGPRINT("*****************************************");
 
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = signalHandler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
 
-	/*********************************************************************/
-	// Setting the Socket
-	listen_sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP); // IPPROTO_TCP
-	if (listen_sock == -1)
-	{
-		error=1;
-	}
+	// One engine and one SSL_CTX shared by all workers, the engine serializes the chip
+	if (serverSetup(async, queueDepth, tls, cacheSize, ticketLifetime) != 0)
+		exit(1);
+	ticketRotated = time(NULL);
 
-	memset(&sa_serv, '\0', sizeof(sa_serv));
+	listen_sock = serverListen(s_port, INADDR_ANY);
+	if (statsPort != 0)
+		stats_sock = serverListen(statsPort, htonl(INADDR_LOOPBACK));
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if ((listen_sock == -1) || ((statsPort != 0) && (stats_sock == -1)) || (epfd == -1))
+		exit(1);
 
-	sa_serv.sin_family = AF_INET;
-	sa_serv.sin_addr.s_addr = INADDR_ANY;
-	sa_serv.sin_port = htons(s_port);
-	err = bind(listen_sock, (struct sockaddr*)&sa_serv,sizeof(sa_serv));
-	if (err == -1)
+	ev.events = EPOLLIN;
+	ev.data.fd = listen_sock;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, listen_sock, &ev);
+	if (stats_sock != -1)
 	{
-		error=1;
+		ev.data.fd = stats_sock;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, stats_sock, &ev);
 	}
 
-	/* Wait for an incoming TCP connection */
-	err = listen(listen_sock, 5);
-	if (err == -1)
+	clock_gettime(CLOCK_MONOTONIC, &stats.start);
+	stats.lastReport = stats.start;
+	for (i = 0; i < nWorkers; i++)
 	{
-		error=1;
+		workers[i].index = i;
+		workers[i].epfd = epoll_create1(EPOLL_CLOEXEC);
+		if ((workers[i].epfd == -1) || (pipe2(workers[i].pipefd, O_CLOEXEC) == -1) ||
+		    (pthread_create(&workers[i].thread, NULL, serverWorker, &workers[i]) != 0))
+		{
+			DEBUGPRINT("Cannot start worker %d", i);
+			exit(1);
+		}
 	}
-	client_len = sizeof(sa_cli);
+	DEBUGPRINT("Listening on port %d, %d workers%s, stats on port %d", s_port, nWorkers,
+		   async ? ", async" : "", statsPort);
 
-	while (error == 0)
+	while (running)
 	{
-		/* Socket for TCP/IP connection is created */
-		DEBUGPRINT("Listening to incoming connection");
-		sock = accept(listen_sock, (struct sockaddr*)&sa_cli,(socklen_t *) &client_len);
-		if (sock == -1)
+		n = epoll_wait(epfd, events, 2, 1000);
+		if ((cacheSize != 0) && (ticketLifetime != 0) && ((time(NULL) - ticketRotated) >= ticketLifetime))
 		{
-			error=1;
-			break;
+			if (ticketKeyRotate() != 0)
+				DEBUGPRINT("Ticket key rotation failed, keeping the current key");
+			ticketRotated = time(NULL);
 		}
-
-		DEBUGPRINT("Connection from %d.%d.%d.%d, port :0x%.4x",
-				sa_cli.sin_addr.s_addr & 0x000000ff,
-				(sa_cli.sin_addr.s_addr & 0x0000ff00) >> 8,
-				(sa_cli.sin_addr.s_addr & 0x00ff0000) >> (8*2),
-				(sa_cli.sin_addr.s_addr & 0xff000000) >> (8*3),
-				sa_cli.sin_port);
-
-		// Create Child process
-		pid = fork();
-		if (pid == -1)
+		for (i = 0; i < n; i++)
 		{
-		    error=1;
-		}
+			if (events[i].data.fd == stats_sock)
+			{
+				int sock = accept4(stats_sock, NULL, NULL, SOCK_CLOEXEC);
 
+				if (sock != -1)
+					serverStats(sock);
+				continue;
+			}
 
-		if (pid == 0)
-		{
-			connect = getpid();
-			close(listen_sock);
-			doServerConnected(sock,connect);
-			DEBUGPRINT("[%d] Return from Child", connect);
-			error=1;
+			// Accept everything waiting, hand the connections out round robin
+			client_len = sizeof(sa_cli);
+			while ((newConn.sock = accept4(listen_sock, (struct sockaddr*)&sa_cli, &client_len,
+						       SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+			{
+				clock_gettime(CLOCK_MONOTONIC, &newConn.accepted);
+				__atomic_add_fetch(&stats.accepted, 1, __ATOMIC_RELAXED);
+				if (write(workers[next].pipefd[1], &newConn, sizeof(newConn)) != sizeof(newConn))
+					close(newConn.sock);
+				next = (next + 1) % nWorkers;
+				client_len = sizeof(sa_cli);
+			}
 		}
 	}
 
-	// Close the Socket
-	err = close(sock);
-	if (err == -1)
+	DEBUGPRINT("Stopping");
+	ENGINE_ctrl_cmd_string(e, "PERF_COUNTERS", NULL, 0);
+	for (i = 0; i < nWorkers; i++)
 	{
-		error=1;
+		close(workers[i].pipefd[1]);
+		pthread_join(workers[i].thread, NULL);
 	}
-
-	DEBUGPRINT("[%d] Leaving Routine!!!", connect);
+	close(listen_sock);
+	if (stats_sock != -1)
+		close(stats_sock);
+	SSL_CTX_free(ctx);
+	ENGINE_finish(e);
+	ENGINE_free(e);
+	DEBUGPRINT("Leaving Routine!!!");
+	return 0;
 }
 
-void doServerConnected(int sock, int connect)
+static int serverListen(short int port, uint32_t addr)
 {
-	int             err;
-	int             len;
-	int             error=0;
-	clock_t		start, end;
+	struct sockaddr_in      sa_serv;
+	int                     sock;
+	int                     on = 1;
 
+	/*********************************************************************/
+	// Setting the Socket
+	sock = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP); // IPPROTO_TCP
+	if (sock == -1)
+		return -1;
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
 
-	SSL_CTX         *ctx;
-	SSL             *ssl;
-	SSL_METHOD      *meth;
+	memset(&sa_serv, '\0', sizeof(sa_serv));
+	sa_serv.sin_family = AF_INET;
+	sa_serv.sin_addr.s_addr = addr;
+	sa_serv.sin_port = htons(port);
+	if ((bind(sock, (struct sockaddr*)&sa_serv, sizeof(sa_serv)) == -1) ||
+	    (listen(sock, SOMAXCONN) == -1))
+	{
+		DEBUGPRINT("Port %d: %s", port, strerror(errno));
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+// New ticket key from the chip TRNG, the current one stays to decrypt the tickets it issued
+static int ticketKeyRotate(void)
+{
+	const RAND_METHOD	*rand = ENGINE_get_RAND(e);
+	ticketKey_t		key;
+	int			ret = -1;
+
+	if ((rand != NULL) && (rand->bytes != NULL) &&
+	    (rand->bytes(key.name, sizeof(key.name)) == 1) &&
+	    (rand->bytes(key.aesKey, sizeof(key.aesKey)) == 1) &&
+	    (rand->bytes(key.hmacKey, sizeof(key.hmacKey)) == 1))
+	{
+		key.valid = 1;
+		pthread_rwlock_wrlock(&ticketLock);
+		ticketKey[1] = ticketKey[0];
+		ticketKey[0] = key;
+		pthread_rwlock_unlock(&ticketLock);
+		__atomic_add_fetch(&stats.ticketKeyRotations, 1, __ATOMIC_RELAXED);
+		ret = 0;
+	}
+	OPENSSL_cleanse(&key, sizeof(key));
+	return ret;
+}
+
+// Encrypts new tickets with the current key, decrypts with the current or the previous one
+static int ticketKeyCallback(SSL *ssl, unsigned char *name, unsigned char *iv,
+			     EVP_CIPHER_CTX *cipherCtx, HMAC_CTX *hmacCtx, int enc)
+{
+	int ret = 0;
+	int i;
 
-	char         buf[4096];
+	pthread_rwlock_rdlock(&ticketLock);
+	if (enc)
+	{
+		if (ticketKey[0].valid && (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) == 1) &&
+		    EVP_EncryptInit_ex(cipherCtx, EVP_aes_256_cbc(), NULL, ticketKey[0].aesKey, iv) &&
+		    HMAC_Init_ex(hmacCtx, ticketKey[0].hmacKey, sizeof(ticketKey[0].hmacKey), EVP_sha256(), NULL))
+		{
+			memcpy(name, ticketKey[0].name, sizeof(ticketKey[0].name));
+			ret = 1;
+		}
+	}
+	else
+	{
+		for (i = 0; i < 2; i++)
+		{
+			if (!ticketKey[i].valid || (memcmp(name, ticketKey[i].name, sizeof(ticketKey[i].name)) != 0))
+				continue;
+			if (EVP_DecryptInit_ex(cipherCtx, EVP_aes_256_cbc(), NULL, ticketKey[i].aesKey, iv) &&
+			    HMAC_Init_ex(hmacCtx, ticketKey[i].hmacKey, sizeof(ticketKey[i].hmacKey), EVP_sha256(), NULL))
+			{
+				// Renew tickets of the previous key. TLS 1.3 only sends a new ticket after a
+				// resumption when renewed, without one the client would do a full handshake next.
+				ret = ((i == 0) && (SSL_version(ssl) != TLS1_3_VERSION)) ? 1 : 2;
+			}
+			break;
+		}
+	}
+	pthread_rwlock_unlock(&ticketLock);
+	return ret;
+}
 
-	// For Engine
-	ENGINE          *e;
+static int serverSetup(int async, int queueDepth, int tls, long cacheSize, int ticketLifetime)
+{
+	SSL_METHOD      *meth;
 	EVP_PKEY        *pkey;
 	UI_METHOD       *ui_method;
 	EC_KEY *ecdh;
 
-	do {
-	    // Init OPENSSL
-	    SSL_library_init();
-	    SSL_load_error_strings();
-	    
-		meth = (SSL_METHOD*) SECURE_COMM;
-	    ctx = SSL_CTX_new(meth);
-	    
-	    if (!ctx)
-	    {
+	// Init OPENSSL
+	SSL_library_init();
+	SSL_load_error_strings();
+
+	meth = (SSL_METHOD*) (tls ? TLS_server_method() : SECURE_COMM);
+	ctx = SSL_CTX_new(meth);
+	if (!ctx)
+	{
 		ERR_print_errors_fp(stderr);
-		exit(1);
-	    }
+		return -1;
+	}
 
-	    ecdh = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
-	    if (ecdh == NULL)
-	    {
+	ecdh = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+	if (ecdh == NULL)
+	{
 		DEBUGPRINT("ECDH Param error......... ");
-	    }
-	    SSL_CTX_set_tmp_ecdh(ctx,ecdh);
-
+	}
+	SSL_CTX_set_tmp_ecdh(ctx,ecdh);
+	EC_KEY_free(ecdh);
 
-	    //Load and init Engine
-	    ENGINE_load_builtin_engines();
-	    e = ENGINE_by_id(ENGINE_NAME);
-	    if(!e)
-	    {
+	//Load and init Engine
+	ENGINE_load_builtin_engines();
+	e = ENGINE_by_id(ENGINE_NAME);
+	if(!e)
+	{
 		DEBUGPRINT("Error loading Engine!!");
-	    }
-	    DEBUGPRINT("Engine ID : %s",ENGINE_get_id(e));
+		return -1;
+	}
+	DEBUGPRINT("Engine ID : %s",ENGINE_get_id(e));
 
-	    if(!ENGINE_init(e))
-	    {
+	if ((queueDepth > 0) && !ENGINE_ctrl_cmd(e, "SIGN_QUEUE_DEPTH", queueDepth, NULL, NULL, 0))
+	{
+		DEBUGPRINT("Cannot set the sign queue depth");
+	}
+
+	if(!ENGINE_init(e))
+	{
 		DEBUGPRINT("Cannot Init Trustx Engine!!");
-	    }
-	    DEBUGPRINT("Init Trustx Engine. Ok");
+		return -1;
+	}
+	DEBUGPRINT("Init Trustx Engine. Ok");
 
-	    if(!ENGINE_set_default(e, ENGINE_METHOD_ALL))
-	    {
+	if(!ENGINE_set_default(e, ENGINE_METHOD_ALL))
+	{
 		DEBUGPRINT(" Cannot use Trustx Engine!");
-	    }
-	    DEBUGPRINT("Set Default Engine Ok.");
+	}
+	DEBUGPRINT("Set Default Engine Ok.");
 
-	    // Load key
-	    ui_method = UI_OpenSSL();
-	    pkey = ENGINE_load_private_key(e,SERVER_KEY,ui_method,NULL);
-	    SSL_CTX_use_PrivateKey(ctx, pkey);
+	// Load key
+	ui_method = UI_OpenSSL();
+	pkey = ENGINE_load_private_key(e,SERVER_KEY,ui_method,NULL);
+	SSL_CTX_use_PrivateKey(ctx, pkey);
+	EVP_PKEY_free(pkey);
 
-	    // Load the servr certificate into ctx
-	    if(SSL_CTX_use_certificate_file(ctx, SERVER_CERT, SSL_FILETYPE_PEM) <= 0)
-	    {
+	// Load the servr certificate into ctx
+	if(SSL_CTX_use_certificate_file(ctx, SERVER_CERT, SSL_FILETYPE_PEM) <= 0)
+	{
 		DEBUGPRINT("Load Certificate Fail");
-		break;
-	    }
-	    DEBUGPRINT("Load Certificate ok");
+		return -1;
+	}
+	DEBUGPRINT("Load Certificate ok");
 
-	    // Check if Private Key Match Server Cert
-	    if(!SSL_CTX_check_private_key(ctx))
-	    {
+	// Check if Private Key Match Server Cert
+	if(!SSL_CTX_check_private_key(ctx))
+	{
 		DEBUGPRINT("Private Key do not Match the Server Certificate!!!!");
-		break;
-	    }
-	    DEBUGPRINT("Private Key Match the Server Certificate.");
-
-	   // Setup to Verify Client
-	   // Load CA cert
-	   if(!SSL_CTX_load_verify_locations(ctx, CA_CERT, NULL))
-	   {
+		return -1;
+	}
+	DEBUGPRINT("Private Key Match the Server Certificate.");
+
+	// Setup to Verify Client
+	// Load CA cert
+	if(!SSL_CTX_load_verify_locations(ctx, CA_CERT, NULL))
+	{
 		DEBUGPRINT("Load CA cert Fail");
-		break;
-	   }
-	   DEBUGPRINT("Load CA cert ok");
+		return -1;
+	}
+	DEBUGPRINT("Load CA cert ok");
 
-	   // Set require Peer to verify cert
-	   SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+	// Set require Peer to verify cert
+	SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
 
-	   // Set verify depth to 1
-	   SSL_CTX_set_verify_depth(ctx,1);
-	}while(0);
+	// Set verify depth to 1
+	SSL_CTX_set_verify_depth(ctx,1);
 
-    if(error==0)
-    {
-	// Estabish the SSL Connection
+	// Sessions of verified peers are only resumed within a session id context
+	SSL_CTX_set_session_id_context(ctx, (const unsigned char *)"simpleTest_Server", strlen("simpleTest_Server"));
 
-	ssl = SSL_new(ctx);
-	if (ssl == NULL)
+	// Resumed handshakes need no signature from the chip. The cache and the ticket keys are
+	// shared by all workers through the SSL_CTX.
+	if (cacheSize == 0)
+	{
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+		SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+		SSL_CTX_set_num_tickets(ctx, 0);
+	}
+	else
 	{
-	    error = 1;
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+		SSL_CTX_sess_set_cache_size(ctx, cacheSize);
+		if (ticketLifetime == 0)
+		{
+			SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+		}
+		else
+		{
+			if (ticketKeyRotate() != 0)
+			{
+				DEBUGPRINT("Cannot get a ticket key from the chip");
+				return -1;
+			}
+			SSL_CTX_set_tlsext_ticket_key_cb(ctx, ticketKeyCallback);
+			// A ticket is accepted until its key is rotated out
+			SSL_CTX_set_timeout(ctx, 2 * ticketLifetime);
+		}
 	}
 
-	// Assign the socket into the SSL structure
-	SSL_set_fd(ssl, sock);
+	// Handshakes signing on the chip pause and let the worker serve other connections
+	if (async)
+		SSL_CTX_set_mode(ctx, SSL_MODE_ASYNC);
+	return 0;
+}
+
+static void connWatch(worker_t *w, conn_t *conn, uint32_t events)
+{
+	struct epoll_event ev;
+
+	ev.events = events;
+	ev.data.ptr = conn;
+	epoll_ctl(w->epfd, EPOLL_CTL_MOD, conn->sock, &ev);
+}
+
+// Runs a handshake paused in an async job to its end, the job still uses the SSL
+static void connFinishAsync(conn_t *conn)
+{
+	OSSL_ASYNC_FD fds[4];
+	struct pollfd pfd[4];
+	size_t num, i;
+
+	while (conn->paused)
+	{
+		num = 0;
+		if (SSL_get_all_async_fds(conn->ssl, NULL, &num) && (num <= 4) &&
+		    SSL_get_all_async_fds(conn->ssl, fds, &num))
+		{
+			for (i = 0; i < num; i++)
+			{
+				pfd[i].fd = fds[i];
+				pfd[i].events = POLLIN;
+			}
+			poll(pfd, num, 1000);
+		}
+		if (SSL_get_error(conn->ssl, SSL_accept(conn->ssl)) != SSL_ERROR_WANT_ASYNC)
+			conn->paused = 0;
+	}
+}
+
+static void connClose(worker_t *w, conn_t *conn)
+{
+	if (conn->closed)
+		return;
+	conn->closed = 1;
+	connFinishAsync(conn);
+	if (conn->connected)
+		SSL_shutdown(conn->ssl);
+	// Also closes the async wait fd of the engine, which leaves the epoll set with it
+	SSL_free(conn->ssl);
+	close(conn->sock);
+	__atomic_sub_fetch(&stats.active, 1, __ATOMIC_RELAXED);
+
+	if (conn->prev != NULL)
+		conn->prev->next = conn->next;
+	else
+		w->conns = conn->next;
+	if (conn->next != NULL)
+		conn->next->prev = conn->prev;
+	// Other events of this batch may still point to conn
+	conn->next = w->dead;
+	w->dead = conn;
+}
 
-	// SSL Perfrom Handshaking
-	DEBUGPRINT("Performing Handshking ......... ");
-	err = SSL_accept(ssl);
-	switch(err)
+// Watches the wait fds of async jobs the engine paused
+static void connAsyncFds(worker_t *w, conn_t *conn)
+{
+	struct epoll_event ev;
+	OSSL_ASYNC_FD add[4], del[4];
+	size_t numAdd, numDel, i;
+
+	if (!SSL_get_changed_async_fds(conn->ssl, NULL, &numAdd, NULL, &numDel) ||
+	    (numAdd > 4) || (numDel > 4))
+		return;
+	SSL_get_changed_async_fds(conn->ssl, add, &numAdd, del, &numDel);
+	for (i = 0; i < numDel; i++)
+		epoll_ctl(w->epfd, EPOLL_CTL_DEL, del[i], NULL);
+	for (i = 0; i < numAdd; i++)
 	{
-		case 1:
-			DEBUGPRINT("Connection using : %s", SSL_get_cipher(ssl));
-			DEBUGPRINT("                 : %s", SSL_get_version(ssl));
-			DEBUGPRINT("++++++++++++++++++++++++++++++++++++++++++++++");
+		ev.events = EPOLLIN;
+		ev.data.ptr = conn;
+		epoll_ctl(w->epfd, EPOLL_CTL_ADD, add[i], &ev);
+	}
+}
+
+static void connHandshakeDone(conn_t *conn)
+{
+	struct timespec now;
+	uint32_t usec;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	usec = (uint32_t)elapsedUsec(&conn->accepted, &now);
+
+	pthread_mutex_lock(&stats.mutex);
+	stats.handshakes++;
+	if (SSL_session_reused(conn->ssl))
+		stats.resumed++;
+	stats.latency[stats.latencyNext] = usec;
+	stats.latencyNext = (stats.latencyNext + 1) % LATENCY_SAMPLES;
+	if (stats.latencyCount < LATENCY_SAMPLES)
+		stats.latencyCount++;
+	pthread_mutex_unlock(&stats.mutex);
+
+	conn->connected = 1;
+	DEBUGPRINT("[%d] Connection using : %s %s%s, %u usec", conn->id,
+		   SSL_get_version(conn->ssl), SSL_get_cipher(conn->ssl),
+		   SSL_session_reused(conn->ssl) ? " resumed" : "", usec);
+}
 
-			start = clock();
-			while(1)
+// Advances the handshake or the echo of conn as far as it goes without blocking
+static void connStep(worker_t *w, conn_t *conn)
+{
+	char	buf[4096];
+	int	ret, err, len;
+
+	conn->lastActive = time(NULL);
+	if (!conn->connected)
+	{
+		ret = SSL_accept(conn->ssl);
+		conn->paused = 0;
+		if (ret == 1)
+		{
+			connHandshakeDone(conn);
+			connWatch(w, conn, EPOLLIN);
+		}
+		else
+		{
+			err = SSL_get_error(conn->ssl, ret);
+			switch (err)
 			{
-				len = SSL_read(ssl, buf, sizeof(buf) - 1);
-				err = SSL_get_error(ssl, len);
+				case SSL_ERROR_WANT_READ:
+					connWatch(w, conn, EPOLLIN);
+					return;
+				case SSL_ERROR_WANT_WRITE:
+					connWatch(w, conn, EPOLLOUT);
+					return;
+				case SSL_ERROR_WANT_ASYNC:
+					conn->paused = 1;
+					connAsyncFds(w, conn);
+					return;
+				default:
+					DEBUGPRINT("[%d] SSL Error!!! %d", conn->id, err);
+					__atomic_add_fetch(&stats.failures, 1, __ATOMIC_RELAXED);
+					connClose(w, conn);
+					return;
+			}
+		}
+	}
 
-				if ((err != 0) && (len == 0))
-				{
-				    end = clock();
-				    if (((end-start)/1000000) > 5)
-				    {
-					DEBUGPRINT("[%d] Timeout !!",connect);
-					break;
-				    }
-				}
-				else
+	while (1)
+	{
+		len = SSL_read(conn->ssl, buf, sizeof(buf) - 1);
+		if (len <= 0)
+		{
+			err = SSL_get_error(conn->ssl, len);
+			if ((err != SSL_ERROR_WANT_READ) && (err != SSL_ERROR_WANT_WRITE))
+				connClose(w, conn);
+			return;
+		}
+
+		DEBUGPRINT("[%d] Received : %d", conn->id, buf[0]);
+		if (buf[0] > 100)
+		{
+			connClose(w, conn);
+			return;
+		}
+
+		sprintf(buf,"From Server [%d] : %.3d",conn->id, buf[0]);
+		if (SSL_write(conn->ssl, buf, strlen(buf)) <= 0)
+		{
+			ERR_print_errors_fp(stderr);
+		}
+	}
+}
+
+static void workerAdd(worker_t *w, const newConn_t *newConn)
+{
+	struct epoll_event ev;
+	conn_t *conn;
+	int on = 1;
+
+	// The echo replies are small records
+	setsockopt(newConn->sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+	conn = calloc(1, sizeof(conn_t));
+	if (conn == NULL)
+	{
+		close(newConn->sock);
+		return;
+	}
+	conn->sock = newConn->sock;
+	conn->accepted = newConn->accepted;
+	conn->lastActive = time(NULL);
+	conn->id = __atomic_add_fetch(&nextId, 1, __ATOMIC_RELAXED);
+	conn->ssl = SSL_new(ctx);
+	if (conn->ssl == NULL)
+	{
+		close(conn->sock);
+		free(conn);
+		return;
+	}
+	// Assign the socket into the SSL structure
+	SSL_set_fd(conn->ssl, conn->sock);
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = conn;
+	epoll_ctl(w->epfd, EPOLL_CTL_ADD, conn->sock, &ev);
+
+	conn->next = w->conns;
+	if (w->conns != NULL)
+		w->conns->prev = conn;
+	w->conns = conn;
+	__atomic_add_fetch(&stats.active, 1, __ATOMIC_RELAXED);
+
+	// The client hello may already be there
+	connStep(w, conn);
+}
+
+static void *serverWorker(void *arg)
+{
+	worker_t		*w = (worker_t *)arg;
+	struct epoll_event	ev, events[MAX_EVENTS];
+	newConn_t		newConn;
+	conn_t			*conn, *next;
+	time_t			now, lastSweep = 0;
+	int			n, i;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->pipefd[0], &ev);
+
+	while (1)
+	{
+		n = epoll_wait(w->epfd, events, MAX_EVENTS, 1000);
+		for (i = 0; i < n; i++)
+		{
+			conn = (conn_t *)events[i].data.ptr;
+			if (conn == NULL)
+			{
+				// Closed by the accept loop on exit
+				if (read(w->pipefd[0], &newConn, sizeof(newConn)) != sizeof(newConn))
+					goto exit;
+				workerAdd(w, &newConn);
+			}
+			else if (!conn->closed)
+			{
+				connStep(w, conn);
+			}
+		}
+
+		while (w->dead != NULL)
+		{
+			next = w->dead->next;
+			free(w->dead);
+			w->dead = next;
+		}
+
+		// Drop idle clients, a handshake waiting for the chip is not idle
+		now = time(NULL);
+		if (now != lastSweep)
+		{
+			lastSweep = now;
+			for (conn = w->conns; conn != NULL; conn = next)
+			{
+				next = conn->next;
+				if (!conn->paused && ((now - conn->lastActive) > IDLE_TIMEOUT))
 				{
-					start = clock();
-					DEBUGPRINT("[%d] Received : %d", connect, buf[0]);
-					if (buf[0] > 100)
-						break;
-
-					sprintf(buf,"From Server [%d] : %.3d",connect, buf[0]);
-					err = SSL_write(ssl, buf,strlen(buf));
-					if (err==-1)
-					{
-						ERR_print_errors_fp(stderr);
-					}
+					DEBUGPRINT("[%d] Timeout !!", conn->id);
+					connClose(w, conn);
 				}
 			}
-			break;
-		case 0:
-			DEBUGPRINT("Connection Refuse ");
-			break;
-		default:
-			DEBUGPRINT("SSL Error!!! %d",err);
+		}
 	}
 
-	err = SSL_shutdown(ssl);
-	DEBUGPRINT("Connection Closed!!!");
-    }
+exit:
+	for (conn = w->conns; conn != NULL; conn = next)
+	{
+		next = conn->next;
+		connClose(w, conn);
+	}
+	while (w->dead != NULL)
+	{
+		next = w->dead->next;
+		free(w->dead);
+		w->dead = next;
+	}
+	close(w->pipefd[0]);
+	close(w->epfd);
+	return NULL;
+}
 
-    // Free the SSL object
-    ENGINE_free(e);
-    SSL_free(ssl);
-    SSL_CTX_free(ctx);
-    DEBUGPRINT("Leaving Routine!!!");
+// Answers one stats request with a plain text HTTP response, e.g. curl http://127.0.0.1:5001/
+static void serverStats(int sock)
+{
+	static uint32_t		sorted[LATENCY_SAMPLES];
+	struct pollfd		pfd = {sock, POLLIN, 0};
+	struct timespec		now;
+	char			buf[1024];
+	uint64_t		handshakes, resumed, recent;
+	double			uptime, interval;
+	uint32_t		count;
+	int			len;
+
+	// Read the request, so that closing does not reset the connection
+	if (poll(&pfd, 1, 100) == 1)
+		len = recv(sock, buf, sizeof(buf), MSG_DONTWAIT);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	pthread_mutex_lock(&stats.mutex);
+	handshakes = stats.handshakes;
+	resumed = stats.resumed;
+	recent = handshakes - stats.lastHandshakes;
+	interval = elapsedUsec(&stats.lastReport, &now) / 1e6;
+	stats.lastHandshakes = handshakes;
+	stats.lastReport = now;
+	count = stats.latencyCount;
+	memcpy(sorted, stats.latency, count * sizeof(uint32_t));
+	pthread_mutex_unlock(&stats.mutex);
+
+	qsort(sorted, count, sizeof(uint32_t), compareU32);
+	uptime = elapsedUsec(&stats.start, &now) / 1e6;
+
+	len = snprintf(buf, sizeof(buf),
+		"HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n"
+		"uptime_s %.1f\n"
+		"connections_accepted %llu\n"
+		"connections_active %llu\n"
+		"handshakes %llu\n"
+		"handshakes_resumed %llu\n"
+		"handshake_failures %llu\n"
+		"handshakes_per_s %.2f\n"
+		"handshakes_per_s_since_last %.2f\n"
+		"latency_samples %u\n"
+		"latency_p50_us %u\n"
+		"latency_p90_us %u\n"
+		"latency_p99_us %u\n"
+		"latency_max_us %u\n"
+		"session_cache_entries %ld\n"
+		"session_cache_hits %ld\n"
+		"ticket_key_rotations %llu\n",
+		uptime,
+		(unsigned long long)__atomic_load_n(&stats.accepted, __ATOMIC_RELAXED),
+		(unsigned long long)__atomic_load_n(&stats.active, __ATOMIC_RELAXED),
+		(unsigned long long)handshakes,
+		(unsigned long long)resumed,
+		(unsigned long long)__atomic_load_n(&stats.failures, __ATOMIC_RELAXED),
+		(uptime > 0) ? handshakes / uptime : 0.0,
+		(interval > 0) ? recent / interval : 0.0,
+		count,
+		count ? sorted[(count - 1) * 50 / 100] : 0,
+		count ? sorted[(count - 1) * 90 / 100] : 0,
+		count ? sorted[(count - 1) * 99 / 100] : 0,
+		count ? sorted[count - 1] : 0,
+		SSL_CTX_sess_number(ctx),
+		SSL_CTX_sess_hits(ctx),
+		(unsigned long long)__atomic_load_n(&stats.ticketKeyRotations, __ATOMIC_RELAXED));
+	if (send(sock, buf, len, MSG_NOSIGNAL) != len)
+		DEBUGPRINT("Stats reply failed");
+	close(sock);
 }
@@ -0,0 +1,127 @@
+/**
+* MIT License
+*
+* Copyright (c) 2019 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "optiga/ifx_i2c/ifx_i2c_config.h"
+#include "optiga/ifx_i2c/ifx_i2c_data_link_layer.h"
+
+// Random frames checked against the reference CRC
+#define CRC_CHECK_FRAMES	100000
+// Bytes run through each CRC for the throughput figure
+#define CRC_BENCH_BYTES		(64UL * 1024 * 1024)
+// Frame length of the throughput run, a full frame of the data link layer
+#define CRC_BENCH_FRAME		DL_MAX_FRAME_SIZE
+
+// The original bitwise data link layer CRC, kept as the reference
+static uint16_t refCrcByte(uint16_t wSeed, uint8_t bByte)
+{
+	uint16_t wh1;
+	uint16_t wh2;
+	uint16_t wh3;
+	uint16_t wh4;
+
+	wh1 = (wSeed ^ bByte) & 0xFF;
+	wh2 = wh1 & 0x0F;
+	wh3 = ((uint16_t)(wh2 << 4)) ^ wh1;
+	wh4 = wh3 >> 4;
+
+	return ((uint16_t)((((uint16_t)((((uint16_t)(wh3 << 1)) ^ wh4) << 4)) ^ wh2) << 3)) ^ wh4
+		^ (wSeed >> 8);
+}
+
+static uint16_t refCrc(const uint8_t *data, uint16_t len)
+{
+	uint16_t i;
+	uint16_t crc = 0;
+
+	for (i = 0; i < len; i++)
+		crc = refCrcByte(crc, data[i]);
+
+	return crc;
+}
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - start->tv_sec) + ((double)(now.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+// Returns MB/s of crcFn over full frames
+static double bench(uint16_t (*crcFn)(const uint8_t *, uint16_t), const uint8_t *data, volatile uint16_t *sink)
+{
+	struct timespec start;
+	unsigned long done;
+	uint16_t crc = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (done = 0; done < CRC_BENCH_BYTES; done += CRC_BENCH_FRAME)
+		crc ^= crcFn(data, CRC_BENCH_FRAME);
+	*sink = crc;
+
+	return ((double)done / (1024 * 1024)) / elapsed(&start);
+}
+
+int main (int argc, char **argv)
+{
+	// Room for every alignment within eight bytes in front of the longest frame
+	uint8_t buffer[DL_MAX_FRAME_SIZE + 8];
+	volatile uint16_t sink;
+	uint32_t frames = CRC_CHECK_FRAMES;
+	uint32_t i, failed = 0;
+	uint16_t len, offset, j;
+	double refRate, dlRate;
+
+	if (argc > 1)
+		frames = (uint32_t)strtoul(argv[1], NULL, 0);
+
+	srand((unsigned int)time(NULL));
+	for (i = 0; i < frames; i++)
+	{
+		len = (uint16_t)(rand() % (DL_MAX_FRAME_SIZE + 1));
+		offset = (uint16_t)(rand() % 8);
+		for (j = 0; j < len; j++)
+			buffer[offset + j] = (uint8_t)rand();
+
+		if (ifx_i2c_dl_calc_crc(buffer + offset, len) != refCrc(buffer + offset, len))
+		{
+			if (failed++ < 10)
+				printf("Mismatch: length %d offset %d: 0x%.4X expected 0x%.4X\n", len, offset,
+					ifx_i2c_dl_calc_crc(buffer + offset, len), refCrc(buffer + offset, len));
+		}
+	}
+	printf("CRC check (%d slices): %u frames, %u mismatches\n", DL_CRC_SLICES, frames, failed);
+
+	for (j = 0; j < CRC_BENCH_FRAME; j++)
+		buffer[j] = (uint8_t)rand();
+	refRate = bench(refCrc, buffer, &sink);
+	dlRate = bench(ifx_i2c_dl_calc_crc, buffer, &sink);
+	printf("Reference CRC : %8.1f MB/s\n", refRate);
+	printf("Data link CRC : %8.1f MB/s (x%.1f)\n", dlRate, dlRate / refRate);
+
+	return (failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,701 @@
+/**
+* MIT License
+*
+* Copyright (c) 2019 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+#include "optiga/ifx_i2c/ifx_i2c_config.h"
+#include "optiga/optiga_util.h"
+#include "optiga/pal/pal_os_completion.h"
+
+#include "trustx.h"
+#include "trustxd.h"
+
+// Maximum number of connected clients
+#define TRUSTXD_MAX_CLIENTS	64
+// A waiting request is raised one priority level each time it was passed over this often
+#define TRUSTXD_AGING		8
+// Queue entry of the socket request, the ring slots follow it
+#define TRUSTXD_SOCKET_REQ	0
+
+typedef struct _tag_trustXd_Req {
+	uint8_t pending;		// complete request waiting for the chip
+	uint8_t priority;
+	uint32_t seq;			// arrival order
+	uint32_t skipped;
+} trustXd_Req_t;
+
+typedef struct _tag_trustXd_Conn {
+	int fd;
+	uint8_t rx[TRUSTXD_HEADER_LEN + TRUSTXD_MAX_APDU];
+	uint16_t rxLen;
+	uint8_t error[8];		// error code read right after a failed command
+	uint16_t errorLen;
+	trustXd_ShmRing_t *ring;	// shared memory ring of the client, if any
+	int doorbellFd;
+	trustXd_Req_t req[1 + TRUSTXD_SHM_SLOTS];
+} trustXd_Conn_t;
+
+static trustXd_Conn_t __conn[TRUSTXD_MAX_CLIENTS];
+static volatile sig_atomic_t __running = 1;
+static volatile sig_atomic_t __dumpStats = 0;
+static volatile host_lib_status_t __chipStatus;
+static uint32_t __seq = 0;
+static uint32_t __served = 0;
+static uint32_t __servedShm = 0;
+static uint32_t __failed = 0;
+static int __verbose = 0;
+
+// GetDataObject of the last error code
+static const uint8_t __errorCmd[] = {0x01, 0x00, 0x00, 0x02, 0xF1, 0xC2};
+
+static void _helpmenu(void)
+{
+	printf("\nHelp menu: trustxd <option> ...<option>\n");
+	printf("option:- \n");
+	printf("-s <socket>   : Unix socket of the daemon (default %s)\n", TRUSTXD_DEFAULT_SOCKET);
+	printf("-m <mode>     : Access mode of the socket, octal (default 0660)\n");
+	printf("-i <device>   : I2C adapter of the chip (default /dev/i2c-1)\n");
+	printf("-a <address>  : I2C slave address of the chip (default 0x30)\n");
+	printf("-b            : Run in the background\n");
+	printf("-v            : Log every request\n");
+	printf("-h            : Print this help \n");
+}
+
+static void __signalHandler(int sig)
+{
+	if (SIGUSR1 == sig)
+		__dumpStats = 1;
+	else
+		__running = 0;
+}
+
+static void __chipEventHandler(void *ctx, host_lib_status_t event)
+{
+	pal_os_completion_signal((volatile host_lib_status_t *)ctx, event);
+}
+
+// Sends one APDU to the chip on the session opened by trustX_Open(), resp may be apdu
+static int __chipTransceive(const uint8_t *apdu, uint16_t length, uint8_t *resp, uint16_t *respLen)
+{
+	optiga_comms.upper_layer_handler = __chipEventHandler;
+	optiga_comms.upper_layer_ctx = (void *)&__chipStatus;
+	__chipStatus = OPTIGA_COMMS_BUSY;
+	if (OPTIGA_COMMS_SUCCESS != optiga_comms_transceive(&optiga_comms, apdu, &length, resp, respLen))
+		return -1;
+	if (OPTIGA_COMMS_SUCCESS != pal_os_completion_wait(&__chipStatus, OPTIGA_COMMS_BUSY))
+		return -1;
+	return 0;
+}
+
+// Runs one APDU, returns the reply type. The error code of a failed command is read at once.
+static uint8_t __execute(uint8_t *apdu, uint16_t apduLen, uint8_t *resp, uint16_t *respLen,
+			 uint8_t *error, uint16_t *errorLen)
+{
+	uint16_t length;
+
+	*errorLen = 0;
+	if ((apduLen > 0) && (0x70 == (apdu[0] & 0x7F)))
+	{
+		// OpenApplication, the application stays open for all clients
+		memset(resp, 0, 4);
+		*respLen = 4;
+	}
+	else if (0 != __chipTransceive(apdu, apduLen, resp, respLen))
+	{
+		fprintf(stderr, "trustxd: chip transceive failed, reopening\n");
+		*respLen = 0;
+		__failed++;
+		trustX_Close();
+		if (OPTIGA_LIB_SUCCESS != trustX_Open())
+			fprintf(stderr, "trustxd: failed to reopen the chip\n");
+		return TRUSTXD_MSG_ERROR;
+	}
+	else if ((*respLen > 0) && (0 != resp[0]))
+	{
+		// Read the error code before a command of another client replaces it
+		length = sizeof(((trustXd_ShmSlot_t *)0)->error);
+		if (0 == __chipTransceive(__errorCmd, sizeof(__errorCmd), error, &length))
+			*errorLen = length;
+	}
+	return TRUSTXD_MSG_APDU;
+}
+
+static void __drop(trustXd_Conn_t *conn)
+{
+	if (__verbose)
+		fprintf(stderr, "trustxd: client %d disconnected\n", conn->fd);
+	close(conn->fd);
+	conn->fd = -1;
+	if (NULL != conn->ring)
+	{
+		munmap(conn->ring, sizeof(trustXd_ShmRing_t));
+		close(conn->doorbellFd);
+		conn->ring = NULL;
+		conn->doorbellFd = -1;
+	}
+	memset(conn->req, 0, sizeof(conn->req));
+}
+
+static int __sendReply(int fd, const uint8_t *buf, size_t len)
+{
+	struct pollfd pfd = {fd, POLLOUT, 0};
+	ssize_t n;
+
+	while (len > 0)
+	{
+		n = send(fd, buf, len, MSG_NOSIGNAL);
+		if (n < 0)
+		{
+			if (EINTR == errno)
+				continue;
+			// A client not reading its reply must not stall the others for long
+			if ((EAGAIN == errno) && (poll(&pfd, 1, 1000) == 1))
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+// Runs the socket request of conn on the chip and replies
+static void __serve(trustXd_Conn_t *conn)
+{
+	uint8_t reply[TRUSTXD_HEADER_LEN + TRUSTXD_MAX_APDU];
+	uint8_t *apdu = conn->rx + TRUSTXD_HEADER_LEN;
+	uint8_t *resp = reply + TRUSTXD_HEADER_LEN;
+	uint16_t apduLen = ((uint16_t)conn->rx[4] << 8) | conn->rx[5];
+	uint16_t bufferSize = ((uint16_t)conn->rx[6] << 8) | conn->rx[7];
+	uint16_t respLen = TRUSTXD_MAX_APDU;
+	uint8_t type = TRUSTXD_MSG_APDU;
+
+	if ((0 != conn->errorLen) && trustXd_IsErrorRead(apdu, apduLen))
+	{
+		// Error code of the previous command of this client
+		memcpy(resp, conn->error, conn->errorLen);
+		respLen = conn->errorLen;
+		conn->errorLen = 0;
+	}
+	else
+	{
+		type = __execute(apdu, apduLen, resp, &respLen, conn->error, &conn->errorLen);
+	}
+
+	if (respLen > bufferSize)
+	{
+		type = TRUSTXD_MSG_ERROR;
+		respLen = 0;
+	}
+	if (__verbose)
+		fprintf(stderr, "trustxd: client %d cmd 0x%.2x prio %d -> %d bytes\n",
+			conn->fd, (apduLen > 0) ? apdu[0] : 0, conn->req[TRUSTXD_SOCKET_REQ].priority, respLen);
+
+	__served++;
+	conn->req[TRUSTXD_SOCKET_REQ].pending = 0;
+	conn->rxLen = 0;
+	trustXd_PutHeader(reply, type, 0, respLen, 0);
+	if (0 != __sendReply(conn->fd, reply, TRUSTXD_HEADER_LEN + respLen))
+		__drop(conn);
+}
+
+// Runs a ring slot of conn on the chip, the response replaces the request in the slot
+static void __serveSlot(trustXd_Conn_t *conn, int index)
+{
+	trustXd_ShmSlot_t *slot = &conn->ring->slot[index];
+	uint16_t apduLen = slot->length;
+	uint16_t respLen = TRUSTXD_MAX_APDU;
+	uint16_t errorLen = 0;
+	uint8_t cmd = slot->data[0];
+	uint8_t type = TRUSTXD_MSG_ERROR;
+
+	__atomic_store_n(&slot->state, TRUSTXD_SLOT_BUSY, __ATOMIC_RELAXED);
+	if (apduLen <= TRUSTXD_MAX_APDU)
+		type = __execute(slot->data, apduLen, slot->data, &respLen, slot->error, &errorLen);
+	if ((TRUSTXD_MSG_APDU != type) || (respLen > slot->bufferSize))
+	{
+		type = TRUSTXD_MSG_ERROR;
+		respLen = 0;
+	}
+	if (__verbose)
+		fprintf(stderr, "trustxd: client %d slot %d cmd 0x%.2x prio %d -> %d bytes\n",
+			conn->fd, index, cmd, conn->req[1 + index].priority, respLen);
+
+	__served++;
+	__servedShm++;
+	conn->req[1 + index].pending = 0;
+	slot->type = type;
+	slot->length = respLen;
+	slot->errorLen = errorLen;
+	__atomic_store_n(&slot->state, TRUSTXD_SLOT_DONE, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&slot->waiting, __ATOMIC_SEQ_CST))
+		syscall(SYS_futex, &slot->state, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// Creates the shared memory ring of conn and passes it with its doorbell to the client
+static void __mapRing(trustXd_Conn_t *conn)
+{
+	uint8_t header[TRUSTXD_HEADER_LEN];
+	char control[CMSG_SPACE(2 * sizeof(int))];
+	struct iovec iov = {header, sizeof(header)};
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	int fds[2] = {-1, -1};
+	void *ring = MAP_FAILED;
+
+	if (NULL == conn->ring)
+	{
+		fds[0] = memfd_create("trustxd", MFD_CLOEXEC);
+		fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if ((fds[0] >= 0) && (fds[1] >= 0) && (0 == ftruncate(fds[0], sizeof(trustXd_ShmRing_t))))
+			ring = mmap(NULL, sizeof(trustXd_ShmRing_t), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+	}
+	if (MAP_FAILED == ring)
+	{
+		fprintf(stderr, "trustxd: no shared memory ring for client %d: %s\n", conn->fd, strerror(errno));
+		if (fds[0] >= 0)
+			close(fds[0]);
+		if (fds[1] >= 0)
+			close(fds[1]);
+		trustXd_PutHeader(header, TRUSTXD_MSG_ERROR, 0, 0, 0);
+		if (0 != __sendReply(conn->fd, header, sizeof(header)))
+			__drop(conn);
+		return;
+	}
+
+	// The memfd is zero filled, all slots start free
+	conn->ring = (trustXd_ShmRing_t *)ring;
+	conn->ring->magic = TRUSTXD_SHM_MAGIC;
+	conn->ring->version = TRUSTXD_PROTO_VERSION;
+	conn->ring->slotCount = TRUSTXD_SHM_SLOTS;
+	conn->doorbellFd = fds[1];
+
+	trustXd_PutHeader(header, TRUSTXD_MSG_SHM, 0, 0, 0);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	if (sendmsg(conn->fd, &msg, MSG_NOSIGNAL) != sizeof(header))
+	{
+		close(fds[0]);
+		__drop(conn);
+		return;
+	}
+	close(fds[0]);
+	if (__verbose)
+		fprintf(stderr, "trustxd: client %d mapped a shared memory ring\n", conn->fd);
+}
+
+static void __enqueue(trustXd_Req_t *req, uint8_t priority)
+{
+	req->pending = 1;
+	req->priority = (priority > TRUSTXD_PRIO_HIGH) ? TRUSTXD_PRIO_HIGH : priority;
+	req->seq = __seq++;
+	req->skipped = 0;
+}
+
+// Queues the newly submitted slots of all rings, returns the number of waiting requests
+static int __scanRings(void)
+{
+	trustXd_Conn_t *conn;
+	int waiting = 0;
+	int i, s;
+
+	for (i = 0; i < TRUSTXD_MAX_CLIENTS; i++)
+	{
+		conn = &__conn[i];
+		if (conn->fd < 0)
+			continue;
+		waiting += conn->req[TRUSTXD_SOCKET_REQ].pending;
+		if (NULL == conn->ring)
+			continue;
+		for (s = 0; s < TRUSTXD_SHM_SLOTS; s++)
+		{
+			if (!conn->req[1 + s].pending &&
+			    (TRUSTXD_SLOT_SUBMITTED == __atomic_load_n(&conn->ring->slot[s].state, __ATOMIC_ACQUIRE)))
+				__enqueue(&conn->req[1 + s], conn->ring->slot[s].priority);
+			waiting += conn->req[1 + s].pending;
+		}
+	}
+	return waiting;
+}
+
+static void __setSleeping(uint32_t sleeping)
+{
+	int i;
+
+	for (i = 0; i < TRUSTXD_MAX_CLIENTS; i++)
+	{
+		if ((__conn[i].fd >= 0) && (NULL != __conn[i].ring))
+			__atomic_store_n(&__conn[i].ring->sleeping, sleeping, __ATOMIC_SEQ_CST);
+	}
+}
+
+// Reads what arrived from conn, queues it once the request is complete
+static void __receive(trustXd_Conn_t *conn)
+{
+	uint16_t need, length;
+	ssize_t n;
+
+	while (!conn->req[TRUSTXD_SOCKET_REQ].pending)
+	{
+		need = TRUSTXD_HEADER_LEN;
+		if (conn->rxLen >= TRUSTXD_HEADER_LEN)
+			need += ((uint16_t)conn->rx[4] << 8) | conn->rx[5];
+
+		if (conn->rxLen < need)
+		{
+			n = recv(conn->fd, conn->rx + conn->rxLen, need - conn->rxLen, 0);
+			if (n < 0)
+			{
+				if (EINTR == errno)
+					continue;
+				if (EAGAIN != errno)
+					__drop(conn);
+				return;
+			}
+			if (0 == n)
+			{
+				__drop(conn);
+				return;
+			}
+			conn->rxLen += (uint16_t)n;
+		}
+
+		if (TRUSTXD_HEADER_LEN == conn->rxLen)
+		{
+			length = ((uint16_t)conn->rx[4] << 8) | conn->rx[5];
+			if ((TRUSTXD_PROTO_VERSION != conn->rx[0]) || (length > TRUSTXD_MAX_APDU) ||
+			    ((TRUSTXD_MSG_APDU != conn->rx[1]) && ((TRUSTXD_MSG_SHM != conn->rx[1]) || (0 != length))))
+			{
+				fprintf(stderr, "trustxd: invalid request from client %d\n", conn->fd);
+				__drop(conn);
+				return;
+			}
+			if (TRUSTXD_MSG_SHM == conn->rx[1])
+			{
+				conn->rxLen = 0;
+				__mapRing(conn);
+				if (conn->fd < 0)
+					return;
+				continue;
+			}
+		}
+
+		if ((conn->rxLen >= TRUSTXD_HEADER_LEN) &&
+		    (conn->rxLen == TRUSTXD_HEADER_LEN + (((uint16_t)conn->rx[4] << 8) | conn->rx[5])))
+			__enqueue(&conn->req[TRUSTXD_SOCKET_REQ], conn->rx[2]);
+	}
+}
+
+// Highest priority first, oldest first within a priority. Requests passed over age.
+static trustXd_Conn_t *__next(int *index)
+{
+	trustXd_Conn_t *best = NULL;
+	trustXd_Req_t *req, *bestReq = NULL;
+	uint32_t prio, bestPrio = 0;
+	int i, r;
+
+	for (i = 0; i < TRUSTXD_MAX_CLIENTS; i++)
+	{
+		if (__conn[i].fd < 0)
+			continue;
+		for (r = 0; r < 1 + TRUSTXD_SHM_SLOTS; r++)
+		{
+			req = &__conn[i].req[r];
+			if (!req->pending)
+				continue;
+			prio = req->priority + (req->skipped / TRUSTXD_AGING);
+			if ((NULL == bestReq) || (prio > bestPrio) ||
+			    ((prio == bestPrio) && ((int32_t)(req->seq - bestReq->seq) < 0)))
+			{
+				best = &__conn[i];
+				bestReq = req;
+				bestPrio = prio;
+				*index = r;
+			}
+		}
+	}
+
+	for (i = 0; i < TRUSTXD_MAX_CLIENTS; i++)
+	{
+		if (__conn[i].fd < 0)
+			continue;
+		for (r = 0; r < 1 + TRUSTXD_SHM_SLOTS; r++)
+		{
+			if (__conn[i].req[r].pending && (&__conn[i].req[r] != bestReq))
+				__conn[i].req[r].skipped++;
+		}
+	}
+	return best;
+}
+
+static void __accept(int listenFd)
+{
+	int fd, i;
+
+	while ((fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		for (i = 0; i < TRUSTXD_MAX_CLIENTS; i++)
+		{
+			if (__conn[i].fd < 0)
+				break;
+		}
+		if (TRUSTXD_MAX_CLIENTS == i)
+		{
+			fprintf(stderr, "trustxd: too many clients\n");
+			close(fd);
+			continue;
+		}
+		memset(&__conn[i], 0, sizeof(__conn[i]));
+		__conn[i].fd = fd;
+		__conn[i].doorbellFd = -1;
+		if (__verbose)
+			fprintf(stderr, "trustxd: client %d connected\n", fd);
+	}
+}
+static int __listen(const char *path, mode_t mode)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "trustxd: socket path too long\n");
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	// Left over by a previous instance
+	if ((0 == lstat(path, &st)) && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	if ((0 != bind(fd, (struct sockaddr *)&addr, sizeof(addr))) ||
+	    (0 != chmod(path, mode)) ||
+	    (0 != listen(fd, TRUSTXD_MAX_CLIENTS)))
+	{
+		fprintf(stderr, "trustxd: %s: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int main (int argc, char **argv)
+{
+	struct pollfd fds[2 * TRUSTXD_MAX_CLIENTS + 1];
+	struct sigaction sa;
+	trustXd_Conn_t *conns[2 * TRUSTXD_MAX_CLIENTS + 1];
+	trustXd_Conn_t *conn;
+	const char *socketPath = TRUSTXD_DEFAULT_SOCKET;
+	const char *i2cDev = NULL;
+	mode_t mode = 0660;
+	uint8_t slaveAddr = 0;
+	int background = 0;
+	int listenFd;
+	int option;
+	uint64_t doorbell;
+	int nfds, pending, index, i;
+
+	opterr = 0; // Disable getopt error messages in case of unknown parameters
+	while (-1 != (option = getopt(argc, argv, "s:m:i:a:bvh")))
+	{
+		switch (option)
+		{
+			case 's':
+				socketPath = optarg;
+				break;
+			case 'm':
+				mode = (mode_t)strtoul(optarg, NULL, 8);
+				break;
+			case 'i':
+				i2cDev = optarg;
+				break;
+			case 'a':
+				slaveAddr = (uint8_t)strtoul(optarg, NULL, 0);
+				break;
+			case 'b':
+				background = 1;
+				break;
+			case 'v':
+				__verbose = 1;
+				break;
+			case 'h':
+			default:
+				_helpmenu();
+				exit(0);
+		}
+	}
+
+	// Fork before the chip is opened, the event thread of the library does not survive a fork
+	if (background && (0 != daemon(0, 1)))
+	{
+		perror("trustxd: daemon");
+		exit(1);
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = __signalHandler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGUSR1, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	for (i = 0; i < TRUSTXD_MAX_CLIENTS; i++)
+		__conn[i].fd = -1;
+
+	// The daemon itself talks to the chip directly
+	trustXd_SetSocket("");
+	if ((OPTIGA_LIB_SUCCESS != trustX_SetInterface(i2cDev, slaveAddr)) ||
+	    (OPTIGA_LIB_SUCCESS != trustX_Open()))
+	{
+		fprintf(stderr, "trustxd: failed to open the chip\n");
+		exit(1);
+	}
+
+	listenFd = __listen(socketPath, mode);
+	if (listenFd < 0)
+	{
+		trustX_Close();
+		exit(1);
+	}
+	fprintf(stderr, "trustxd: listening on %s\n", socketPath);
+
+	while (__running)
+	{
+		fds[0].fd = listenFd;
+		fds[0].events = POLLIN;
+		nfds = 1;
+		for (i = 0; i < TRUSTXD_MAX_CLIENTS; i++)
+		{
+			if (__conn[i].fd < 0)
+				continue;
+			if (!__conn[i].req[TRUSTXD_SOCKET_REQ].pending)
+			{
+				fds[nfds].fd = __conn[i].fd;
+				fds[nfds].events = POLLIN;
+				conns[nfds] = &__conn[i];
+				nfds++;
+			}
+			if (NULL != __conn[i].ring)
+			{
+				fds[nfds].fd = __conn[i].doorbellFd;
+				fds[nfds].events = POLLIN;
+				conns[nfds] = &__conn[i];
+				nfds++;
+			}
+		}
+
+		// Producers only ring the doorbell while the daemon sleeps, look at the rings again after announcing it
+		pending = __scanRings();
+		if (0 == pending)
+		{
+			__setSleeping(1);
+			pending = __scanRings();
+		}
+
+		// Collect all waiting requests before picking the next one, do not block while some are pending
+		if (poll(fds, nfds, pending ? 0 : -1) < 0)
+		{
+			if (EINTR != errno)
+				break;
+		}
+		else
+		{
+			if (fds[0].revents & POLLIN)
+				__accept(listenFd);
+			for (i = 1; i < nfds; i++)
+			{
+				// The client may have been dropped while handling its other descriptor
+				if (conns[i]->fd < 0)
+					continue;
+				if (fds[i].fd == conns[i]->doorbellFd)
+				{
+					if ((fds[i].revents & POLLIN) && (read(fds[i].fd, &doorbell, sizeof(doorbell)) < 0))
+						fprintf(stderr, "trustxd: doorbell: %s\n", strerror(errno));
+				}
+				else if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+				{
+					__receive(conns[i]);
+				}
+			}
+		}
+		__setSleeping(0);
+		__scanRings();
+
+		conn = __next(&index);
+		if (NULL != conn)
+		{
+			if (TRUSTXD_SOCKET_REQ == index)
+				__serve(conn);
+			else
+				__serveSlot(conn, index - 1);
+		}
+
+		if (__dumpStats)
+		{
+			__dumpStats = 0;
+			fprintf(stderr, "trustxd: %u requests served, %u from shared memory rings, %u chip failures\n",
+				__served, __servedShm, __failed);
+		}
+	}
+
+	fprintf(stderr, "trustxd: exiting, %u requests served\n", __served);
+	for (i = 0; i < TRUSTXD_MAX_CLIENTS; i++)
+	{
+		if (__conn[i].fd >= 0)
+			__drop(&__conn[i]);
+	}
+	close(listenFd);
+	unlink(socketPath);
+	trustX_Close();
+	return 0;
+}
@@ -34,12 +34,19 @@
 * @{
 */
 
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <errno.h>
 #include <signal.h>
 #include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include "optiga/pal/pal_os_timer.h"
 #include "optiga/pal/pal_os_event.h"
 
@@ -61,8 +68,20 @@
 #endif
 
 
-#define CLOCKID CLOCK_REALTIME
-#define SIG SIGRTMIN
+#define CLOCKID CLOCK_MONOTONIC
+
+/// Maximum number of one-shot callbacks that can be pending at the same time
+#ifndef PAL_OS_EVENT_MAX_PENDING
+#define PAL_OS_EVENT_MAX_PENDING    16
+#endif
+
+/// Maximum number of one-shot callbacks that can be pending inline on one thread
+#ifndef PAL_OS_EVENT_INLINE_MAX_PENDING
+#define PAL_OS_EVENT_INLINE_MAX_PENDING 4
+#endif
+
+/// Number of nanoseconds in a second
+#define PAL_OS_EVENT_NSEC_PER_SEC   1000000000ULL
 
 /** \brief PAL os event structure */
 typedef struct pal_os_event
@@ -71,117 +90,478 @@ typedef struct pal_os_event
     register_callback callback_registered;
     /// context to be passed to callback
     void * callback_ctx;
+    /// absolute expiry time on CLOCKID in nanoseconds
+    uint64_t expiry_ns;
+    /// registration order, keeps callbacks with equal expiry in FIFO order
+    uint64_t seq;
 }pal_os_event_t;
 
-static pal_os_event_t pal_os_event_0 = {0};
-static 	timer_t timerid;
+/** \brief PAL os event scheduler structure */
+typedef struct pal_os_event_loop
+{
+    /// min-heap of pending one-shot callbacks ordered by expiry
+    pal_os_event_t heap[PAL_OS_EVENT_MAX_PENDING];
+    /// number of entries in heap
+    uint16_t count;
+    /// next registration sequence number
+    uint64_t next_seq;
+    /// timerfd armed to the earliest expiry
+    int timer_fd;
+    /// eventfd used to wake up the loop on stop
+    int wake_fd;
+    /// epoll instance waiting on timer_fd and wake_fd
+    int epoll_fd;
+    /// event loop thread
+    pthread_t thread;
+    /// set while the event loop thread is running
+    volatile uint8_t running;
+    /// set from a stop request until the event loop thread has released its descriptors
+    uint8_t stopping;
+    /// protects all of the above
+    pthread_mutex_t mutex;
+    /// signalled when stopping is cleared
+    pthread_cond_t stopped;
+}pal_os_event_loop_t;
 
-static void handler(int sig, siginfo_t *si, void *uc)
+/** \brief PAL os event inline execution structure, one per thread */
+typedef struct pal_os_event_inline
 {
-	register_callback callback;
+    /// pending one-shot callbacks registered by this thread
+    pal_os_event_t pending[PAL_OS_EVENT_INLINE_MAX_PENDING];
+    /// number of entries in pending
+    uint8_t count;
+    /// nesting depth of pal_os_event_inline_begin, callbacks are queued here while non-zero
+    uint8_t depth;
+    /// next registration sequence number
+    uint64_t next_seq;
+}pal_os_event_inline_t;
+
+static pal_os_event_loop_t pal_os_event_loop_0 = {
+    .timer_fd = -1,
+    .wake_fd = -1,
+    .epoll_fd = -1,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .stopped = PTHREAD_COND_INITIALIZER,
+};
+
+static __thread pal_os_event_inline_t pal_os_event_inline_0;
 
-	PAL_DBGFN(">");
-		
-	if (pal_os_event_0.callback_registered)
+static uint64_t pal_os_event_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCKID, &ts);
+    return ((uint64_t)ts.tv_sec * PAL_OS_EVENT_NSEC_PER_SEC) + (uint64_t)ts.tv_nsec;
+}
+
+static int pal_os_event_before(const pal_os_event_t * p_a, const pal_os_event_t * p_b)
+{
+    if (p_a->expiry_ns != p_b->expiry_ns)
     {
-        callback = pal_os_event_0.callback_registered;
-        pal_os_event_0.callback_registered = NULL;
-        callback((void * )pal_os_event_0.callback_ctx);
+        return (p_a->expiry_ns < p_b->expiry_ns);
     }
-    
-	PAL_DBGFN("<");	    
+    return (p_a->seq < p_b->seq);
+}
+
+static void pal_os_event_swap(pal_os_event_t * p_a, pal_os_event_t * p_b)
+{
+    pal_os_event_t tmp = *p_a;
+    *p_a = *p_b;
+    *p_b = tmp;
+}
+
+// Must be called with the loop mutex held
+static void pal_os_event_heap_push(pal_os_event_loop_t * p_loop, const pal_os_event_t * p_event)
+{
+    uint16_t index = p_loop->count++;
+    uint16_t parent;
+
+    p_loop->heap[index] = *p_event;
+    while (index > 0)
+    {
+        parent = (uint16_t)((index - 1) / 2);
+        if (!pal_os_event_before(&p_loop->heap[index], &p_loop->heap[parent]))
+        {
+            break;
+        }
+        pal_os_event_swap(&p_loop->heap[index], &p_loop->heap[parent]);
+        index = parent;
+    }
+}
+
+// Must be called with the loop mutex held and count > 0
+static void pal_os_event_heap_pop(pal_os_event_loop_t * p_loop, pal_os_event_t * p_event)
+{
+    uint16_t index = 0;
+    uint16_t child;
+
+    *p_event = p_loop->heap[0];
+    p_loop->heap[0] = p_loop->heap[--p_loop->count];
+    for (;;)
+    {
+        child = (uint16_t)((2 * index) + 1);
+        if (child >= p_loop->count)
+        {
+            break;
+        }
+        if (((child + 1) < p_loop->count) &&
+            pal_os_event_before(&p_loop->heap[child + 1], &p_loop->heap[child]))
+        {
+            child++;
+        }
+        if (!pal_os_event_before(&p_loop->heap[child], &p_loop->heap[index]))
+        {
+            break;
+        }
+        pal_os_event_swap(&p_loop->heap[index], &p_loop->heap[child]);
+        index = child;
+    }
+}
+
+// Arms the timerfd to the earliest pending expiry, or disarms it if nothing is pending.
+// Must be called with the loop mutex held
+static void pal_os_event_rearm(pal_os_event_loop_t * p_loop)
+{
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    if (p_loop->count > 0)
+    {
+        its.it_value.tv_sec = (time_t)(p_loop->heap[0].expiry_ns / PAL_OS_EVENT_NSEC_PER_SEC);
+        its.it_value.tv_nsec = (long)(p_loop->heap[0].expiry_ns % PAL_OS_EVENT_NSEC_PER_SEC);
+        // A zero it_value disarms the timer, an expiry in the past fires immediately
+        if ((its.it_value.tv_sec == 0) && (its.it_value.tv_nsec == 0))
+        {
+            its.it_value.tv_nsec = 1;
+        }
+    }
+
+    if (timerfd_settime(p_loop->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == -1)
+    {
+        PAL_ERRFN("timerfd_settime (%s)", strerror(errno));
+    }
+}
+
+static void pal_os_event_close_fds(pal_os_event_loop_t * p_loop)
+{
+    if (p_loop->epoll_fd != -1)
+    {
+        close(p_loop->epoll_fd);
+        p_loop->epoll_fd = -1;
+    }
+    if (p_loop->timer_fd != -1)
+    {
+        close(p_loop->timer_fd);
+        p_loop->timer_fd = -1;
+    }
+    if (p_loop->wake_fd != -1)
+    {
+        close(p_loop->wake_fd);
+        p_loop->wake_fd = -1;
+    }
+}
+
+static void * pal_os_event_thread(void * p_arg)
+{
+    pal_os_event_loop_t * p_loop = (pal_os_event_loop_t *)p_arg;
+    struct epoll_event events[2];
+    pal_os_event_t event;
+    uint64_t value;
+    sigset_t mask;
+    int count;
+    int i;
+
+    PAL_DBGFN(">");
+
+    // Signals are left to the application threads
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    while (p_loop->running)
+    {
+        count = epoll_wait(p_loop->epoll_fd, events, 2, -1);
+        if (count == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            PAL_ERRFN("epoll_wait (%s)", strerror(errno));
+            break;
+        }
+
+        for (i = 0; i < count; i++)
+        {
+            // Both descriptors are non-blocking, reading just clears the readiness
+            if (read(events[i].data.fd, &value, sizeof(value)) == -1)
+            {
+                PAL_DBG("read returned %d", errno);
+            }
+        }
+
+        pthread_mutex_lock(&p_loop->mutex);
+        while (p_loop->running && (p_loop->count > 0) &&
+               (p_loop->heap[0].expiry_ns <= pal_os_event_now_ns()))
+        {
+            pal_os_event_heap_pop(p_loop, &event);
+            // The callback usually registers the next step of the protocol, so run it unlocked
+            pthread_mutex_unlock(&p_loop->mutex);
+            event.callback_registered(event.callback_ctx);
+            pthread_mutex_lock(&p_loop->mutex);
+        }
+        if (p_loop->running)
+        {
+            pal_os_event_rearm(p_loop);
+        }
+        pthread_mutex_unlock(&p_loop->mutex);
+    }
+
+    // The descriptors are released here, so that a stop from a callback needs no join
+    pthread_mutex_lock(&p_loop->mutex);
+    if (!p_loop->stopping)
+    {
+        // Left on an error, nobody is going to join
+        pthread_detach(pthread_self());
+        p_loop->running = 0;
+    }
+    pal_os_event_close_fds(p_loop);
+    p_loop->stopping = 0;
+    pthread_cond_broadcast(&p_loop->stopped);
+    pthread_mutex_unlock(&p_loop->mutex);
+
+    PAL_DBGFN("<");
+    return NULL;
+}
+
+// Must be called with the loop mutex held
+static pal_status_t pal_os_event_start(pal_os_event_loop_t * p_loop)
+{
+    pal_status_t status = PAL_STATUS_FAILURE;
+    struct epoll_event ev;
+
+    // A previous loop thread may still be shutting down and holds the descriptors
+    while (p_loop->stopping)
+    {
+        if (pthread_equal(p_loop->thread, pthread_self()))
+        {
+            PAL_ERRFN("Event loop restarted from its own stopping thread");
+            return status;
+        }
+        pthread_cond_wait(&p_loop->stopped, &p_loop->mutex);
+    }
+
+    do
+    {
+        if (p_loop->running)
+        {
+            status = PAL_STATUS_SUCCESS;
+            break;
+        }
+
+        p_loop->timer_fd = timerfd_create(CLOCKID, TFD_NONBLOCK | TFD_CLOEXEC);
+        p_loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        p_loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if ((p_loop->timer_fd == -1) || (p_loop->wake_fd == -1) || (p_loop->epoll_fd == -1))
+        {
+            PAL_ERRFN("Failed to create event descriptors (%s)", strerror(errno));
+            break;
+        }
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = p_loop->timer_fd;
+        if (epoll_ctl(p_loop->epoll_fd, EPOLL_CTL_ADD, p_loop->timer_fd, &ev) == -1)
+        {
+            PAL_ERRFN("epoll_ctl timerfd (%s)", strerror(errno));
+            break;
+        }
+        ev.data.fd = p_loop->wake_fd;
+        if (epoll_ctl(p_loop->epoll_fd, EPOLL_CTL_ADD, p_loop->wake_fd, &ev) == -1)
+        {
+            PAL_ERRFN("epoll_ctl eventfd (%s)", strerror(errno));
+            break;
+        }
+
+        p_loop->count = 0;
+        p_loop->running = 1;
+        if (pthread_create(&p_loop->thread, NULL, pal_os_event_thread, p_loop) != 0)
+        {
+            PAL_ERRFN("Failed to create event thread");
+            p_loop->running = 0;
+            break;
+        }
+        status = PAL_STATUS_SUCCESS;
+    } while (0);
+
+    if (status != PAL_STATUS_SUCCESS)
+    {
+        pal_os_event_close_fds(p_loop);
+    }
+    return status;
 }
 
 pal_status_t pal_os_event_init(void)
 {
-	struct sigevent sev;
-	struct sigaction sa;
-	
-	/* Establishing handler for signal */
-	PAL_DBGFN(">");
-	
-	sa.sa_flags = SA_SIGINFO;
-	sa.sa_sigaction = handler;
-	sigemptyset(&sa.sa_mask);
-	if (sigaction(SIG, &sa, NULL) == -1)
-	{
-		printf("sigaction\n");
-		exit(1);
-	}
-
-	/* Create the timer */
-
-	sev.sigev_notify = SIGEV_SIGNAL;
-	sev.sigev_signo = SIG;
-	sev.sigev_value.sival_ptr = &timerid;
-	if (timer_create(CLOCKID, &sev, &timerid) == -1)
-	{
-		printf("timer_create\n");
-		exit(1);
-	}
-	PAL_DBGFN("<");
-	return PAL_STATUS_SUCCESS;
+    pal_status_t status;
+
+    PAL_DBGFN(">");
+    pthread_mutex_lock(&pal_os_event_loop_0.mutex);
+    status = pal_os_event_start(&pal_os_event_loop_0);
+    pthread_mutex_unlock(&pal_os_event_loop_0.mutex);
+    PAL_DBGFN("<");
+    return status;
 }
 
 pal_status_t pal_os_event_stop(void)
 {
-	PAL_DBGFN(">");
+    pal_os_event_loop_t * p_loop = &pal_os_event_loop_0;
+    uint64_t value = 1;
+    pthread_t thread;
+
+    PAL_DBGFN(">");
+
+    pthread_mutex_lock(&p_loop->mutex);
+    if (!p_loop->running)
+    {
+        pthread_mutex_unlock(&p_loop->mutex);
+        return PAL_STATUS_SUCCESS;
+    }
+    p_loop->running = 0;
+    p_loop->stopping = 1;
+    p_loop->count = 0;
+    thread = p_loop->thread;
+    if (write(p_loop->wake_fd, &value, sizeof(value)) == -1)
+    {
+        PAL_ERRFN("Failed to wake event thread (%s)", strerror(errno));
+    }
+    pthread_mutex_unlock(&p_loop->mutex);
+
+    // Stop may be requested from a callback running on the event thread itself
+    if (pthread_equal(thread, pthread_self()))
+    {
+        pthread_detach(thread);
+    }
+    else
+    {
+        pthread_join(thread, NULL);
+    }
 
-	if (timerid != 0)
-	{
-		timer_delete(timerid);
-	}
-	PAL_DBGFN("<");
-	return PAL_STATUS_SUCCESS;
-} 
+    PAL_DBGFN("<");
+    return PAL_STATUS_SUCCESS;
+}
 
 pal_status_t pal_os_event_disarm(void)
 {
-	struct itimerspec its;
+    PAL_DBGFN(">");
 
-	PAL_DBGFN(">");
-	its.it_value.tv_sec = 0;
-	its.it_value.tv_nsec = 0;
-	its.it_interval.tv_sec = 0;
-	its.it_interval.tv_nsec = 0;
-	
-	if (timer_settime(timerid, 0, &its, NULL) == -1)
-	{
-		printf("Error in timer_settime\n");
-	    exit(1);
-	}
+    pal_os_event_inline_0.count = 0;
 
-	PAL_DBGFN("<");
-	return PAL_STATUS_SUCCESS;	
-} 
+    pthread_mutex_lock(&pal_os_event_loop_0.mutex);
+    pal_os_event_loop_0.count = 0;
+    if (pal_os_event_loop_0.running)
+    {
+        pal_os_event_rearm(&pal_os_event_loop_0);
+    }
+    pthread_mutex_unlock(&pal_os_event_loop_0.mutex);
+
+    PAL_DBGFN("<");
+    return PAL_STATUS_SUCCESS;
+}
 
 void pal_os_event_register_callback_oneshot(register_callback callback, 
                                             void*             callback_args,
                                             uint32_t          time_us)
 {
-	struct itimerspec its;
-	long long freq_nanosecs;
-	PAL_DBGFN(">");
-
-    pal_os_event_0.callback_registered = callback;
-    pal_os_event_0.callback_ctx = callback_args;
-	
-	/* Start the timer */
-
-	freq_nanosecs = time_us * 1000;
-	its.it_value.tv_sec = freq_nanosecs / 1000000000;
-	its.it_value.tv_nsec = freq_nanosecs % 1000000000;
-	its.it_interval.tv_sec = its.it_value.tv_sec;
-	its.it_interval.tv_nsec = its.it_value.tv_nsec;
-	
-	if (timer_settime(timerid, 0, &its, NULL) == -1)
-	{
-		printf("Error in timer_settime\n");
-	    exit(1);
-	}
-
-	PAL_DBGFN("<");	
+    pal_os_event_loop_t * p_loop = &pal_os_event_loop_0;
+    pal_os_event_t event;
+
+    PAL_DBGFN(">");
+
+    event.callback_registered = callback;
+    event.callback_ctx = callback_args;
+    event.expiry_ns = pal_os_event_now_ns() + ((uint64_t)time_us * 1000);
+
+    // Within pal_os_event_inline_begin/end the calling thread runs the callback itself
+    if ((pal_os_event_inline_0.depth > 0) &&
+        (pal_os_event_inline_0.count < PAL_OS_EVENT_INLINE_MAX_PENDING))
+    {
+        event.seq = pal_os_event_inline_0.next_seq++;
+        pal_os_event_inline_0.pending[pal_os_event_inline_0.count++] = event;
+        PAL_DBGFN("< inline");
+        return;
+    }
+
+    pthread_mutex_lock(&p_loop->mutex);
+    do
+    {
+        // The stack may be opened without an explicit pal_os_event_init
+        if (PAL_STATUS_SUCCESS != pal_os_event_start(p_loop))
+        {
+            break;
+        }
+        if (p_loop->count >= PAL_OS_EVENT_MAX_PENDING)
+        {
+            PAL_ERRFN("Too many pending events (%d)", p_loop->count);
+            break;
+        }
+        event.seq = p_loop->next_seq++;
+        pal_os_event_heap_push(p_loop, &event);
+        // Only a new earliest entry moves the deadline
+        if (p_loop->heap[0].seq == event.seq)
+        {
+            pal_os_event_rearm(p_loop);
+        }
+    } while (0);
+    pthread_mutex_unlock(&p_loop->mutex);
+
+    PAL_DBGFN("<");
+}
+
+void pal_os_event_inline_begin(void)
+{
+    pal_os_event_inline_0.depth++;
+}
+
+void pal_os_event_inline_end(void)
+{
+    pal_os_event_inline_t * p_inline = &pal_os_event_inline_0;
+    pal_os_event_t event;
+    struct timespec ts;
+    uint8_t next;
+    uint8_t i;
+
+    PAL_DBGFN(">");
+
+    // Only the outermost end drives the callbacks, nested pairs are entered from a callback
+    if (--p_inline->depth > 0)
+    {
+        return;
+    }
+
+    p_inline->depth = 1;
+    while (p_inline->count > 0)
+    {
+        next = 0;
+        for (i = 1; i < p_inline->count; i++)
+        {
+            if (pal_os_event_before(&p_inline->pending[i], &p_inline->pending[next]))
+            {
+                next = i;
+            }
+        }
+        event = p_inline->pending[next];
+        p_inline->pending[next] = p_inline->pending[--p_inline->count];
+
+        ts.tv_sec = (time_t)(event.expiry_ns / PAL_OS_EVENT_NSEC_PER_SEC);
+        ts.tv_nsec = (long)(event.expiry_ns % PAL_OS_EVENT_NSEC_PER_SEC);
+        while (clock_nanosleep(CLOCKID, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        {
+        }
+        event.callback_registered(event.callback_ctx);
+    }
+    p_inline->depth = 0;
 
+    PAL_DBGFN("<");
 }
 
 /**
@@ -24,22 +24,289 @@
 */
 
 #include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <openssl/engine.h>
 
 #include "trustx_engine_common.h"
 #include "trustx_engine_ec.h"
 #include "trustx.h"
+#include "trustx_queue.h"
+#include "optiga/ifx_i2c/ifx_i2c.h"
+#include "optiga/comms/optiga_comms_pool.h"
 
 //Globe
 trustx_ctx_t trustx_ctx;
+trustxEngine_stats_t trustx_stats;
 
 //Local
 static const char *engine_id   = "trustx_engine";
 static const char *engine_name = "Infineon OPTIGA Trust X engine";
 
+static pthread_mutex_t chip_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int chip_opened = 0;
+
 static int engine_init(ENGINE *e);
 static int engine_finish(ENGINE *e);
 static int engine_destroy(ENGINE *e);
+static int engine_ctrl(ENGINE *e, int cmd, long i, void *p, void (*f)(void));
+
+// Control commands, e.g. set from the engine section of openssl.cnf
+#define TRUSTX_ENGINE_CMD_I2C_DEVICE        (ENGINE_CMD_BASE)
+#define TRUSTX_ENGINE_CMD_I2C_ADDRESS       (ENGINE_CMD_BASE + 1)
+#define TRUSTX_ENGINE_CMD_RAND_POOL_SIZE    (ENGINE_CMD_BASE + 2)
+#define TRUSTX_ENGINE_CMD_RAND_DRBG         (ENGINE_CMD_BASE + 3)
+#define TRUSTX_ENGINE_CMD_KEY_CACHE         (ENGINE_CMD_BASE + 4)
+#define TRUSTX_ENGINE_CMD_KEY_CACHE_DIR     (ENGINE_CMD_BASE + 5)
+#define TRUSTX_ENGINE_CMD_SIGN_QUEUE_DEPTH  (ENGINE_CMD_BASE + 6)
+#define TRUSTX_ENGINE_CMD_PERF_COUNTERS     (ENGINE_CMD_BASE + 7)
+
+static const ENGINE_CMD_DEFN engine_cmd_defns[] = {
+  {TRUSTX_ENGINE_CMD_I2C_DEVICE, "I2C_DEVICE",
+   "I2C adapter of the chip (default /dev/i2c-1), before first use", ENGINE_CMD_FLAG_STRING},
+  {TRUSTX_ENGINE_CMD_I2C_ADDRESS, "I2C_ADDRESS",
+   "I2C slave address of the chip (default 0x30), before first use", ENGINE_CMD_FLAG_STRING},
+  {TRUSTX_ENGINE_CMD_RAND_POOL_SIZE, "RAND_POOL_SIZE",
+   "Entropy pool size in bytes (256 to 65536)", ENGINE_CMD_FLAG_NUMERIC},
+  {TRUSTX_ENGINE_CMD_RAND_DRBG, "RAND_DRBG",
+   "1 serves random values from a DRBG reseeded from the pool, 0 from the pool", ENGINE_CMD_FLAG_NUMERIC},
+  {TRUSTX_ENGINE_CMD_KEY_CACHE, "KEY_CACHE",
+   "1 enables the key cache, 0 disables it", ENGINE_CMD_FLAG_NUMERIC},
+  {TRUSTX_ENGINE_CMD_KEY_CACHE_DIR, "KEY_CACHE_DIR",
+   "Directory of the persistent key cache, empty keeps it in memory", ENGINE_CMD_FLAG_STRING},
+  {TRUSTX_ENGINE_CMD_SIGN_QUEUE_DEPTH, "SIGN_QUEUE_DEPTH",
+   "Pending async signs, 0 for the default, before the first async sign", ENGINE_CMD_FLAG_NUMERIC},
+  {TRUSTX_ENGINE_CMD_PERF_COUNTERS, "PERF_COUNTERS",
+   "Prints the performance counters to stderr", ENGINE_CMD_FLAG_NO_INPUT},
+  {0, NULL, NULL, 0}
+};
+
+/*
+ * Opens the chip on first use and shares the session with all later callers. Loading the
+ * engine alone does not touch the chip, so OpenSSL commands that never use it do not pay
+ * for the I2C setup and the application open. A failed open is retried on the next use.
+ */
+int trustxEngine_open(void)
+{
+  int ret = TRUSTX_ENGINE_SUCCESS;
+
+  if (__atomic_load_n(&chip_opened, __ATOMIC_ACQUIRE))
+    return TRUSTX_ENGINE_SUCCESS;
+
+  pthread_mutex_lock(&chip_mutex);
+  if (!chip_opened)
+  {
+    TRUSTX_ENGINE_DBGFN("> Opening OPTIGA");
+    if (trustX_Open() == OPTIGA_LIB_SUCCESS)
+    {
+      trustxEngine_keycache_chip_opened();
+      __atomic_store_n(&chip_opened, 1, __ATOMIC_RELEASE);
+      TRUSTX_ENGINE_STAT_ADD(chip_open, 1);
+    }
+    else
+    {
+      TRUSTX_ENGINE_ERRFN("< failed to open OPTIGA application.\n");
+      ret = TRUSTX_ENGINE_FAIL;
+    }
+  }
+  pthread_mutex_unlock(&chip_mutex);
+  return ret;
+}
+
+/*
+ * Selects the chip interface, only possible while the chip is not open yet.
+ * NULL or 0 keeps the current setting.
+ */
+static int trustxEngine_set_interface(const char *device, uint8_t addr)
+{
+  int ret = TRUSTX_ENGINE_FAIL;
+
+  pthread_mutex_lock(&chip_mutex);
+  if (chip_opened)
+    TRUSTX_ENGINE_ERRFN("OPTIGA already open, interface not changed");
+  else if (trustX_SetInterface(device, addr) == OPTIGA_LIB_SUCCESS)
+    ret = TRUSTX_ENGINE_SUCCESS;
+  pthread_mutex_unlock(&chip_mutex);
+  return ret;
+}
+
+/*
+ * Prints the counters and the per command latencies of the I2C protocol stack, and the
+ * execution times learned by the adaptive status poller. Commands never sent are skipped.
+ */
+static void trustxEngine_dump_i2c_stats(void)
+{
+  ifx_i2c_perf_t *perf;
+  ifx_i2c_pl_exec_time_t exec_time;
+  uint32_t cmd;
+#if IFX_I2C_PERF_LATENCY == 1
+  const ifx_i2c_perf_latency_t *latency;
+  uint32_t bucket;
+#endif
+
+  // Too large for the stack with a latency histogram per command
+  perf = OPENSSL_zalloc(sizeof(ifx_i2c_perf_t));
+  if ((perf != NULL) && (ifx_i2c_get_perf(&ifx_i2c_context_0, perf) == IFX_I2C_STACK_SUCCESS))
+  {
+    fprintf(stderr, "I2C protocol stack\n");
+#if IFX_I2C_PERF_COUNTERS == 1
+    fprintf(stderr, "  transceives         : %u\n", perf->counters.transceives);
+    fprintf(stderr, "  transceive errors   : %u\n", perf->counters.transceive_errors);
+    fprintf(stderr, "  TL chaining errors  : %u\n", perf->counters.tl_chaining_errors);
+    fprintf(stderr, "  TL resends          : %u\n", perf->counters.tl_resends);
+    fprintf(stderr, "  DL frames sent      : %u\n", perf->counters.dl_frames_sent);
+    fprintf(stderr, "  DL frames received  : %u\n", perf->counters.dl_frames_received);
+    fprintf(stderr, "  DL CRC errors       : %u\n", perf->counters.dl_crc_errors);
+    fprintf(stderr, "  DL NACKs sent       : %u\n", perf->counters.dl_nacks_sent);
+    fprintf(stderr, "  DL NACKs received   : %u\n", perf->counters.dl_nacks_received);
+    fprintf(stderr, "  DL retransmissions  : %u\n", perf->counters.dl_retransmissions);
+    fprintf(stderr, "  DL resyncs          : %u\n", perf->counters.dl_resyncs);
+    fprintf(stderr, "  PL status polls     : %u\n", perf->counters.pl_status_polls);
+    fprintf(stderr, "  PL I2C errors       : %u\n", perf->counters.pl_i2c_errors);
+    fprintf(stderr, "  PL bytes sent       : %u\n", perf->counters.pl_bytes_sent);
+    fprintf(stderr, "  PL bytes received   : %u\n", perf->counters.pl_bytes_received);
+#endif
+#if IFX_I2C_PERF_LATENCY == 1
+    // Bucket n counts latencies below 2^(IFX_I2C_PERF_LATENCY_MIN_SHIFT + n) us, the last one all longer ones
+    for (cmd = 0; cmd < IFX_I2C_PERF_LATENCY_SLOTS; cmd++)
+    {
+      latency = &perf->latency[cmd];
+      if (latency->count == 0)
+        continue;
+      fprintf(stderr, "  command 0x%02X latency: %u done, max %u us,", cmd, latency->count, latency->max_us);
+      for (bucket = 0; bucket < IFX_I2C_PERF_LATENCY_BUCKETS; bucket++)
+      {
+        if (latency->bucket[bucket] == 0)
+          continue;
+        if (bucket == (IFX_I2C_PERF_LATENCY_BUCKETS - 1))
+          fprintf(stderr, " >=%u us:%u", 1u << (IFX_I2C_PERF_LATENCY_MIN_SHIFT + bucket - 1), latency->bucket[bucket]);
+        else
+          fprintf(stderr, " <%u us:%u", 1u << (IFX_I2C_PERF_LATENCY_MIN_SHIFT + bucket), latency->bucket[bucket]);
+      }
+      fprintf(stderr, "\n");
+    }
+#endif
+  }
+  OPENSSL_free(perf);
+
+  for (cmd = 0; cmd <= 0xFF; cmd++)
+  {
+    if ((ifx_i2c_get_exec_time(&ifx_i2c_context_0, (uint8_t)cmd, &exec_time) != IFX_I2C_STACK_SUCCESS) ||
+        (exec_time.samples == 0))
+      continue;
+    fprintf(stderr, "  command 0x%02X exec time: %u us +- %u us, %u samples\n", cmd,
+            exec_time.average_us, exec_time.deviation_us, exec_time.samples);
+  }
+}
+
+// Prints the use of the APDU buffer pool of the command library
+static void trustxEngine_dump_pool_stats(void)
+{
+  optiga_comms_pool_stats_t stats[OPTIGA_COMMS_POOL_CLASSES];
+  uint32_t oversized;
+  uint32_t i;
+
+  optiga_comms_pool_get_stats(&optiga_comms_pool_0, stats, &oversized);
+  fprintf(stderr, "APDU buffer pool\n");
+  for (i = 0; i < OPTIGA_COMMS_POOL_CLASSES; i++)
+  {
+    fprintf(stderr, "  %u x %u bytes: %u allocations, %u misses, %u in use, %u at most\n",
+            stats[i].buffer_count, stats[i].buffer_size, stats[i].allocations,
+            stats[i].misses, stats[i].in_use, stats[i].high_water);
+  }
+  fprintf(stderr, "  oversized requests  : %u\n", oversized);
+}
+
+static void trustxEngine_dump_stats(void)
+{
+  uint64_t sign = __atomic_load_n(&trustx_stats.sign, __ATOMIC_RELAXED);
+  uint64_t sign_usec = __atomic_load_n(&trustx_stats.sign_usec, __ATOMIC_RELAXED);
+
+  fprintf(stderr, "%s performance counters\n", engine_id);
+  fprintf(stderr, "  chip opens          : %" PRIu64 "\n", trustx_stats.chip_open);
+  fprintf(stderr, "  signs               : %" PRIu64 "\n", sign);
+  fprintf(stderr, "  signs async         : %" PRIu64 "\n", trustx_stats.sign_async);
+  fprintf(stderr, "  signs failed        : %" PRIu64 "\n", trustx_stats.sign_fail);
+  fprintf(stderr, "  sign time avg (us)  : %" PRIu64 "\n", sign ? (sign_usec / sign) : 0);
+  fprintf(stderr, "  random bytes        : %" PRIu64 "\n", trustx_stats.rand_bytes);
+  fprintf(stderr, "  TRNG reads on demand: %" PRIu64 "\n", trustx_stats.rand_trng);
+  fprintf(stderr, "  TRNG reads prefetch : %" PRIu64 "\n", trustx_stats.rand_prefetch);
+  fprintf(stderr, "  key cache hits      : %" PRIu64 "\n", trustx_stats.keycache_hit);
+  fprintf(stderr, "  key cache misses    : %" PRIu64 "\n", trustx_stats.keycache_miss);
+
+  trustxEngine_dump_i2c_stats();
+  trustxEngine_dump_pool_stats();
+}
+
+static int engine_ctrl(ENGINE *e, int cmd, long i, void *p, void (*f)(void))
+{
+  int ret = TRUSTX_ENGINE_FAIL;
+  unsigned long addr;
+  char *end;
+
+  TRUSTX_ENGINE_DBGFN("> cmd=%d i=%ld", cmd, i);
+
+  switch (cmd)
+  {
+    case TRUSTX_ENGINE_CMD_I2C_DEVICE:
+      if ((p == NULL) || (((const char *)p)[0] == '\0'))
+        TRUSTX_ENGINE_ERRFN("I2C_DEVICE needs a device name");
+      else
+        ret = trustxEngine_set_interface((const char *)p, 0);
+      break;
+
+    case TRUSTX_ENGINE_CMD_I2C_ADDRESS:
+      addr = (p == NULL) ? 0 : strtoul((const char *)p, &end, 0);
+      if ((p == NULL) || (*end != '\0') || (addr == 0) || (addr > 0x7F))
+        TRUSTX_ENGINE_ERRFN("I2C_ADDRESS needs a 7 bit address");
+      else
+        ret = trustxEngine_set_interface(NULL, (uint8_t)addr);
+      break;
+
+    case TRUSTX_ENGINE_CMD_RAND_POOL_SIZE:
+      if ((i > 0) && (i <= TRUSTX_ENGINE_RAND_POOL_MAX))
+        ret = trustxEngine_rand_set_pool_size((uint32_t)i);
+      else
+        TRUSTX_ENGINE_ERRFN("RAND_POOL_SIZE %ld out of range", i);
+      break;
+
+    case TRUSTX_ENGINE_CMD_RAND_DRBG:
+      ret = trustxEngine_rand_set_drbg(i != 0);
+      break;
+
+    case TRUSTX_ENGINE_CMD_KEY_CACHE:
+      trustxEngine_keycache_set_enabled(i != 0);
+      ret = TRUSTX_ENGINE_SUCCESS;
+      break;
+
+    case TRUSTX_ENGINE_CMD_KEY_CACHE_DIR:
+      ret = trustxEngine_keycache_set_dir((const char *)p);
+      break;
+
+    case TRUSTX_ENGINE_CMD_SIGN_QUEUE_DEPTH:
+      if ((i >= 0) && (i <= UINT16_MAX))
+      {
+        trustxEngine_set_queue_depth((uint16_t)i);
+        ret = TRUSTX_ENGINE_SUCCESS;
+      }
+      else
+        TRUSTX_ENGINE_ERRFN("SIGN_QUEUE_DEPTH %ld out of range", i);
+      break;
+
+    case TRUSTX_ENGINE_CMD_PERF_COUNTERS:
+      trustxEngine_dump_stats();
+      ret = TRUSTX_ENGINE_SUCCESS;
+      break;
+
+    default:
+      TRUSTX_ENGINE_DBGFN("unsupported command %d", cmd);
+      break;
+  }
+
+  TRUSTX_ENGINE_DBGFN("<");
+  return ret;
+}
 
 static int engine_init(ENGINE *e)
 {
@@ -63,14 +330,8 @@ static int engine_init(ENGINE *e)
     trustx_ctx.key_oid = 0;
     trustx_ctx.pubkeyfilename[0] = '\0';
 
+    //The trustx application is opened on first use, see trustxEngine_open()
 
-    //Open trustx application
-    if (trustX_Open() != OPTIGA_LIB_SUCCESS)
-    {
-	TRUSTX_ENGINE_ERRFN("< failed to open OPTIGA application.\n");
-	break;
-    }
-    
     //Init EC
     ret = trustxEngine_init_ec(e);
     if (ret != TRUSTX_ENGINE_SUCCESS) {
@@ -96,7 +357,16 @@ static int engine_init(ENGINE *e)
 static int engine_destroy(ENGINE *e)
 {
   TRUSTX_ENGINE_DBGFN("> Engine 0x%x destroy", (unsigned int) e);
-  trustX_Close();
+  trustX_QueueStop();
+  trustxEngine_finish_rand();
+  trustxEngine_keycache_flush();
+  pthread_mutex_lock(&chip_mutex);
+  if (chip_opened)
+  {
+    trustX_Close();
+    __atomic_store_n(&chip_opened, 0, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&chip_mutex);
   TRUSTX_ENGINE_DBGFN("<");
   return TRUSTX_ENGINE_SUCCESS;
 }
@@ -104,7 +374,6 @@ static int engine_destroy(ENGINE *e)
 static int engine_finish(ENGINE *e)
 {
   TRUSTX_ENGINE_DBGFN("> Engine 0x%x finish (releasing functional reference)", (unsigned int) e);
-  //trustx_disarm_timer();
   TRUSTX_ENGINE_DBGFN("<");
   return TRUSTX_ENGINE_SUCCESS;
 }
@@ -149,18 +418,16 @@ static int bind(ENGINE *e, const char *id)
 
 		//just to try ....ret = ENGINE_set_EC(e, engine_destroy);
 
-/*
 		if (!ENGINE_set_ctrl_function(e, engine_ctrl)) {
 			TRUSTX_ENGINE_DBGFN("ENGINE_set_ctrl_function failed\n");
 			break;
 		}
 
-
 		if (!ENGINE_set_cmd_defns(e, engine_cmd_defns)) {
 			TRUSTX_ENGINE_DBGFN("ENGINE_set_cmd_defns failed\n");
 			break;
 		}
-*/
+
 		ret = TRUSTX_ENGINE_SUCCESS;
 	}while(FALSE);
 
@@ -36,6 +36,15 @@
 #define KEY_CONTEXT_MAX_LEN  (100)
 #define PARAM_MAX_LEN        (128)
 
+#define TRUSTX_ENGINE_RAND_POOL_SIZE       (4096) /* Entropy pool size in bytes, RAND_POOL_SIZE changes it at runtime */
+#define TRUSTX_ENGINE_RAND_POOL_MAX        (65536) /* Largest entropy pool size in bytes */
+#define TRUSTX_ENGINE_RAND_LOW_WATERMARK   (1024) /* Prefetch from the TRNG starts below this level */
+#define TRUSTX_ENGINE_RAND_HIGH_WATERMARK  (4096) /* Prefetch stops at this level */
+#define TRUSTX_ENGINE_RAND_DRBG            (0)    /* 1 serves random values from a DRBG reseeded from the pool */
+#define TRUSTX_ENGINE_RAND_RESEED_INTERVAL (4096) /* DRBG output in bytes between reseeds */
+#define TRUSTX_ENGINE_KEY_CACHE_DIR        ""     /* Directory of the persistent key cache, empty keeps it in memory */
+#define TRUSTX_ENGINE_SIGN_QUEUE_DEPTH     (0)    /* Pending async signs, 0 selects TRUSTX_QUEUE_DEFAULT_DEPTH */
+
 //#define TRUSTX_ENGINE_DEBUG = 1
 
 #ifdef TRUSTX_ENGINE_DEBUG
@@ -112,15 +121,51 @@ typedef struct trustx_ctx_str
   
 } trustx_ctx_t;
 
+// Per key context, attached to the EC_KEY of every EVP_PKEY returned by trustx_loadKey
+typedef struct trustx_key_ctx_str
+{
+  uint16_t	key_oid;
+  optiga_ecc_curve_t  ec_key_curve;
+  uint8_t   pubkey[PUBKEY_SIZE];
+  uint16_t  pubkeylen;
+} trustx_key_ctx_t;
+
+// Performance counters, dumped by the PERF_COUNTERS control command
+typedef struct trustxEngine_stats_str
+{
+  uint64_t  chip_open;      // chip opens
+  uint64_t  sign;           // signs on the chip
+  uint64_t  sign_async;     // of those, signs of paused async jobs
+  uint64_t  sign_fail;      // failed signs
+  uint64_t  sign_usec;      // time spent signing
+  uint64_t  rand_bytes;     // random bytes served
+  uint64_t  rand_trng;      // TRNG reads of requesting threads (pool empty)
+  uint64_t  rand_prefetch;  // TRNG reads of the prefetch thread
+  uint64_t  keycache_hit;
+  uint64_t  keycache_miss;
+} trustxEngine_stats_t;
+
+#define TRUSTX_ENGINE_STAT_ADD(field, n)  __atomic_add_fetch(&trustx_stats.field, (n), __ATOMIC_RELAXED)
+
 //extern
 extern trustx_ctx_t trustx_ctx;
+extern trustxEngine_stats_t trustx_stats;
 
 //function prototype
+int trustxEngine_open(void);
 uint16_t trustxEngine_init_ec(ENGINE *e);
 uint16_t trustxEngine_init_rand(ENGINE *e);
-
-// This is a temporarily work around 
-void trustx_arm_timer(void);
-void trustx_disarm_timer(void);
+void trustxEngine_finish_rand(void);
+int trustxEngine_rand_set_drbg(int enable);
+int trustxEngine_rand_set_pool_size(uint32_t size);
+void trustxEngine_set_queue_depth(uint16_t depth);
+void trustxEngine_keycache_set_enabled(int enable);
+int trustxEngine_keycache_set_dir(const char *dir);
+EVP_PKEY *trustxEngine_keycache_get(const char *key_id);
+int trustxEngine_keycache_load(const char *key_id, uint16_t key_oid, uint8_t *der, uint16_t *der_len);
+void trustxEngine_keycache_put(const char *key_id, uint16_t key_oid, EVP_PKEY *key, int persist);
+void trustxEngine_keycache_invalidate(uint16_t key_oid);
+void trustxEngine_keycache_flush(void);
+void trustxEngine_keycache_chip_opened(void);
 
 #endif // _TRUSTX_ENGINE_COMMON_
@@ -27,8 +27,13 @@
 #include "pal_os_event.h"
 
 #include "trustx.h"
+#include "trustx_queue.h"
 
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 #include <openssl/ec.h>
 #include <openssl/evp.h>
@@ -36,11 +41,19 @@
 #include <openssl/x509.h>
 #include <openssl/pem.h>
 #include <openssl/engine.h>
+#include <openssl/async.h>
 
 //Globe
 const EC_KEY_METHOD *default_ec = NULL;
 EC_KEY_METHOD *ec_methods = NULL;
 
+//Local
+static int trustx_key_ex_index = -1;
+static ECDSA_SIG *(*default_sign_sig)(const unsigned char *, int, const BIGNUM *,
+                                      const BIGNUM *, EC_KEY *) = NULL;
+static const char trustx_async_key[] = "trustx_engine";
+static uint16_t sign_queue_depth = TRUSTX_ENGINE_SIGN_QUEUE_DEPTH;
+
 unsigned char dummy_ec_public_key_256[] = 
 {
 0x30,0x59,0x30,0x13,0x06,0x07,0x2A,0x86,0x48,0xCE,
@@ -72,9 +85,15 @@ unsigned char dummy_ec_public_key_384[] =
 };
 
 
-static uint32_t parseKeyParams(const char *aArg)
+/*
+ * Splits key_oid:<pubkeyfile>:NEW:<curve>:<usage>:LOCK into the context of the key being
+ * loaded. Nothing is kept in the engine context, every load starts from the engine defaults.
+ */
+static uint32_t parseKeyParams(const char *aArg, trustx_key_ctx_t *key_ctx, trustxEngine_flag_t *ec_flag,
+                               optiga_key_usage_t *ec_key_usage, char *pubkeyfilename)
 {
 	uint32_t value;
+	uint32_t param;
 	char in[1024];
 
 	char *token[6];
@@ -90,6 +109,9 @@ static uint32_t parseKeyParams(const char *aArg)
 		TRUSTX_ENGINE_ERRFN("No input key parameters present. (key_oid:<pubkeyfile>)");
 		return EVP_FAIL;
 	}
+	*ec_flag = TRUSTX_ENGINE_FLAG_NONE;
+	*ec_key_usage = trustx_ctx.ec_key_usage;
+	key_ctx->ec_key_curve = trustx_ctx.ec_key_curve;
 	
 	i = 0;
 	token[0] = strtok(in, ":");
@@ -136,19 +158,19 @@ static uint32_t parseKeyParams(const char *aArg)
 			value = 0;
 	}
 
-	trustx_ctx.key_oid = value;
+	key_ctx->key_oid = value;
 	TRUSTX_ENGINE_DBGFN("value %x", value);
 
 	
 	if ((token[1] != NULL) && (*(token[1]) != '*') && (*(token[1]) != '^'))
 	{
-		strncpy(trustx_ctx.pubkeyfilename, token[1], PUBKEYFILE_SIZE);
+		strncpy(pubkeyfilename, token[1], PUBKEYFILE_SIZE);
 	}
 	else
 	{
-		trustx_ctx.pubkeyfilename[0]='\0';
+		pubkeyfilename[0]='\0';
 		if((token[1] != NULL) && (*(token[1]) == '^'))
-		  trustx_ctx.ec_flag = TRUSTX_ENGINE_FLAG_SAVEPUBKEY;
+		  *ec_flag = TRUSTX_ENGINE_FLAG_SAVEPUBKEY;
 	}
 
 
@@ -160,13 +182,13 @@ static uint32_t parseKeyParams(const char *aArg)
 				if (((value >= 0xE0F1) && (value <= 0xE0F3)))
 				{
 					TRUSTX_ENGINE_DBGFN("found NEW\n");
-					trustx_ctx.ec_flag |= TRUSTX_ENGINE_FLAG_NEW;
-					if ((i>3) && (strncmp(token[3], "0x",2) == 0))
-						sscanf(token[3],"%x",&(trustx_ctx.ec_key_curve));
-					if ((i>4) && (strncmp(token[4], "0x",2) == 0))
-						sscanf(token[4],"%x",&(trustx_ctx.ec_key_usage));
+					*ec_flag |= TRUSTX_ENGINE_FLAG_NEW;
+					if ((i>3) && (strncmp(token[3], "0x",2) == 0) && (sscanf(token[3],"%x",&param) == 1))
+						key_ctx->ec_key_curve = (optiga_ecc_curve_t)param;
+					if ((i>4) && (strncmp(token[4], "0x",2) == 0) && (sscanf(token[4],"%x",&param) == 1))
+						*ec_key_usage = (optiga_key_usage_t)param;
 					if ((i>5) && (strcmp(token[5], "LOCK") == 0))
-						trustx_ctx.ec_flag |= TRUSTX_ENGINE_FLAG_LOCK;
+						*ec_flag |= TRUSTX_ENGINE_FLAG_LOCK;
 				}
 				
 			}
@@ -189,13 +211,89 @@ static uint32_t parseKeyParams(const char *aArg)
 	return value;
 }
 
-void trustx_disarm_timer(void)
+
+static void trustx_key_ctx_free(void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+                                int idx, long argl, void *argp)
 {
-  TRUSTX_ENGINE_DBGFN(">");
-  pal_os_event_disarm();
-  TRUSTX_ENGINE_DBGFN("<");
+  OPENSSL_free(ptr);
 }
 
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int trustx_key_ctx_dup(CRYPTO_EX_DATA *to, const CRYPTO_EX_DATA *from,
+                              void **from_d, int idx, long argl, void *argp)
+{
+  void **p_ctx = from_d;
+#else
+static int trustx_key_ctx_dup(CRYPTO_EX_DATA *to, const CRYPTO_EX_DATA *from,
+                              void *from_d, int idx, long argl, void *argp)
+{
+  void **p_ctx = (void **)from_d;
+#endif
+  // The copy gets a context of its own, both are freed independently
+  if (*p_ctx != NULL)
+  {
+    *p_ctx = OPENSSL_memdup(*p_ctx, sizeof(trustx_key_ctx_t));
+    if (*p_ctx == NULL)
+      return 0;
+  }
+  return 1;
+}
+
+/*
+ * Moves the public key into an EC_KEY of this engine, carrying a copy of the key context parsed
+ * by trustx_loadKey. Signing uses this copy, so keys loaded one after another stay apart.
+ * Consumes pubkey, returns NULL on failure.
+ */
+static EVP_PKEY *trustx_bindKey(ENGINE *e, EVP_PKEY *pubkey, const trustx_key_ctx_t *ctx)
+{
+  EVP_PKEY         *key     = NULL;
+  EC_KEY           *pub     = NULL;
+  EC_KEY           *eckey   = NULL;
+  trustx_key_ctx_t *key_ctx = NULL;
+
+  do {
+    pub = EVP_PKEY_get1_EC_KEY(pubkey);
+    if (pub == NULL)
+    {
+      TRUSTX_ENGINE_ERRFN("public key is no EC key");
+      break;
+    }
+
+    key_ctx = OPENSSL_memdup(ctx, sizeof(trustx_key_ctx_t));
+    if (key_ctx == NULL)
+      break;
+    // The key itself tells the curve, whatever was asked for on the command line
+    key_ctx->ec_key_curve = (EC_GROUP_get_curve_name(EC_KEY_get0_group(pub)) == NID_secp384r1) ?
+                            OPTIGA_ECC_NIST_P_384 : OPTIGA_ECC_NIST_P_256;
+
+    eckey = EC_KEY_new_method(e);
+    if ((eckey == NULL) ||
+        !EC_KEY_set_group(eckey, EC_KEY_get0_group(pub)) ||
+        !EC_KEY_set_public_key(eckey, EC_KEY_get0_public_key(pub)))
+    {
+      TRUSTX_ENGINE_ERRFN("failed to create EC key");
+      break;
+    }
+    if (!EC_KEY_set_ex_data(eckey, trustx_key_ex_index, key_ctx))
+      break;
+    key_ctx = NULL;
+
+    key = EVP_PKEY_new();
+    if ((key == NULL) || !EVP_PKEY_assign_EC_KEY(key, eckey))
+    {
+      EVP_PKEY_free(key);
+      key = NULL;
+      break;
+    }
+    eckey = NULL;
+  }while(FALSE);
+
+  OPENSSL_free(key_ctx);
+  EC_KEY_free(eckey);
+  EC_KEY_free(pub);
+  EVP_PKEY_free(pubkey);
+  return key;
+}
 
 /*
  * With command
@@ -218,6 +316,10 @@ EVP_PKEY *trustx_loadKey(
   
   optiga_key_id_t optiga_key_id;
   uint16_t key_oid;
+  trustx_key_ctx_t key_ctx;
+  trustxEngine_flag_t ec_flag;
+  optiga_key_usage_t ec_key_usage;
+  char pubkeyfilename[PUBKEYFILE_SIZE];
   FILE *fp;
   char *name;
   char *header;
@@ -226,6 +328,9 @@ EVP_PKEY *trustx_loadKey(
   uint8_t pubkey[150];
   
   uint16_t i;
+  int cacheable;
+  uint16_t cache_len;
+  int persist = 1;
   uint8_t eccheader256[] = {0x30,0x59, // SEQUENCE
 			    0x30,0x13, // SEQUENCE
 			    0x06,0x07, // OID:1.2.840.10045.2.1
@@ -244,19 +349,53 @@ EVP_PKEY *trustx_loadKey(
   TRUSTX_ENGINE_DBGFN("key_id=<%s>", key_id);
   TRUSTX_ENGINE_DBGFN("cb_data=0x<%x>", (unsigned int) cb_data);
 
+  if (key_id != NULL)
+  {
+	key = trustxEngine_keycache_get(key_id);
+	if (key != NULL)
+	{
+	  TRUSTX_ENGINE_DBGFN("< key cache hit");
+	  return key;
+	}
+  }
+
+  if (!trustxEngine_open())
+	return (EVP_PKEY *) NULL;
  
   while (1)
   {
 	  
-	parseKeyParams(key_id);
+	memset(&key_ctx, 0, sizeof(key_ctx));
+	if (parseKeyParams(key_id, &key_ctx, &ec_flag, &ec_key_usage, pubkeyfilename) == EVP_FAIL)
+	  break;
 	
-	key_oid = trustx_ctx.key_oid;
-	TRUSTX_ENGINE_DBGFN("trustx_ctx.ec_flag      : 0x%.2x",trustx_ctx.ec_flag);
-	TRUSTX_ENGINE_DBGFN("trustx_ctx.ec_key_curve : 0x%.2x",trustx_ctx.ec_key_curve);
-	TRUSTX_ENGINE_DBGFN("trustx_ctx.ec_key_usage : 0x%.2x",trustx_ctx.ec_key_usage);
+	key_oid = key_ctx.key_oid;
+	// Keys named by OID with the public key from the chip or the cache, key files may change any time
+	cacheable = ((key_id != NULL) && (strncmp(key_id, "0x", 2) == 0) &&
+		     ((ec_flag & TRUSTX_ENGINE_FLAG_NEW) != TRUSTX_ENGINE_FLAG_NEW) &&
+		     (pubkeyfilename[0] == '\0'));
+	if (cacheable)
+	{
+		cache_len = sizeof(key_ctx.pubkey);
+		if (trustxEngine_keycache_load(key_id, key_oid, key_ctx.pubkey, &cache_len))
+		{
+			key_ctx.pubkeylen = cache_len;
+			data = key_ctx.pubkey;
+			key = d2i_PUBKEY(NULL,(const unsigned char **)&data,cache_len);
+			persist = 0;
+		}
+	}
+
+	TRUSTX_ENGINE_DBGFN("ec_flag      : 0x%.2x",ec_flag);
+	TRUSTX_ENGINE_DBGFN("ec_key_curve : 0x%.2x",key_ctx.ec_key_curve);
+	TRUSTX_ENGINE_DBGFN("ec_key_usage : 0x%.2x",ec_key_usage);
 	
 	TRUSTX_ENGINE_DBGFN("KEY_OID : 0x%.4x",key_oid);
-	if (key_oid == 0xE0F0)
+	if (key != NULL)
+	{
+		TRUSTX_ENGINE_DBGFN("Using public key from the key cache");
+	}
+	else if (key_oid == 0xE0F0)
 	{
 		TRUSTX_ENGINE_DBGFN("Using internal Cert");
 		cert_len = sizeof(cert);
@@ -268,27 +407,21 @@ EVP_PKEY *trustx_loadKey(
 		}
 		TRUSTX_ENGINE_DBGFN("Got raw cert from OPTIGA: 0x%x bytes", cert_len);
 	  
-		const unsigned char *p = cert;
-		x509_cert = d2i_X509(NULL, &p, cert_len);
+		const unsigned char *p = trustX_certDER(cert, &cert_len);
+		if (p != NULL)
+		  x509_cert = d2i_X509(NULL, &p, cert_len);
 		if (x509_cert == NULL)
 		{
-		  // TODO/Hack: If certificate does not start with proper tag
-		  TRUSTX_ENGINE_DBGFN("applying metadata hack");
-		  const unsigned char *p2 = cert + 9;
-		  x509_cert = d2i_X509(NULL, &p2, cert_len - 9);
-		  if (x509_cert == NULL)
-		  {
-			TRUSTX_ENGINE_ERRFN("failed to parse certificate data from OPTIGA");
-			break;
-		  }
+		  TRUSTX_ENGINE_ERRFN("failed to parse certificate data from OPTIGA");
+		  break;
 		}
 		TRUSTX_ENGINE_DBGFN("Parsed X509 from raw cert");
   
-		data = trustx_ctx.pubkey;
+		data = key_ctx.pubkey;
 		key = X509_get_pubkey(x509_cert);
-		trustx_ctx.pubkeylen = i2d_PUBKEY(key,&data);
+		key_ctx.pubkeylen = i2d_PUBKEY(key,&data);
 		
-		//trustXHexDump(trustx_ctx.pubkey,trustx_ctx.pubkeylen);
+		//trustXHexDump(key_ctx.pubkey,key_ctx.pubkeylen);
 		
 		if (key == NULL)
 		{
@@ -299,25 +432,25 @@ EVP_PKEY *trustx_loadKey(
 	}
 	else
 	{
-		if (trustx_ctx.pubkeyfilename[0] != '\0')
+		if (pubkeyfilename[0] != '\0')
 		{
-			TRUSTX_ENGINE_DBGFN("filename : %s\n",trustx_ctx.pubkeyfilename);
+			TRUSTX_ENGINE_DBGFN("filename : %s\n",pubkeyfilename);
 			//open 
-			fp = fopen((const char *)trustx_ctx.pubkeyfilename,"r");
+			fp = fopen((const char *)pubkeyfilename,"r");
 			if (!fp)
 			{
-				TRUSTX_ENGINE_ERRFN("failed to open file %s\n",trustx_ctx.pubkeyfilename);
+				TRUSTX_ENGINE_ERRFN("failed to open file %s\n",pubkeyfilename);
 				break;
 			}
 			PEM_read(fp, &name,&header,&data,(long int *)&len);
-			//memcpy(trustx_ctx.pubkey,data,len);
-			trustx_ctx.pubkeylen = len;
+			//memcpy(key_ctx.pubkey,data,len);
+			key_ctx.pubkeylen = len;
 			for (i=0; i < len ; i++)
 			{
-			  trustx_ctx.pubkey[i] = *(data+i);
+			  key_ctx.pubkey[i] = *(data+i);
 			}
 			
-			//trustXHexDump(trustx_ctx.pubkey, trustx_ctx.pubkeylen);
+			//trustXHexDump(key_ctx.pubkey, key_ctx.pubkeylen);
 			TRUSTX_ENGINE_DBGFN("len: %d",len);
 			
 			key = d2i_PUBKEY(NULL,(const unsigned char **)&data,len);
@@ -325,31 +458,31 @@ EVP_PKEY *trustx_loadKey(
 		}
 		else // 
 		{
-		  if ((trustx_ctx.ec_flag & TRUSTX_ENGINE_FLAG_NEW) == TRUSTX_ENGINE_FLAG_NEW)
+		  if ((ec_flag & TRUSTX_ENGINE_FLAG_NEW) == TRUSTX_ENGINE_FLAG_NEW)
 		  {
 		    TRUSTX_ENGINE_DBGFN("Generating New Key");
-		    optiga_key_id = trustx_ctx.key_oid;
+		    optiga_key_id = key_ctx.key_oid;
 		    
 		    len = sizeof(pubkey);
-		    if(trustx_ctx.ec_key_curve == OPTIGA_ECC_NIST_P_256)
+		    if(key_ctx.ec_key_curve == OPTIGA_ECC_NIST_P_256)
 		    {
-		      trustx_ctx.pubkeylen = sizeof(eccheader256);
-		      for (i=0;i<trustx_ctx.pubkeylen;i++)
+		      key_ctx.pubkeylen = sizeof(eccheader256);
+		      for (i=0;i<key_ctx.pubkeylen;i++)
 		      {
 			pubkey[i] = eccheader256[i];
 		      }
 		    }
 		    else
 		    {
-		      trustx_ctx.pubkeylen = sizeof(eccheader384);
-		      for (i=0;i<trustx_ctx.pubkeylen;i++)
+		      key_ctx.pubkeylen = sizeof(eccheader384);
+		      for (i=0;i<key_ctx.pubkeylen;i++)
 		      {
 			pubkey[i] = eccheader384[i];
 		      }    
 		    }
 		    
-		    return_status = optiga_crypt_ecc_generate_keypair(trustx_ctx.ec_key_curve, //key size 256
-								      trustx_ctx.ec_key_usage, // Type = Auth
+		    return_status = optiga_crypt_ecc_generate_keypair(key_ctx.ec_key_curve, //key size 256
+								      ec_key_usage, // Type = Auth
 								      FALSE,
 								      &optiga_key_id,
 								      (pubkey+i),
@@ -359,11 +492,13 @@ EVP_PKEY *trustx_loadKey(
 		      TRUSTX_ENGINE_ERRFN("Error!!! [0x%.8X]\n",return_status);
 		      break;
 		    }
+		    // The slot holds a different key now
+		    trustxEngine_keycache_invalidate(key_ctx.key_oid);
 
-		    if ((trustx_ctx.ec_flag & TRUSTX_ENGINE_FLAG_SAVEPUBKEY) == TRUSTX_ENGINE_FLAG_SAVEPUBKEY)
+		    if ((ec_flag & TRUSTX_ENGINE_FLAG_SAVEPUBKEY) == TRUSTX_ENGINE_FLAG_SAVEPUBKEY)
 		    {
-		      TRUSTX_ENGINE_DBGFN("Save Pubkey to : 0x%.4x",(trustx_ctx.key_oid) + (0xF1D0-0xE0F0));
-		      return_status = optiga_util_write_data((trustx_ctx.key_oid) + (0xF1D0-0xE0F0),
+		      TRUSTX_ENGINE_DBGFN("Save Pubkey to : 0x%.4x",(key_ctx.key_oid) + (0xF1D0-0xE0F0));
+		      return_status = optiga_util_write_data((key_ctx.key_oid) + (0xF1D0-0xE0F0),
 								OPTIGA_UTIL_WRITE_ONLY,
 								0,
 								(pubkey+i), 
@@ -382,21 +517,21 @@ EVP_PKEY *trustx_loadKey(
 		    }
 
 		    data = pubkey;		
-		    memcpy(trustx_ctx.pubkey,data,len+i);
-		    trustx_ctx.pubkeylen = len+i;		    
+		    memcpy(key_ctx.pubkey,data,len+i);
+		    key_ctx.pubkeylen = len+i;		    
 		    key = d2i_PUBKEY(NULL,(const unsigned char **)&data,len+i);
 		    
 
 		  }
 		  else // Load Dummy Pubkey
 		  {
-		    if ((trustx_ctx.ec_flag & TRUSTX_ENGINE_FLAG_SAVEPUBKEY) == TRUSTX_ENGINE_FLAG_SAVEPUBKEY)
+		    if ((ec_flag & TRUSTX_ENGINE_FLAG_SAVEPUBKEY) == TRUSTX_ENGINE_FLAG_SAVEPUBKEY)
 		    {
-		      TRUSTX_ENGINE_DBGFN("Load Pubkey from : 0x%.4x",(trustx_ctx.key_oid) + (0xF1D0-0xE0F0));
+		      TRUSTX_ENGINE_DBGFN("Load Pubkey from : 0x%.4x",(key_ctx.key_oid) + (0xF1D0-0xE0F0));
 		      len = sizeof(pubkey);
 		      
 	      
-		      return_status = optiga_util_read_data((trustx_ctx.key_oid) + (0xF1D0-0xE0F0),
+		      return_status = optiga_util_read_data((key_ctx.key_oid) + (0xF1D0-0xE0F0),
 							    0,
 							    pubkey,
 							    (uint16_t *)&len);
@@ -413,51 +548,167 @@ EVP_PKEY *trustx_loadKey(
 			//TRUSTX_ENGINE_DBGFN("len : %d", len);
 			if(len == 0x44)
 			{
-			  trustx_ctx.pubkeylen = sizeof(eccheader256);
-			  for (i=0;i<trustx_ctx.pubkeylen;i++)
+			  key_ctx.pubkeylen = sizeof(eccheader256);
+			  for (i=0;i<key_ctx.pubkeylen;i++)
 			  {
-			    trustx_ctx.pubkey[i] = eccheader256[i];
+			    key_ctx.pubkey[i] = eccheader256[i];
 			  }
-			  trustx_ctx.ec_key_curve = OPTIGA_ECC_NIST_P_256;
+			  key_ctx.ec_key_curve = OPTIGA_ECC_NIST_P_256;
 			}
 			else
 			{
-			  trustx_ctx.pubkeylen = sizeof(eccheader384);
-			  for (i=0;i<trustx_ctx.pubkeylen;i++)
+			  key_ctx.pubkeylen = sizeof(eccheader384);
+			  for (i=0;i<key_ctx.pubkeylen;i++)
 			  {
-			    trustx_ctx.pubkey[i] = eccheader384[i];
+			    key_ctx.pubkey[i] = eccheader384[i];
 			  }    
-			  trustx_ctx.ec_key_curve = OPTIGA_ECC_NIST_P_384;
+			  key_ctx.ec_key_curve = OPTIGA_ECC_NIST_P_384;
 
 			}
-			TRUSTX_ENGINE_DBGFN("trustx_ctx.ec_key_curve : 0x%.2x",trustx_ctx.ec_key_curve);	
-			memcpy(&trustx_ctx.pubkey[i],data,len);
-			trustx_ctx.pubkeylen += len;
-			data = trustx_ctx.pubkey;		    
-			key = d2i_PUBKEY(NULL,(const unsigned char **)&data,trustx_ctx.pubkeylen);
+			TRUSTX_ENGINE_DBGFN("ec_key_curve : 0x%.2x",key_ctx.ec_key_curve);	
+			memcpy(&key_ctx.pubkey[i],data,len);
+			key_ctx.pubkeylen += len;
+			data = key_ctx.pubkey;		    
+			key = d2i_PUBKEY(NULL,(const unsigned char **)&data,key_ctx.pubkeylen);
 		      }
 		    }
 		    else
 		    {		  
 		      TRUSTX_ENGINE_DBGFN("No Pubkey filename. Load Prikey Only With Dummy public Key\n");
 		      data = dummy_ec_public_key_256;
-		      trustx_ctx.pubkeylen = 0;		
+		      key_ctx.pubkeylen = 0;		
 		      key = d2i_PUBKEY(NULL,(const unsigned char **)&data,sizeof(dummy_ec_public_key_256));
 		    }
 		  }
 		}
 	}
 
+    if (key == NULL)
+      break;
+    key = trustx_bindKey(e, key, &key_ctx);
+    if (key == NULL)
+      break;
+    if (cacheable)
+      trustxEngine_keycache_put(key_id, key_oid, key, persist);
+
     TRUSTX_ENGINE_DBGFN("<");
-    trustx_disarm_timer();    
     return key; // SUCCESS
   }
 
-  trustx_disarm_timer();
   TRUSTX_ENGINE_ERRFN("<");
   return (EVP_PKEY *) NULL; // RETURN FAIL
 }
 
+/*
+ * Wait fd handed to the application while a sign job is paused. Created once per wait
+ * context (i.e. per SSL connection) and closed by OpenSSL together with it.
+ */
+static void trustx_async_cleanup(ASYNC_WAIT_CTX *wait_ctx, const void *key,
+                                 OSSL_ASYNC_FD fd, void *custom)
+{
+  close(fd);
+}
+
+static int trustx_async_wait_fd(ASYNC_WAIT_CTX *wait_ctx, OSSL_ASYNC_FD *fd)
+{
+  void *custom;
+
+  if (ASYNC_WAIT_CTX_get_fd(wait_ctx, trustx_async_key, fd, &custom))
+    return TRUSTX_ENGINE_SUCCESS;
+
+  *fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (*fd == -1)
+    return TRUSTX_ENGINE_FAIL;
+  if (!ASYNC_WAIT_CTX_set_wait_fd(wait_ctx, trustx_async_key, *fd, NULL, trustx_async_cleanup))
+  {
+    close(*fd);
+    return TRUSTX_ENGINE_FAIL;
+  }
+  return TRUSTX_ENGINE_SUCCESS;
+}
+
+// Runs on the queue thread, makes the wait fd of the paused job readable
+static void trustx_async_wake(trustX_QueueReq_t *req, void *ctx)
+{
+  uint64_t value = 1;
+
+  if (write((int)(intptr_t)ctx, &value, sizeof(value)) == -1)
+    TRUSTX_ENGINE_ERRFN("Could not signal the async wait fd");
+}
+
+/*
+ * Sets the number of async signs the queue holds. The queue is sized when the first async
+ * sign starts it, later changes apply after the engine is reloaded.
+ */
+void trustxEngine_set_queue_depth(uint16_t depth)
+{
+  __atomic_store_n(&sign_queue_depth, depth, __ATOMIC_RELAXED);
+}
+
+/*
+ * Signs on the chip. Inside an OpenSSL async job the sign goes through the trustx queue and
+ * the job is paused until the queue completes it, so one application thread can drive many
+ * handshakes while the chip works. Otherwise, or when the queue is unavailable, signs directly.
+ */
+static optiga_lib_status_t trustx_ecdsa_sign_chip(
+  const unsigned char  *dgst,
+  int                   dgstlen,
+  uint16_t              key_oid,
+  uint8_t              *sig,
+  uint16_t             *sig_len
+)
+{
+  ASYNC_JOB          *job = ASYNC_get_current_job();
+  ASYNC_WAIT_CTX     *wait_ctx = NULL;
+  OSSL_ASYNC_FD       fd;
+  trustX_QueueReq_t   req;
+  uint64_t            value;
+
+  if (!trustxEngine_open())
+    return OPTIGA_LIB_ERROR;
+
+  if (job != NULL)
+    wait_ctx = ASYNC_get_wait_ctx(job);
+
+  if ((wait_ctx == NULL) ||
+      !trustx_async_wait_fd(wait_ctx, &fd) ||
+      (trustX_QueueStart(__atomic_load_n(&sign_queue_depth, __ATOMIC_RELAXED)) != OPTIGA_LIB_SUCCESS))
+  {
+    return optiga_crypt_ecdsa_sign((uint8_t *) dgst, dgstlen, key_oid, sig, sig_len);
+  }
+
+  memset(&req, 0, sizeof(req));
+  req.eCmd = TRUSTX_QCMD_SIGN;
+  req.u.sign.keyId = key_oid;
+  req.u.sign.digest = (uint8_t *) dgst;
+  req.u.sign.digestLen = dgstlen;
+  req.u.sign.signature = sig;
+  req.u.sign.signatureLen = *sig_len;
+  req.callback = trustx_async_wake;
+  req.callbackCtx = (void *)(intptr_t) fd;
+
+  // Queue full, do not make the handshake wait for a free slot
+  if (trustX_QueueSubmit(&req) != OPTIGA_LIB_SUCCESS)
+    return optiga_crypt_ecdsa_sign((uint8_t *) dgst, dgstlen, key_oid, sig, sig_len);
+
+  TRUSTX_ENGINE_STAT_ADD(sign_async, 1);
+  TRUSTX_ENGINE_DBGFN("sign queued, pausing job");
+  while (!trustX_QueuePoll(&req))
+  {
+    if (!ASYNC_pause_job())
+      break;
+  }
+  // Done is set before the wake up, so this only waits for the callback to return
+  trustX_QueueWait(&req);
+
+  // Drain the wait fd, so that the application does not resume this connection for nothing
+  if (read(fd, &value, sizeof(value)) == -1)
+    TRUSTX_ENGINE_DBGFN("wait fd already drained");
+
+  *sig_len = req.u.sign.signatureLen;
+  return req.status;
+}
+
 static ECDSA_SIG* trustx_ecdsa_sign(
   const unsigned char  *dgst,
   int                   dgstlen,
@@ -466,8 +717,18 @@ static ECDSA_SIG* trustx_ecdsa_sign(
   EC_KEY               *eckey
 )
 {
+  const trustx_key_ctx_t *key_ctx = EC_KEY_get_ex_data(eckey, trustx_key_ex_index);
+
+  // Not an OPTIGA key (e.g. a software key while the engine is the default), sign in software
+  if (key_ctx == NULL)
+  {
+    if (default_sign_sig == NULL)
+      return NULL;
+    return default_sign_sig(dgst, dgstlen, in_kinv, in_r, eckey);
+  }
+
   TRUSTX_ENGINE_DBGFN(">");
-  TRUSTX_ENGINE_DBGFN("oid : 0x%.4x",trustx_ctx.key_oid);
+  TRUSTX_ENGINE_DBGFN("oid : 0x%.4x",key_ctx->key_oid);
   TRUSTX_ENGINE_DBGFN("dgst len : %d",dgstlen);
 
   uint8_t     sig[256];
@@ -476,6 +737,7 @@ static ECDSA_SIG* trustx_ecdsa_sign(
   optiga_lib_status_t return_status;
   //int	ret = TRUSTX_ENGINE_FAIL;
   ECDSA_SIG  *ecdsa_sig = NULL;
+  struct timespec start, end;
   
   // TODO/HACK:
   if (dgstlen != 32)
@@ -485,16 +747,20 @@ static ECDSA_SIG* trustx_ecdsa_sign(
   }
 
   do {
-    return_status = optiga_crypt_ecdsa_sign((uint8_t *) dgst,
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    return_status = trustx_ecdsa_sign_chip(dgst,
 					    dgstlen,
-					     trustx_ctx.key_oid,
+					     key_ctx->key_oid,
 					     (sig+2), 
 					     &sig_len);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    TRUSTX_ENGINE_STAT_ADD(sign, 1);
+    TRUSTX_ENGINE_STAT_ADD(sign_usec, (uint64_t)((end.tv_sec - start.tv_sec) * 1000000L +
+                                                 (end.tv_nsec - start.tv_nsec) / 1000L));
     if (return_status != OPTIGA_LIB_SUCCESS)                                             
     {
+      TRUSTX_ENGINE_STAT_ADD(sign_fail, 1);
       TRUSTX_ENGINE_ERRFN("Could not get signature form OPTIGA : %x", return_status);
-
-      trustx_disarm_timer();
       break;
     }
 
@@ -509,7 +775,6 @@ static ECDSA_SIG* trustx_ecdsa_sign(
 
   }while(FALSE);
   
-  trustx_disarm_timer();
   TRUSTX_ENGINE_DBGFN("<");
   //return ret;
   return ecdsa_sig;
@@ -539,6 +804,13 @@ uint16_t trustxEngine_init_ec(ENGINE *e)
 	default_ec = EC_KEY_OpenSSL();
 	if (default_ec == NULL)
 	  break;
+	EC_KEY_METHOD_get_sign(default_ec, NULL, NULL, &default_sign_sig);
+
+	if (trustx_key_ex_index < 0)
+	  trustx_key_ex_index = EC_KEY_get_ex_new_index(0, "trustx key", NULL,
+							trustx_key_ctx_dup, trustx_key_ctx_free);
+	if (trustx_key_ex_index < 0)
+	  break;
 
 	ec_methods = EC_KEY_METHOD_new(default_ec);
 	trustx_ctx.ec_key_method = ec_methods;
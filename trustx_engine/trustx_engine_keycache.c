@@ -0,0 +1,375 @@
+/**
+* MIT License
+*
+* Copyright (c) 2019 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <openssl/crypto.h>
+
+#include "trustx_engine_common.h"
+#include "trustx.h"
+
+// Cache entry of a loaded key
+typedef struct trustx_keycache_entry
+{
+  char          *key_id;
+  uint16_t       key_oid;
+  EVP_PKEY      *key;
+  struct trustx_keycache_entry *next;
+} trustx_keycache_entry_t;
+
+static pthread_mutex_t keycache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static trustx_keycache_entry_t *keycache_head = NULL;
+static char keycache_dir[PARAM_MAX_LEN] = TRUSTX_ENGINE_KEY_CACHE_DIR;
+static uint8_t keycache_enabled = 1;
+static utrustX_UID_t keycache_uid;
+static uint8_t keycache_uid_valid = 0;
+
+/*
+ * Entries are only valid for the chip they were loaded from. Reads the chip UID, unless it
+ * was read when the chip was opened. Must be called with the cache mutex held.
+ */
+static int trustx_keycache_check_uid(void)
+{
+  if (!keycache_uid_valid)
+  {
+    if (trustX_readUID(&keycache_uid) != OPTIGA_LIB_SUCCESS)
+    {
+      TRUSTX_ENGINE_ERRFN("failed to read chip UID, key cache bypassed");
+      return TRUSTX_ENGINE_FAIL;
+    }
+    keycache_uid_valid = 1;
+  }
+  return TRUSTX_ENGINE_SUCCESS;
+}
+
+/*
+ * Persistent entry file name <dir>/<chip UID>-<key OID>-<SHA-256 of the key id>.der
+ * Must be called with the cache mutex held.
+ */
+static int trustx_keycache_path(const char *key_id, uint16_t key_oid, char *path, size_t size)
+{
+  unsigned char md[EVP_MAX_MD_SIZE];
+  unsigned int  md_len = 0;
+  char          uid[2 * sizeof(keycache_uid.b) + 1];
+  char          id[2 * 8 + 1];
+  unsigned int  i;
+  int           len;
+
+  if (!EVP_Digest(key_id, strlen(key_id), md, &md_len, EVP_sha256(), NULL))
+    return TRUSTX_ENGINE_FAIL;
+  for (i = 0; i < sizeof(keycache_uid.b); i++)
+    sprintf(&uid[2 * i], "%.2x", keycache_uid.b[i]);
+  for (i = 0; i < 8; i++)
+    sprintf(&id[2 * i], "%.2x", md[i]);
+
+  len = snprintf(path, size, "%s/%s-%.4x-%s.der", keycache_dir, uid, key_oid, id);
+  return ((len > 0) && ((size_t)len < size)) ? TRUSTX_ENGINE_SUCCESS : TRUSTX_ENGINE_FAIL;
+}
+
+/*
+ * Sets the directory of the persistent cache, which lets processes started later skip the
+ * I2C reads as well. NULL or an empty string keeps the cache in memory only.
+ * Return 1 on success, otherwise 0.
+ */
+int trustxEngine_keycache_set_dir(const char *dir)
+{
+  int ret = TRUSTX_ENGINE_SUCCESS;
+
+  pthread_mutex_lock(&keycache_mutex);
+  if ((dir == NULL) || (dir[0] == '\0'))
+  {
+    keycache_dir[0] = '\0';
+  }
+  else if (strlen(dir) >= sizeof(keycache_dir))
+  {
+    TRUSTX_ENGINE_ERRFN("key cache directory name too long");
+    ret = TRUSTX_ENGINE_FAIL;
+  }
+  else
+  {
+    strcpy(keycache_dir, dir);
+  }
+  pthread_mutex_unlock(&keycache_mutex);
+  return ret;
+}
+
+/*
+ * Returns a new reference to the cached key of key_id, NULL if not cached. The in memory
+ * entries all belong to the chip of keycache_uid, they are dropped when another chip is opened.
+ */
+EVP_PKEY *trustxEngine_keycache_get(const char *key_id)
+{
+  trustx_keycache_entry_t *entry;
+  EVP_PKEY *key = NULL;
+
+  pthread_mutex_lock(&keycache_mutex);
+  for (entry = (keycache_enabled && keycache_uid_valid) ? keycache_head : NULL; entry != NULL; entry = entry->next)
+  {
+    if (strcmp(entry->key_id, key_id) == 0)
+    {
+      if (EVP_PKEY_up_ref(entry->key))
+        key = entry->key;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&keycache_mutex);
+  if (key != NULL)
+    TRUSTX_ENGINE_STAT_ADD(keycache_hit, 1);
+  else
+    TRUSTX_ENGINE_STAT_ADD(keycache_miss, 1);
+  return key;
+}
+
+/*
+ * Looks key_id up in the persistent cache. On success der holds the SubjectPublicKeyInfo.
+ * Return 1 on success, otherwise 0.
+ */
+int trustxEngine_keycache_load(const char *key_id, uint16_t key_oid, uint8_t *der, uint16_t *der_len)
+{
+  char   path[PARAM_MAX_LEN + 128];
+  FILE  *fp;
+  size_t len;
+  int    ret = TRUSTX_ENGINE_FAIL;
+
+  pthread_mutex_lock(&keycache_mutex);
+  do {
+    if (!keycache_enabled || (keycache_dir[0] == '\0'))
+      break;
+    if (!trustx_keycache_check_uid() || !trustx_keycache_path(key_id, key_oid, path, sizeof(path)))
+      break;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+      break;
+    len = fread(der, 1, *der_len, fp);
+    fclose(fp);
+    if ((len == 0) || (len >= *der_len))
+      break;
+
+    TRUSTX_ENGINE_DBGFN("key cache hit %s", path);
+    *der_len = (uint16_t)len;
+    ret = TRUSTX_ENGINE_SUCCESS;
+  }while(FALSE);
+  pthread_mutex_unlock(&keycache_mutex);
+  return ret;
+}
+
+/*
+ * Caches key under key_id, taking a reference of its own. Writes the persistent entry unless
+ * the key came from there.
+ */
+void trustxEngine_keycache_put(const char *key_id, uint16_t key_oid, EVP_PKEY *key, int persist)
+{
+  trustx_keycache_entry_t *entry;
+  char           path[PARAM_MAX_LEN + 128];
+  char           tmp[PARAM_MAX_LEN + 160];
+  unsigned char *der = NULL;
+  int            der_len;
+  size_t         written;
+  FILE          *fp;
+
+  pthread_mutex_lock(&keycache_mutex);
+  do {
+    // Without the UID the entry could not be told apart from one of another chip
+    if (!keycache_enabled || !trustx_keycache_check_uid())
+      break;
+    for (entry = keycache_head; entry != NULL; entry = entry->next)
+    {
+      if (strcmp(entry->key_id, key_id) == 0)
+        break;
+    }
+    if (entry != NULL)
+      break;
+
+    entry = OPENSSL_zalloc(sizeof(trustx_keycache_entry_t));
+    if (entry == NULL)
+      break;
+    entry->key_id = OPENSSL_strdup(key_id);
+    if ((entry->key_id == NULL) || !EVP_PKEY_up_ref(key))
+    {
+      OPENSSL_free(entry->key_id);
+      OPENSSL_free(entry);
+      break;
+    }
+    entry->key_oid = key_oid;
+    entry->key = key;
+    entry->next = keycache_head;
+    keycache_head = entry;
+
+    if (!persist || (keycache_dir[0] == '\0'))
+      break;
+    if (!trustx_keycache_path(key_id, key_oid, path, sizeof(path)))
+      break;
+    der_len = i2d_PUBKEY(key, &der);
+    if (der_len <= 0)
+      break;
+
+    if ((mkdir(keycache_dir, 0700) != 0) && (errno != EEXIST))
+    {
+      TRUSTX_ENGINE_ERRFN("failed to create key cache directory %s (%s)", keycache_dir, strerror(errno));
+      break;
+    }
+
+    // Other processes may read the entry meanwhile, so only complete files get the final name
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    fp = fopen(tmp, "wb");
+    if (fp == NULL)
+      break;
+    written = fwrite(der, 1, der_len, fp);
+    if ((fclose(fp) != 0) || (written != (size_t)der_len) || (rename(tmp, path) != 0))
+    {
+      TRUSTX_ENGINE_ERRFN("failed to write key cache entry %s", path);
+      unlink(tmp);
+    }
+  }while(FALSE);
+  pthread_mutex_unlock(&keycache_mutex);
+  OPENSSL_free(der);
+}
+
+/*
+ * Drops the in memory entries of key_oid, all entries if key_oid is 0.
+ * Must be called with the cache mutex held.
+ */
+static void trustx_keycache_drop(uint16_t key_oid)
+{
+  trustx_keycache_entry_t **p_entry;
+  trustx_keycache_entry_t *entry;
+
+  p_entry = &keycache_head;
+  while (*p_entry != NULL)
+  {
+    entry = *p_entry;
+    if ((key_oid != 0) && (entry->key_oid != key_oid))
+    {
+      p_entry = &entry->next;
+      continue;
+    }
+    *p_entry = entry->next;
+    EVP_PKEY_free(entry->key);
+    OPENSSL_free(entry->key_id);
+    OPENSSL_free(entry);
+  }
+}
+
+/*
+ * Drops the cached keys of key_oid, all keys if key_oid is 0. Called when a new key is
+ * generated in the slot, so that the old public key is not handed out anymore.
+ */
+void trustxEngine_keycache_invalidate(uint16_t key_oid)
+{
+  char           path[PARAM_MAX_LEN + NAME_MAX + 2];
+  char           oid[8];
+  DIR           *dir;
+  struct dirent *de;
+
+  pthread_mutex_lock(&keycache_mutex);
+  trustx_keycache_drop(key_oid);
+  if (keycache_dir[0] != '\0')
+  {
+    dir = opendir(keycache_dir);
+    if (dir != NULL)
+    {
+      snprintf(oid, sizeof(oid), "-%.4x-", key_oid);
+      while ((de = readdir(dir)) != NULL)
+      {
+        if ((strstr(de->d_name, ".der") == NULL) || ((key_oid != 0) && (strstr(de->d_name, oid) == NULL)))
+          continue;
+        snprintf(path, sizeof(path), "%s/%s", keycache_dir, de->d_name);
+        unlink(path);
+      }
+      closedir(dir);
+    }
+  }
+  pthread_mutex_unlock(&keycache_mutex);
+}
+
+/*
+ * Enables or disables the cache. Disabling releases the in memory entries and makes every
+ * load read the chip again, the persistent entries are kept for when it is enabled again.
+ */
+void trustxEngine_keycache_set_enabled(int enable)
+{
+  pthread_mutex_lock(&keycache_mutex);
+  keycache_enabled = enable ? 1 : 0;
+  if (!keycache_enabled)
+    trustx_keycache_drop(0);
+  pthread_mutex_unlock(&keycache_mutex);
+}
+
+/*
+ * Releases the in memory entries, the persistent ones stay valid. The UID is read again
+ * when the chip is opened next, which may be another one.
+ */
+void trustxEngine_keycache_flush(void)
+{
+  pthread_mutex_lock(&keycache_mutex);
+  trustx_keycache_drop(0);
+  keycache_uid_valid = 0;
+  pthread_mutex_unlock(&keycache_mutex);
+}
+
+/*
+ * Called after the chip was opened. Reads its UID and drops the in memory entries if they
+ * were loaded from another chip.
+ */
+void trustxEngine_keycache_chip_opened(void)
+{
+  utrustX_UID_t uid;
+
+  pthread_mutex_lock(&keycache_mutex);
+  do {
+    // A disabled cache has no entries, the UID is read when it is enabled again
+    if (!keycache_enabled)
+    {
+      keycache_uid_valid = 0;
+      break;
+    }
+    if (trustX_readUID(&uid) != OPTIGA_LIB_SUCCESS)
+    {
+      TRUSTX_ENGINE_ERRFN("failed to read chip UID, key cache dropped");
+      trustx_keycache_drop(0);
+      keycache_uid_valid = 0;
+      break;
+    }
+    if (keycache_uid_valid && (memcmp(uid.b, keycache_uid.b, sizeof(uid.b)) != 0))
+    {
+      TRUSTX_ENGINE_DBGFN("chip UID changed, key cache dropped");
+      trustx_keycache_drop(0);
+    }
+    keycache_uid = uid;
+    keycache_uid_valid = 1;
+  }while(FALSE);
+  pthread_mutex_unlock(&keycache_mutex);
+}
@@ -25,13 +25,32 @@
 
 
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <openssl/engine.h>
+#include <openssl/crypto.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/evp.h>
+#include <openssl/core_names.h>
+#endif
 
 #include "trustx_engine_common.h"
 #include "trustx_engine_ec.h"
 #include "optiga/optiga_util.h"
+#include "optiga/pal/pal_os_lock.h"
 #include "optiga_crypt.h"
 
+// Trustx lib doesn't work with small num. So the TRNG is always read in chunks of this size
+#define MAX_RAND_INPUT 256
+// Delay before the prefetch thread retries after a TRNG error
+#define RAND_RETRY_MS 100
+// Entropy taken from the pool for one DRBG reseed
+#define RAND_RESEED_LEN 48
+// Largest DRBG output per generate call
+#define RAND_DRBG_MAX_REQUEST 4096
+
 static int trustxEngine_getrandom(unsigned char *buf, int num);
 static int trustxEngine_rand_status(void);
 
@@ -45,6 +64,297 @@ static RAND_METHOD rand_methods = {
     trustxEngine_rand_status		// status()
 };
 
+// Entropy pool, a ring buffer refilled from the TRNG by a background thread
+typedef struct trustxEngine_rand_pool
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t refill;		// level dropped below the low watermark or stop
+    pthread_t thread;
+    uint8_t buf[TRUSTX_ENGINE_RAND_POOL_MAX];
+    uint32_t size;			// bytes of buf in use
+    uint32_t low;			// prefetch starts below this level
+    uint32_t high;			// prefetch stops at this level
+    uint32_t head;			// next byte to serve
+    uint32_t level;			// bytes available
+    uint8_t running;
+    uint8_t enabled;			// prefetch starts with the first request
+    uint8_t drbg;			// serve from the DRBG instead of the pool
+    pid_t pid;				// process the pool and the DRBG belong to
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    EVP_RAND_CTX *drbg_ctx;
+    uint32_t drbg_output;		// bytes generated since the last reseed
+#endif
+} trustxEngine_rand_pool_t;
+
+static trustxEngine_rand_pool_t rand_pool = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .refill = PTHREAD_COND_INITIALIZER,
+    .size = TRUSTX_ENGINE_RAND_POOL_SIZE,
+    .low = TRUSTX_ENGINE_RAND_LOW_WATERMARK,
+    .high = TRUSTX_ENGINE_RAND_HIGH_WATERMARK,
+    .drbg = TRUSTX_ENGINE_RAND_DRBG,
+};
+
+/** Drops the state inherited from the parent after a fork
+ * Parent and child would otherwise serve the same buffered bytes and DRBG output, and the
+ * child has no prefetch thread. The pool restarts empty, the DRBG is created anew on demand.
+ * Must be called with the pool mutex held.
+ */
+static void trustxEngine_rand_check_fork(void)
+{
+    pid_t pid = getpid();
+
+    if (rand_pool.pid == pid)
+        return;
+    if (rand_pool.pid != 0)
+    {
+        TRUSTX_ENGINE_DBGFN("fork detected, resetting entropy pool");
+        OPENSSL_cleanse(rand_pool.buf, sizeof(rand_pool.buf));
+        rand_pool.head = 0;
+        rand_pool.level = 0;
+        // The thread stayed in the parent, the next request starts one for this process
+        rand_pool.running = 0;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        EVP_RAND_CTX_free(rand_pool.drbg_ctx);
+        rand_pool.drbg_ctx = NULL;
+#endif
+    }
+    rand_pool.pid = pid;
+}
+
+/** Copies out of the pool and wipes what was served
+ * Must be called with the pool mutex held.
+ * @retval number of bytes copied
+ */
+static uint32_t trustxEngine_rand_take(unsigned char *buf, uint32_t num)
+{
+    uint32_t len, n = 0;
+
+    while ((n < num) && (rand_pool.level > 0))
+    {
+        len = rand_pool.size - rand_pool.head;
+        if (len > rand_pool.level)
+            len = rand_pool.level;
+        if (len > (num - n))
+            len = num - n;
+        memcpy(buf + n, &rand_pool.buf[rand_pool.head], len);
+        OPENSSL_cleanse(&rand_pool.buf[rand_pool.head], len);
+        rand_pool.head = (rand_pool.head + len) % rand_pool.size;
+        rand_pool.level -= len;
+        n += len;
+    }
+
+    if (rand_pool.running && (rand_pool.level < rand_pool.low))
+        pthread_cond_signal(&rand_pool.refill);
+    return n;
+}
+
+/** Appends to the pool, bytes not fitting are dropped
+ * Must be called with the pool mutex held.
+ */
+static void trustxEngine_rand_put(const uint8_t *buf, uint32_t num)
+{
+    uint32_t tail, len;
+
+    while ((num > 0) && (rand_pool.level < rand_pool.size))
+    {
+        tail = (rand_pool.head + rand_pool.level) % rand_pool.size;
+        len = rand_pool.size - tail;
+        if (len > (rand_pool.size - rand_pool.level))
+            len = rand_pool.size - rand_pool.level;
+        if (len > num)
+            len = num;
+        memcpy(&rand_pool.buf[tail], buf, len);
+        rand_pool.level += len;
+        buf += len;
+        num -= len;
+    }
+}
+
+/** Serves num bytes from the pool
+ * When the pool runs dry the caller reads the TRNG itself and leaves the surplus in the pool,
+ * so a TLS thread never waits behind the low priority prefetch.
+ * Must be called with the pool mutex held.
+ * @retval 1 on success
+ * @retval 0 on failure
+ */
+static int trustxEngine_rand_read(unsigned char *buf, uint32_t num)
+{
+    uint8_t tempbuf[MAX_RAND_INPUT];
+    optiga_lib_status_t return_status;
+    uint32_t n, len;
+
+    n = trustxEngine_rand_take(buf, num);
+    while (n < num)
+    {
+        // Large requests bypass the pool
+        if ((num - n) >= MAX_RAND_INPUT)
+        {
+            pthread_mutex_unlock(&rand_pool.mutex);
+            return_status = optiga_crypt_random(OPTIGA_RNG_TYPE_TRNG, buf + n, MAX_RAND_INPUT);
+            pthread_mutex_lock(&rand_pool.mutex);
+            TRUSTX_ENGINE_STAT_ADD(rand_trng, 1);
+            if (return_status != OPTIGA_LIB_SUCCESS)
+            {
+                TRUSTX_ENGINE_ERRFN("failed to generate random number1");
+                return TRUSTX_ENGINE_FAIL;
+            }
+            n += MAX_RAND_INPUT;
+            continue;
+        }
+
+        pthread_mutex_unlock(&rand_pool.mutex);
+        return_status = optiga_crypt_random(OPTIGA_RNG_TYPE_TRNG, tempbuf, MAX_RAND_INPUT);
+        pthread_mutex_lock(&rand_pool.mutex);
+        TRUSTX_ENGINE_STAT_ADD(rand_trng, 1);
+        if (return_status != OPTIGA_LIB_SUCCESS)
+        {
+            TRUSTX_ENGINE_ERRFN("failed to generate random number2");
+            return TRUSTX_ENGINE_FAIL;
+        }
+        // The prefetch may have refilled meanwhile, serve in order and keep the fresh bytes
+        n += trustxEngine_rand_take(buf + n, num - n);
+        len = num - n;
+        memcpy(buf + n, tempbuf, len);
+        n += len;
+        trustxEngine_rand_put(tempbuf + len, MAX_RAND_INPUT - len);
+        OPENSSL_cleanse(tempbuf, sizeof(tempbuf));
+    }
+    return TRUSTX_ENGINE_SUCCESS;
+}
+
+/** Prefetch thread, keeps the pool between the low and the high watermark
+ */
+static void *trustxEngine_rand_thread(void *arg)
+{
+    uint8_t tempbuf[MAX_RAND_INPUT];
+    optiga_lib_status_t return_status;
+    struct timespec ts;
+
+    TRUSTX_ENGINE_DBGFN(">");
+    // Prefetching must not delay requests of other threads
+    pal_os_lock_set_thread_priority(PAL_OS_LOCK_PRIORITY_LOW);
+
+    pthread_mutex_lock(&rand_pool.mutex);
+    while (rand_pool.running)
+    {
+        if (rand_pool.level >= rand_pool.low)
+        {
+            pthread_cond_wait(&rand_pool.refill, &rand_pool.mutex);
+            continue;
+        }
+
+        while (rand_pool.running && (rand_pool.level < rand_pool.high))
+        {
+            pthread_mutex_unlock(&rand_pool.mutex);
+            return_status = optiga_crypt_random(OPTIGA_RNG_TYPE_TRNG, tempbuf, MAX_RAND_INPUT);
+            pthread_mutex_lock(&rand_pool.mutex);
+            TRUSTX_ENGINE_STAT_ADD(rand_prefetch, 1);
+            if (return_status != OPTIGA_LIB_SUCCESS)
+            {
+                TRUSTX_ENGINE_ERRFN("failed to prefetch random number");
+                clock_gettime(CLOCK_REALTIME, &ts);
+                ts.tv_nsec += RAND_RETRY_MS * 1000000L;
+                if (ts.tv_nsec >= 1000000000L)
+                {
+                    ts.tv_sec++;
+                    ts.tv_nsec -= 1000000000L;
+                }
+                pthread_cond_timedwait(&rand_pool.refill, &rand_pool.mutex, &ts);
+                break;
+            }
+            trustxEngine_rand_put(tempbuf, MAX_RAND_INPUT);
+        }
+    }
+    pthread_mutex_unlock(&rand_pool.mutex);
+    OPENSSL_cleanse(tempbuf, sizeof(tempbuf));
+
+    TRUSTX_ENGINE_DBGFN("<");
+    return NULL;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+/** Creates the DRBG, instantiated from the OS and reseeded from the pool
+ * Must be called with the pool mutex held.
+ */
+static int trustxEngine_rand_drbg_new(void)
+{
+    EVP_RAND *rand;
+    OSSL_PARAM params[2];
+    static const char pers[] = "trustx_engine";
+
+    rand = EVP_RAND_fetch(NULL, "CTR-DRBG", NULL);
+    if (rand == NULL)
+        return TRUSTX_ENGINE_FAIL;
+    rand_pool.drbg_ctx = EVP_RAND_CTX_new(rand, NULL);
+    EVP_RAND_free(rand);
+    if (rand_pool.drbg_ctx == NULL)
+        return TRUSTX_ENGINE_FAIL;
+
+    params[0] = OSSL_PARAM_construct_utf8_string(OSSL_DRBG_PARAM_CIPHER, "AES-256-CTR", 0);
+    params[1] = OSSL_PARAM_construct_end();
+    if (!EVP_RAND_instantiate(rand_pool.drbg_ctx, 256, 0, (const unsigned char *)pers, sizeof(pers) - 1, params))
+    {
+        EVP_RAND_CTX_free(rand_pool.drbg_ctx);
+        rand_pool.drbg_ctx = NULL;
+        return TRUSTX_ENGINE_FAIL;
+    }
+    // Reseed from the chip before the first output
+    rand_pool.drbg_output = TRUSTX_ENGINE_RAND_RESEED_INTERVAL;
+    return TRUSTX_ENGINE_SUCCESS;
+}
+
+/** Generates from the DRBG, reseeding it with TRNG entropy every TRUSTX_ENGINE_RAND_RESEED_INTERVAL bytes
+ * Must be called with the pool mutex held.
+ */
+static int trustxEngine_rand_drbg_read(unsigned char *buf, uint32_t num)
+{
+    uint8_t seed[RAND_RESEED_LEN];
+    uint32_t len;
+    int ret = TRUSTX_ENGINE_FAIL;
+
+    do {
+        while (num > 0)
+        {
+            // Checked again on every round, finish may free the DRBG while the mutex is dropped for the TRNG
+            if ((rand_pool.drbg_ctx == NULL) && !trustxEngine_rand_drbg_new())
+            {
+                TRUSTX_ENGINE_ERRFN("failed to create DRBG");
+                break;
+            }
+            if (rand_pool.drbg_output >= TRUSTX_ENGINE_RAND_RESEED_INTERVAL)
+            {
+                if (!trustxEngine_rand_read(seed, sizeof(seed)))
+                    break;
+                if (rand_pool.drbg_ctx == NULL)
+                    continue;
+                if (!EVP_RAND_reseed(rand_pool.drbg_ctx, 0, seed, sizeof(seed), NULL, 0))
+                {
+                    TRUSTX_ENGINE_ERRFN("failed to reseed DRBG");
+                    break;
+                }
+                rand_pool.drbg_output = 0;
+            }
+
+            len = (num > RAND_DRBG_MAX_REQUEST) ? RAND_DRBG_MAX_REQUEST : num;
+            if (!EVP_RAND_generate(rand_pool.drbg_ctx, buf, len, 0, 0, NULL, 0))
+            {
+                TRUSTX_ENGINE_ERRFN("failed to generate DRBG output");
+                break;
+            }
+            rand_pool.drbg_output += len;
+            buf += len;
+            num -= len;
+        }
+        if (num == 0)
+            ret = TRUSTX_ENGINE_SUCCESS;
+    }while(FALSE);
+
+    OPENSSL_cleanse(seed, sizeof(seed));
+    return ret;
+}
+#endif
+
 /** Return the entropy status of the prng
  * Since we provide real randomness 
  * function, our status is allways good.
@@ -55,7 +365,26 @@ static int trustxEngine_rand_status(void)
     return TRUSTX_ENGINE_SUCCESS;
 }
 
+/** Starts the prefetch thread filling the entropy pool, once the chip is open
+ * Must be called with the pool mutex held.
+ */
+static void trustxEngine_rand_start(void)
+{
+	if (!rand_pool.enabled || rand_pool.running)
+		return;
+
+	rand_pool.running = 1;
+	if (pthread_create(&rand_pool.thread, NULL, trustxEngine_rand_thread, NULL) != 0)
+	{
+		// Still usable, every request then reads the TRNG itself
+		TRUSTX_ENGINE_ERRFN("failed to create random prefetch thread");
+		rand_pool.running = 0;
+		rand_pool.enabled = 0;
+	}
+}
+
 /** Initialize the trusttx rand 
+ * The prefetch thread starts with the first request, so loading the engine does not touch the chip.
  *
  * @param e The engine context.
  */
@@ -64,13 +393,97 @@ uint16_t trustxEngine_init_rand(ENGINE *e)
 	uint16_t ret = TRUSTX_ENGINE_FAIL;
 	TRUSTX_ENGINE_DBGFN(">");
 	
-	ret = ENGINE_set_RAND(e, &rand_methods);
+	do {
+		ret = ENGINE_set_RAND(e, &rand_methods);
+		if (ret != TRUSTX_ENGINE_SUCCESS)
+			break;
+
+		pthread_mutex_lock(&rand_pool.mutex);
+		rand_pool.enabled = 1;
+		pthread_mutex_unlock(&rand_pool.mutex);
+	}while(FALSE);
     
 	TRUSTX_ENGINE_DBGFN("<");
     return ret;
     
 }
 
+/** Stops the prefetch thread and wipes the entropy pool
+ */
+void trustxEngine_finish_rand(void)
+{
+	uint8_t running;
+
+	TRUSTX_ENGINE_DBGFN(">");
+
+	pthread_mutex_lock(&rand_pool.mutex);
+	trustxEngine_rand_check_fork();
+	running = rand_pool.running;
+	rand_pool.running = 0;
+	rand_pool.enabled = 0;
+	pthread_cond_signal(&rand_pool.refill);
+	pthread_mutex_unlock(&rand_pool.mutex);
+
+	if (running)
+		pthread_join(rand_pool.thread, NULL);
+
+	pthread_mutex_lock(&rand_pool.mutex);
+	OPENSSL_cleanse(rand_pool.buf, sizeof(rand_pool.buf));
+	rand_pool.head = 0;
+	rand_pool.level = 0;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	EVP_RAND_CTX_free(rand_pool.drbg_ctx);
+	rand_pool.drbg_ctx = NULL;
+#endif
+	pthread_mutex_unlock(&rand_pool.mutex);
+
+	TRUSTX_ENGINE_DBGFN("<");
+}
+
+/** Selects whether random values come straight from the pool or from a DRBG reseeded from it
+ * @param enable 1 for the DRBG, 0 for the pool
+ * @retval 1 on success
+ * @retval 0 if the DRBG is not supported by this OpenSSL version
+ */
+int trustxEngine_rand_set_drbg(int enable)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	pthread_mutex_lock(&rand_pool.mutex);
+	rand_pool.drbg = enable ? 1 : 0;
+	pthread_mutex_unlock(&rand_pool.mutex);
+	return TRUSTX_ENGINE_SUCCESS;
+#else
+	return enable ? TRUSTX_ENGINE_FAIL : TRUSTX_ENGINE_SUCCESS;
+#endif
+}
+
+/** Resizes the entropy pool, the watermarks follow at a quarter and at the full size
+ * The pool is emptied, the prefetch thread refills it to the new size.
+ * @param size Pool size in bytes, from 256 up to TRUSTX_ENGINE_RAND_POOL_MAX
+ * @retval 1 on success
+ * @retval 0 if the size is out of range
+ */
+int trustxEngine_rand_set_pool_size(uint32_t size)
+{
+	if ((size < MAX_RAND_INPUT) || (size > TRUSTX_ENGINE_RAND_POOL_MAX))
+	{
+		TRUSTX_ENGINE_ERRFN("pool size %u out of range", size);
+		return TRUSTX_ENGINE_FAIL;
+	}
+
+	pthread_mutex_lock(&rand_pool.mutex);
+	OPENSSL_cleanse(rand_pool.buf, rand_pool.size);
+	rand_pool.size = size;
+	rand_pool.low = size / 4;
+	rand_pool.high = size;
+	rand_pool.head = 0;
+	rand_pool.level = 0;
+	if (rand_pool.running)
+		pthread_cond_signal(&rand_pool.refill);
+	pthread_mutex_unlock(&rand_pool.mutex);
+	return TRUSTX_ENGINE_SUCCESS;
+}
+
 /** Genereate random values
  * @param buf The buffer to write the random values to
  * @param num The amound of random bytes to generate
@@ -79,58 +492,28 @@ uint16_t trustxEngine_init_rand(ENGINE *e)
  */
 static int trustxEngine_getrandom(unsigned char *buf, int num)
 {
-	#define MAX_RAND_INPUT 256
-
 	int ret = TRUSTX_ENGINE_FAIL;
-	optiga_lib_status_t return_status;
-	int i,j,k;
-	uint8_t tempbuf[MAX_RAND_INPUT];
 	
 	TRUSTX_ENGINE_DBGFN("> num : %d", num);
 
-	i = num % MAX_RAND_INPUT; // max random number output, find the reminder
-	j = (num - i)/MAX_RAND_INPUT; // Get the count 
+	if (num <= 0)
+		return (num == 0) ? TRUSTX_ENGINE_SUCCESS : TRUSTX_ENGINE_FAIL;
+	if (!trustxEngine_open())
+		return TRUSTX_ENGINE_FAIL;
 
-	do {
-		k = 0;
-		if(i > 0)  
-		{
-			// Trustx lib doesn't work with small num. So used Max
-			return_status = optiga_crypt_random(OPTIGA_RNG_TYPE_TRNG,
-						tempbuf,
-						MAX_RAND_INPUT);
-			if (return_status != OPTIGA_LIB_SUCCESS)
-			{
-			  TRUSTX_ENGINE_ERRFN("failed to generate random number2");
-			  printf("return error = %x\n",return_status);
-			  break;
-			}
-
-			for (k=0;k<i;k++)
-			{
-				*(buf+k) = tempbuf[k]; 
-			}
-		}
-
-		for(;j>0;j--)  
-		{
-			return_status = optiga_crypt_random(OPTIGA_RNG_TYPE_TRNG,
-						(buf+k),
-						MAX_RAND_INPUT);
-			if (return_status != OPTIGA_LIB_SUCCESS)
-			{
-			  TRUSTX_ENGINE_ERRFN("failed to generate random number1");
-			  break;
-			}
-			k += (MAX_RAND_INPUT);
-		}
-
-		
-		ret = TRUSTX_ENGINE_SUCCESS;
-	}while(FALSE);
+	pthread_mutex_lock(&rand_pool.mutex);
+	trustxEngine_rand_check_fork();
+	trustxEngine_rand_start();
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	if (rand_pool.drbg)
+		ret = trustxEngine_rand_drbg_read(buf, (uint32_t)num);
+	else
+#endif
+	ret = trustxEngine_rand_read(buf, (uint32_t)num);
+	pthread_mutex_unlock(&rand_pool.mutex);
+	if (ret == TRUSTX_ENGINE_SUCCESS)
+		TRUSTX_ENGINE_STAT_ADD(rand_bytes, num);
 	
-	#undef MAX_RAND_INPUT
-	trustx_disarm_timer(); // temp work around for trustx lib
 	TRUSTX_ENGINE_DBGFN("<");	
 	return ret;
 }
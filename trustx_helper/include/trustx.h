@@ -57,6 +57,11 @@
 
 #endif
 
+// Certificate data objects, see trustX_certDER()
+#define TRUSTX_CERT_DER_TAG		0x30
+#define TRUSTX_CERT_IDENTITY_TAG	0xC0
+#define TRUSTX_CERT_IDENTITY_HDR_LEN	9
+
 //extern
 extern char *i2c_if;
 extern char dev[];
@@ -97,9 +102,11 @@ extern host_lib_status_t optiga_comms_status;
 
 // Function Prototype
 void optiga_comms_event_handler(void* upper_layer_ctx, host_lib_status_t event);
+optiga_lib_status_t trustX_SetInterface(const char *device, uint8_t slaveAddr);
 optiga_lib_status_t trustX_Open(void);
 optiga_lib_status_t trustX_readUID(utrustX_UID_t *UID);
 optiga_lib_status_t trustX_readCert(uint16_t oid, uint8_t* p_cert, uint32_t* length);
+const uint8_t *trustX_certDER(const uint8_t* p_cert, uint32_t* length);
 
 void trustX_Close(void);
 
@@ -0,0 +1,67 @@
+/**
+* MIT License
+*
+* Copyright (c) 2019 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+
+*/
+#ifndef _TRUSTX_POOL_H_
+#define _TRUSTX_POOL_H_
+
+#include <stdint.h>
+
+#include "trustx_queue.h"
+
+// Maximum number of OPTIGA devices in the pool
+#define TRUSTX_POOL_MAX_CHIPS		4
+// Submits stateless commands to the least loaded chip, key bound commands to the owner of the key
+// and all others to chip 0
+#define TRUSTX_POOL_CHIP_ANY		0xFF
+// Maximum number of keys owned by one chip
+#define TRUSTX_POOL_MAX_KEYS		8
+// Default IFX I2C slave address
+#define TRUSTX_POOL_DEFAULT_ADDR	0x30
+
+// ********** typedef
+typedef struct _tag_trustX_PoolChipCfg {
+	const char *i2cDev;		// I2C adapter, e.g. "/dev/i2c-1"
+	uint8_t slaveAddr;		// 0 selects TRUSTX_POOL_DEFAULT_ADDR
+	const uint16_t *keyOids;	// keys used on this chip, each key OID is owned by one chip at most
+	uint8_t keyCount;
+} trustX_PoolChipCfg_t;
+
+typedef struct _tag_trustX_PoolChipStats {
+	uint8_t isOpen;
+	uint16_t depth;			// queued and executing requests
+	uint32_t completed;
+} trustX_PoolChipStats_t;
+
+// Function Prototype
+optiga_lib_status_t trustX_PoolOpen(const trustX_PoolChipCfg_t *cfg, uint8_t count, uint16_t maxDepth);
+void trustX_PoolClose(void);
+uint8_t trustX_PoolChips(void);
+optiga_lib_status_t trustX_PoolSetKeyOwner(uint16_t keyOid, uint8_t chip);
+optiga_lib_status_t trustX_PoolSubmit(trustX_QueueReq_t *req, uint8_t chip);
+int trustX_PoolPoll(const trustX_QueueReq_t *req);
+optiga_lib_status_t trustX_PoolWait(trustX_QueueReq_t *req);
+optiga_lib_status_t trustX_PoolGetStats(uint8_t chip, trustX_PoolChipStats_t *stats);
+
+#endif	// _TRUSTX_POOL_H_
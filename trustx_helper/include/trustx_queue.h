@@ -0,0 +1,111 @@
+/**
+* MIT License
+*
+* Copyright (c) 2019 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+
+*/
+#ifndef _TRUSTX_QUEUE_H_
+#define _TRUSTX_QUEUE_H_
+
+#include <stdint.h>
+
+#include "optiga/optiga_crypt.h"
+#include "optiga/optiga_util.h"
+
+// Default maximum number of queued requests
+#define TRUSTX_QUEUE_DEFAULT_DEPTH	64
+
+// ********** typedef
+typedef enum _tag_trustX_eQueueCmd {
+	TRUSTX_QCMD_SIGN = 0,		// optiga_crypt_ecdsa_sign
+	TRUSTX_QCMD_RANDOM,		// optiga_crypt_random (TRNG)
+	TRUSTX_QCMD_GET_DATA,		// optiga_util_read_data
+	TRUSTX_QCMD_HASH,		// optiga_crypt_hash_start/update/finalize (SHA256)
+	TRUSTX_QCMD_ECDH,		// optiga_crypt_ecdh
+	TRUSTX_QCMD_VERIFY		// optiga_crypt_ecdsa_verify with a public key from the host
+} trustX_eQueueCmd_t;
+
+typedef struct _tag_trustX_QueueReq trustX_QueueReq_t;
+
+// Completion callback, runs on the queue I/O thread and must not block
+typedef void (*trustX_QueueCallback_t)(trustX_QueueReq_t *req, void *ctx);
+
+// Command descriptor, owned by the caller until released. Its address is the request handle.
+struct _tag_trustX_QueueReq {
+	trustX_eQueueCmd_t eCmd;
+	union {
+		struct {
+			optiga_key_id_t keyId;
+			uint8_t *digest;
+			uint8_t digestLen;
+			uint8_t *signature;
+			uint16_t signatureLen;		// in: buffer size, out: DER signature length
+		} sign;
+		struct {
+			uint8_t *buffer;
+			uint16_t length;
+		} random;
+		struct {
+			uint16_t oid;
+			uint16_t offset;
+			uint8_t *buffer;
+			uint16_t length;		// in: buffer size, out: bytes read
+		} getData;
+		struct {
+			const uint8_t *data;
+			uint32_t length;
+			uint8_t digest[32];		// out
+		} hash;
+		struct {
+			optiga_key_id_t keyId;
+			public_key_from_host_t publicKey;
+			uint8_t *sharedSecret;		// out, NULL keeps the secret in the session OID
+		} ecdh;
+		struct {
+			uint8_t *digest;
+			uint8_t digestLen;
+			uint8_t *signature;
+			uint16_t signatureLen;
+			public_key_from_host_t publicKey;
+		} verify;
+	} u;
+
+	trustX_QueueCallback_t callback;	// optional
+	void *callbackCtx;
+
+	// Set by the queue
+	volatile optiga_lib_status_t status;
+	volatile uint8_t done;			// result available
+	volatile uint8_t released;		// callback returned, the caller may free the request
+	trustX_QueueReq_t *next;
+};
+
+// Function Prototype
+optiga_lib_status_t trustX_QueueStart(uint16_t maxDepth);
+void trustX_QueueStop(void);
+optiga_lib_status_t trustX_QueueSubmit(trustX_QueueReq_t *req);
+int trustX_QueuePoll(const trustX_QueueReq_t *req);
+optiga_lib_status_t trustX_QueueWait(trustX_QueueReq_t *req);
+int trustX_QueueEventFd(void);
+optiga_lib_status_t trustX_QueueExec(trustX_QueueReq_t *req);
+
+#endif	// _TRUSTX_QUEUE_H_
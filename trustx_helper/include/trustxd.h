@@ -0,0 +1,120 @@
+/**
+* MIT License
+*
+* Copyright (c) 2019 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+
+*/
+#ifndef _TRUSTXD_H_
+#define _TRUSTXD_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "optiga/comms/optiga_comms.h"
+
+/*
+ * trustxd broker protocol. The daemon owns the chip and relays the command APDUs of its
+ * clients over a Unix domain stream socket, one request in flight per connection.
+ *
+ * Frame: version, type, priority (request) or status (reply), reserved,
+ *        payload length (big endian), response buffer size (big endian), payload
+ */
+#define TRUSTXD_DEFAULT_SOCKET		"/var/run/trustxd.sock"
+#define TRUSTXD_SOCKET_ENV		"TRUSTXD_SOCKET"
+#define TRUSTXD_TRANSPORT_ENV		"TRUSTXD_TRANSPORT"	// "shm" selects the shared memory ring
+#define TRUSTXD_PROTO_VERSION		1
+#define TRUSTXD_HEADER_LEN		8
+// Largest APDU relayed, matches the large APDU buffers of the command library
+#define TRUSTXD_MAX_APDU		OPTIGA_COMMS_POOL_LARGE_SIZE
+
+// Message types
+#define TRUSTXD_MSG_APDU		0x01	// request: command APDU, reply: response APDU
+#define TRUSTXD_MSG_SHM			0x02	// request: map a ring, reply: no payload, ring memfd and doorbell eventfd attached
+#define TRUSTXD_MSG_ERROR		0x7F	// reply: the chip could not be reached, no payload
+
+// Request priorities, the daemon serves higher ones first
+#define TRUSTXD_PRIO_LOW		0	// data object access, key generation
+#define TRUSTXD_PRIO_NORMAL		1	// random, hash, verify
+#define TRUSTXD_PRIO_HIGH		2	// sign, shared secret, key derivation, decrypt
+
+/*
+ * Shared memory ring, one per client process. Producers claim a free slot with a compare and
+ * swap, write the APDU in place and mark it submitted. The daemon runs it on the chip in place
+ * and marks it done. Syscalls are only made to wake a sleeping side: the doorbell eventfd when
+ * the daemon waits in poll(), a futex on the slot state when the producer waits for the reply.
+ */
+#define TRUSTXD_SHM_MAGIC		0x54585352	// "TXSR"
+#define TRUSTXD_SHM_SLOTS		16
+
+// Slot states
+#define TRUSTXD_SLOT_FREE		0
+#define TRUSTXD_SLOT_CLAIMED		1	// producer writes the request
+#define TRUSTXD_SLOT_SUBMITTED		2
+#define TRUSTXD_SLOT_BUSY		3	// daemon runs it on the chip
+#define TRUSTXD_SLOT_DONE		4	// producer reads the reply
+
+// ********** typedef
+typedef struct _tag_trustXd_ShmSlot {
+	uint32_t state;			// futex word
+	uint32_t waiting;		// producer sleeps on state
+	uint16_t length;		// request, then response APDU length
+	uint16_t bufferSize;		// producer response buffer size
+	uint8_t priority;
+	uint8_t type;			// TRUSTXD_MSG_APDU or TRUSTXD_MSG_ERROR
+	uint16_t errorLen;		// error code response of a failed command
+	uint8_t error[8];
+	uint8_t data[TRUSTXD_MAX_APDU];
+} trustXd_ShmSlot_t;
+
+typedef struct _tag_trustXd_ShmRing {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t slotCount;
+	uint32_t sleeping;		// daemon waits for the doorbell
+	uint32_t hint;			// next slot to try
+	trustXd_ShmSlot_t slot[TRUSTXD_SHM_SLOTS];
+} trustXd_ShmRing_t;
+
+typedef struct _tag_trustXd_Client {
+	int fd;
+	pthread_mutex_t mutex;		// one request in flight per connection
+	char path[108];
+	trustXd_ShmRing_t *ring;	// shared memory transport only
+	int doorbellFd;
+	uint8_t dead;			// the daemon went away while the ring was mapped
+} trustXd_Client_t;
+
+// *********** Extern
+extern const optiga_comms_ops_t trustXd_CommsOps;
+extern const optiga_comms_ops_t trustXd_ShmCommsOps;
+
+// Function Prototype
+void trustXd_SetSocket(const char *path);
+const char *trustXd_GetSocket(int *explicitPath);
+int trustXd_UseShm(void);
+optiga_lib_status_t trustXd_ShmAttachThread(optiga_comms_t *p_comms);
+void trustXd_ShmDetachThread(void);
+uint8_t trustXd_Priority(const uint8_t *apdu, uint16_t length);
+int trustXd_IsErrorRead(const uint8_t *apdu, uint16_t length);
+void trustXd_PutHeader(uint8_t *header, uint8_t type, uint8_t prioStatus, uint16_t length, uint16_t bufferSize);
+
+#endif	// _TRUSTXD_H_
@@ -25,6 +25,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <openssl/x509.h>
@@ -37,6 +38,7 @@
 #include "optiga/optiga_util.h"
 
 #include "trustx.h"
+#include "trustxd.h"
 
 //Globe
 char *i2c_if;
@@ -52,7 +54,10 @@ extern pal_status_t pal_os_event_stop(void);
 *  Global
 *************************************************************************/
 extern ifx_i2c_context_t ifx_i2c_context_0;
-optiga_comms_t optiga_comms = {(void*)&ifx_i2c_context_0, NULL,NULL, OPTIGA_COMMS_SUCCESS};
+optiga_comms_t optiga_comms = {(void*)&ifx_i2c_context_0, NULL,NULL, OPTIGA_COMMS_SUCCESS, &optiga_comms_pool_0};
+
+// Connection to trustxd, used instead of the I2C stack when the daemon runs
+static trustXd_Client_t __trustxd = {.fd = -1, .mutex = PTHREAD_MUTEX_INITIALIZER, .doorbellFd = -1};
 
 /*************************************************************************
 *  Read Metadata support
@@ -531,6 +536,31 @@ optiga_lib_status_t trustX_readCert(uint16_t oid, uint8_t* p_cert, uint32_t* len
 
 }
 
+/**********************************************************************
+* trustX_certDER()
+* Certificate objects written with the TLS identity tag carry 9 bytes
+* in front of the DER certificate: tag 0xC0 with a 2 byte length, the
+* 3 byte length of the certificate list and the 3 byte length of the
+* certificate. Returns the start of the DER certificate and adjusts
+* length, NULL if the object holds no certificate.
+**********************************************************************/
+const uint8_t *trustX_certDER(const uint8_t* p_cert, uint32_t* length)
+{
+	if ((*length > 0) && (p_cert[0] == TRUSTX_CERT_DER_TAG))
+		return p_cert;
+
+	if ((*length > TRUSTX_CERT_IDENTITY_HDR_LEN) &&
+	    (p_cert[0] == TRUSTX_CERT_IDENTITY_TAG) &&
+	    (p_cert[TRUSTX_CERT_IDENTITY_HDR_LEN] == TRUSTX_CERT_DER_TAG))
+	{
+		*length -= TRUSTX_CERT_IDENTITY_HDR_LEN;
+		return p_cert + TRUSTX_CERT_IDENTITY_HDR_LEN;
+	}
+
+	TRUSTX_HELPER_ERRFN("no certificate tag found\n");
+	return NULL;
+}
+
 /**********************************************************************
 * trustX_readUID()
 **********************************************************************/
@@ -573,6 +603,31 @@ optiga_lib_status_t trustX_readUID(utrustX_UID_t *UID)
     return return_status;
 }
 
+/**********************************************************************
+* trustX_SetInterface()
+* Selects the I2C adapter and the slave address used by the next trustX_Open().
+* NULL or 0 keeps the current setting.
+**********************************************************************/
+optiga_lib_status_t trustX_SetInterface(const char *device, uint8_t slaveAddr)
+{
+	static char i2c_dev[64];
+
+	if (NULL != device)
+	{
+		if (strlen(device) >= sizeof(i2c_dev))
+		{
+			TRUSTX_HELPER_ERRFN("I2C device name too long\n");
+			return OPTIGA_LIB_ERROR;
+		}
+		strcpy(i2c_dev, device);
+		i2c_if = i2c_dev;
+	}
+	if (0 != slaveAddr)
+		ifx_i2c_context_0.slave_address = slaveAddr & 0x7F;
+
+	return OPTIGA_LIB_SUCCESS;
+}
+
 /**********************************************************************
 * trustX_Open()
 **********************************************************************/
@@ -580,10 +635,33 @@ optiga_lib_status_t trustX_Open(void)
 {
 	int32_t status = (int32_t) OPTIGA_LIB_ERROR;
 		
+	const char *brokerPath;
+	int explicitPath;
+
 	TRUSTX_HELPER_DBGFN(">> Enter trustX_Open()\n");
 	do
 	{
-		i2c_if = dev;
+		// Share the warm chip session of trustxd if it runs
+		brokerPath = trustXd_GetSocket(&explicitPath);
+		if (NULL != brokerPath)
+		{
+			strncpy(__trustxd.path, brokerPath, sizeof(__trustxd.path) - 1);
+			optiga_comms.comms_ctx = (void*)&__trustxd;
+			optiga_comms.p_ops = trustXd_UseShm() ? &trustXd_ShmCommsOps : &trustXd_CommsOps;
+			status = optiga_util_open_application(&optiga_comms);
+			if ((OPTIGA_LIB_SUCCESS == status) || explicitPath)
+			{
+				if (OPTIGA_LIB_SUCCESS != status)
+					TRUSTX_HELPER_ERRFN( "Failure: trustxd at %s not reachable\n\r", brokerPath);
+				break;
+			}
+			// Stale default socket, open the chip directly
+			optiga_comms.comms_ctx = (void*)&ifx_i2c_context_0;
+			optiga_comms.p_ops = NULL;
+		}
+
+		if (NULL == i2c_if)
+			i2c_if = dev;
 		pal_gpio_init();
 		pal_os_event_init();
 
@@ -628,6 +706,13 @@ void trustX_Close(void)
 			break;
 		}
 		status = OPTIGA_LIB_SUCCESS;
+		if (NULL != optiga_comms.p_ops)
+		{
+			// Only the connection to trustxd was open
+			optiga_comms.comms_ctx = (void*)&ifx_i2c_context_0;
+			optiga_comms.p_ops = NULL;
+			break;
+		}
 		pal_os_event_stop();
 		pal_gpio_deinit();
 
@@ -0,0 +1,529 @@
+/**
+* MIT License
+*
+* Copyright (c) 2019 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "optiga/cmd/CommandLib.h"
+#include "optiga/pal/pal_os_lock.h"
+#include "pal_linux.h"
+
+#include "trustx.h"
+#include "trustx_pool.h"
+
+extern pal_status_t pal_init(void);
+extern pal_status_t pal_os_event_init(void);
+
+/*************************************************************************
+*  Local
+*************************************************************************/
+// One OPTIGA with its own protocol stack, driven by its own I/O thread only
+typedef struct _tag_trustX_PoolChip {
+	pal_linux_t palLinux;
+	pal_i2c_t palI2c;
+	ifx_i2c_context_t ifxI2c;
+	optiga_comms_t comms;
+	optiga_comms_pool_t apduPool;	// APDU buffers of this chip only
+	optiga_comms_pool_storage_t apduStorage;
+	uint16_t keyOid[TRUSTX_POOL_MAX_KEYS];
+	uint8_t keyCount;
+	pthread_t thread;
+	pthread_cond_t work;		// request queued or stop
+	trustX_QueueReq_t *head;
+	trustX_QueueReq_t *tail;
+	uint16_t depth;			// queued and executing requests
+	uint32_t completed;
+	optiga_lib_status_t openStatus;	// OPTIGA_LIB_STATUS_BUSY while opening
+	uint8_t isOpen;
+	uint8_t isStarted;
+} trustX_PoolChip_t;
+
+typedef struct _tag_trustX_Pool {
+	pthread_mutex_t mutex;
+	pthread_cond_t complete;	// request completed or chip opened
+	trustX_PoolChip_t chip[TRUSTX_POOL_MAX_CHIPS];
+	uint8_t count;
+	uint16_t maxDepth;
+	uint8_t nextChip;		// start of the least loaded search, spreads ties
+	uint8_t running;
+} trustX_Pool_t;
+
+static trustX_Pool_t __pool = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.complete = PTHREAD_COND_INITIALIZER,
+};
+
+// Must be called with the pool mutex held
+static void __poolComplete(trustX_QueueReq_t *req, optiga_lib_status_t status)
+{
+	req->status = status;
+	// Done before the callback signals, so that a poll after the signal never misses it
+	req->done = 1;
+	if (NULL != req->callback)
+	{
+		pthread_mutex_unlock(&__pool.mutex);
+		req->callback(req, req->callbackCtx);
+		pthread_mutex_lock(&__pool.mutex);
+	}
+	// The caller may free the request from now on
+	req->released = 1;
+	pthread_cond_broadcast(&__pool.complete);
+}
+
+static void * __poolThread(void *arg)
+{
+	trustX_PoolChip_t *chip = (trustX_PoolChip_t *)arg;
+	trustX_QueueReq_t *req;
+	optiga_lib_status_t status = OPTIGA_LIB_ERROR;
+
+	TRUSTX_HELPER_DBGFN(">");
+
+	// Nobody else talks to this chip, so neither share the command library context nor the lock
+	if (PAL_STATUS_SUCCESS == pal_os_lock_enter_domain())
+	{
+		CmdLib_SetThreadOptigaCommsContext(&chip->comms);
+		status = optiga_util_open_application(&chip->comms);
+		if (OPTIGA_LIB_SUCCESS != status)
+		{
+			TRUSTX_HELPER_ERRFN("Failure: optiga_util_open_application(%s): 0x%04X\n",
+						chip->palLinux.p_i2c_device, status);
+		}
+	}
+
+	pthread_mutex_lock(&__pool.mutex);
+	chip->openStatus = status;
+	chip->isOpen = (OPTIGA_LIB_SUCCESS == status) ? 1 : 0;
+	pthread_cond_broadcast(&__pool.complete);
+
+	while (__pool.running && chip->isOpen)
+	{
+		if (NULL == chip->head)
+		{
+			pthread_cond_wait(&chip->work, &__pool.mutex);
+			continue;
+		}
+
+		req = chip->head;
+		chip->head = req->next;
+		if (NULL == chip->head)
+			chip->tail = NULL;
+
+		pthread_mutex_unlock(&__pool.mutex);
+		status = trustX_QueueExec(req);
+		pthread_mutex_lock(&__pool.mutex);
+
+		chip->depth--;
+		chip->completed++;
+		__poolComplete(req, status);
+	}
+	pthread_mutex_unlock(&__pool.mutex);
+
+	if (chip->isOpen)
+	{
+		optiga_comms_close(&chip->comms);
+	}
+	CmdLib_SetThreadOptigaCommsContext(NULL);
+	pal_os_lock_leave_domain();
+
+	TRUSTX_HELPER_DBGFN("<");
+	return NULL;
+}
+
+// Random numbers, hashes and verification with a host key do not depend on objects of a chip
+static uint8_t __poolIsStateless(trustX_eQueueCmd_t eCmd)
+{
+	return ((TRUSTX_QCMD_RANDOM == eCmd) || (TRUSTX_QCMD_HASH == eCmd) ||
+		(TRUSTX_QCMD_VERIFY == eCmd)) ? 1 : 0;
+}
+
+// Key the request uses, 0 for requests without a key
+static uint16_t __poolReqKey(const trustX_QueueReq_t *req)
+{
+	switch (req->eCmd)
+	{
+		case TRUSTX_QCMD_SIGN:
+			return (uint16_t)req->u.sign.keyId;
+		case TRUSTX_QCMD_ECDH:
+			return (uint16_t)req->u.ecdh.keyId;
+		default:
+			return 0;
+	}
+}
+
+// Must be called with the pool mutex held, returns TRUSTX_POOL_CHIP_ANY if no chip owns the key
+static uint8_t __poolKeyOwner(uint16_t keyOid)
+{
+	uint8_t i, k;
+
+	for (i = 0; (0 != keyOid) && (i < __pool.count); i++)
+	{
+		for (k = 0; k < __pool.chip[i].keyCount; k++)
+		{
+			if (__pool.chip[i].keyOid[k] == keyOid)
+				return i;
+		}
+	}
+	return TRUSTX_POOL_CHIP_ANY;
+}
+
+// Must be called with the pool mutex held
+static void __poolRemoveKey(uint16_t keyOid)
+{
+	trustX_PoolChip_t *chip;
+	uint8_t owner = __poolKeyOwner(keyOid);
+	uint8_t k;
+
+	if (TRUSTX_POOL_CHIP_ANY == owner)
+		return;
+	chip = &__pool.chip[owner];
+	for (k = 0; k < chip->keyCount; k++)
+	{
+		if (chip->keyOid[k] == keyOid)
+		{
+			chip->keyOid[k] = chip->keyOid[--chip->keyCount];
+			break;
+		}
+	}
+}
+
+// Must be called with the pool mutex held
+static optiga_lib_status_t __poolAddKey(uint16_t keyOid, uint8_t chip)
+{
+	trustX_PoolChip_t *owner = &__pool.chip[chip];
+	uint8_t current = __poolKeyOwner(keyOid);
+
+	if (current == chip)
+		return OPTIGA_LIB_SUCCESS;
+	if (TRUSTX_POOL_CHIP_ANY != current)
+	{
+		TRUSTX_HELPER_ERRFN("Key 0x%04X is already owned by chip %d\n", keyOid, current);
+		return OPTIGA_LIB_ERROR;
+	}
+	if (owner->keyCount >= TRUSTX_POOL_MAX_KEYS)
+	{
+		TRUSTX_HELPER_ERRFN("Too many keys for chip %d\n", chip);
+		return OPTIGA_LIB_ERROR;
+	}
+	owner->keyOid[owner->keyCount++] = keyOid;
+	return OPTIGA_LIB_SUCCESS;
+}
+
+// Must be called with the pool mutex held, returns TRUSTX_POOL_CHIP_ANY if no chip is open
+static uint8_t __poolLeastLoaded(void)
+{
+	uint8_t best = TRUSTX_POOL_CHIP_ANY;
+	uint8_t i;
+	uint8_t index;
+
+	for (i = 0; i < __pool.count; i++)
+	{
+		index = (uint8_t)((__pool.nextChip + i) % __pool.count);
+		if (!__pool.chip[index].isOpen)
+			continue;
+		if ((TRUSTX_POOL_CHIP_ANY == best) || (__pool.chip[index].depth < __pool.chip[best].depth))
+			best = index;
+	}
+	__pool.nextChip = (uint8_t)((__pool.nextChip + 1) % __pool.count);
+
+	return best;
+}
+
+/*************************************************************************
+*  Pool API
+*************************************************************************/
+// Opens one OPTIGA per cfg entry, replaces trustX_Open for multi device setups.
+// Chip indices follow cfg, chips failing to open stay unusable. Fails if no chip opened.
+optiga_lib_status_t trustX_PoolOpen(const trustX_PoolChipCfg_t *cfg, uint8_t count, uint16_t maxDepth)
+{
+	optiga_lib_status_t status = OPTIGA_LIB_ERROR;
+	trustX_PoolChip_t *chip;
+	uint8_t opened = 0;
+	uint8_t i, k;
+
+	TRUSTX_HELPER_DBGFN(">> Enter trustX_PoolOpen()\n");
+
+	do
+	{
+		if ((NULL == cfg) || (0 == count) || (count > TRUSTX_POOL_MAX_CHIPS))
+		{
+			TRUSTX_HELPER_ERRFN("Invalid pool configuration (%d chips)\n", count);
+			break;
+		}
+
+		pthread_mutex_lock(&__pool.mutex);
+		if (__pool.running)
+		{
+			pthread_mutex_unlock(&__pool.mutex);
+			status = OPTIGA_LIB_SUCCESS;
+			break;
+		}
+
+		if (NULL == i2c_if)
+			i2c_if = dev;
+		pal_os_event_init();
+		if (pal_init() != PAL_STATUS_SUCCESS)
+		{
+			pthread_mutex_unlock(&__pool.mutex);
+			TRUSTX_HELPER_ERRFN("Failure: pal_init()!!!\n");
+			break;
+		}
+
+		for (i = 0; i < count; i++)
+		{
+			chip = &__pool.chip[i];
+			memset(chip, 0, sizeof(trustX_PoolChip_t));
+			chip->palLinux.p_i2c_device = cfg[i].i2cDev;
+			chip->palI2c.p_i2c_hw_config = (void*)&chip->palLinux;
+			chip->palI2c.slave_address = (0 != cfg[i].slaveAddr) ? cfg[i].slaveAddr : TRUSTX_POOL_DEFAULT_ADDR;
+			// No Vdd and reset pins, the protocol stack falls back to a soft reset
+			chip->ifxI2c.slave_address = (uint8_t)chip->palI2c.slave_address;
+			chip->ifxI2c.frequency = ifx_i2c_context_0.frequency;
+			chip->ifxI2c.frame_size = ifx_i2c_context_0.frame_size;
+			chip->ifxI2c.p_pal_i2c_ctx = &chip->palI2c;
+			chip->comms.comms_ctx = (void*)&chip->ifxI2c;
+			chip->comms.state = OPTIGA_COMMS_SUCCESS;
+			// Chips run in parallel, a shared pool would run short of buffers and fall back to the heap
+			optiga_comms_pool_init(&chip->apduPool, &chip->apduStorage);
+			chip->comms.p_pool = &chip->apduPool;
+			pthread_cond_init(&chip->work, NULL);
+		}
+		__pool.count = count;
+		for (i = 0; i < count; i++)
+		{
+			for (k = 0; k < cfg[i].keyCount; k++)
+				__poolAddKey(cfg[i].keyOids[k], i);
+		}
+		__pool.maxDepth = (0 != maxDepth) ? maxDepth : TRUSTX_QUEUE_DEFAULT_DEPTH;
+		__pool.nextChip = 0;
+		__pool.running = 1;
+
+		// One chip at a time, the command library learns the maximum APDU size from the first one
+		for (i = 0; i < count; i++)
+		{
+			chip = &__pool.chip[i];
+			chip->openStatus = OPTIGA_LIB_STATUS_BUSY;
+			if (pthread_create(&chip->thread, NULL, __poolThread, chip) != 0)
+			{
+				TRUSTX_HELPER_ERRFN("Failed to create pool thread for %s\n", cfg[i].i2cDev);
+				chip->openStatus = OPTIGA_LIB_ERROR;
+				continue;
+			}
+			chip->isStarted = 1;
+			while (OPTIGA_LIB_STATUS_BUSY == chip->openStatus)
+				pthread_cond_wait(&__pool.complete, &__pool.mutex);
+			if (chip->isOpen)
+				opened++;
+		}
+		pthread_mutex_unlock(&__pool.mutex);
+
+		if (0 == opened)
+		{
+			trustX_PoolClose();
+			break;
+		}
+		status = OPTIGA_LIB_SUCCESS;
+	} while(0);
+
+	TRUSTX_HELPER_DBGFN("<< Exit trustX_PoolOpen()\n");
+	return status;
+}
+
+void trustX_PoolClose(void)
+{
+	trustX_PoolChip_t *chip;
+	trustX_QueueReq_t *req;
+	uint8_t i;
+
+	TRUSTX_HELPER_DBGFN(">> Enter trustX_PoolClose()\n");
+
+	pthread_mutex_lock(&__pool.mutex);
+	if (!__pool.running)
+	{
+		pthread_mutex_unlock(&__pool.mutex);
+		return;
+	}
+	__pool.running = 0;
+	for (i = 0; i < __pool.count; i++)
+		pthread_cond_signal(&__pool.chip[i].work);
+	pthread_mutex_unlock(&__pool.mutex);
+
+	// Lets the requests in execution complete and closes the chips
+	for (i = 0; i < __pool.count; i++)
+	{
+		if (__pool.chip[i].isStarted)
+			pthread_join(__pool.chip[i].thread, NULL);
+	}
+
+	// Fail the requests still queued, so that no waiter blocks forever
+	pthread_mutex_lock(&__pool.mutex);
+	for (i = 0; i < __pool.count; i++)
+	{
+		chip = &__pool.chip[i];
+		while (NULL != chip->head)
+		{
+			req = chip->head;
+			chip->head = req->next;
+			__poolComplete(req, OPTIGA_LIB_ERROR);
+		}
+		chip->tail = NULL;
+		chip->depth = 0;
+		chip->isOpen = 0;
+		chip->isStarted = 0;
+		chip->keyCount = 0;
+		pthread_cond_destroy(&chip->work);
+	}
+	__pool.count = 0;
+	pthread_mutex_unlock(&__pool.mutex);
+
+	TRUSTX_HELPER_DBGFN("<< Exit trustX_PoolClose()\n");
+}
+
+// Number of configured chips, including the ones which failed to open
+uint8_t trustX_PoolChips(void)
+{
+	uint8_t count;
+
+	pthread_mutex_lock(&__pool.mutex);
+	count = __pool.count;
+	pthread_mutex_unlock(&__pool.mutex);
+
+	return count;
+}
+
+// Moves the ownership of a key, e.g. after generating it. TRUSTX_POOL_CHIP_ANY drops the owner.
+optiga_lib_status_t trustX_PoolSetKeyOwner(uint16_t keyOid, uint8_t chip)
+{
+	optiga_lib_status_t status = OPTIGA_LIB_ERROR;
+
+	pthread_mutex_lock(&__pool.mutex);
+	if ((TRUSTX_POOL_CHIP_ANY == chip) || (chip < __pool.count))
+	{
+		__poolRemoveKey(keyOid);
+		status = (TRUSTX_POOL_CHIP_ANY == chip) ? OPTIGA_LIB_SUCCESS : __poolAddKey(keyOid, chip);
+	}
+	pthread_mutex_unlock(&__pool.mutex);
+
+	return status;
+}
+
+// chip selects the device holding the key or data object of the request. With TRUSTX_POOL_CHIP_ANY
+// stateless requests go to the least loaded chip, key bound requests to the owner of the key
+// and all others to chip 0. A key owned by another chip than the given one fails the request.
+optiga_lib_status_t trustX_PoolSubmit(trustX_QueueReq_t *req, uint8_t chip)
+{
+	optiga_lib_status_t status = OPTIGA_LIB_ERROR;
+	trustX_PoolChip_t *target;
+	uint8_t owner;
+
+	pthread_mutex_lock(&__pool.mutex);
+	do
+	{
+		if ((NULL == req) || !__pool.running)
+			break;
+
+		owner = __poolKeyOwner(__poolReqKey(req));
+		if (TRUSTX_POOL_CHIP_ANY == chip)
+		{
+			if (__poolIsStateless(req->eCmd))
+				chip = __poolLeastLoaded();
+			else
+				chip = (TRUSTX_POOL_CHIP_ANY != owner) ? owner : 0;
+		}
+		else if ((TRUSTX_POOL_CHIP_ANY != owner) && (owner != chip))
+		{
+			TRUSTX_HELPER_ERRFN("Key 0x%04X is owned by chip %d, not %d\n", __poolReqKey(req), owner, chip);
+			break;
+		}
+		if (chip >= __pool.count)
+			break;
+		target = &__pool.chip[chip];
+		if (!target->isOpen)
+			break;
+		if (target->depth >= __pool.maxDepth)
+		{
+			status = OPTIGA_LIB_STATUS_BUSY;
+			break;
+		}
+
+		req->status = OPTIGA_LIB_STATUS_BUSY;
+		req->done = 0;
+		req->released = 0;
+		req->next = NULL;
+		if (NULL == target->tail)
+			target->head = req;
+		else
+			target->tail->next = req;
+		target->tail = req;
+		target->depth++;
+		pthread_cond_signal(&target->work);
+		status = OPTIGA_LIB_SUCCESS;
+	} while(0);
+	pthread_mutex_unlock(&__pool.mutex);
+
+	return status;
+}
+
+// Returns 1 once the request is completed, its status is then in req->status.
+// The callback may still run, call trustX_PoolWait() before releasing the request.
+int trustX_PoolPoll(const trustX_QueueReq_t *req)
+{
+	int done;
+
+	pthread_mutex_lock(&__pool.mutex);
+	done = req->done;
+	pthread_mutex_unlock(&__pool.mutex);
+
+	return done;
+}
+
+// Blocks until the request is released
+optiga_lib_status_t trustX_PoolWait(trustX_QueueReq_t *req)
+{
+	pthread_mutex_lock(&__pool.mutex);
+	while (!req->released)
+		pthread_cond_wait(&__pool.complete, &__pool.mutex);
+	pthread_mutex_unlock(&__pool.mutex);
+
+	return req->status;
+}
+
+optiga_lib_status_t trustX_PoolGetStats(uint8_t chip, trustX_PoolChipStats_t *stats)
+{
+	optiga_lib_status_t status = OPTIGA_LIB_ERROR;
+
+	pthread_mutex_lock(&__pool.mutex);
+	if ((NULL != stats) && (chip < __pool.count))
+	{
+		stats->isOpen = __pool.chip[chip].isOpen;
+		stats->depth = __pool.chip[chip].depth;
+		stats->completed = __pool.chip[chip].completed;
+		status = OPTIGA_LIB_SUCCESS;
+	}
+	pthread_mutex_unlock(&__pool.mutex);
+
+	return status;
+}
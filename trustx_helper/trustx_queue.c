@@ -0,0 +1,318 @@
+/**
+* MIT License
+*
+* Copyright (c) 2019 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "trustx.h"
+#include "trustx_queue.h"
+
+/*************************************************************************
+*  Local
+*************************************************************************/
+typedef struct _tag_trustX_Queue {
+	pthread_mutex_t mutex;
+	pthread_cond_t work;		// request queued or stop
+	pthread_cond_t complete;	// request completed
+	pthread_t thread;
+	trustX_QueueReq_t *head;
+	trustX_QueueReq_t *tail;
+	uint16_t depth;
+	uint16_t maxDepth;
+	int eventFd;			// counts completions
+	uint8_t running;
+} trustX_Queue_t;
+
+static trustX_Queue_t __queue = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.complete = PTHREAD_COND_INITIALIZER,
+	.eventFd = -1,
+};
+
+// Executes the command of the descriptor on the calling thread
+optiga_lib_status_t trustX_QueueExec(trustX_QueueReq_t *req)
+{
+	optiga_lib_status_t status = OPTIGA_LIB_ERROR;
+	uint8_t hashContextBuffer[130];
+	optiga_hash_context_t hashContext;
+	hash_data_from_host_t hashData;
+
+	switch (req->eCmd)
+	{
+		case TRUSTX_QCMD_SIGN:
+			status = optiga_crypt_ecdsa_sign(req->u.sign.digest, req->u.sign.digestLen,
+							req->u.sign.keyId,
+							req->u.sign.signature, &req->u.sign.signatureLen);
+			break;
+		case TRUSTX_QCMD_RANDOM:
+			status = optiga_crypt_random(OPTIGA_RNG_TYPE_TRNG, req->u.random.buffer, req->u.random.length);
+			break;
+		case TRUSTX_QCMD_GET_DATA:
+			status = optiga_util_read_data(req->u.getData.oid, req->u.getData.offset,
+							req->u.getData.buffer, &req->u.getData.length);
+			break;
+		case TRUSTX_QCMD_HASH:
+			hashContext.context_buffer = hashContextBuffer;
+			hashContext.context_buffer_length = sizeof(hashContextBuffer);
+			hashContext.hash_algo = OPTIGA_HASH_TYPE_SHA_256;
+			hashData.buffer = req->u.hash.data;
+			hashData.length = req->u.hash.length;
+			do
+			{
+				status = optiga_crypt_hash_start(&hashContext);
+				if (OPTIGA_LIB_SUCCESS != status)
+					break;
+				status = optiga_crypt_hash_update(&hashContext, OPTIGA_CRYPT_HOST_DATA, &hashData);
+				if (OPTIGA_LIB_SUCCESS != status)
+					break;
+				status = optiga_crypt_hash_finalize(&hashContext, req->u.hash.digest);
+			} while(0);
+			break;
+		case TRUSTX_QCMD_ECDH:
+			status = optiga_crypt_ecdh(req->u.ecdh.keyId, &req->u.ecdh.publicKey,
+						(NULL != req->u.ecdh.sharedSecret) ? TRUE : FALSE,
+						req->u.ecdh.sharedSecret);
+			break;
+		case TRUSTX_QCMD_VERIFY:
+			status = optiga_crypt_ecdsa_verify(req->u.verify.digest, req->u.verify.digestLen,
+							req->u.verify.signature, req->u.verify.signatureLen,
+							OPTIGA_CRYPT_HOST_DATA, &req->u.verify.publicKey);
+			break;
+		default:
+			TRUSTX_HELPER_ERRFN("Unknown queue command %d\n", req->eCmd);
+			break;
+	}
+
+	return status;
+}
+
+// Must be called with the queue mutex held
+static void __queueComplete(trustX_QueueReq_t *req, optiga_lib_status_t status)
+{
+	uint64_t value = 1;
+
+	req->status = status;
+	// Done before the callback signals, so that a poll after the signal never misses it
+	req->done = 1;
+	if (NULL != req->callback)
+	{
+		pthread_mutex_unlock(&__queue.mutex);
+		req->callback(req, req->callbackCtx);
+		pthread_mutex_lock(&__queue.mutex);
+	}
+	// The caller may free the request from now on
+	req->released = 1;
+	pthread_cond_broadcast(&__queue.complete);
+
+	if (write(__queue.eventFd, &value, sizeof(value)) == -1)
+	{
+		TRUSTX_HELPER_ERRFN("eventfd write (%s)\n", strerror(errno));
+	}
+}
+
+static void * __queueThread(void *arg)
+{
+	trustX_QueueReq_t *req;
+	optiga_lib_status_t status;
+
+	TRUSTX_HELPER_DBGFN(">");
+
+	pthread_mutex_lock(&__queue.mutex);
+	while (__queue.running)
+	{
+		if (NULL == __queue.head)
+		{
+			pthread_cond_wait(&__queue.work, &__queue.mutex);
+			continue;
+		}
+
+		req = __queue.head;
+		__queue.head = req->next;
+		if (NULL == __queue.head)
+			__queue.tail = NULL;
+		__queue.depth--;
+
+		// Only this thread talks to the chip, keep the queue open for submitters meanwhile
+		pthread_mutex_unlock(&__queue.mutex);
+		status = trustX_QueueExec(req);
+		pthread_mutex_lock(&__queue.mutex);
+
+		__queueComplete(req, status);
+	}
+	pthread_mutex_unlock(&__queue.mutex);
+
+	TRUSTX_HELPER_DBGFN("<");
+	return NULL;
+}
+
+/*************************************************************************
+*  Queue API
+*************************************************************************/
+optiga_lib_status_t trustX_QueueStart(uint16_t maxDepth)
+{
+	optiga_lib_status_t status = OPTIGA_LIB_ERROR;
+
+	TRUSTX_HELPER_DBGFN(">> Enter trustX_QueueStart()\n");
+
+	pthread_mutex_lock(&__queue.mutex);
+	do
+	{
+		if (__queue.running)
+		{
+			status = OPTIGA_LIB_SUCCESS;
+			break;
+		}
+
+		__queue.eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (-1 == __queue.eventFd)
+		{
+			TRUSTX_HELPER_ERRFN("eventfd (%s)\n", strerror(errno));
+			break;
+		}
+
+		__queue.head = NULL;
+		__queue.tail = NULL;
+		__queue.depth = 0;
+		__queue.maxDepth = (0 != maxDepth) ? maxDepth : TRUSTX_QUEUE_DEFAULT_DEPTH;
+		__queue.running = 1;
+		if (pthread_create(&__queue.thread, NULL, __queueThread, NULL) != 0)
+		{
+			TRUSTX_HELPER_ERRFN("Failed to create queue thread\n");
+			__queue.running = 0;
+			close(__queue.eventFd);
+			__queue.eventFd = -1;
+			break;
+		}
+		status = OPTIGA_LIB_SUCCESS;
+	} while(0);
+	pthread_mutex_unlock(&__queue.mutex);
+
+	TRUSTX_HELPER_DBGFN("<< Exit trustX_QueueStart()\n");
+	return status;
+}
+
+void trustX_QueueStop(void)
+{
+	trustX_QueueReq_t *req;
+
+	TRUSTX_HELPER_DBGFN(">> Enter trustX_QueueStop()\n");
+
+	pthread_mutex_lock(&__queue.mutex);
+	if (!__queue.running)
+	{
+		pthread_mutex_unlock(&__queue.mutex);
+		return;
+	}
+	__queue.running = 0;
+	pthread_cond_signal(&__queue.work);
+	pthread_mutex_unlock(&__queue.mutex);
+
+	// Lets the request in execution complete
+	pthread_join(__queue.thread, NULL);
+
+	// Fail the requests still queued, so that no waiter blocks forever
+	pthread_mutex_lock(&__queue.mutex);
+	while (NULL != __queue.head)
+	{
+		req = __queue.head;
+		__queue.head = req->next;
+		__queueComplete(req, OPTIGA_LIB_ERROR);
+	}
+	__queue.tail = NULL;
+	__queue.depth = 0;
+	close(__queue.eventFd);
+	__queue.eventFd = -1;
+	pthread_mutex_unlock(&__queue.mutex);
+
+	TRUSTX_HELPER_DBGFN("<< Exit trustX_QueueStop()\n");
+}
+
+optiga_lib_status_t trustX_QueueSubmit(trustX_QueueReq_t *req)
+{
+	optiga_lib_status_t status = OPTIGA_LIB_ERROR;
+
+	pthread_mutex_lock(&__queue.mutex);
+	do
+	{
+		if ((NULL == req) || !__queue.running)
+			break;
+		if (__queue.depth >= __queue.maxDepth)
+		{
+			status = OPTIGA_LIB_STATUS_BUSY;
+			break;
+		}
+
+		req->status = OPTIGA_LIB_STATUS_BUSY;
+		req->done = 0;
+		req->released = 0;
+		req->next = NULL;
+		if (NULL == __queue.tail)
+			__queue.head = req;
+		else
+			__queue.tail->next = req;
+		__queue.tail = req;
+		__queue.depth++;
+		pthread_cond_signal(&__queue.work);
+		status = OPTIGA_LIB_SUCCESS;
+	} while(0);
+	pthread_mutex_unlock(&__queue.mutex);
+
+	return status;
+}
+
+// Returns 1 once the request is completed, its status is then in req->status.
+// The callback may still run, call trustX_QueueWait() before releasing the request.
+int trustX_QueuePoll(const trustX_QueueReq_t *req)
+{
+	int done;
+
+	pthread_mutex_lock(&__queue.mutex);
+	done = req->done;
+	pthread_mutex_unlock(&__queue.mutex);
+
+	return done;
+}
+
+// Blocks until the request is released
+optiga_lib_status_t trustX_QueueWait(trustX_QueueReq_t *req)
+{
+	pthread_mutex_lock(&__queue.mutex);
+	while (!req->released)
+		pthread_cond_wait(&__queue.complete, &__queue.mutex);
+	pthread_mutex_unlock(&__queue.mutex);
+
+	return req->status;
+}
+
+// Readable (counter > 0) after requests completed, for poll/epoll based callers
+int trustX_QueueEventFd(void)
+{
+	return __queue.eventFd;
+}
@@ -0,0 +1,547 @@
+/**
+* MIT License
+*
+* Copyright (c) 2019 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+#include "optiga/ifx_i2c/ifx_i2c.h"
+#include "optiga/cmd/CommandLib.h"
+#include "optiga/pal/pal_os_lock.h"
+
+#include "trustx.h"
+#include "trustxd.h"
+
+/*************************************************************************
+*  Local
+*************************************************************************/
+// NULL selects TRUSTXD_SOCKET or the default socket, "" opens the chip directly
+static const char *__socketPath = NULL;
+static char __socketPathBuf[sizeof(((trustXd_Client_t *)0)->path)];
+
+// Polls of the slot state before the producer sleeps on it
+#define SHM_SPIN		200
+// Sleep between checks that the daemon is still there
+#define SHM_WAIT_MS		100
+
+// Error code of the last failed command of this thread, replayed to the command library
+static __thread uint8_t __shmError[8];
+static __thread uint16_t __shmErrorLen;
+
+static int __sendAll(int fd, const uint8_t *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0)
+	{
+		n = send(fd, buf, len, MSG_NOSIGNAL);
+		if (n < 0)
+		{
+			if (EINTR == errno)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+static int __recvAll(int fd, uint8_t *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0)
+	{
+		n = recv(fd, buf, len, 0);
+		if (n <= 0)
+		{
+			if ((n < 0) && (EINTR == errno))
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+// Must be called with the client mutex held
+static int __connect(trustXd_Client_t *client)
+{
+	struct sockaddr_un addr;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, client->path, sizeof(addr.sun_path) - 1);
+
+	client->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (client->fd < 0)
+		return -1;
+	if (connect(client->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+	{
+		TRUSTX_HELPER_DBGFN("connect %s: %s\n", client->path, strerror(errno));
+		close(client->fd);
+		client->fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+static host_lib_status_t __open(optiga_comms_t *p_ctx)
+{
+	trustXd_Client_t *client = (trustXd_Client_t *)p_ctx->comms_ctx;
+	host_lib_status_t status = OPTIGA_COMMS_SUCCESS;
+
+	pthread_mutex_lock(&client->mutex);
+	if ((client->fd < 0) && (__connect(client) != 0))
+		status = OPTIGA_COMMS_ERROR;
+	pthread_mutex_unlock(&client->mutex);
+	return status;
+}
+
+static host_lib_status_t __transceive(optiga_comms_t *p_ctx, const uint8_t *p_data,
+				      const uint16_t *p_data_length,
+				      uint8_t *p_buffer, uint16_t *p_buffer_len)
+{
+	trustXd_Client_t *client = (trustXd_Client_t *)p_ctx->comms_ctx;
+	uint8_t frame[TRUSTXD_HEADER_LEN + TRUSTXD_MAX_APDU];
+	host_lib_status_t status = OPTIGA_COMMS_ERROR;
+	uint16_t length;
+	int connected = 1;
+
+	if (*p_data_length > TRUSTXD_MAX_APDU)
+		return IFX_I2C_STACK_MEM_ERROR;
+
+	pthread_mutex_lock(&client->mutex);
+	do
+	{
+		// Reconnects after a restart of the daemon, the chip session is kept there
+		if ((client->fd < 0) && (__connect(client) != 0))
+			break;
+
+		trustXd_PutHeader(frame, TRUSTXD_MSG_APDU, trustXd_Priority(p_data, *p_data_length),
+				  *p_data_length, *p_buffer_len);
+		memcpy(frame + TRUSTXD_HEADER_LEN, p_data, *p_data_length);
+		connected = 0;
+		if (__sendAll(client->fd, frame, TRUSTXD_HEADER_LEN + *p_data_length) != 0)
+			break;
+		if (__recvAll(client->fd, frame, TRUSTXD_HEADER_LEN) != 0)
+			break;
+
+		length = ((uint16_t)frame[4] << 8) | frame[5];
+		if ((TRUSTXD_PROTO_VERSION != frame[0]) || (length > *p_buffer_len))
+		{
+			TRUSTX_HELPER_ERRFN("Invalid reply from trustxd\n");
+			break;
+		}
+		if (__recvAll(client->fd, p_buffer, length) != 0)
+			break;
+		connected = 1;
+
+		if (TRUSTXD_MSG_APDU != frame[1])
+		{
+			TRUSTX_HELPER_ERRFN("trustxd could not reach the chip\n");
+			break;
+		}
+		*p_buffer_len = length;
+		status = OPTIGA_COMMS_SUCCESS;
+	} while(0);
+
+	if ((!connected) && (client->fd >= 0))
+	{
+		close(client->fd);
+		client->fd = -1;
+	}
+	pthread_mutex_unlock(&client->mutex);
+
+	if (OPTIGA_COMMS_SUCCESS != status)
+		*p_buffer_len = 0;
+	return status;
+}
+
+static host_lib_status_t __close(optiga_comms_t *p_ctx)
+{
+	trustXd_Client_t *client = (trustXd_Client_t *)p_ctx->comms_ctx;
+
+	pthread_mutex_lock(&client->mutex);
+	if (client->fd >= 0)
+	{
+		close(client->fd);
+		client->fd = -1;
+	}
+	pthread_mutex_unlock(&client->mutex);
+	return OPTIGA_COMMS_SUCCESS;
+}
+
+static int __futex(uint32_t *addr, int op, uint32_t val, const struct timespec *timeout)
+{
+	return (int)syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+// Must be called with the client mutex held
+static int __shmMap(trustXd_Client_t *client)
+{
+	uint8_t header[TRUSTXD_HEADER_LEN];
+	char control[CMSG_SPACE(2 * sizeof(int))];
+	struct iovec iov = {header, sizeof(header)};
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	int fds[2] = {-1, -1};
+	void *ring;
+
+	trustXd_PutHeader(header, TRUSTXD_MSG_SHM, 0, 0, 0);
+	if (__sendAll(client->fd, header, sizeof(header)) != 0)
+		return -1;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	if (recvmsg(client->fd, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL) != sizeof(header))
+		return -1;
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if ((NULL != cmsg) && (SCM_RIGHTS == cmsg->cmsg_type) && (cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int))))
+		memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+	if ((TRUSTXD_MSG_SHM != header[1]) || (fds[0] < 0))
+	{
+		TRUSTX_HELPER_ERRFN("trustxd refused the shared memory ring\n");
+		if (fds[0] >= 0)
+			close(fds[0]);
+		if (fds[1] >= 0)
+			close(fds[1]);
+		return -1;
+	}
+
+	ring = mmap(NULL, sizeof(trustXd_ShmRing_t), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+	close(fds[0]);
+	if (MAP_FAILED == ring)
+	{
+		close(fds[1]);
+		return -1;
+	}
+	client->ring = (trustXd_ShmRing_t *)ring;
+	if ((TRUSTXD_SHM_MAGIC != client->ring->magic) || (TRUSTXD_PROTO_VERSION != client->ring->version) ||
+	    (TRUSTXD_SHM_SLOTS != client->ring->slotCount))
+	{
+		TRUSTX_HELPER_ERRFN("Invalid shared memory ring\n");
+		munmap(ring, sizeof(trustXd_ShmRing_t));
+		client->ring = NULL;
+		close(fds[1]);
+		return -1;
+	}
+	client->doorbellFd = fds[1];
+	client->dead = 0;
+	return 0;
+}
+
+static host_lib_status_t __shmOpen(optiga_comms_t *p_ctx)
+{
+	trustXd_Client_t *client = (trustXd_Client_t *)p_ctx->comms_ctx;
+	host_lib_status_t status = OPTIGA_COMMS_SUCCESS;
+
+	pthread_mutex_lock(&client->mutex);
+	if ((NULL == client->ring) &&
+	    (((client->fd < 0) && (__connect(client) != 0)) || (__shmMap(client) != 0)))
+	{
+		status = OPTIGA_COMMS_ERROR;
+	}
+	pthread_mutex_unlock(&client->mutex);
+	return status;
+}
+
+// The daemon keeps the socket of the ring open, a hang up means it is gone
+static int __shmDaemonAlive(trustXd_Client_t *client)
+{
+	struct pollfd pfd = {client->fd, POLLIN, 0};
+
+	if (poll(&pfd, 1, 0) == 0)
+		return 1;
+	client->dead = 1;
+	TRUSTX_HELPER_ERRFN("trustxd went away\n");
+	return 0;
+}
+
+static host_lib_status_t __shmTransceive(optiga_comms_t *p_ctx, const uint8_t *p_data,
+					 const uint16_t *p_data_length,
+					 uint8_t *p_buffer, uint16_t *p_buffer_len)
+{
+	trustXd_Client_t *client = (trustXd_Client_t *)p_ctx->comms_ctx;
+	trustXd_ShmRing_t *ring = client->ring;
+	trustXd_ShmSlot_t *slot;
+	struct timespec timeout = {0, SHM_WAIT_MS * 1000000L};
+	host_lib_status_t status = OPTIGA_COMMS_SUCCESS;
+	uint64_t doorbell = 1;
+	uint32_t start, i, state, expected;
+
+	if (trustXd_IsErrorRead(p_data, *p_data_length) && (0 != __shmErrorLen) && (__shmErrorLen <= *p_buffer_len))
+	{
+		memcpy(p_buffer, __shmError, __shmErrorLen);
+		*p_buffer_len = __shmErrorLen;
+		__shmErrorLen = 0;
+		return OPTIGA_COMMS_SUCCESS;
+	}
+	if ((NULL == ring) || client->dead || (*p_data_length > TRUSTXD_MAX_APDU))
+	{
+		*p_buffer_len = 0;
+		return OPTIGA_COMMS_ERROR;
+	}
+
+	// Claim a free slot, producers only contend on the slot state
+	start = __atomic_fetch_add(&ring->hint, 1, __ATOMIC_RELAXED);
+	for (i = 0; ; i++)
+	{
+		slot = &ring->slot[(start + i) % TRUSTXD_SHM_SLOTS];
+		expected = TRUSTXD_SLOT_FREE;
+		if (__atomic_compare_exchange_n(&slot->state, &expected, TRUSTXD_SLOT_CLAIMED, 0,
+						__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+		if ((TRUSTXD_SHM_SLOTS - 1) == (i % TRUSTXD_SHM_SLOTS))
+			sched_yield();
+	}
+
+	memcpy(slot->data, p_data, *p_data_length);
+	slot->length = *p_data_length;
+	slot->bufferSize = *p_buffer_len;
+	slot->priority = trustXd_Priority(p_data, *p_data_length);
+	slot->waiting = 0;
+	__atomic_store_n(&slot->state, TRUSTXD_SLOT_SUBMITTED, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ring->sleeping, __ATOMIC_SEQ_CST))
+	{
+		if (write(client->doorbellFd, &doorbell, sizeof(doorbell)) < 0)
+			TRUSTX_HELPER_DBGFN("doorbell: %s\n", strerror(errno));
+	}
+
+	for (i = 0; TRUSTXD_SLOT_DONE != (state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE)); i++)
+	{
+		if (i < SHM_SPIN)
+			continue;
+		__atomic_store_n(&slot->waiting, 1, __ATOMIC_SEQ_CST);
+		if ((__futex(&slot->state, FUTEX_WAIT, state, &timeout) != 0) && (ETIMEDOUT == errno) &&
+		    !__shmDaemonAlive(client))
+		{
+			// The slot stays claimed, the ring is not used any more
+			*p_buffer_len = 0;
+			return OPTIGA_COMMS_ERROR;
+		}
+	}
+
+	__shmErrorLen = 0;
+	if ((TRUSTXD_MSG_APDU != slot->type) || (slot->length > *p_buffer_len))
+	{
+		*p_buffer_len = 0;
+		status = OPTIGA_COMMS_ERROR;
+	}
+	else
+	{
+		memcpy(p_buffer, slot->data, slot->length);
+		*p_buffer_len = slot->length;
+		if ((0 != slot->errorLen) && (slot->errorLen <= sizeof(__shmError)))
+		{
+			memcpy(__shmError, slot->error, slot->errorLen);
+			__shmErrorLen = slot->errorLen;
+		}
+	}
+	__atomic_store_n(&slot->state, TRUSTXD_SLOT_FREE, __ATOMIC_RELEASE);
+	return status;
+}
+
+static host_lib_status_t __shmClose(optiga_comms_t *p_ctx)
+{
+	trustXd_Client_t *client = (trustXd_Client_t *)p_ctx->comms_ctx;
+
+	pthread_mutex_lock(&client->mutex);
+	if (NULL != client->ring)
+	{
+		munmap(client->ring, sizeof(trustXd_ShmRing_t));
+		client->ring = NULL;
+		close(client->doorbellFd);
+		client->doorbellFd = -1;
+	}
+	pthread_mutex_unlock(&client->mutex);
+	return __close(p_ctx);
+}
+
+/*************************************************************************
+*  Global
+*************************************************************************/
+// optiga comms transport relaying the APDUs through trustxd, comms_ctx is a trustXd_Client_t
+const optiga_comms_ops_t trustXd_CommsOps = {
+	__open,
+	__transceive,
+	__close
+};
+
+// optiga comms transport through the shared memory ring of trustxd, comms_ctx is a trustXd_Client_t
+const optiga_comms_ops_t trustXd_ShmCommsOps = {
+	__shmOpen,
+	__shmTransceive,
+	__shmClose
+};
+
+/**********************************************************************
+* trustXd_SetSocket()
+* Selects the socket of trustxd. NULL restores the default: TRUSTXD_SOCKET
+* or TRUSTXD_DEFAULT_SOCKET if it exists. "" opens the chip directly.
+**********************************************************************/
+void trustXd_SetSocket(const char *path)
+{
+	if (NULL == path)
+	{
+		__socketPath = NULL;
+		return;
+	}
+	strncpy(__socketPathBuf, path, sizeof(__socketPathBuf) - 1);
+	__socketPathBuf[sizeof(__socketPathBuf) - 1] = '\0';
+	__socketPath = __socketPathBuf;
+}
+
+/**********************************************************************
+* trustXd_GetSocket()
+* Returns the socket of trustxd, NULL if the chip is to be opened directly.
+* explicitPath is set unless the socket was found at the default location.
+**********************************************************************/
+const char *trustXd_GetSocket(int *explicitPath)
+{
+	const char *path = __socketPath;
+
+	*explicitPath = 1;
+	if (NULL == path)
+		path = getenv(TRUSTXD_SOCKET_ENV);
+	if (NULL == path)
+	{
+		*explicitPath = 0;
+		path = TRUSTXD_DEFAULT_SOCKET;
+		if (0 != access(path, F_OK))
+			return NULL;
+	}
+	return ('\0' != path[0]) ? path : NULL;
+}
+
+/**********************************************************************
+* trustXd_UseShm()
+* Returns 1 if TRUSTXD_TRANSPORT selects the shared memory ring.
+**********************************************************************/
+int trustXd_UseShm(void)
+{
+	const char *transport = getenv(TRUSTXD_TRANSPORT_ENV);
+
+	return ((NULL != transport) && (0 == strcmp(transport, "shm"))) ? 1 : 0;
+}
+
+/**********************************************************************
+* trustXd_ShmAttachThread()
+* Lets the calling thread submit to the shared memory ring opened by
+* trustX_Open() concurrently with other threads. p_comms must stay valid
+* until trustXd_ShmDetachThread().
+**********************************************************************/
+optiga_lib_status_t trustXd_ShmAttachThread(optiga_comms_t *p_comms)
+{
+	if (&trustXd_ShmCommsOps != optiga_comms.p_ops)
+		return OPTIGA_LIB_ERROR;
+
+	memset(p_comms, 0, sizeof(*p_comms));
+	p_comms->comms_ctx = optiga_comms.comms_ctx;
+	p_comms->p_pool = optiga_comms.p_pool;
+	p_comms->p_ops = &trustXd_ShmCommsOps;
+
+	// The library lock would serialize the threads again
+	if (PAL_STATUS_SUCCESS != pal_os_lock_enter_domain())
+		return OPTIGA_LIB_ERROR;
+	CmdLib_SetThreadOptigaCommsContext(p_comms);
+	return OPTIGA_LIB_SUCCESS;
+}
+
+/**********************************************************************
+* trustXd_ShmDetachThread()
+**********************************************************************/
+void trustXd_ShmDetachThread(void)
+{
+	CmdLib_SetThreadOptigaCommsContext(NULL);
+	pal_os_lock_leave_domain();
+}
+
+/**********************************************************************
+* trustXd_Priority()
+* Priority of a command APDU, handshake operations go first.
+**********************************************************************/
+uint8_t trustXd_Priority(const uint8_t *apdu, uint16_t length)
+{
+	if (0 == length)
+		return TRUSTXD_PRIO_LOW;
+
+	switch (apdu[0] & 0x7F)
+	{
+		case 0x31:	// CalcSign
+		case 0x33:	// CalcSSec
+		case 0x34:	// DeriveKey
+		case 0x1B:	// ProcDownlinkMsg, decrypt
+			return TRUSTXD_PRIO_HIGH;
+		case 0x0C:	// GetRandom
+		case 0x30:	// CalcHash
+		case 0x32:	// VerifySign
+		case 0x1A:	// ProcUplinkMsg, encrypt
+			return TRUSTXD_PRIO_NORMAL;
+		default:
+			return TRUSTXD_PRIO_LOW;
+	}
+}
+
+/**********************************************************************
+* trustXd_IsErrorRead()
+* Returns 1 if the APDU reads the last error code of the chip.
+**********************************************************************/
+int trustXd_IsErrorRead(const uint8_t *apdu, uint16_t length)
+{
+	return ((6 == length) && (0x01 == (apdu[0] & 0x7F)) && (0x00 == apdu[1]) &&
+		(0x00 == apdu[2]) && (0x02 == apdu[3]) && (0xF1 == apdu[4]) && (0xC2 == apdu[5])) ? 1 : 0;
+}
+
+/**********************************************************************
+* trustXd_PutHeader()
+**********************************************************************/
+void trustXd_PutHeader(uint8_t *header, uint8_t type, uint8_t prioStatus, uint16_t length, uint16_t bufferSize)
+{
+	header[0] = TRUSTXD_PROTO_VERSION;
+	header[1] = type;
+	header[2] = prioStatus;
+	header[3] = 0;
+	header[4] = (uint8_t)(length >> 8);
+	header[5] = (uint8_t)length;
+	header[6] = (uint8_t)(bufferSize >> 8);
+	header[7] = (uint8_t)bufferSize;
+}
@@ -34,15 +34,17 @@
 #include "optiga/common/Util.h"
 #include "optiga/cmd/CommandLib.h"
 #include "optiga/common/MemoryMgmt.h"
-
-#ifdef USE_CMDLIB_WITH_RTOS
-#include "optiga/pal/pal_os_timer.h"
-#endif
+#include "optiga/pal/pal_os_completion.h"
 
 /// @cond hidden
 
 static optiga_comms_t* p_optiga_comms;
 
+///OPTIGA comms context of a thread which drives its own OPTIGA, overrides p_optiga_comms when set
+static CMDLIB_THREAD_LOCAL optiga_comms_t* p_optiga_comms_thread;
+
+#define CMDLIB_COMMS()      ((NULL != p_optiga_comms_thread) ? p_optiga_comms_thread : p_optiga_comms)
+
 ///Maximum size of buffer, considering Maximum size of arbitrary data (1500) and header bytes
 #define MAX_APDU_BUFF_LEN           	1558
 	
@@ -300,7 +302,12 @@ uint16_t wMaxCommsBuffer = INVALID_MAX_COMMS_BUFF_SIZE;
 }
 
 /**
- * Initializes the APDU buffer in heap.<br>
+ * APDU buffer pool of the comms context.<br>
+ **/
+#define APDU_BUFFER_POOL	((NULL != CMDLIB_COMMS()->p_pool) ? CMDLIB_COMMS()->p_pool : &optiga_comms_pool_0)
+
+/**
+ * Initializes the APDU buffer from the APDU buffer pool.<br>
  **/
 #define INIT_HEAP_APDUBUFFER(pbBuffer,wLen)					\
 {															\
@@ -309,7 +316,7 @@ uint16_t wMaxCommsBuffer = INVALID_MAX_COMMS_BUFF_SIZE;
 		i4Status = (int32_t)CMD_DEV_EXEC_ERROR;				\
         break;                                              \
 	}														\
-	pbBuffer = (uint8_t*)OCP_MALLOC(wLen);					\
+	pbBuffer = optiga_comms_pool_alloc(APDU_BUFFER_POOL, (uint16_t)(wLen));	\
 	if(NULL == pbBuffer)									\
 	{														\
 		i4Status = (int32_t)CMD_LIB_INSUFFICIENT_MEMORY;	\
@@ -318,13 +325,13 @@ uint16_t wMaxCommsBuffer = INVALID_MAX_COMMS_BUFF_SIZE;
 }															\
 
 /**
- * Frees the heap memory.<br>
+ * Returns the APDU buffer to the APDU buffer pool.<br>
  **/
 #define FREE_HEAP_APDUBUFFER(pbBuffer)      \
 {											\
 	if(NULL != pbBuffer)					\
 	{										\
-		OCP_FREE(pbBuffer);					\
+		optiga_comms_pool_free(APDU_BUFFER_POOL, pbBuffer);	\
 		pbBuffer = NULL;					\
 	}										\
 }
@@ -394,12 +401,13 @@ typedef enum eFragSeq_d
     eContinue = 0x02
 }eFragSeq_d;
 
-volatile static host_lib_status_t optiga_comms_status;
+volatile static CMDLIB_THREAD_LOCAL host_lib_status_t optiga_comms_status;
 
-//lint --e{715, 818} suppress "This is ignored as app_event_handler_t handler function prototype requires this argument.This will be used for object based implementation"
+//lint --e{818} suppress "This is ignored as app_event_handler_t handler function prototype requires this argument"
 static void optiga_comms_event_handler(void* upper_layer_ctx, host_lib_status_t event)
 {
-    optiga_comms_status = event;
+    //upper_layer_ctx is the status of the waiting thread, the event may be reported on another thread
+    pal_os_completion_signal((volatile host_lib_status_t*)upper_layer_ctx, event);
 }
 
 /**
@@ -419,12 +427,14 @@ _STATIC_H int32_t CmdLib_GetDeviceError(void)
     int32_t i4Status  = (int32_t)CMD_DEV_ERROR;
     uint8_t rgbErrorCmd[] = {CMD_GETDATA,0x00,0x00,0x02,(uint8_t)(OID_ERROR>>8),(uint8_t)OID_ERROR};
     uint16_t wBufferLength = sizeof(rgbErrorCmd);
+    optiga_comms_t* p_comms = CMDLIB_COMMS();
 
     do
     {
-        p_optiga_comms->upper_layer_handler = optiga_comms_event_handler;
+        p_comms->upper_layer_handler = optiga_comms_event_handler;
+        p_comms->upper_layer_ctx = (void*)&optiga_comms_status;
         optiga_comms_status  = OPTIGA_COMMS_BUSY;
-        i4Status  =  optiga_comms_transceive(p_optiga_comms,rgbErrorCmd,&wBufferLength,
+        i4Status  =  optiga_comms_transceive(p_comms,rgbErrorCmd,&wBufferLength,
                                                  rgbErrorCmd,&wBufferLength);
         if(OPTIGA_COMMS_SUCCESS != i4Status)
         {
@@ -433,12 +443,7 @@ _STATIC_H int32_t CmdLib_GetDeviceError(void)
         }
 
         //wait for completion
-        while(optiga_comms_status == OPTIGA_COMMS_BUSY){
-#ifdef USE_CMDLIB_WITH_RTOS
-        	pal_os_timer_delay_in_milliseconds(1);
-#endif
-        };
-        if(optiga_comms_status != OPTIGA_COMMS_SUCCESS)
+        if(pal_os_completion_wait(&optiga_comms_status, OPTIGA_COMMS_BUSY) != OPTIGA_COMMS_SUCCESS)
         {
             i4Status = (int32_t)CMD_DEV_EXEC_ERROR;
             break;
@@ -466,9 +471,10 @@ _STATIC_H int32_t TransceiveAPDU(sApduData_d *PpsApduData,uint8_t bGetError)
     //lint --e{818} suppress "PpsResponse is out parameter"
     int32_t i4Status = (int32_t)CMD_LIB_ERROR;
     uint16_t wTotalLength;
+    optiga_comms_t* p_comms = CMDLIB_COMMS();
     do
     {
-        if(NULL == PpsApduData || NULL == p_optiga_comms)
+        if(NULL == PpsApduData || NULL == p_comms)
         { 
             i4Status = (int32_t)CMD_LIB_NULL_PARAM;
             break;
@@ -483,9 +489,10 @@ _STATIC_H int32_t TransceiveAPDU(sApduData_d *PpsApduData,uint8_t bGetError)
         //update total length to consider total header length
         wTotalLength = PpsApduData->wPayloadLength + LEN_APDUHEADER;
 
-        p_optiga_comms->upper_layer_handler = optiga_comms_event_handler;
+        p_comms->upper_layer_handler = optiga_comms_event_handler;
+        p_comms->upper_layer_ctx = (void*)&optiga_comms_status;
         optiga_comms_status  = OPTIGA_COMMS_BUSY;
-        i4Status  =  optiga_comms_transceive(p_optiga_comms,PpsApduData->prgbAPDUBuffer,&wTotalLength,
+        i4Status  =  optiga_comms_transceive(p_comms,PpsApduData->prgbAPDUBuffer,&wTotalLength,
                                                 PpsApduData->prgbRespBuffer,&PpsApduData->wResponseLength);
         if(OPTIGA_COMMS_SUCCESS != i4Status)
         {
@@ -493,14 +500,7 @@ _STATIC_H int32_t TransceiveAPDU(sApduData_d *PpsApduData,uint8_t bGetError)
             break;
         }
         //wait for completion
-        do
-        {
-#ifdef USE_CMDLIB_WITH_RTOS
-        	pal_os_timer_delay_in_milliseconds(1);
-#endif
-        }while(optiga_comms_status == OPTIGA_COMMS_BUSY);
-        
-        if(optiga_comms_status != OPTIGA_COMMS_SUCCESS)
+        if(pal_os_completion_wait(&optiga_comms_status, OPTIGA_COMMS_BUSY) != OPTIGA_COMMS_SUCCESS)
         {
             i4Status = (int32_t)CMD_DEV_EXEC_ERROR;
             break;
@@ -817,7 +817,27 @@ _STATIC_H int32_t Get_KeySize(eAlgId_d PeAlgoIden,uint8_t* pbKeySize )
 */
 void CmdLib_SetOptigaCommsContext(const optiga_comms_t *p_input_optiga_comms)
 {
-	p_optiga_comms = (optiga_comms_t*)p_input_optiga_comms;
+	if(NULL != p_optiga_comms_thread)
+	{
+		p_optiga_comms_thread = (optiga_comms_t*)p_input_optiga_comms;
+	}
+	else
+	{
+		p_optiga_comms = (optiga_comms_t*)p_input_optiga_comms;
+	}
+}
+
+/**
+* Binds the calling thread to an OPTIGA comms context of its own. The command library APIs invoked
+* by this thread then use this context instead of the one set by #CmdLib_SetOptigaCommsContext.
+* Requires CMDLIB_THREAD_LOCAL to be defined as thread local storage class if several threads bind.
+* 
+* <br>
+* \param[in] p_input_optiga_comms Pointer to OPTIGA comms context, NULL to return to the shared context
+*/
+void CmdLib_SetThreadOptigaCommsContext(const optiga_comms_t *p_input_optiga_comms)
+{
+	p_optiga_comms_thread = (optiga_comms_t*)p_input_optiga_comms;
 }
 
 /**
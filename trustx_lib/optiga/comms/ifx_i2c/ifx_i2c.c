@@ -74,6 +74,11 @@ void ifx_i2c_tl_event_handler(ifx_i2c_context_t* p_ctx,host_lib_status_t event,
 /// Performs initialization
 static host_lib_status_t ifx_i2c_init(ifx_i2c_context_t* ifx_i2c_context);
 
+#if IFX_I2C_PERF
+/// Accounts the completed transceive in the performance statistics
+static void ifx_i2c_perf_transceive_done(ifx_i2c_context_t* p_ctx, host_lib_status_t event);
+#endif
+
 //lint --e{526} suppress "This API is defined in ifx_i2c_physical_layer. Since it is a low level API, 
 //to avoid exposing, header file is not included "
 extern host_lib_status_t ifx_i2c_pl_write_slave_address(ifx_i2c_context_t *p_ctx, uint8_t slave_address, uint8_t storage_type);
@@ -103,18 +108,22 @@ extern host_lib_status_t ifx_i2c_pl_write_slave_address(ifx_i2c_context_t *p_ctx
  *   - <b>slave address</b> : Address of I2C slave
  *   - <b>frame_size</b> : Frame size in bytes.Minimum supported value is 16 bytes.<br> 
  *              - It is recommended not to use a value greater than the slave's frame size.
- *              - The user specified frame size is written to I2C slave's frame size register.
+ *              - The user specified frame size, limited to #DL_MAX_FRAME_SIZE, is written to I2C slave's frame size register.
  *                The frame size register is read back from I2C slave.
  *                This frame value is used by the ifx-i2c protocol even if it is not equal to the user specified value.
+ *              - The user specified value is kept, a later initialization negotiates the frame size again.
  *
  *   - <b>frequency</b> : Frequency/speed of I2C master in KHz.
  *              - This must be lowest of the maximum frequency supported by the devices (master/slave) connected on the bus.
  *              - Initial negotiation starts with a frequency of 100KHz.
  *              - If the user specified frequency is more than 400 KHz, the I2C slave is configured to operate in "Fm+" mode, 
  *                otherwise the I2C slave is configured for "SM & Fm" mode. <br>
+ *              - The frequency is limited to the maximum reported by #pal_i2c_get_max_bitrate and by the slave's
+ *                MAX_SCL_FREQU register. The result is stored in the negotiated_frequency of the physical layer.<br>
  *              - If the user specified frequency frequency negotiation fails, the I2C master frequency remains at 100KHz<br>
  * 
  *   - <b>upper_layer_event_handler</b> : Upper layer event handler.This is invoked when #ifx_i2c_open() is asynchronously completed.
+ *     With #IFX_I2C_SYNC_MODE it is invoked on the calling thread before #ifx_i2c_open() returns.
  *   - <b>upper_layer_ctx</b> : Context of upper layer.
  *   - <b>p_slave_vdd_pin</b> : GPIO pin for VDD. If not set, cold reset is not done. 
  *   - <b>p_slave_reset_pin</b> : GPIO pin for Reset. If not set, warm reset is not done.
@@ -147,11 +156,18 @@ host_lib_status_t ifx_i2c_open(ifx_i2c_context_t *p_ctx)
         p_ctx->do_pal_init = TRUE;
         p_ctx->state = IFX_I2C_STATE_UNINIT;
 
+#if IFX_I2C_SYNC_MODE == 1
+        pal_os_event_inline_begin();
+#endif
         api_status = ifx_i2c_init(p_ctx);
         if(IFX_I2C_STACK_SUCCESS == api_status)
         {
             p_ctx->status = IFX_I2C_STATUS_BUSY;
         }
+#if IFX_I2C_SYNC_MODE == 1
+        // Drive the reset sequence and the negotiation until the upper layer is notified
+        pal_os_event_inline_end();
+#endif
     }
 
     return api_status;
@@ -197,11 +213,17 @@ host_lib_status_t ifx_i2c_reset(ifx_i2c_context_t *p_ctx, ifx_i2c_reset_type_t r
         p_ctx->reset_state = IFX_I2C_STATE_RESET_PIN_LOW;
         p_ctx->do_pal_init = FALSE;
 
+#if IFX_I2C_SYNC_MODE == 1
+        pal_os_event_inline_begin();
+#endif
         api_status = ifx_i2c_init(p_ctx);
         if(IFX_I2C_STACK_SUCCESS == api_status)
         {
             p_ctx->status = IFX_I2C_STATUS_BUSY;
         }
+#if IFX_I2C_SYNC_MODE == 1
+        pal_os_event_inline_end();
+#endif
     }
     return api_status;
 }
@@ -226,6 +248,7 @@ host_lib_status_t ifx_i2c_reset(ifx_i2c_context_t *p_ctx, ifx_i2c_reset_type_t r
  * - The following parameters in #ifx_i2c_context_t must be initialized with appropriate values <br>
  *   - <b>upper_layer_event_handler</b> : Upper layer event handler, if it is different from that in #ifx_i2c_open().
  *     This is invoked when #ifx_i2c_transceive is asynchronously completed.
+ *     With #IFX_I2C_SYNC_MODE it is invoked on the calling thread before #ifx_i2c_transceive returns.
  *   - <b>upper_layer_ctx</b> : Context of upper layer, if it is different from that in #ifx_i2c_open.
  *
  *<b>Notes:</b>
@@ -252,12 +275,35 @@ host_lib_status_t ifx_i2c_transceive(ifx_i2c_context_t *p_ctx,const uint8_t* p_d
     { 
         p_ctx->p_upper_layer_rx_buffer = p_rx_buffer;
         p_ctx->p_upper_layer_rx_buffer_len = p_rx_buffer_len;
+#if PL_ADAPTIVE_POLLING == 1
+        // The physical layer learns the execution time per command code
+        p_ctx->pl.apdu_cmd = (0 != (*p_data_length)) ? p_data[0] : 0;
+#endif
+#if IFX_I2C_PERF
+        p_ctx->perf.apdu_cmd = (0 != (*p_data_length)) ? p_data[0] : 0;
+        p_ctx->perf.start_time_us = pal_os_timer_get_time_in_microseconds();
+        p_ctx->perf.transceive_active = TRUE;
+#endif
+#if IFX_I2C_SYNC_MODE == 1
+        pal_os_event_inline_begin();
+#endif
         api_status = ifx_i2c_tl_transceive(p_ctx,(uint8_t*)p_data, (*p_data_length),
                                            (uint8_t*)p_rx_buffer , p_rx_buffer_len);
         if (IFX_I2C_STACK_SUCCESS == api_status)
         {
             p_ctx->status = IFX_I2C_STATUS_BUSY;
         }
+#if IFX_I2C_PERF
+        else
+        {
+            // Not started, no completion will be reported
+            p_ctx->perf.transceive_active = FALSE;
+        }
+#endif
+#if IFX_I2C_SYNC_MODE == 1
+        // Poll the slave and receive the response on this thread, the upper layer is notified before returning
+        pal_os_event_inline_end();
+#endif
     }
     return api_status;
 }
@@ -351,10 +397,161 @@ host_lib_status_t ifx_i2c_set_slave_address(ifx_i2c_context_t *p_ctx, uint8_t sl
     return api_status;
 }
 
+/**
+* Reads the execution time learned by the adaptive status poller for an APDU command.<br>
+*
+*<b>Pre Conditions:</b>
+* - None<br>
+*
+*<b>API Details:</b>
+*  - The physical layer measures the time from writing the last command frame until the response is ready.<br>
+*  - Only commands which kept the slave busy for at least one status poll are learned.<br>
+*
+* \param[in]     p_ctx              Pointer to #ifx_i2c_context_t
+* \param[in]     apdu_cmd           APDU command code
+* \param[out]    p_exec_time        Pointer to #ifx_i2c_pl_exec_time_t to copy the learned model into
+*
+* \retval  #IFX_I2C_STACK_SUCCESS
+* \retval  #IFX_I2C_STACK_ERROR, if adaptive polling is disabled
+*/
+host_lib_status_t ifx_i2c_get_exec_time(const ifx_i2c_context_t *p_ctx, uint8_t apdu_cmd, ifx_i2c_pl_exec_time_t* p_exec_time)
+{
+    host_lib_status_t api_status = (int32_t)IFX_I2C_STACK_ERROR;
+#if PL_ADAPTIVE_POLLING == 1
+    if ((NULL != p_ctx) && (NULL != p_exec_time))
+    {
+        *p_exec_time = p_ctx->pl.exec_time[apdu_cmd];
+        api_status = IFX_I2C_STACK_SUCCESS;
+    }
+#endif
+    return api_status;
+}
+
+/**
+* Clears the execution times learned by the adaptive status poller.<br>
+*
+* \param[in,out] p_ctx              Pointer to #ifx_i2c_context_t
+*
+* \retval  #IFX_I2C_STACK_SUCCESS
+* \retval  #IFX_I2C_STACK_ERROR, if adaptive polling is disabled
+*/
+host_lib_status_t ifx_i2c_reset_exec_time(ifx_i2c_context_t *p_ctx)
+{
+    host_lib_status_t api_status = (int32_t)IFX_I2C_STACK_ERROR;
+#if PL_ADAPTIVE_POLLING == 1
+    if (NULL != p_ctx)
+    {
+        memset(p_ctx->pl.exec_time, 0, sizeof(p_ctx->pl.exec_time));
+        api_status = IFX_I2C_STACK_SUCCESS;
+    }
+#endif
+    return api_status;
+}
+
+/**
+* Takes a snapshot of the performance counters and latency histograms.<br>
+*
+*<b>Pre Conditions:</b>
+* - None<br>
+*
+*<b>API Details:</b>
+*  - The counters are updated by the protocol stack without locking. The snapshot is only guaranteed
+*    to be consistent if no transceive is ongoing.<br>
+*  - The latency of a command is measured from #ifx_i2c_transceive until the response is reported to the upper layer.<br>
+*
+* \param[in]     p_ctx              Pointer to #ifx_i2c_context_t
+* \param[out]    p_perf             Pointer to #ifx_i2c_perf_t to copy the statistics into
+*
+* \retval  #IFX_I2C_STACK_SUCCESS
+* \retval  #IFX_I2C_STACK_ERROR, if the statistics are disabled
+*/
+host_lib_status_t ifx_i2c_get_perf(const ifx_i2c_context_t *p_ctx, ifx_i2c_perf_t* p_perf)
+{
+    host_lib_status_t api_status = (int32_t)IFX_I2C_STACK_ERROR;
+#if IFX_I2C_PERF
+    if ((NULL != p_ctx) && (NULL != p_perf))
+    {
+        *p_perf = p_ctx->perf;
+        api_status = IFX_I2C_STACK_SUCCESS;
+    }
+#endif
+    return api_status;
+}
+
+/**
+* Clears the performance counters and latency histograms.<br>
+*
+* \param[in,out] p_ctx              Pointer to #ifx_i2c_context_t
+*
+* \retval  #IFX_I2C_STACK_SUCCESS
+* \retval  #IFX_I2C_STACK_ERROR, if the statistics are disabled
+*/
+host_lib_status_t ifx_i2c_reset_perf(ifx_i2c_context_t *p_ctx)
+{
+    host_lib_status_t api_status = (int32_t)IFX_I2C_STACK_ERROR;
+#if IFX_I2C_PERF_COUNTERS == 1
+    if (NULL != p_ctx)
+    {
+        memset(&p_ctx->perf.counters, 0, sizeof(p_ctx->perf.counters));
+        api_status = IFX_I2C_STACK_SUCCESS;
+    }
+#endif
+#if IFX_I2C_PERF_LATENCY == 1
+    if (NULL != p_ctx)
+    {
+        // The ongoing transceive, if any, is still recorded
+        memset(p_ctx->perf.latency, 0, sizeof(p_ctx->perf.latency));
+        api_status = IFX_I2C_STACK_SUCCESS;
+    }
+#endif
+    return api_status;
+}
+
 /// @cond hidden
+#if IFX_I2C_PERF
+static void ifx_i2c_perf_transceive_done(ifx_i2c_context_t* p_ctx, host_lib_status_t event)
+{
+#if IFX_I2C_PERF_LATENCY == 1
+    ifx_i2c_perf_latency_t* p_latency = &p_ctx->perf.latency[p_ctx->perf.apdu_cmd];
+    uint32_t latency_us = pal_os_timer_get_time_in_microseconds() - p_ctx->perf.start_time_us;
+    uint32_t range = latency_us >> IFX_I2C_PERF_LATENCY_MIN_SHIFT;
+    uint8_t bucket = 0;
+#endif
+
+    p_ctx->perf.transceive_active = FALSE;
+    IFX_I2C_PERF_COUNT(p_ctx, transceives, 1);
+    if (IFX_I2C_STACK_SUCCESS != event)
+    {
+        IFX_I2C_PERF_COUNT(p_ctx, transceive_errors, 1);
+    }
+
+#if IFX_I2C_PERF_LATENCY == 1
+    // Logarithmic buckets, the last one is open ended
+    while ((0 != range) && (bucket < (IFX_I2C_PERF_LATENCY_BUCKETS - 1)))
+    {
+        range >>= 1;
+        bucket++;
+    }
+    p_latency->bucket[bucket]++;
+    p_latency->count++;
+    if (latency_us > p_latency->max_us)
+    {
+        p_latency->max_us = latency_us;
+    }
+#endif
+}
+#endif
+
 //lint --e{715} suppress "This is ignored as ifx_i2c_event_handler_t handler function prototype requires this argument"
 void ifx_i2c_tl_event_handler(ifx_i2c_context_t* p_ctx,host_lib_status_t event, const uint8_t* p_data, uint16_t data_len)
 {
+#if IFX_I2C_PERF
+    // Account before the upper layer is notified, it may start the next transceive
+    if (p_ctx->perf.transceive_active)
+    {
+        ifx_i2c_perf_transceive_done(p_ctx, event);
+    }
+#endif
     // If there is no upper layer handler, don't do anything and return
     if (NULL != p_ctx->upper_layer_event_handler)
     {
@@ -57,12 +57,8 @@ ifx_i2c_context_t ifx_i2c_context_0 =
     0x30,
     /// i2c-master frequency
     400,
-    /// IFX-I2C frame size
-#if (DL_MAX_FRAME_SIZE >= 0x0115)
-    0x0115,
-#else
-	DL_MAX_FRAME_SIZE,
-#endif
+    /// IFX-I2C frame size, the largest the frame buffers hold. The slave reduces it to its own maximum during negotiation
+    DL_MAX_FRAME_SIZE,
     /// Vdd pin
     &optiga_vdd_0,
     /// Reset pin
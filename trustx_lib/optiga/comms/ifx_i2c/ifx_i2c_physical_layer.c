@@ -66,6 +66,9 @@
 #define PL_ACTION_WRITE_REGISTER        (0x02)
 #define PL_I2C_CMD_WRITE                (0x01)
 #define PL_I2C_CMD_READ                 (0x02)
+#define PL_I2C_CMD_WRITE_READ           (0x03)
+#define PL_I2C_CMD_READ_REGISTERS       (0x04)
+#define PL_STATUS_REG_COUNT             (2)
 
 // Physical Layer high level interface constants
 #define PL_ACTION_WRITE_FRAME           (0x01)
@@ -106,6 +109,13 @@
 // Physical Layer Base Address Register mask
 #define PL_REG_I2C_BASE_ADDRESS_MASK     (0x7F)
 
+// Written frame inspection of the adaptive poller, DL frame control byte and TL PCTR behind the DL header
+#define PL_DL_FCTR_CONTROL_FRAME         (0x80)
+#define PL_TL_PCTR_OFFSET                (3)
+#define PL_TL_PCTR_CHAIN_MASK            (0x07)
+#define PL_TL_CHAINING_NO                (0x00)
+#define PL_TL_CHAINING_LAST              (0x04)
+
 // Setup debug log statements
 #if IFX_I2C_LOG_PL == 1
 #include "common/Log_api.h"
@@ -150,6 +160,10 @@ static void ifx_i2c_pl_guard_time_callback(void *p_ctx);
 static void ifx_i2c_pl_pal_event_handler(void *p_ctx, host_lib_status_t event);
 /// Physical layer low level event handler for set slave address
 static void ifx_i2c_pl_pal_slave_addr_event_handler(void *p_input_ctx, host_lib_status_t event);
+/// Physical Layer adaptive poller (delay until the next status register poll)
+static uint32_t ifx_i2c_pl_next_poll_interval(ifx_i2c_context_t *p_ctx);
+/// Physical Layer adaptive poller (learn the execution time of the ongoing command)
+static void ifx_i2c_pl_learn_exec_time(ifx_i2c_context_t *p_ctx);
   
 /// @endcond
 /***********************************************************************************************************************
@@ -163,6 +177,7 @@ host_lib_status_t ifx_i2c_pl_init(ifx_i2c_context_t *p_ctx,ifx_i2c_event_handler
     p_ctx->pl.upper_layer_event_handler = handler;
     p_ctx->pl.frame_state = PL_STATE_UNINIT;
     p_ctx->pl.negotiate_state = PL_INIT_SET_FREQ_DEFAULT;
+    p_ctx->pl.negotiated_frame_size = 0;
     p_ctx->p_pal_i2c_ctx->slave_address = p_ctx->slave_address;
     p_ctx->p_pal_i2c_ctx->upper_layer_event_handler = ifx_i2c_pl_pal_event_handler;
     p_ctx->pl.retry_counter = PL_POLLING_MAX_CNT;
@@ -293,9 +308,32 @@ host_lib_status_t ifx_i2c_pl_write_slave_address(ifx_i2c_context_t *p_ctx, uint8
     return status;
 }
 
+// Starts the register read prepared in the buffer, in one combined transfer if the PAL can do it
+static void ifx_i2c_pl_start_read_register(ifx_i2c_context_t *p_ctx)
+{
+#if PL_COMBINED_REG_READ == 1
+    // Register address and register content are transferred without guard time in between
+    p_ctx->pl.i2c_cmd = PL_I2C_CMD_WRITE_READ;
+    if (PAL_STATUS_FAILURE != pal_i2c_write_read(p_ctx->p_pal_i2c_ctx, p_ctx->pl.buffer, p_ctx->pl.buffer_tx_len,
+                                                 p_ctx->pl.buffer, p_ctx->pl.buffer_rx_len))
+    {
+        return;
+    }
+    // No combined transfer on this PAL, write the address, wait the guard time and read
+#endif
+    p_ctx->pl.i2c_cmd = PL_I2C_CMD_WRITE;
+
+    //lint --e{534} suppress "Return value is not required to be checked"
+    pal_i2c_write(p_ctx->p_pal_i2c_ctx,p_ctx->pl.buffer, p_ctx->pl.buffer_tx_len);
+}
+
 static void ifx_i2c_pl_read_register(ifx_i2c_context_t *p_ctx,uint8_t reg_addr, uint16_t reg_len)
 {
     LOG_PL("[IFX-PL]: Read register %x len %d\n", reg_addr, reg_len);
+    if (PL_REG_I2C_STATE == reg_addr)
+    {
+        IFX_I2C_PERF_COUNT(p_ctx, pl_status_polls, 1);
+    }
 
     // Prepare transmit buffer to write register address
     p_ctx->pl.buffer[0]     = reg_addr;
@@ -305,11 +343,47 @@ static void ifx_i2c_pl_read_register(ifx_i2c_context_t *p_ctx,uint8_t reg_addr,
     p_ctx->pl.buffer_rx_len   = reg_len;
     p_ctx->pl.register_action = PL_ACTION_READ_REGISTER;
     p_ctx->pl.retry_counter   = PL_POLLING_MAX_CNT;
-    p_ctx->pl.i2c_cmd         = PL_I2C_CMD_WRITE;
+    ifx_i2c_pl_start_read_register(p_ctx);
+}
 
-    //lint --e{534} suppress "Return value is not required to be checked"
-    pal_i2c_write(p_ctx->p_pal_i2c_ctx,p_ctx->pl.buffer, p_ctx->pl.buffer_tx_len);
+#if PL_COMBINED_REG_READ == 1
+// Starts the batched STATE and DATA_REG_LEN read, or reads the STATE register alone if the PAL cannot batch
+static void ifx_i2c_pl_start_read_status_registers(ifx_i2c_context_t *p_ctx)
+{
+    p_ctx->pl.i2c_cmd = PL_I2C_CMD_READ_REGISTERS;
+    if (PAL_STATUS_FAILURE != pal_i2c_read_registers(p_ctx->p_pal_i2c_ctx, p_ctx->pl.status_regs, PL_STATUS_REG_COUNT))
+    {
+        return;
+    }
+    // No batched transfer on this PAL, the frame size is then only checked against the negotiated one
+    p_ctx->pl.buffer[0]     = PL_REG_I2C_STATE;
+    p_ctx->pl.buffer_tx_len = 1;
+    p_ctx->pl.buffer_rx_len = PL_REG_LEN_I2C_STATE;
+    ifx_i2c_pl_start_read_register(p_ctx);
+}
+
+// Reads the STATE register with the read length of the response and the slave's DATA_REG_LEN in one transfer
+static void ifx_i2c_pl_read_status_registers(ifx_i2c_context_t *p_ctx)
+{
+    LOG_PL("[IFX-PL]: Read registers %x and %x\n", PL_REG_I2C_STATE, PL_REG_DATA_REG_LEN);
+    IFX_I2C_PERF_COUNT(p_ctx, pl_status_polls, 1);
+
+    // Register contents are stored one after another in the buffer
+    p_ctx->pl.status_regs[0].reg_addr = PL_REG_I2C_STATE;
+    p_ctx->pl.status_regs[0].p_data   = p_ctx->pl.buffer;
+    p_ctx->pl.status_regs[0].length   = PL_REG_LEN_I2C_STATE;
+    p_ctx->pl.status_regs[1].reg_addr = PL_REG_DATA_REG_LEN;
+    p_ctx->pl.status_regs[1].p_data   = p_ctx->pl.buffer + PL_REG_LEN_I2C_STATE;
+    p_ctx->pl.status_regs[1].length   = PL_REG_LEN_DATA_REG_LEN;
+
+    // One register address byte is written per register
+    p_ctx->pl.buffer_tx_len   = PL_STATUS_REG_COUNT;
+    p_ctx->pl.buffer_rx_len   = PL_REG_LEN_I2C_STATE + PL_REG_LEN_DATA_REG_LEN;
+    p_ctx->pl.register_action = PL_ACTION_READ_REGISTER;
+    p_ctx->pl.retry_counter   = PL_POLLING_MAX_CNT;
+    ifx_i2c_pl_start_read_status_registers(p_ctx);
 }
+#endif
 
 
 static void ifx_i2c_pl_write_register(ifx_i2c_context_t *p_ctx,uint8_t reg_addr, uint16_t reg_len, const uint8_t* p_content)
@@ -374,9 +448,10 @@ static void ifx_i2c_pl_negotiation_event_handler(void *p_input_ctx)
     uint8_t continue_negotiation;
     ifx_i2c_context_t* p_ctx = (ifx_i2c_context_t*)p_input_ctx;
 	uint8_t i2c_mode_value[2];
-    uint8_t max_frame_size[2] = { (uint8_t)(p_ctx->frame_size >> 8), (uint8_t)(p_ctx->frame_size) };
+    uint8_t max_frame_size[2];
     uint16_t buffer_len = 0;
     uint16_t slave_frequency;
+    uint16_t master_frequency;
 	uint16_t slave_frame_len;
     uint8_t* p_buffer = NULL;
     
@@ -394,6 +469,18 @@ static void ifx_i2c_pl_negotiation_event_handler(void *p_input_ctx)
 	
                 if(IFX_I2C_STACK_SUCCESS == event)
                 {
+                    // Never ask the slave for more than the I2C master is able to drive
+                    p_ctx->pl.negotiated_frequency = p_ctx->frequency;
+                    if (PAL_STATUS_SUCCESS != pal_i2c_get_max_bitrate(p_ctx->p_pal_i2c_ctx, &master_frequency))
+                    {
+                        // Unknown master capability, stay at the default frequency the master runs at now
+                        master_frequency = PL_DEFAULT_FREQUENCY;
+                    }
+                    if (master_frequency < p_ctx->pl.negotiated_frequency)
+                    {
+                        LOG_PL("[IFX-PL]: I2C master limited to %d KHz\n", master_frequency);
+                        p_ctx->pl.negotiated_frequency = master_frequency;
+                    }
                     p_ctx->pl.negotiate_state = PL_INIT_GET_FREQ_REG;
                     continue_negotiation = TRUE;
                 }
@@ -418,14 +505,14 @@ static void ifx_i2c_pl_negotiation_event_handler(void *p_input_ctx)
                 slave_frequency = (p_ctx->pl.buffer[2] << 8) | p_ctx->pl.buffer[3];
                 
                 i2c_mode_value[0] = PL_REG_I2C_MODE_PERSISTANT;
-                if((p_ctx->frequency > PL_SM_FM_MAX_FREQUENCY)&&(slave_frequency<=PL_SM_FM_MAX_FREQUENCY))
+                if((p_ctx->pl.negotiated_frequency > PL_SM_FM_MAX_FREQUENCY)&&(slave_frequency<=PL_SM_FM_MAX_FREQUENCY))
                 {
                     //Change to FM+ mode if slave's current supported frequency is below user's requested frequency
                     i2c_mode_value[1] = PL_REG_I2C_MODE_FM_PLUS;
                     p_ctx->pl.negotiate_state = PL_INIT_READ_FREQ;
                     ifx_i2c_pl_write_register(p_ctx,PL_REG_I2C_MODE, PL_REG_LEN_I2C_MODE, i2c_mode_value);
                 }
-                else if((p_ctx->frequency <= PL_SM_FM_MAX_FREQUENCY)&&(slave_frequency>PL_SM_FM_MAX_FREQUENCY))
+                else if((p_ctx->pl.negotiated_frequency <= PL_SM_FM_MAX_FREQUENCY)&&(slave_frequency>PL_SM_FM_MAX_FREQUENCY))
                 {
                     //Change to SM&FM mode if slave's current supported frequency is above user's requested frequency
                     i2c_mode_value[1] = PL_REG_I2C_MODE_SM_FM;
@@ -450,7 +537,14 @@ static void ifx_i2c_pl_negotiation_event_handler(void *p_input_ctx)
             case PL_INIT_VERIFY_FREQ:
             {
                 slave_frequency = (p_ctx->pl.buffer[2] << 8) | p_ctx->pl.buffer[3];
-                if(p_ctx->frequency > slave_frequency)
+                if((p_ctx->pl.negotiated_frequency > slave_frequency) && (slave_frequency >= PL_DEFAULT_FREQUENCY))
+                {
+                    // Slave did not accept the requested mode, continue with the frequency it reports
+                    LOG_PL("[IFX-PL]: Slave limited to %d KHz\n", slave_frequency);
+                    p_ctx->pl.negotiated_frequency = slave_frequency;
+                    p_ctx->pl.negotiate_state = PL_INIT_AGREE_FREQ;
+                }
+                else if(p_ctx->pl.negotiated_frequency > slave_frequency)
                 {
                     LOG_PL("[IFX-PL]: Unexpected frequency in MAX_SCL_FREQU\n");
                     p_buffer = NULL;
@@ -468,12 +562,20 @@ static void ifx_i2c_pl_negotiation_event_handler(void *p_input_ctx)
             case PL_INIT_AGREE_FREQ:
             {
                 // Frequency negotiation between master and slave is complete
-                event = ifx_i2c_pl_set_bit_rate(p_input_ctx, p_ctx->frequency);
+                event = ifx_i2c_pl_set_bit_rate(p_input_ctx, p_ctx->pl.negotiated_frequency);
                 if(IFX_I2C_STACK_SUCCESS == event)
                 {
                     p_ctx->pl.negotiate_state = PL_INIT_SET_DATA_REG_LEN;
                     continue_negotiation = TRUE;
                 }
+                else if ((IFX_I2C_STACK_ERROR == event) && (PL_DEFAULT_FREQUENCY != p_ctx->pl.negotiated_frequency))
+                {
+                    // Fall back to the default frequency, which is supported by every slave
+                    LOG_PL("[IFX-PL]: Set bit rate failed, fall back to %d KHz\n", PL_DEFAULT_FREQUENCY);
+                    p_ctx->pl.negotiated_frequency = PL_DEFAULT_FREQUENCY;
+                    p_ctx->pl.retry_counter = PL_POLLING_MAX_CNT;
+                    continue_negotiation = TRUE;
+                }
                 else if (IFX_I2C_STACK_ERROR == event)
                 {
                     p_ctx->pl.negotiate_state = PL_INIT_DONE;
@@ -485,6 +587,14 @@ static void ifx_i2c_pl_negotiation_event_handler(void *p_input_ctx)
             // Start frame length negotiation by writing the requested frame length
             case PL_INIT_SET_DATA_REG_LEN:
             {
+                // Never ask the slave for frames larger than the frame buffers
+                p_ctx->pl.negotiated_frame_size = p_ctx->frame_size;
+                if (DL_MAX_FRAME_SIZE < p_ctx->pl.negotiated_frame_size)
+                {
+                    p_ctx->pl.negotiated_frame_size = DL_MAX_FRAME_SIZE;
+                }
+                max_frame_size[0] = (uint8_t)(p_ctx->pl.negotiated_frame_size >> 8);
+                max_frame_size[1] = (uint8_t)(p_ctx->pl.negotiated_frame_size);
                 p_ctx->pl.negotiate_state = PL_INIT_GET_DATA_REG_LEN;
                 ifx_i2c_pl_write_register(p_ctx,PL_REG_DATA_REG_LEN, sizeof(max_frame_size), max_frame_size);
             }
@@ -501,10 +611,12 @@ static void ifx_i2c_pl_negotiation_event_handler(void *p_input_ctx)
             {
 				p_ctx->pl.negotiate_state = PL_INIT_DONE;
 				slave_frame_len = (p_ctx->pl.buffer[0] << 8) | p_ctx->pl.buffer[1]; 
-                // Error if slave's frame length is more than requested frame length
-				if(p_ctx->frame_size >= slave_frame_len)
+                // Slave may reduce the frame length to its maximum.
+                // Error if slave's frame length is more than requested frame length or too small to carry a packet
+				if((p_ctx->pl.negotiated_frame_size >= slave_frame_len) && (DL_MIN_FRAME_SIZE <= slave_frame_len))
 				{
-					p_ctx->frame_size = slave_frame_len;
+					LOG_PL("[IFX-PL]: Frame size negotiated to %d bytes\n", slave_frame_len);
+					p_ctx->pl.negotiated_frame_size = slave_frame_len;
 					event = IFX_I2C_STACK_SUCCESS;
 				}
                 p_buffer = NULL;
@@ -536,6 +648,10 @@ static void ifx_i2c_pl_negotiation_event_handler(void *p_input_ctx)
 static void ifx_i2c_pl_frame_event_handler(ifx_i2c_context_t *p_ctx,host_lib_status_t event)
 {
     uint16_t frame_size;
+    uint16_t max_frame_size;
+#if PL_COMBINED_REG_READ == 1
+    uint16_t slave_frame_len;
+#endif
     if (event != IFX_I2C_STACK_SUCCESS)
     {
         p_ctx->pl.frame_state = PL_STATE_READY;
@@ -563,6 +679,14 @@ static void ifx_i2c_pl_frame_event_handler(ifx_i2c_context_t *p_ctx,host_lib_sta
             {
                 // Start polling status register
                 p_ctx->pl.frame_state			= PL_STATE_DATA_AVAILABLE;
+#if PL_COMBINED_REG_READ == 1
+                // The first status read of a response also fetches the slave's frame size
+                if (p_ctx->pl.frame_action == PL_ACTION_READ_FRAME)
+                {
+                    ifx_i2c_pl_read_status_registers(p_ctx);
+                    break;
+                }
+#endif
                 ifx_i2c_pl_read_register(p_ctx,PL_REG_I2C_STATE, PL_REG_LEN_I2C_STATE);
             }
             break;
@@ -574,8 +698,23 @@ static void ifx_i2c_pl_frame_event_handler(ifx_i2c_context_t *p_ctx,host_lib_sta
                 && (p_ctx->pl.buffer[0] & PL_REG_I2C_STATE_RESPONSE_READY))
                 {
                     frame_size = (p_ctx->pl.buffer[2] << 8) | p_ctx->pl.buffer[3];
-                    if ((frame_size > 0) && (frame_size <= p_ctx->frame_size))
+                    max_frame_size = p_ctx->pl.negotiated_frame_size;
+#if PL_COMBINED_REG_READ == 1
+                    if (p_ctx->pl.i2c_cmd == PL_I2C_CMD_READ_REGISTERS)
+                    {
+                        // DATA_REG_LEN falls back to its default, if the slave was reset since the negotiation
+                        slave_frame_len = (p_ctx->pl.buffer[PL_REG_LEN_I2C_STATE] << 8) |
+                                          p_ctx->pl.buffer[PL_REG_LEN_I2C_STATE + 1];
+                        if (slave_frame_len < max_frame_size)
+                        {
+                            LOG_PL("[IFX-PL]: Slave frame size dropped to %d bytes\n", slave_frame_len);
+                            max_frame_size = slave_frame_len;
+                        }
+                    }
+#endif
+                    if ((frame_size > 0) && (frame_size <= max_frame_size))
                     {
+                        ifx_i2c_pl_learn_exec_time(p_ctx);
                         p_ctx->pl.frame_state = PL_STATE_RXTX;
                         ifx_i2c_pl_read_register(p_ctx,PL_REG_DATA, frame_size);
                     }
@@ -584,7 +723,8 @@ static void ifx_i2c_pl_frame_event_handler(ifx_i2c_context_t *p_ctx,host_lib_sta
                         // Continue polling STATUS register if retry limit is not reached
                         if ((pal_os_timer_get_time_in_milliseconds() - p_ctx->dl.frame_start_time) < p_ctx->dl.data_poll_timeout)
                         {
-                            pal_os_event_register_callback_oneshot(ifx_i2c_pl_status_poll_callback, (void *)p_ctx, PL_DATA_POLLING_INVERVAL_US);
+                            pal_os_event_register_callback_oneshot(ifx_i2c_pl_status_poll_callback, (void *)p_ctx,
+                                                                   ifx_i2c_pl_next_poll_interval(p_ctx));
                         }
                         else
                         {
@@ -606,7 +746,8 @@ static void ifx_i2c_pl_frame_event_handler(ifx_i2c_context_t *p_ctx,host_lib_sta
                     // Continue polling STATUS register if retry limit is not reached
                     if ((pal_os_timer_get_time_in_milliseconds() - p_ctx->dl.frame_start_time) < p_ctx->dl.data_poll_timeout)
                     {
-                        pal_os_event_register_callback_oneshot(ifx_i2c_pl_status_poll_callback, (void *)p_ctx, PL_DATA_POLLING_INVERVAL_US);
+                        pal_os_event_register_callback_oneshot(ifx_i2c_pl_status_poll_callback, (void *)p_ctx,
+                                                               ifx_i2c_pl_next_poll_interval(p_ctx));
                     }
                     else
                     {
@@ -621,6 +762,30 @@ static void ifx_i2c_pl_frame_event_handler(ifx_i2c_context_t *p_ctx,host_lib_sta
             {
                 // Writing/reading of frame to/from DATA register complete
                 p_ctx->pl.frame_state = PL_STATE_READY;
+#if PL_ADAPTIVE_POLLING == 1
+                if (p_ctx->pl.frame_action == PL_ACTION_WRITE_FRAME)
+                {
+                    p_ctx->pl.poll_interval_us = PL_ADAPTIVE_POLL_MIN_US;
+                    p_ctx->pl.busy_polls       = 0;
+                    // The slave starts executing once the data frame with the complete command is written,
+                    // acknowledges and intermediate fragments do not start an execution
+                    p_ctx->pl.exec_time_pending = 0;
+                    if ((p_ctx->pl.tx_frame_len > PL_TL_PCTR_OFFSET) &&
+                        (0 == (p_ctx->pl.p_tx_frame[0] & PL_DL_FCTR_CONTROL_FRAME)))
+                    {
+                        switch (p_ctx->pl.p_tx_frame[PL_TL_PCTR_OFFSET] & PL_TL_PCTR_CHAIN_MASK)
+                        {
+                            case PL_TL_CHAINING_NO:
+                            case PL_TL_CHAINING_LAST:
+                                p_ctx->pl.tx_done_time_us   = pal_os_timer_get_time_in_microseconds();
+                                p_ctx->pl.exec_time_pending = 1;
+                                break;
+                            default:
+                                break;
+                        }
+                    }
+                }
+#endif
                 p_ctx->pl.upper_layer_event_handler(p_ctx,IFX_I2C_STACK_SUCCESS, p_ctx->pl.buffer, p_ctx->pl.buffer_rx_len);
             }
             break;
@@ -645,6 +810,19 @@ static void ifx_i2c_pal_poll_callback(void *p_ctx)
         //lint --e{534} suppress "Return value is not required to be checked"
         pal_i2c_read(p_local_ctx->p_pal_i2c_ctx,p_local_ctx->pl.buffer, p_local_ctx->pl.buffer_rx_len);
     }
+#if PL_COMBINED_REG_READ == 1
+    else if (p_local_ctx->pl.i2c_cmd == PL_I2C_CMD_WRITE_READ)
+    {
+        LOG_PL("[IFX-PL]: Poll Timer elapsed  -> Restart combined Read Register\n");
+        // The register address is still in the buffer, since a failed transfer does not return data
+        ifx_i2c_pl_start_read_register(p_local_ctx);
+    }
+    else if (p_local_ctx->pl.i2c_cmd == PL_I2C_CMD_READ_REGISTERS)
+    {
+        LOG_PL("[IFX-PL]: Poll Timer elapsed  -> Restart batched Read Registers\n");
+        ifx_i2c_pl_start_read_status_registers(p_local_ctx);
+    }
+#endif
 }
 
 
@@ -660,7 +838,8 @@ static void ifx_i2c_pl_guard_time_callback(void *p_ctx)
 			//lint --e{534} suppress "Return value is not required to be checked"
             pal_i2c_read(p_local_ctx->p_pal_i2c_ctx,p_local_ctx->pl.buffer, p_local_ctx->pl.buffer_rx_len);
     	}
-    	else if (p_local_ctx->pl.i2c_cmd == PL_I2C_CMD_READ)
+    	else if ((p_local_ctx->pl.i2c_cmd == PL_I2C_CMD_READ) || (p_local_ctx->pl.i2c_cmd == PL_I2C_CMD_WRITE_READ) ||
+    	         (p_local_ctx->pl.i2c_cmd == PL_I2C_CMD_READ_REGISTERS))
     	{
     		LOG_PL("[IFX-PL]: GT done -> REG is read\n");
     		ifx_i2c_pl_frame_event_handler(p_local_ctx,IFX_I2C_STACK_SUCCESS);
@@ -680,6 +859,7 @@ static void ifx_i2c_pl_pal_event_handler(void *p_ctx, host_lib_status_t event)
     {
         case PAL_I2C_EVENT_ERROR:            
         case PAL_I2C_EVENT_BUSY:
+            IFX_I2C_PERF_COUNT(p_local_ctx, pl_i2c_errors, 1);
             // Error event usually occurs when the device is in sleep mode and needs time to wake up
             if (p_local_ctx->pl.retry_counter--)
             {
@@ -695,6 +875,14 @@ static void ifx_i2c_pl_pal_event_handler(void *p_ctx, host_lib_status_t event)
             
         case PAL_I2C_EVENT_SUCCESS:
             LOG_PL("[IFX-PL]: PAL Success -> Wait Guard Time\n");
+            if (p_local_ctx->pl.i2c_cmd != PL_I2C_CMD_READ)
+            {
+                IFX_I2C_PERF_COUNT(p_local_ctx, pl_bytes_sent, p_local_ctx->pl.buffer_tx_len);
+            }
+            if (p_local_ctx->pl.i2c_cmd != PL_I2C_CMD_WRITE)
+            {
+                IFX_I2C_PERF_COUNT(p_local_ctx, pl_bytes_received, p_local_ctx->pl.buffer_rx_len);
+            }
             pal_os_event_register_callback_oneshot(ifx_i2c_pl_guard_time_callback,p_local_ctx,PL_GUARD_TIME_INTERVAL_US);
             break;
         default:
@@ -746,6 +934,87 @@ static void ifx_i2c_pl_soft_reset(ifx_i2c_context_t *p_ctx)
 	}    
 }
 
+//lint --e{715} suppress "p_ctx is not used, if adaptive polling is disabled"
+static uint32_t ifx_i2c_pl_next_poll_interval(ifx_i2c_context_t *p_ctx)
+{
+#if PL_ADAPTIVE_POLLING == 1
+    ifx_i2c_pl_exec_time_t* p_exec_time = &p_ctx->pl.exec_time[p_ctx->pl.apdu_cmd];
+    uint32_t elapsed_us = pal_os_timer_get_time_in_microseconds() - p_ctx->pl.tx_done_time_us;
+    uint32_t margin_us;
+    uint32_t interval_us;
+
+    p_ctx->pl.busy_polls++;
+    if (p_ctx->pl.exec_time_pending && (p_exec_time->samples > 0))
+    {
+        // Sleep until shortly before the predicted completion of the command
+        margin_us = (2 * p_exec_time->deviation_us) + PL_ADAPTIVE_POLL_MIN_US;
+        if ((p_exec_time->average_us > margin_us) &&
+            ((elapsed_us + PL_ADAPTIVE_POLL_MIN_US) < (p_exec_time->average_us - margin_us)))
+        {
+            LOG_PL("[IFX-PL]: Command %x predicted in %d us\n", p_ctx->pl.apdu_cmd, p_exec_time->average_us);
+            return (p_exec_time->average_us - margin_us) - elapsed_us;
+        }
+    }
+
+    // Poll densely around the predicted completion and back off towards the fixed interval
+    interval_us = p_ctx->pl.poll_interval_us;
+    if (interval_us < PL_ADAPTIVE_POLL_MIN_US)
+    {
+        interval_us = PL_ADAPTIVE_POLL_MIN_US;
+    }
+    p_ctx->pl.poll_interval_us = ((2 * interval_us) < PL_DATA_POLLING_INVERVAL_US) ?
+                                 (2 * interval_us) : PL_DATA_POLLING_INVERVAL_US;
+    return interval_us;
+#else
+    return PL_DATA_POLLING_INVERVAL_US;
+#endif
+}
+
+//lint --e{715} suppress "p_ctx is not used, if adaptive polling is disabled"
+static void ifx_i2c_pl_learn_exec_time(ifx_i2c_context_t *p_ctx)
+{
+#if PL_ADAPTIVE_POLLING == 1
+    ifx_i2c_pl_exec_time_t* p_exec_time = &p_ctx->pl.exec_time[p_ctx->pl.apdu_cmd];
+    int32_t sample_us;
+    int32_t diff_us;
+
+    // One sample per written command
+    if (!p_ctx->pl.exec_time_pending)
+    {
+        return;
+    }
+    p_ctx->pl.exec_time_pending = 0;
+
+    // Response was available on the first poll, this tells nothing about the execution time
+    if (0 == p_ctx->pl.busy_polls)
+    {
+        return;
+    }
+    p_ctx->pl.busy_polls = 0;
+
+    sample_us = (int32_t)(pal_os_timer_get_time_in_microseconds() - p_ctx->pl.tx_done_time_us);
+    if (0 == p_exec_time->samples)
+    {
+        p_exec_time->average_us   = (uint32_t)sample_us;
+        p_exec_time->deviation_us = (uint32_t)sample_us / 2;
+    }
+    else
+    {
+        // Exponentially weighted average and mean deviation (gains 1/8 and 1/4)
+        diff_us = sample_us - (int32_t)p_exec_time->average_us;
+        p_exec_time->average_us = (uint32_t)((int32_t)p_exec_time->average_us + (diff_us / 8));
+        if (diff_us < 0)
+        {
+            diff_us = -diff_us;
+        }
+        p_exec_time->deviation_us = (uint32_t)((int32_t)p_exec_time->deviation_us +
+                                               ((diff_us - (int32_t)p_exec_time->deviation_us) / 4));
+    }
+    p_exec_time->samples++;
+    LOG_PL("[IFX-PL]: Command %x executed in %d us\n", p_ctx->pl.apdu_cmd, sample_us);
+#endif
+}
+
 //lint --e{715} suppress "This is used for synchromous implementation, hence p_ctx not used"
 //lint --e{818} suppress "This is ignored as upper layer handler function prototype requires this argument"
 static void ifx_i2c_pl_pal_slave_addr_event_handler(void *p_ctx, host_lib_status_t event)
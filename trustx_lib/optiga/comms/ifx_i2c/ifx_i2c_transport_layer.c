@@ -118,7 +118,8 @@ host_lib_status_t ifx_i2c_tl_init(ifx_i2c_context_t *p_ctx,ifx_i2c_event_handler
 
     p_ctx->tl.upper_layer_event_handler = handler;
     p_ctx->tl.state                     = TL_STATE_IDLE;
-    p_ctx->tl.max_packet_length = p_ctx->frame_size - (DL_HEADER_SIZE + TL_HEADER_SIZE);
+    // Updated once the physical layer has negotiated the frame size with the slave
+    p_ctx->tl.max_packet_length = DL_MIN_FRAME_SIZE - (DL_HEADER_SIZE + TL_HEADER_SIZE);
 
     return IFX_I2C_STACK_SUCCESS;
 }
@@ -269,6 +270,8 @@ _STATIC_H void ifx_i2c_dl_event_handler(ifx_i2c_context_t* p_ctx,host_lib_status
             case TL_STATE_IDLE:
             {
                 exit_machine = FALSE;
+                // Initialization complete, fragment packets according to the negotiated frame size
+                p_ctx->tl.max_packet_length = p_ctx->pl.negotiated_frame_size - (DL_HEADER_SIZE + TL_HEADER_SIZE);
                 p_ctx->tl.upper_layer_event_handler(p_ctx,IFX_I2C_STACK_SUCCESS, 0, 0);
             }
             break;
@@ -451,6 +454,7 @@ _STATIC_H void ifx_i2c_dl_event_handler(ifx_i2c_context_t* p_ctx,host_lib_status
                 if(0 == (p_ctx->tl.chaining_error_count++))
                 {  
                     LOG_TL("[IFX-TL]: Resend : Resending\n");
+                    IFX_I2C_PERF_COUNT(p_ctx, tl_resends, 1);
                     p_ctx->tl.state = TL_STATE_IDLE;
                     if(ifx_i2c_tl_resend_packets(p_ctx))
                     {
@@ -472,6 +476,7 @@ _STATIC_H void ifx_i2c_dl_event_handler(ifx_i2c_context_t* p_ctx,host_lib_status
             case TL_STATE_CHAINING_ERROR:
             {		
                 // Send chaining error to slave
+                IFX_I2C_PERF_COUNT(p_ctx, tl_chaining_errors, 1);
                 p_ctx->tl.state = TL_STATE_TX;
                 if(0 == (p_ctx->tl.master_chaining_error_count++))
                 {
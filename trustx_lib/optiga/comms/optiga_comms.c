@@ -51,6 +51,7 @@
  *********************************************************************************************************************/
 static host_lib_status_t check_optiga_comms_state(optiga_comms_t *p_ctx);
 static void ifx_i2c_event_handler(void* upper_layer_ctx, host_lib_status_t event);
+static host_lib_status_t optiga_comms_ops_complete(optiga_comms_t *p_ctx, host_lib_status_t status);
 
 /// @endcond
 /**********************************************************************************************************************
@@ -91,6 +92,10 @@ host_lib_status_t optiga_comms_open(optiga_comms_t *p_ctx)
     host_lib_status_t status = OPTIGA_COMMS_ERROR;
     if (OPTIGA_COMMS_SUCCESS == check_optiga_comms_state(p_ctx))
     {
+        if (NULL != p_ctx->p_ops)
+        {
+            return optiga_comms_ops_complete(p_ctx, p_ctx->p_ops->open(p_ctx));
+        }
         ((ifx_i2c_context_t*)(p_ctx->comms_ctx))->p_upper_layer_ctx = (void*)p_ctx;
         ((ifx_i2c_context_t*)(p_ctx->comms_ctx))->upper_layer_event_handler = ifx_i2c_event_handler;
         status = ifx_i2c_open((ifx_i2c_context_t*)(p_ctx->comms_ctx)); 
@@ -134,6 +139,12 @@ host_lib_status_t optiga_comms_reset(optiga_comms_t *p_ctx,uint8_t reset_type)
     host_lib_status_t status = OPTIGA_COMMS_ERROR;
     if (OPTIGA_COMMS_SUCCESS == check_optiga_comms_state(p_ctx))
     {
+        if (NULL != p_ctx->p_ops)
+        {
+            //The chip is shared behind the transport, it is not reset on behalf of one user
+            p_ctx->state = OPTIGA_COMMS_FREE;
+            return OPTIGA_COMMS_ERROR;
+        }
         ((ifx_i2c_context_t*)(p_ctx->comms_ctx))->p_upper_layer_ctx = (void*)p_ctx;
         ((ifx_i2c_context_t*)(p_ctx->comms_ctx))->upper_layer_event_handler = ifx_i2c_event_handler;
         status = ifx_i2c_reset((ifx_i2c_context_t*)(p_ctx->comms_ctx),(ifx_i2c_reset_type_t)reset_type); 
@@ -190,6 +201,11 @@ host_lib_status_t optiga_comms_transceive(optiga_comms_t *p_ctx,const uint8_t* p
     host_lib_status_t status = OPTIGA_COMMS_ERROR;
     if (OPTIGA_COMMS_SUCCESS == check_optiga_comms_state(p_ctx))
     {
+        if (NULL != p_ctx->p_ops)
+        {
+            return optiga_comms_ops_complete(p_ctx, p_ctx->p_ops->transceive(p_ctx, p_data, p_data_length,
+                                                                             p_buffer, p_buffer_len));
+        }
         ((ifx_i2c_context_t*)(p_ctx->comms_ctx))->p_upper_layer_ctx = (void*)p_ctx;
         ((ifx_i2c_context_t*)(p_ctx->comms_ctx))->upper_layer_event_handler = ifx_i2c_event_handler;
         status = (ifx_i2c_transceive((ifx_i2c_context_t*)(p_ctx->comms_ctx),p_data,p_data_length,p_buffer,p_buffer_len));
@@ -226,6 +242,12 @@ host_lib_status_t optiga_comms_close(optiga_comms_t *p_ctx)
     host_lib_status_t status = OPTIGA_COMMS_ERROR;
     if (OPTIGA_COMMS_SUCCESS == check_optiga_comms_state(p_ctx))
     {      
+        if (NULL != p_ctx->p_ops)
+        {
+            status = p_ctx->p_ops->close(p_ctx);
+            p_ctx->state = OPTIGA_COMMS_FREE;
+            return status;
+        }
         ((ifx_i2c_context_t*)(p_ctx->comms_ctx))->p_upper_layer_ctx = (void*)p_ctx;
         ((ifx_i2c_context_t*)(p_ctx->comms_ctx))->upper_layer_event_handler = ifx_i2c_event_handler;
         status = ifx_i2c_close((ifx_i2c_context_t*)(p_ctx->comms_ctx)); 
@@ -257,6 +279,17 @@ static void ifx_i2c_event_handler(void* upper_layer_ctx, host_lib_status_t event
     ((optiga_comms_t*)upper_layer_ctx)->state = OPTIGA_COMMS_FREE;
 }
 
+//Transports of p_ops complete synchronously, report the completion as the ifx i2c stack does
+static host_lib_status_t optiga_comms_ops_complete(optiga_comms_t *p_ctx, host_lib_status_t status)
+{
+    p_ctx->state = OPTIGA_COMMS_FREE;
+    if (OPTIGA_COMMS_SUCCESS == status)
+    {
+        p_ctx->upper_layer_handler(p_ctx->upper_layer_ctx, OPTIGA_COMMS_SUCCESS);
+    }
+    return status;
+}
+
 /// @endcond
 /**
 * @}
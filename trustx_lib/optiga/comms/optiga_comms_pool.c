@@ -0,0 +1,282 @@
+/**
+* MIT License
+*
+* Copyright (c) 2018 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+*
+*
+* \file
+*
+* \brief This file implements the APDU buffer pool of the optiga comms layer.
+*
+* \ingroup  grOptigaComms
+* @{
+*/
+
+/**********************************************************************************************************************
+ * HEADER FILES
+ *********************************************************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "optiga/comms/optiga_comms_pool.h"
+#include "optiga/common/MemoryMgmt.h"
+
+/// @cond hidden
+/**********************************************************************************************************************
+ * MACROS
+ *********************************************************************************************************************/
+#if (OPTIGA_COMMS_POOL_SMALL_COUNT > 32) || (OPTIGA_COMMS_POOL_LARGE_COUNT > 32)
+#error "A size class of the APDU buffer pool holds at most 32 buffers"
+#endif
+
+#if defined(__GNUC__)
+/// Atomically replaces *p_value by desired if it still equals expected
+#define POOL_CAS(p_value, expected, desired)    __atomic_compare_exchange_n((p_value), &(expected), (desired), 0, \
+                                                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+/// Atomically reads *p_value
+#define POOL_LOAD(p_value)                      __atomic_load_n((p_value), __ATOMIC_ACQUIRE)
+/// Atomically adds delta to *p_value and returns the new value
+#define POOL_ADD(p_value, delta)                __atomic_add_fetch((p_value), (delta), __ATOMIC_ACQ_REL)
+/// Atomically sets the bits of mask in *p_value
+#define POOL_OR(p_value, mask)                  ((void)__atomic_fetch_or((p_value), (mask), __ATOMIC_RELEASE))
+#else
+// Without atomics the command library calls must be serialized by the caller, e.g. with pal_os_lock
+#define POOL_CAS(p_value, expected, desired)    ((*(p_value) == (expected)) ? ((*(p_value) = (desired)), TRUE) : FALSE)
+#define POOL_LOAD(p_value)                      (*(p_value))
+#define POOL_ADD(p_value, delta)                (*(p_value) += (delta))
+#define POOL_OR(p_value, mask)                  (*(p_value) |= (mask))
+#endif
+
+/// Free mask with the lowest count bits set
+#define POOL_FULL_MASK(count)                   ((uint32_t)(((uint64_t)1 << (count)) - 1))
+
+/**********************************************************************************************************************
+ * LOCAL DATA
+ *********************************************************************************************************************/
+/// Storage of the small size class
+static uint8_t rgbPoolSmall[OPTIGA_COMMS_POOL_SMALL_COUNT][OPTIGA_COMMS_POOL_SMALL_SIZE];
+/// Storage of the large size class
+static uint8_t rgbPoolLarge[OPTIGA_COMMS_POOL_LARGE_COUNT][OPTIGA_COMMS_POOL_LARGE_SIZE];
+
+/**********************************************************************************************************************
+ * LOCAL ROUTINES
+ *********************************************************************************************************************/
+static uint8_t* optiga_comms_pool_take(optiga_comms_pool_class_t* p_class);
+/// @endcond
+
+/**********************************************************************************************************************
+ * GLOBAL
+ *********************************************************************************************************************/
+//lint --e{785} suppress "Statistics are zero initialized"
+optiga_comms_pool_t optiga_comms_pool_0 =
+{
+    {
+        {&rgbPoolSmall[0][0], POOL_FULL_MASK(OPTIGA_COMMS_POOL_SMALL_COUNT),
+         {OPTIGA_COMMS_POOL_SMALL_SIZE, OPTIGA_COMMS_POOL_SMALL_COUNT}},
+        {&rgbPoolLarge[0][0], POOL_FULL_MASK(OPTIGA_COMMS_POOL_LARGE_COUNT),
+         {OPTIGA_COMMS_POOL_LARGE_SIZE, OPTIGA_COMMS_POOL_LARGE_COUNT}},
+    },
+    0
+};
+
+/**********************************************************************************************************************
+ * API IMPLEMENTATION
+ *********************************************************************************************************************/
+
+/**
+ * Sets up a pool with all buffers of the storage free.<br>
+ * Used for pools beside #optiga_comms_pool_0, e.g. one per OPTIGA when several are driven in parallel.
+ * The pool must not be in use.
+ *
+ * \param[out]    p_pool     Pointer to the pool
+ * \param[in]     p_storage  Pointer to the buffer storage, must outlive the pool
+ */
+void optiga_comms_pool_init(optiga_comms_pool_t* p_pool, optiga_comms_pool_storage_t* p_storage)
+{
+    memset(p_pool, 0, sizeof(optiga_comms_pool_t));
+    p_pool->size_class[0].p_storage = &p_storage->small[0][0];
+    p_pool->size_class[0].free_mask = POOL_FULL_MASK(OPTIGA_COMMS_POOL_SMALL_COUNT);
+    p_pool->size_class[0].stats.buffer_size = OPTIGA_COMMS_POOL_SMALL_SIZE;
+    p_pool->size_class[0].stats.buffer_count = OPTIGA_COMMS_POOL_SMALL_COUNT;
+    p_pool->size_class[1].p_storage = &p_storage->large[0][0];
+    p_pool->size_class[1].free_mask = POOL_FULL_MASK(OPTIGA_COMMS_POOL_LARGE_COUNT);
+    p_pool->size_class[1].stats.buffer_size = OPTIGA_COMMS_POOL_LARGE_SIZE;
+    p_pool->size_class[1].stats.buffer_count = OPTIGA_COMMS_POOL_LARGE_COUNT;
+}
+
+/**
+ * Takes a buffer of at least the requested length from the pool.<br>
+ *
+ *<b>API Details:</b>
+ * - The smallest size class which fits the length is tried first, then the larger ones.<br>
+ * - Buffers are claimed lock free, the pool may be shared by several threads.<br>
+ * - If no pooled buffer is available, the buffer is allocated from the heap,
+ *   unless #OPTIGA_COMMS_POOL_HEAP_FALLBACK is 0.<br>
+ *
+ * \param[in,out] p_pool     Pointer to the pool
+ * \param[in]     length     Required length in bytes
+ *
+ * \retval  Pointer to the buffer
+ * \retval  NULL, if no buffer is available
+ */
+uint8_t* optiga_comms_pool_alloc(optiga_comms_pool_t* p_pool, uint16_t length)
+{
+    uint8_t* p_buffer = NULL;
+    uint8_t missed = FALSE;
+    uint8_t i;
+
+    for (i = 0; (i < OPTIGA_COMMS_POOL_CLASSES) && (NULL == p_buffer); i++)
+    {
+        if (length > p_pool->size_class[i].stats.buffer_size)
+        {
+            continue;
+        }
+        p_buffer = optiga_comms_pool_take(&p_pool->size_class[i]);
+        // Account the miss to the best fitting size class only
+        if ((NULL == p_buffer) && (FALSE == missed))
+        {
+            POOL_ADD(&p_pool->size_class[i].stats.misses, 1);
+            missed = TRUE;
+        }
+    }
+
+    if (NULL == p_buffer)
+    {
+        if (FALSE == missed)
+        {
+            POOL_ADD(&p_pool->oversized, 1);
+        }
+#if OPTIGA_COMMS_POOL_HEAP_FALLBACK == 1
+        p_buffer = (uint8_t*)OCP_MALLOC(length);
+#endif
+    }
+    return p_buffer;
+}
+
+/**
+ * Returns a buffer taken by #optiga_comms_pool_alloc to the pool.<br>
+ *
+ * \param[in,out] p_pool     Pointer to the pool
+ * \param[in]     p_buffer   Pointer to the buffer, may be NULL
+ */
+void optiga_comms_pool_free(optiga_comms_pool_t* p_pool, uint8_t* p_buffer)
+{
+    optiga_comms_pool_class_t* p_class;
+    uint32_t offset;
+    uint8_t i;
+
+    if (NULL == p_buffer)
+    {
+        return;
+    }
+    for (i = 0; i < OPTIGA_COMMS_POOL_CLASSES; i++)
+    {
+        p_class = &p_pool->size_class[i];
+        if ((p_buffer >= p_class->p_storage) &&
+            (p_buffer < p_class->p_storage + (p_class->stats.buffer_size * p_class->stats.buffer_count)))
+        {
+            offset = (uint32_t)(p_buffer - p_class->p_storage);
+            POOL_ADD(&p_class->stats.in_use, (uint32_t)-1);
+            POOL_OR(&p_class->free_mask, (uint32_t)1 << (offset / p_class->stats.buffer_size));
+            return;
+        }
+    }
+#if OPTIGA_COMMS_POOL_HEAP_FALLBACK == 1
+    OCP_FREE(p_buffer);
+#endif
+}
+
+/**
+ * Copies the statistics of the size classes.<br>
+ *
+ * \param[in]     p_pool        Pointer to the pool
+ * \param[out]    p_stats       Array of #OPTIGA_COMMS_POOL_CLASSES statistics, ordered by ascending buffer size
+ * \param[out]    p_oversized   Number of requests larger than the largest size class, may be NULL
+ */
+void optiga_comms_pool_get_stats(const optiga_comms_pool_t* p_pool,
+                                 optiga_comms_pool_stats_t* p_stats, uint32_t* p_oversized)
+{
+    uint8_t i;
+
+    for (i = 0; i < OPTIGA_COMMS_POOL_CLASSES; i++)
+    {
+        p_stats[i] = p_pool->size_class[i].stats;
+    }
+    if (NULL != p_oversized)
+    {
+        *p_oversized = p_pool->oversized;
+    }
+}
+
+/**
+ * Clears the allocation, miss and high water statistics.<br>
+ * The high water mark restarts from the number of buffers currently in use.
+ *
+ * \param[in,out] p_pool     Pointer to the pool
+ */
+void optiga_comms_pool_reset_stats(optiga_comms_pool_t* p_pool)
+{
+    uint8_t i;
+
+    for (i = 0; i < OPTIGA_COMMS_POOL_CLASSES; i++)
+    {
+        p_pool->size_class[i].stats.allocations = 0;
+        p_pool->size_class[i].stats.misses = 0;
+        p_pool->size_class[i].stats.high_water = POOL_LOAD(&p_pool->size_class[i].stats.in_use);
+    }
+    p_pool->oversized = 0;
+}
+
+/// @cond hidden
+static uint8_t* optiga_comms_pool_take(optiga_comms_pool_class_t* p_class)
+{
+    uint32_t free_mask = POOL_LOAD(&p_class->free_mask);
+    uint32_t in_use;
+    uint32_t high_water;
+    uint8_t index;
+
+    // Claim the lowest free buffer, retry if another thread changed the mask in between
+    while (0 != free_mask)
+    {
+        for (index = 0; 0 == (free_mask & ((uint32_t)1 << index)); index++)
+        {
+        }
+        if (POOL_CAS(&p_class->free_mask, free_mask, free_mask & ~((uint32_t)1 << index)))
+        {
+            POOL_ADD(&p_class->stats.allocations, 1);
+            in_use = POOL_ADD(&p_class->stats.in_use, 1);
+            high_water = POOL_LOAD(&p_class->stats.high_water);
+            while ((in_use > high_water) && !POOL_CAS(&p_class->stats.high_water, high_water, in_use))
+            {
+            }
+            return p_class->p_storage + ((uint32_t)index * p_class->stats.buffer_size);
+        }
+        // On failure free_mask has been reloaded
+#if !defined(__GNUC__)
+        free_mask = POOL_LOAD(&p_class->free_mask);
+#endif
+    }
+    return NULL;
+}
+/// @endcond
+
+/**
+* @}
+*/
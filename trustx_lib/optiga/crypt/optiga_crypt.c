@@ -48,7 +48,7 @@ optiga_lib_status_t optiga_crypt_random(optiga_rng_types_t rng_type,
     rand_response.wBufferLength = random_data_length;
     rand_response.wRespLength   = 0;
     
-    while (pal_os_lock_acquire() != OPTIGA_LIB_SUCCESS);
+    pal_os_lock_acquire();
     return_value = CmdLib_GetRandom(&rand_options,&rand_response);
     pal_os_lock_release();
 
@@ -76,7 +76,7 @@ optiga_lib_status_t optiga_crypt_hash_start(optiga_hash_context_t * hash_ctx)
     hash_options.sContextInfo.dwContextLen   = hash_ctx->context_buffer_length;
     hash_options.sContextInfo.eContextAction = eExport;
 
-    while (pal_os_lock_acquire() != OPTIGA_LIB_SUCCESS);
+    pal_os_lock_acquire();
     return_value = CmdLib_CalcHash(&hash_options);
     pal_os_lock_release();
 
@@ -168,7 +168,7 @@ optiga_lib_status_t optiga_crypt_hash_update(optiga_hash_context_t * hash_ctx,
 
     while (1)
     {   
-        while (pal_os_lock_acquire() != OPTIGA_LIB_SUCCESS);
+        pal_os_lock_acquire();
         return_value = CmdLib_CalcHash(&hash_options);
         pal_os_lock_release();
 
@@ -233,7 +233,7 @@ optiga_lib_status_t optiga_crypt_hash_finalize(optiga_hash_context_t * hash_ctx,
 		hash_options.sOutHash.wBufferLength  = 32;
 	}
 
-    while (pal_os_lock_acquire() != OPTIGA_LIB_SUCCESS);
+    pal_os_lock_acquire();
     return_value = CmdLib_CalcHash(&hash_options);
     pal_os_lock_release();
     
@@ -279,7 +279,7 @@ optiga_lib_status_t optiga_crypt_ecc_generate_keypair(optiga_ecc_curve_t curve_i
 
 
 
-    while (pal_os_lock_acquire() != OPTIGA_LIB_SUCCESS);
+    pal_os_lock_acquire();
     return_value = CmdLib_GenerateKeyPair(&keypair_options,&public_key_out);
     pal_os_lock_release();
 
@@ -311,7 +311,7 @@ optiga_lib_status_t optiga_crypt_ecdsa_sign (uint8_t * digest,
     sign.prgbStream = signature;
     sign.wLen       =  *signature_length;
 
-    while (pal_os_lock_acquire() != OPTIGA_LIB_SUCCESS);
+    pal_os_lock_acquire();
 
     return_value = CmdLib_CalculateSign(&sign_options,&sign);
     pal_os_lock_release();
@@ -356,7 +356,7 @@ optiga_lib_status_t optiga_crypt_ecdsa_verify (uint8_t * digest,
     sign.prgbStream = signature;
     sign.wLen       = signature_length;
 
-    while (pal_os_lock_acquire() != OPTIGA_LIB_SUCCESS);
+    pal_os_lock_acquire();
     return_value = CmdLib_VerifySign(&verifysign_options, &dgst, &sign);
     pal_os_lock_release();
 
@@ -397,7 +397,7 @@ optiga_lib_status_t optiga_crypt_ecdh(optiga_key_id_t private_key,
         shared_secret_options.wOIDSharedSecret = *((uint16_t *)shared_secret);
     }
 
-    while (pal_os_lock_acquire() != OPTIGA_LIB_SUCCESS);
+    pal_os_lock_acquire();
     return_value = CmdLib_CalculateSharedSecret(&shared_secret_options, &sharedsecret);
     pal_os_lock_release();
 
@@ -446,7 +446,7 @@ optiga_lib_status_t optiga_crypt_tls_prf_sha256(uint16_t secret,
 		derivekey_options.wOIDDerivedKey = *((uint16_t *)derived_key);
     }
 
-    while (pal_os_lock_acquire() != OPTIGA_LIB_SUCCESS);
+    pal_os_lock_acquire();
     return_value = CmdLib_DeriveKey(&derivekey_options, &derivekey_output_buffer);
     pal_os_lock_release();
 
@@ -98,6 +98,11 @@
 ///Overhead for import and export hash context
 #define CALC_HASH_IMPORT_AND_EXPORT_OVERHEAD_SIZE  (0x06)
 
+///Storage class of the command library state which is kept per thread (e.g. __thread), empty on single threaded targets
+#ifndef CMDLIB_THREAD_LOCAL
+#define CMDLIB_THREAD_LOCAL
+#endif
+
 /****************************************************************************
  *
  * Common data structure used across all functions.
@@ -157,6 +162,11 @@ LIBRARY_EXPORTS int32_t CmdLib_OpenApplication(const sOpenApp_d* PpsOpenApp);
 /// @cond hidden
 LIBRARY_EXPORTS void CmdLib_SetOptigaCommsContext(const optiga_comms_t *p_input_optiga_comms);
 /// @endcond 
+
+/**
+ * \brief Binds the calling thread to an OPTIGA comms context of its own, NULL returns it to the shared context.
+ */
+LIBRARY_EXPORTS void CmdLib_SetThreadOptigaCommsContext(const optiga_comms_t *p_input_optiga_comms);
 /****************************************************************************
  *
  * Definitions related to GetDataObject and SetDataObject commands.
@@ -36,6 +36,7 @@
  * HEADER FILES
  *********************************************************************************************************************/
 #include "optiga/common/Datatypes.h"
+#include "optiga/comms/optiga_comms_pool.h"
 
 /**********************************************************************************************************************
  * MACROS
@@ -52,6 +53,22 @@
  * DATA STRUCTURES
  *********************************************************************************************************************/
 
+struct optiga_comms;
+
+/** @brief Transport replacing the ifx i2c protocol stack, e.g. the trustxd broker client.
+ *  The functions complete synchronously, the completion is reported to the upper layer by optiga comms. */
+typedef struct optiga_comms_ops
+{
+    /// Opens the communication channel
+    host_lib_status_t (*open)(struct optiga_comms* p_ctx);
+    /// Sends the command APDU and receives the response APDU
+    host_lib_status_t (*transceive)(struct optiga_comms* p_ctx, const uint8_t* p_data,
+                                    const uint16_t* p_data_length,
+                                    uint8_t* p_buffer, uint16_t* p_buffer_len);
+    /// Closes the communication channel
+    host_lib_status_t (*close)(struct optiga_comms* p_ctx);
+}optiga_comms_ops_t;
+
 /** @brief optiga comms structure */
 typedef struct optiga_comms
 {
@@ -63,6 +80,10 @@ typedef struct optiga_comms
     app_event_handler_t upper_layer_handler; 
     /// Optiga comms state
     uint8_t state;
+    /// APDU buffer pool of the command library, #optiga_comms_pool_0 is used if NULL
+    optiga_comms_pool_t* p_pool;
+    /// Transport of this context, the ifx i2c protocol stack is used if NULL
+    const optiga_comms_ops_t* p_ops;
 }optiga_comms_t;
 
 extern optiga_comms_t optiga_comms;
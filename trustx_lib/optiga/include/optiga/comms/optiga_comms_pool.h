@@ -0,0 +1,163 @@
+/**
+* MIT License
+*
+* Copyright (c) 2018 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+*
+*
+* \file
+*
+* \brief This file defines the APDU buffer pool of the optiga comms layer.
+*
+* \ingroup  grOptigaComms
+* @{
+*/
+
+#ifndef _OPTIGA_COMMS_POOL_H_
+#define _OPTIGA_COMMS_POOL_H_
+
+/**********************************************************************************************************************
+ * HEADER FILES
+ *********************************************************************************************************************/
+#include "optiga/common/Datatypes.h"
+
+/**********************************************************************************************************************
+ * MACROS
+ *********************************************************************************************************************/
+
+/// Size of the buffers in the small size class, fits the sign, random and key agreement APDUs
+#ifndef OPTIGA_COMMS_POOL_SMALL_SIZE
+#define OPTIGA_COMMS_POOL_SMALL_SIZE        (0x0120)
+#endif
+/// Number of buffers in the small size class (at most 32)
+#ifndef OPTIGA_COMMS_POOL_SMALL_COUNT
+#define OPTIGA_COMMS_POOL_SMALL_COUNT       (4)
+#endif
+/// Size of the buffers in the large size class, fits a data object read or write of the maximum comms buffer size
+#ifndef OPTIGA_COMMS_POOL_LARGE_SIZE
+#define OPTIGA_COMMS_POOL_LARGE_SIZE        (0x0680)
+#endif
+/// Number of buffers in the large size class (at most 32)
+#ifndef OPTIGA_COMMS_POOL_LARGE_COUNT
+#define OPTIGA_COMMS_POOL_LARGE_COUNT       (2)
+#endif
+/// Allocate from the heap if no pooled buffer is available, set to 0 for a heap free build (set to 0 or 1)
+#ifndef OPTIGA_COMMS_POOL_HEAP_FALLBACK
+#define OPTIGA_COMMS_POOL_HEAP_FALLBACK     1
+#endif
+
+/// Number of size classes
+#define OPTIGA_COMMS_POOL_CLASSES           (2)
+
+/**********************************************************************************************************************
+ * DATA STRUCTURES
+ *********************************************************************************************************************/
+
+/** @brief Statistics of a size class of the APDU buffer pool */
+typedef struct optiga_comms_pool_stats
+{
+    /// Size of the buffers in bytes
+    uint32_t buffer_size;
+    /// Number of buffers
+    uint32_t buffer_count;
+    /// Number of buffers handed out
+    uint32_t allocations;
+    /// Number of requests for this class which found all its buffers in use
+    uint32_t misses;
+    /// Number of buffers currently in use
+    uint32_t in_use;
+    /// Maximum number of buffers in use at the same time
+    uint32_t high_water;
+} optiga_comms_pool_stats_t;
+
+/** @brief Size class of the APDU buffer pool */
+typedef struct optiga_comms_pool_class
+{
+    /// Storage of buffer_count buffers of buffer_size bytes each
+    uint8_t* p_storage;
+    /// Bit n is set while buffer n is free
+    uint32_t free_mask;
+    /// Statistics
+    optiga_comms_pool_stats_t stats;
+} optiga_comms_pool_class_t;
+
+/** @brief APDU buffer pool */
+typedef struct optiga_comms_pool
+{
+    /// Size classes, ordered by ascending buffer size
+    optiga_comms_pool_class_t size_class[OPTIGA_COMMS_POOL_CLASSES];
+    /// Number of requests larger than the largest size class
+    uint32_t oversized;
+} optiga_comms_pool_t;
+
+/** @brief Buffer storage of an APDU buffer pool with the configured size classes */
+typedef struct optiga_comms_pool_storage
+{
+    /// Storage of the small size class
+    uint8_t small[OPTIGA_COMMS_POOL_SMALL_COUNT][OPTIGA_COMMS_POOL_SMALL_SIZE];
+    /// Storage of the large size class
+    uint8_t large[OPTIGA_COMMS_POOL_LARGE_COUNT][OPTIGA_COMMS_POOL_LARGE_SIZE];
+} optiga_comms_pool_storage_t;
+
+/** @brief Default APDU buffer pool */
+extern optiga_comms_pool_t optiga_comms_pool_0;
+
+/**********************************************************************************************************************
+ * API Prototypes
+ *********************************************************************************************************************/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   Sets up a pool with all buffers of the storage free.
+ */
+LIBRARY_EXPORTS void optiga_comms_pool_init(optiga_comms_pool_t* p_pool, optiga_comms_pool_storage_t* p_storage);
+
+/**
+ * \brief   Takes a buffer of at least the requested length from the pool.
+ */
+LIBRARY_EXPORTS uint8_t* optiga_comms_pool_alloc(optiga_comms_pool_t* p_pool, uint16_t length);
+
+/**
+ * \brief   Returns a buffer taken by #optiga_comms_pool_alloc to the pool.
+ */
+LIBRARY_EXPORTS void optiga_comms_pool_free(optiga_comms_pool_t* p_pool, uint8_t* p_buffer);
+
+/**
+ * \brief   Copies the statistics of the size classes.
+ */
+LIBRARY_EXPORTS void optiga_comms_pool_get_stats(const optiga_comms_pool_t* p_pool,
+                                                 optiga_comms_pool_stats_t* p_stats, uint32_t* p_oversized);
+
+/**
+ * \brief   Clears the allocation, miss and high water statistics.
+ */
+LIBRARY_EXPORTS void optiga_comms_pool_reset_stats(optiga_comms_pool_t* p_pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+* @}
+*/
+
+#endif /*_OPTIGA_COMMS_POOL_H_*/
@@ -94,6 +94,26 @@ host_lib_status_t ifx_i2c_close(ifx_i2c_context_t *p_ctx);
  */
 host_lib_status_t ifx_i2c_set_slave_address(ifx_i2c_context_t *p_ctx, uint8_t slave_address, uint8_t persistent);
 
+/**
+ * \brief   Reads the execution time learned by the adaptive status poller for an APDU command.
+ */
+host_lib_status_t ifx_i2c_get_exec_time(const ifx_i2c_context_t *p_ctx, uint8_t apdu_cmd, ifx_i2c_pl_exec_time_t* p_exec_time);
+
+/**
+ * \brief   Clears the execution times learned by the adaptive status poller.
+ */
+host_lib_status_t ifx_i2c_reset_exec_time(ifx_i2c_context_t *p_ctx);
+
+/**
+ * \brief   Takes a snapshot of the performance counters and latency histograms.
+ */
+host_lib_status_t ifx_i2c_get_perf(const ifx_i2c_context_t *p_ctx, ifx_i2c_perf_t* p_perf);
+
+/**
+ * \brief   Clears the performance counters and latency histograms.
+ */
+host_lib_status_t ifx_i2c_reset_perf(ifx_i2c_context_t *p_ctx);
+
 #ifdef __cplusplus
 }
 #endif
@@ -51,6 +51,11 @@ extern "C" {
 
 /** @brief I2C slave address of the Infineon device */
 #define IFX_I2C_BASE_ADDR           (0x30)
+/** @brief IFX I2C: open, reset and transceive run the protocol state machines on the calling thread and return once
+ *         complete, sleeping instead of scheduling timer events (set to 0 or 1). Meant for hosted platforms */
+#ifndef IFX_I2C_SYNC_MODE
+#define IFX_I2C_SYNC_MODE           0
+#endif
 
 /** @brief Physical Layer: polling interval in microseconds */
 #define PL_POLLING_INVERVAL_US      (1000)
@@ -60,11 +65,55 @@ extern "C" {
 #define PL_DATA_POLLING_INVERVAL_US (5000)
 /** @brief Physical Layer: guard time interval in microseconds */
 #define PL_GUARD_TIME_INTERVAL_US   (50)
+/** @brief Physical Layer: read registers with one combined PAL write/read transaction (set to 0 or 1) */
+#ifndef PL_COMBINED_REG_READ
+#define PL_COMBINED_REG_READ        0
+#endif
+/** @brief Physical Layer: learn the command execution time and poll the status register adaptively (set to 0 or 1) */
+#ifndef PL_ADAPTIVE_POLLING
+#define PL_ADAPTIVE_POLLING         1
+#endif
+/** @brief Physical Layer: shortest status register polling interval of the adaptive poller in microseconds */
+#define PL_ADAPTIVE_POLL_MIN_US     (250)
+/** @brief Physical Layer: number of APDU command codes tracked by the adaptive poller, one per command byte */
+#define PL_ADAPTIVE_MODEL_SIZE      (0x100)
+
+/** @brief IFX I2C: count frames, bytes, retries and errors of every layer (set to 0 or 1) */
+#ifndef IFX_I2C_PERF_COUNTERS
+#define IFX_I2C_PERF_COUNTERS       1
+#endif
+/** @brief IFX I2C: record a latency histogram per APDU command code (set to 0 or 1) */
+#ifndef IFX_I2C_PERF_LATENCY
+#define IFX_I2C_PERF_LATENCY        1
+#endif
+/** @brief IFX I2C: number of APDU command codes with a latency histogram, one per command byte */
+#define IFX_I2C_PERF_LATENCY_SLOTS  (0x100)
+/** @brief IFX I2C: number of latency histogram buckets, the last one also counts all longer latencies */
+#define IFX_I2C_PERF_LATENCY_BUCKETS (16)
+/** @brief IFX I2C: the first latency histogram bucket counts latencies below 2^IFX_I2C_PERF_LATENCY_MIN_SHIFT
+ *         microseconds, each further bucket doubles the upper bound */
+#define IFX_I2C_PERF_LATENCY_MIN_SHIFT (8)
+/// @cond hidden
+/// Any performance statistics enabled
+#define IFX_I2C_PERF                ((IFX_I2C_PERF_COUNTERS == 1) || (IFX_I2C_PERF_LATENCY == 1))
+#if IFX_I2C_PERF_COUNTERS == 1
+/// Increments a performance counter of the context
+#define IFX_I2C_PERF_COUNT(p_ctx, counter, value)   ((p_ctx)->perf.counters.counter += (value))
+#else
+#define IFX_I2C_PERF_COUNT(p_ctx, counter, value)
+#endif
+/// @endcond
 
-/** @brief Data link layer: maximum frame size */
+/** @brief Data link layer: maximum frame size, sizes the frame buffers and bounds the negotiated frame size */
 #ifndef DL_MAX_FRAME_SIZE
 #define DL_MAX_FRAME_SIZE           (300)
 #endif
+/** @brief Data link layer: minimum frame size accepted during frame size negotiation */
+#define DL_MIN_FRAME_SIZE           (16)
+/** @brief Data link layer: CRC implementation, 0 = bitwise, 1 = 256 entry lookup table, 8 = slice-by-8 lookup tables */
+#ifndef DL_CRC_SLICES
+#define DL_CRC_SLICES               8
+#endif
 /** @brief Data link layer: header size */
 #define DL_HEADER_SIZE              (5)
 /** @brief Data link layer: maximum number of retries in case of transmission error */
@@ -125,6 +174,82 @@ typedef struct ifx_i2c_context ifx_i2c_context_t;
 /** @brief Event handler function prototype */
 typedef void (*ifx_i2c_event_handler_t)(struct ifx_i2c_context* ctx, host_lib_status_t event, const uint8_t* data, uint16_t data_len);
 
+/** @brief Physical layer learned execution time of an APDU command */
+typedef struct ifx_i2c_pl_exec_time
+{
+    /// Smoothed execution time in microseconds
+    uint32_t average_us;
+    /// Smoothed mean deviation of the execution time in microseconds
+    uint32_t deviation_us;
+    /// Number of learned samples
+    uint32_t samples;
+} ifx_i2c_pl_exec_time_t;
+
+/** @brief Performance counters of the protocol stack */
+typedef struct ifx_i2c_perf_counters
+{
+    /// Number of completed transceives
+    uint32_t transceives;
+    /// Number of transceives completed with an error
+    uint32_t transceive_errors;
+    /// Transport layer: chaining errors detected by the master and sent to the slave
+    uint32_t tl_chaining_errors;
+    /// Transport layer: packets resent by the master after a chaining error, not counted as chaining errors
+    uint32_t tl_resends;
+    /// Data link layer: data and control frames sent, including retransmissions
+    uint32_t dl_frames_sent;
+    /// Data link layer: frames received
+    uint32_t dl_frames_received;
+    /// Data link layer: received frames with CRC error
+    uint32_t dl_crc_errors;
+    /// Data link layer: NACK control frames sent
+    uint32_t dl_nacks_sent;
+    /// Data link layer: NACKs received from the slave
+    uint32_t dl_nacks_received;
+    /// Data link layer: frames retransmitted, up to #DL_TRANS_REPEAT times per frame
+    uint32_t dl_retransmissions;
+    /// Data link layer: re-synchronizations sent or received
+    uint32_t dl_resyncs;
+    /// Physical layer: status register polls
+    uint32_t pl_status_polls;
+    /// Physical layer: I2C transfers which were not acknowledged or failed
+    uint32_t pl_i2c_errors;
+    /// Physical layer: bytes written to the slave
+    uint32_t pl_bytes_sent;
+    /// Physical layer: bytes read from the slave
+    uint32_t pl_bytes_received;
+} ifx_i2c_perf_counters_t;
+
+/** @brief Latency histogram of an APDU command */
+typedef struct ifx_i2c_perf_latency
+{
+    /// Number of completed commands
+    uint32_t count;
+    /// Longest latency in microseconds
+    uint32_t max_us;
+    /// Number of commands per latency bucket, see #IFX_I2C_PERF_LATENCY_MIN_SHIFT
+    uint32_t bucket[IFX_I2C_PERF_LATENCY_BUCKETS];
+} ifx_i2c_perf_latency_t;
+
+/** @brief Performance statistics of the protocol stack */
+typedef struct ifx_i2c_perf
+{
+#if IFX_I2C_PERF_COUNTERS == 1
+    /// Event counters
+    ifx_i2c_perf_counters_t counters;
+#endif
+#if IFX_I2C_PERF_LATENCY == 1
+    /// Latency from #ifx_i2c_transceive until the response is reported, per APDU command code
+    ifx_i2c_perf_latency_t latency[IFX_I2C_PERF_LATENCY_SLOTS];
+#endif
+    /// APDU command code of the ongoing transceive
+    uint8_t  apdu_cmd;
+    /// Set while a transceive is ongoing
+    uint8_t  transceive_active;
+    /// Start time of the ongoing transceive in microseconds
+    uint32_t start_time_us;
+} ifx_i2c_perf_t;
+
 /** @brief Physical layer structure */
 typedef struct ifx_i2c_pl
 {    
@@ -160,8 +285,33 @@ typedef struct ifx_i2c_pl
     
     /// Negotiation state
     uint8_t   negotiate_state;
+    /// Frequency negotiated with the slave in KHz
+    uint16_t  negotiated_frequency;
+    /// Frame size negotiated with the slave (value of the slave's DATA_REG_LEN register)
+    uint16_t  negotiated_frame_size;
     /// Soft reset requested
     uint8_t   request_soft_reset;
+#if PL_COMBINED_REG_READ == 1
+    /// STATE and DATA_REG_LEN requests of the batched status read
+    pal_i2c_reg_read_t status_regs[2];
+#endif
+
+#if PL_ADAPTIVE_POLLING == 1
+    // Physical Layer adaptive status polling variables
+
+    /// APDU command code of the ongoing transceive
+    uint8_t   apdu_cmd;
+    /// Number of status polls which found the response not ready
+    uint16_t  busy_polls;
+    /// Current dense polling interval in microseconds
+    uint32_t  poll_interval_us;
+    /// Time the last command frame was written in microseconds
+    uint32_t  tx_done_time_us;
+    /// Set while the execution time of the last written command is not yet sampled
+    uint8_t   exec_time_pending;
+    /// Learned execution time per APDU command code
+    ifx_i2c_pl_exec_time_t exec_time[PL_ADAPTIVE_MODEL_SIZE];
+#endif
 } ifx_i2c_pl_t;
 
 /** @brief Datalink layer structure */
@@ -244,7 +394,7 @@ typedef struct ifx_i2c_context
     uint8_t slave_address;
     /// Frequency of i2c master
     uint16_t frequency;
-    /// Data link layer frame size
+    /// Requested data link layer frame size, see #ifx_i2c_pl_t.negotiated_frame_size for the one in use
     uint16_t frame_size;
     /// Pointer to pal gpio context for vdd
     pal_gpio_t* p_slave_vdd_pin;
@@ -280,6 +430,10 @@ typedef struct ifx_i2c_context
     ifx_i2c_dl_t dl;
     /// Physical layer context
     ifx_i2c_pl_t pl;
+#if IFX_I2C_PERF
+    /// Performance statistics
+    ifx_i2c_perf_t perf;
+#endif
     
     /// IFX I2C tx frame of max length
     uint8_t tx_frame_buffer[DL_MAX_FRAME_SIZE];
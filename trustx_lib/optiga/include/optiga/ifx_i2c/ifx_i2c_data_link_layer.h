@@ -105,6 +105,19 @@ host_lib_status_t ifx_i2c_dl_send_frame(ifx_i2c_context_t *p_ctx,uint16_t frame_
  */
 host_lib_status_t ifx_i2c_dl_receive_frame(ifx_i2c_context_t *p_ctx);
 
+/**
+ * @brief Function for calculating the CRC of a frame.
+ *
+ * Calculates the frame check sequence over the frame header and payload, as appended by
+ * @ref ifx_i2c_dl_send_frame. The implementation is selected by DL_CRC_SLICES.
+ *
+ * @param[in] p_data        Pointer to the frame.
+ * @param[in] data_len      Number of bytes to include.
+ *
+ * @return  CRC of the frame.
+ */
+uint16_t ifx_i2c_dl_calc_crc(const uint8_t* p_data, uint16_t data_len);
+
 #ifdef __cplusplus
 }
 #endif
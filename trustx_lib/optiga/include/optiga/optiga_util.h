@@ -146,7 +146,7 @@ typedef enum eOID_d
  *<b>Notes:</b><br>
  * Initialisation flow example:
  *
- *     optiga_comms_t optiga_comms = {(void*)&ifx_i2c_context_0, NULL, NULL, 0};
+ *     optiga_comms_t optiga_comms = {(void*)&ifx_i2c_context_0, NULL, NULL, 0, &optiga_comms_pool_0};
  *
  *     static int32_t optiga_init(void)
  *    {
@@ -70,6 +70,17 @@ typedef struct pal_i2c
     
 } pal_i2c_t;
 
+/** @brief PAL I2C register read request, used for batched register reads */
+typedef struct pal_i2c_reg_read
+{
+    /// Register address written before the read
+    uint8_t reg_addr;
+    /// Buffer to store the register content
+    uint8_t* p_data;
+    /// Number of bytes to read
+    uint16_t length;
+} pal_i2c_reg_read_t;
+
 /**********************************************************************************************************************
  * API Prototypes
  *********************************************************************************************************************/
@@ -83,6 +94,11 @@ pal_status_t pal_i2c_init(const pal_i2c_t* p_i2c_context);
  */
 pal_status_t pal_i2c_set_bitrate(const pal_i2c_t* p_i2c_context, uint16_t bitrate);
 
+/**
+ * @brief Gets the maximum bitrate (KHz) supported by the I2C master
+ */
+pal_status_t pal_i2c_get_max_bitrate(const pal_i2c_t* p_i2c_context, uint16_t* p_bitrate);
+
 //Dileep:  "write on I2C bus" --> "write to I2C bus"
 /**
  * @brief Writes on I2C bus.
@@ -94,6 +110,21 @@ pal_status_t pal_i2c_write(pal_i2c_t* p_i2c_context, uint8_t* p_data , uint16_t
  */
 pal_status_t pal_i2c_read(pal_i2c_t* p_i2c_context, uint8_t* p_data , uint16_t length);
 
+/**
+ * @brief Writes to and reads from I2C bus in one combined transaction (repeated start, no stop in between).
+ *        Returns PAL_STATUS_FAILURE without an event if the master cannot do combined transactions,
+ *        the caller then uses pal_i2c_write and pal_i2c_read.
+ */
+pal_status_t pal_i2c_write_read(pal_i2c_t* p_i2c_context, uint8_t* p_tx_data, uint16_t tx_length,
+                                uint8_t* p_rx_data, uint16_t rx_length);
+
+/**
+ * @brief Reads several registers from I2C bus in one batched transaction.
+ *        Returns PAL_STATUS_FAILURE without an event if the master cannot do combined transactions,
+ *        the caller then reads the registers one by one.
+ */
+pal_status_t pal_i2c_read_registers(pal_i2c_t* p_i2c_context, pal_i2c_reg_read_t* p_regs, uint8_t count);
+
 /**
  * @brief De-initializes the I2C master.
  */
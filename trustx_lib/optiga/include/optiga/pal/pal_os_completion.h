@@ -0,0 +1,93 @@
+/**
+* MIT License
+*
+* Copyright (c) 2018 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+*
+*
+* \file
+*
+* \brief This file implements the prototype declarations of pal os completion functionalities.
+*
+* \ingroup  grPAL
+* @{
+*/
+#ifndef _PAL_OS_COMPLETION_H_
+#define _PAL_OS_COMPLETION_H_
+
+/**********************************************************************************************************************
+ * HEADER FILES
+ *********************************************************************************************************************/
+ 
+#include "optiga/pal/pal.h"
+
+/*********************************************************************************************************************
+ * pal_os_completion.h
+*********************************************************************************************************************/
+
+
+/**********************************************************************************************************************
+ * MACROS
+ *********************************************************************************************************************/
+
+
+/**********************************************************************************************************************
+ * ENUMS
+ *********************************************************************************************************************/
+
+
+/**********************************************************************************************************************
+ * DATA STRUCTURES
+ *********************************************************************************************************************/
+
+ 
+/**********************************************************************************************************************
+ * API Prototypes
+ *********************************************************************************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+    
+/**
+ * @brief Stores the completion status and wakes up the threads waiting on it.
+ *
+ * Called from the upper layer event handler of the communication stack.
+ */
+void pal_os_completion_signal(volatile uint16_t * p_status, uint16_t status);
+
+/**
+ * @brief Blocks the caller as long as the status is equal to busy_status.
+ *
+ * \retval  uint16_t final status stored by #pal_os_completion_signal
+ */
+uint16_t pal_os_completion_wait(volatile uint16_t * p_status, uint16_t busy_status);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PAL_OS_COMPLETION_H_ */
+
+/**
+* @}
+*/
+
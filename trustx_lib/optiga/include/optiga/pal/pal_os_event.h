@@ -74,6 +74,16 @@ pal_status_t pal_os_event_stop(void);
 void pal_os_event_register_callback_oneshot(register_callback callback, void* callback_args, uint32_t time_us);
 pal_status_t pal_os_event_disarm(void);
 
+/**
+ * @brief Callbacks registered by the calling thread from now on are run on that thread by #pal_os_event_inline_end.
+ *        Required by the IFX I2C synchronous mode only.
+ */
+void pal_os_event_inline_begin(void);
+/**
+ * @brief Sleeps until each callback registered inline expires and runs it, until no callback is pending.
+ */
+void pal_os_event_inline_end(void);
+
 
 #endif //_PAL_OS_EVENT_H_
 
@@ -39,6 +39,25 @@ extern "C" {
 
 #include "pal.h"
 
+/// Timeout value to wait for the lock without a deadline
+#define PAL_OS_LOCK_WAIT_FOREVER    (0xFFFFFFFF)
+
+/**
+ * @brief Priority lanes of the PAL OS lock. Waiters of a higher lane are granted the lock before
+ *        waiters of a lower lane, waiters within a lane are granted the lock in FIFO order.
+ */
+typedef enum pal_os_lock_priority
+{
+    /// Latency critical requests (e.g. TLS handshake signatures)
+    PAL_OS_LOCK_PRIORITY_HIGH = 0,
+    /// Default lane of #pal_os_lock_acquire
+    PAL_OS_LOCK_PRIORITY_NORMAL,
+    /// Background requests (e.g. random number prefetch)
+    PAL_OS_LOCK_PRIORITY_LOW,
+    /// Number of priority lanes
+    PAL_OS_LOCK_PRIORITY_COUNT
+} pal_os_lock_priority_t;
+
 /**
  * @brief   Acquires a lock.
  *
@@ -46,13 +65,65 @@ extern "C" {
  * None.<br>
  *
  *<b>API Details:</b>
- * - Acquires the lock.<br>
+ * - Acquires the lock in the lane of the calling thread, see #pal_os_lock_set_thread_priority.<br>
+ * - Blocks the caller until the lock is granted.<br>
  *<br>
  *
  *
  */
 pal_status_t pal_os_lock_acquire(void);
 
+/**
+ * @brief   Acquires a lock with a deadline.
+ *
+ *<b>Pre-conditions:</b>
+ * None.<br>
+ *
+ *<b>API Details:</b>
+ * - Acquires the lock in the lane of the calling thread, see #pal_os_lock_set_thread_priority.<br>
+ * - Blocks the caller until the lock is granted or timeout_ms has elapsed.<br>
+ * - Returns PAL_STATUS_FAILURE if the lock was not granted in time.<br>
+ *<br>
+ *
+ * \param[in] timeout_ms  Maximum time to wait in milliseconds, #PAL_OS_LOCK_WAIT_FOREVER to wait without deadline
+ *
+ */
+pal_status_t pal_os_lock_acquire_timed(uint32_t timeout_ms);
+
+/**
+ * @brief   Acquires a lock in a priority lane with a deadline.
+ *
+ *<b>Pre-conditions:</b>
+ * None.<br>
+ *
+ *<b>API Details:</b>
+ * - Acquires the lock in the given priority lane.<br>
+ * - Blocks the caller until the lock is granted or timeout_ms has elapsed.<br>
+ * - Returns PAL_STATUS_FAILURE if the lock was not granted in time.<br>
+ *<br>
+ *
+ * \param[in] priority    Priority lane of the request
+ * \param[in] timeout_ms  Maximum time to wait in milliseconds, #PAL_OS_LOCK_WAIT_FOREVER to wait without deadline
+ *
+ */
+pal_status_t pal_os_lock_acquire_priority(pal_os_lock_priority_t priority, uint32_t timeout_ms);
+
+/**
+ * @brief   Sets the priority lane of the calling thread.
+ *
+ *<b>Pre-conditions:</b>
+ * None.<br>
+ *
+ *<b>API Details:</b>
+ * - #pal_os_lock_acquire and #pal_os_lock_acquire_timed of the calling thread use the given lane.<br>
+ * - The lane is #PAL_OS_LOCK_PRIORITY_NORMAL until changed.<br>
+ *<br>
+ *
+ * \param[in] priority    Priority lane of the calling thread
+ *
+ */
+void pal_os_lock_set_thread_priority(pal_os_lock_priority_t priority);
+
 /**
  * @brief   Releases the lock.
  *
@@ -61,12 +132,41 @@ pal_status_t pal_os_lock_acquire(void);
  *
  *<b>API Details:</b>
  * - Releases the lock.<br>
+ * - Hands the lock over to the oldest waiter of the highest non empty priority lane.<br>
  *<br>
  *
  *
  */
 void pal_os_lock_release(void);
 
+/**
+ * @brief   Gives the calling thread a private lock.
+ *
+ *<b>Pre-conditions:</b>
+ * None.<br>
+ *
+ *<b>API Details:</b>
+ * - Subsequent lock calls of the calling thread use a lock of its own instead of the shared one.<br>
+ * - Used by threads which drive an OPTIGA instance no other thread talks to.<br>
+ * - Returns PAL_STATUS_FAILURE if the private lock could not be created.<br>
+ *<br>
+ *
+ */
+pal_status_t pal_os_lock_enter_domain(void);
+
+/**
+ * @brief   Returns the calling thread to the shared lock.
+ *
+ *<b>Pre-conditions:</b>
+ * - The private lock of the calling thread is not owned.<br>
+ *
+ *<b>API Details:</b>
+ * - Destroys the private lock created by #pal_os_lock_enter_domain.<br>
+ *<br>
+ *
+ */
+void pal_os_lock_leave_domain(void);
+
 #ifdef __cplusplus
 }
 #endif
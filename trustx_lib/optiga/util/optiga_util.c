@@ -32,18 +32,18 @@
 #include "optiga/optiga_util.h"
 #include "optiga/comms/optiga_comms.h"
 #include "optiga/cmd/CommandLib.h"
-#include "optiga/pal/pal_os_timer.h"
+#include "optiga/pal/pal_os_completion.h"
 
 ///Length of metadata
 #define LENGTH_METADATA             0x1C
 
-volatile static host_lib_status_t optiga_comms_status;
+volatile static CMDLIB_THREAD_LOCAL host_lib_status_t optiga_comms_status;
 
 #ifdef MODULE_ENABLE_READ_WRITE
 
 static void __optiga_util_comms_event_handler(void* upper_layer_ctx, host_lib_status_t event)
 {
-	optiga_comms_status = event;
+	pal_os_completion_signal((volatile host_lib_status_t*)upper_layer_ctx, event);
 }
 
 optiga_lib_status_t optiga_util_open_application(optiga_comms_t* p_comms)
@@ -56,6 +56,7 @@ optiga_lib_status_t optiga_util_open_application(optiga_comms_t* p_comms)
 		//Invoke optiga_comms_open to initialize the IFX I2C Protocol and security chip
 		optiga_comms_status = OPTIGA_COMMS_BUSY;
 		p_comms->upper_layer_handler = __optiga_util_comms_event_handler;
+		p_comms->upper_layer_ctx = (void*)&optiga_comms_status;
 		status = optiga_comms_open(p_comms);
 		if(E_COMMS_SUCCESS != status)
 		{
@@ -64,12 +65,7 @@ optiga_lib_status_t optiga_util_open_application(optiga_comms_t* p_comms)
 		}
 
 		//Wait until IFX I2C initialization is complete
-		while(optiga_comms_status == OPTIGA_COMMS_BUSY)
-		{
-			pal_os_timer_delay_in_milliseconds(1);
-		}
-
-		if((OPTIGA_COMMS_SUCCESS != status) || (optiga_comms_status == OPTIGA_COMMS_ERROR))
+		if(pal_os_completion_wait(&optiga_comms_status, OPTIGA_COMMS_BUSY) == OPTIGA_COMMS_ERROR)
 		{
 			status = OPTIGA_LIB_ERROR;
 			break;
@@ -446,6 +446,68 @@ pal_status_t pal_i2c_read(pal_i2c_t * p_i2c_context, uint8_t * p_data, uint16_t
 }
 
 
+/**
+ * Writes to and reads from the I2C slave in one combined transaction.
+ * <br>
+ *
+ *<b>API Details:</b>
+ * - The USB to I2C bridge has no repeated start transfer, no event is raised.<br>
+ * - The caller falls back to #pal_i2c_write and #pal_i2c_read.<br>
+ *
+ * \param[in]  p_i2c_context  Pointer to the pal I2C context #pal_i2c_t
+ * \param[in]  p_tx_data      Pointer to the data to be written
+ * \param[in]  tx_length      Length of the data to be written
+ * \param[out] p_rx_data      Pointer to the data buffer to be filled
+ * \param[in]  rx_length      Length of the data to be read
+ *
+ * \retval  #PAL_STATUS_FAILURE  Combined transactions are not supported.
+ */
+//lint --e{715} suppress "The bridge has no combined transfer"
+pal_status_t pal_i2c_write_read(pal_i2c_t * p_i2c_context, uint8_t * p_tx_data, uint16_t tx_length,
+                                uint8_t * p_rx_data, uint16_t rx_length)
+{
+    return PAL_STATUS_FAILURE;
+}
+
+/**
+ * Reads several registers of the I2C slave in one batched transaction.
+ * <br>
+ *
+ *<b>API Details:</b>
+ * - The USB to I2C bridge has no repeated start transfer, no event is raised.<br>
+ * - The caller reads the registers one by one.<br>
+ *
+ * \param[in]     p_i2c_context  Pointer to the pal I2C context #pal_i2c_t
+ * \param[in,out] p_regs         Register read requests
+ * \param[in]     count          Number of register read requests
+ *
+ * \retval  #PAL_STATUS_FAILURE  Batched transactions are not supported.
+ */
+//lint --e{715} suppress "The bridge has no combined transfer"
+pal_status_t pal_i2c_read_registers(pal_i2c_t * p_i2c_context, pal_i2c_reg_read_t * p_regs, uint8_t count)
+{
+    return PAL_STATUS_FAILURE;
+}
+
+/**
+ * Gets the maximum bitrate/speed(KHz) supported by the I2C master.
+ * <br>
+ *
+ *<b>API Details:</b>
+ * - The USB to I2C bridge does not report its bus speed, #PAL_I2C_MASTER_MAX_BITRATE of the bridge is returned.<br>
+ *
+ * \param[in]  p_i2c_context  Pointer to the pal i2c context
+ * \param[out] p_bitrate      Maximum bitrate of i2c master in KHz
+ *
+ * \retval  #PAL_STATUS_SUCCESS  Always.
+ */
+//lint --e{715} suppress "The bridge has no capability query"
+pal_status_t pal_i2c_get_max_bitrate(const pal_i2c_t * p_i2c_context, uint16_t * p_bitrate)
+{
+    *p_bitrate = PAL_I2C_MASTER_MAX_BITRATE;
+    return PAL_STATUS_SUCCESS;
+}
+
 /**
  * Sets the bitrate/speed(KHz) of I2C master.
  * <br>
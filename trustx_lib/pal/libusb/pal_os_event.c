@@ -104,6 +104,35 @@ void pal_os_event_register_callback_oneshot(register_callback callback,
     timer_delay_in_ms = (time_us / CONVERT_US_TO_MS);
 }
 
+/**
+* Prepares running the registered callbacks on the calling thread.
+* <br>
+*
+* <b>API Details:</b>
+*         The callbacks are always triggered by the caller on this platform, nothing to prepare.<br>
+*
+*/
+void pal_os_event_inline_begin(void)
+{
+}
+
+/**
+* Runs the registered callbacks on the calling thread until none is pending.
+* <br>
+*
+* <b>API Details:</b>
+*         Waits for the delay of the registered callback and triggers it.<br>
+*
+*/
+void pal_os_event_inline_end(void)
+{
+    while (callback_registered)
+    {
+        pal_os_timer_delay_in_milliseconds((uint16_t)timer_delay_in_ms);
+        pal_os_event_trigger_registered_callback();
+    }
+}
+
 /**
 * @}
 */
@@ -42,7 +42,9 @@ typedef struct pal_os_lock
 
 volatile static pal_os_lock_t pal_os_lock = {.lock = 0};
 
-pal_status_t pal_os_lock_acquire(void)
+#include "optiga/pal/pal_os_timer.h"
+
+static pal_status_t pal_os_lock_try_acquire(void)
 {
     pal_status_t return_status = PAL_STATUS_FAILURE;
 
@@ -58,6 +60,33 @@ pal_status_t pal_os_lock_acquire(void)
     return return_status;
 }
 
+// Single threaded USB host, priority lanes have no effect and waiting degrades to polling
+pal_status_t pal_os_lock_acquire_priority(pal_os_lock_priority_t priority, uint32_t timeout_ms)
+{
+    uint32_t start_time = pal_os_timer_get_time_in_milliseconds();
+
+    (void)priority;
+    while (PAL_STATUS_SUCCESS != pal_os_lock_try_acquire())
+    {
+        if ((PAL_OS_LOCK_WAIT_FOREVER != timeout_ms) &&
+            ((pal_os_timer_get_time_in_milliseconds() - start_time) >= timeout_ms))
+        {
+            return PAL_STATUS_FAILURE;
+        }
+    }
+    return PAL_STATUS_SUCCESS;
+}
+
+pal_status_t pal_os_lock_acquire_timed(uint32_t timeout_ms)
+{
+    return pal_os_lock_acquire_priority(PAL_OS_LOCK_PRIORITY_NORMAL, timeout_ms);
+}
+
+pal_status_t pal_os_lock_acquire(void)
+{
+    return pal_os_lock_acquire_priority(PAL_OS_LOCK_PRIORITY_NORMAL, PAL_OS_LOCK_WAIT_FOREVER);
+}
+
 void pal_os_lock_release(void)
 {
     if(pal_os_lock.lock)
@@ -66,6 +95,21 @@ void pal_os_lock_release(void)
     }
 }
 
+void pal_os_lock_set_thread_priority(pal_os_lock_priority_t priority)
+{
+    (void)priority;
+}
+
+// Single threaded USB host, there is only one lock domain
+pal_status_t pal_os_lock_enter_domain(void)
+{
+    return PAL_STATUS_SUCCESS;
+}
+
+void pal_os_lock_leave_domain(void)
+{
+}
+
 /**
 * @}
 */
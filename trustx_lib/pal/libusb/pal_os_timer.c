@@ -98,6 +98,31 @@ uint32_t pal_os_timer_get_time_in_milliseconds(void)
 }
 #endif
 
+/**
+ * Function to get the tick count in micro seconds
+ *
+ * \retval  uint32_t time in microseconds
+ */
+#ifdef __WIN32__
+uint32_t pal_os_timer_get_time_in_microseconds(void)
+{
+    struct timeb time;
+
+    ftime(&time);
+
+    return ((uint32_t) (1000000 * time.time + 1000 * time.millitm));
+}
+#else
+uint32_t pal_os_timer_get_time_in_microseconds(void)
+{
+    struct timespec spec;
+
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+
+    return ((uint32_t) (1000000 * spec.tv_sec + spec.tv_nsec / 1000));
+}
+#endif
+
 /**
 * Funtion to wait or delay until the supplied milli seconds time
 * 
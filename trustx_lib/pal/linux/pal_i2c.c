@@ -35,7 +35,10 @@
 */
 
 #include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <stdio.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
 
@@ -54,8 +57,15 @@ extern char * i2c_if;
 
 // Slave address not initialization
 #define IFXI2C_SLAVE_ADDRESS_INIT 0xFFFF
+// Bitrate used if the adapter does not report its bus frequency
+#ifndef PAL_I2C_MASTER_MAX_BITRATE
 #define PAL_I2C_MASTER_MAX_BITRATE 100
+#endif
+// Bus frequency of the adapter as configured by the device tree
+#define PAL_I2C_ADAPTER_FREQ_PATH "/sys/bus/i2c/devices/i2c-%u/of_node/clock-frequency"
 #define WAIT_500_MS	(500)
+// Maximum number of registers in one batched read, each register takes two I2C_RDWR messages
+#define PAL_I2C_MAX_BATCH_REGS (16)
 /// @cond hidden
 
 void i2c_master_end_of_transmit_callback(void);
@@ -63,11 +73,20 @@ void i2c_master_end_of_receive_callback(void);
 void invoke_upper_layer_callback (const pal_i2c_t* p_pal_i2c_ctx, optiga_lib_status_t event);
 uint16_t usb_i2c_poll_operation_result(pal_i2c_t* p_i2c_context);
 
-/* Varibale to indicate the re-entrant count of the i2c bus acquire function*/
-static volatile uint32_t g_entry_count = 0;
+/* Varibale to indicate the re-entrant count of the i2c bus acquire function.
+   Transfers complete synchronously on the calling thread, so each thread driving its own OPTIGA keeps its own*/
+static __thread uint32_t g_entry_count = 0;
 
 /* Pointer to the current pal i2c context*/
-static pal_i2c_t * gp_pal_i2c_current_ctx;
+static __thread pal_i2c_t * gp_pal_i2c_current_ctx;
+
+// I2C adapter of the context, falls back to the process wide i2c_if
+static const char * pal_i2c_get_device(const pal_i2c_t* p_i2c_context)
+{
+    const pal_linux_t * pal_linux = (const pal_linux_t*) p_i2c_context->p_i2c_hw_config;
+
+    return ((NULL != pal_linux) && (NULL != pal_linux->p_i2c_device)) ? pal_linux->p_i2c_device : i2c_if;
+}
 
 //lint --e{715} suppress the unused p_i2c_context variable lint error , since this is kept for future enhancements
 static pal_status_t pal_i2c_acquire(const void * p_i2c_context)
@@ -158,10 +177,11 @@ pal_status_t pal_i2c_init(const pal_i2c_t* p_i2c_context)
 {
 	int32_t ret = PAL_I2C_EVENT_ERROR;
 	pal_linux_t *pal_linux;
+	unsigned long funcs = 0;
 	do
 	{
 		pal_linux = (pal_linux_t*) p_i2c_context->p_i2c_hw_config;
-		pal_linux->i2c_handle = open(i2c_if, O_RDWR);
+		pal_linux->i2c_handle = open(pal_i2c_get_device(p_i2c_context), O_RDWR);
 		LOG_HAL("IFX OPTIGA TRUST X Logs \n");
 		
 		// Assign the slave address
@@ -171,6 +191,10 @@ pal_status_t pal_i2c_init(const pal_i2c_t* p_i2c_context)
 			LOG_HAL((uint32_t)pal_linux->i2c_handle, "ioctl returned an error = ", ret);
 			break;
 		}
+
+		// Combined transfers need plain I2C messages, SMBus only adapters reject I2C_RDWR
+		pal_linux->rdwr_supported = ((0 == ioctl(pal_linux->i2c_handle, I2C_FUNCS, &funcs)) &&
+		                             (0 != (funcs & I2C_FUNC_I2C))) ? true : false;
 		
 		//start_transceive_thread();
 	}while(0);
@@ -277,10 +301,155 @@ pal_status_t pal_i2c_read(pal_i2c_t* p_i2c_context , uint8_t* p_data , uint16_t
     return i2c_read_status;
 }
 
+
+// Submits the messages as one I2C_RDWR transaction and reports the result to the upper layer.
+// Returns PAL_STATUS_FAILURE without an event if the adapter cannot do combined transfers
+static pal_status_t pal_i2c_transfer(pal_i2c_t* p_i2c_context, struct i2c_msg* p_msgs, uint32_t msg_count)
+{
+    pal_status_t status = PAL_STATUS_FAILURE;
+    struct i2c_rdwr_ioctl_data rdwr;
+	pal_linux_t *pal_linux;
+
+	pal_linux = (pal_linux_t*) p_i2c_context->p_i2c_hw_config;
+    if (!pal_linux->rdwr_supported)
+    {
+        return PAL_STATUS_FAILURE;
+    }
+    if (PAL_STATUS_SUCCESS == pal_i2c_acquire(p_i2c_context))
+    {
+        gp_pal_i2c_current_ctx = p_i2c_context;
+
+        rdwr.msgs = p_msgs;
+        rdwr.nmsgs = msg_count;
+        if (0 > ioctl(pal_linux->i2c_handle, I2C_RDWR, &rdwr))
+        {
+            LOG_HAL("[IFX-HAL]: I2C_RDWR ERROR\n");
+            if ((EOPNOTSUPP == errno) || (EINVAL == errno))
+            {
+                // Rejected by the adapter driver, the caller falls back to separate transfers from now on
+                pal_linux->rdwr_supported = false;
+                pal_i2c_release((void *)p_i2c_context);
+                return PAL_STATUS_FAILURE;
+            }
+            //lint --e{611} suppress "void* function pointer is type casted to app_event_handler_t  type"
+            ((app_event_handler_t )(p_i2c_context->upper_layer_event_handler))
+                                                       (p_i2c_context->upper_layer_ctx  , PAL_I2C_EVENT_ERROR);
+            //Release I2C Bus
+            pal_i2c_release((void *)p_i2c_context);
+        }
+        else
+        {
+            i2c_master_end_of_receive_callback();
+        }
+        // The transfer was attempted, its outcome went to the upper layer
+        status = PAL_STATUS_SUCCESS;
+    }
+    else
+    {
+        status = PAL_STATUS_I2C_BUSY;
+        //lint --e{611} suppress "void* function pointer is type casted to app_event_handler_t  type"
+        ((app_event_handler_t )(p_i2c_context->upper_layer_event_handler))
+                                                        (p_i2c_context->upper_layer_ctx  , PAL_I2C_EVENT_BUSY);
+    }
+    return status;
+}
+
+
+pal_status_t pal_i2c_write_read(pal_i2c_t* p_i2c_context, uint8_t* p_tx_data, uint16_t tx_length,
+                                uint8_t* p_rx_data, uint16_t rx_length)
+{
+    struct i2c_msg msgs[2];
+
+    LOG_HAL("[IFX-HAL]: I2C TX (%d) RX (%d)\n", tx_length, rx_length);
+
+    msgs[0].addr  = p_i2c_context->slave_address;
+    msgs[0].flags = 0;
+    msgs[0].len   = tx_length;
+    msgs[0].buf   = p_tx_data;
+    msgs[1].addr  = p_i2c_context->slave_address;
+    msgs[1].flags = I2C_M_RD;
+    msgs[1].len   = rx_length;
+    msgs[1].buf   = p_rx_data;
+
+    return pal_i2c_transfer(p_i2c_context, msgs, 2);
+}
+
+
+pal_status_t pal_i2c_read_registers(pal_i2c_t* p_i2c_context, pal_i2c_reg_read_t* p_regs, uint8_t count)
+{
+    struct i2c_msg msgs[2 * PAL_I2C_MAX_BATCH_REGS];
+    uint8_t index;
+
+    LOG_HAL("[IFX-HAL]: I2C batched register read (%d)\n", count);
+
+    if ((0 == count) || (count > PAL_I2C_MAX_BATCH_REGS))
+    {
+        return PAL_STATUS_FAILURE;
+    }
+
+    for (index = 0; index < count; index++)
+    {
+        msgs[2 * index].addr      = p_i2c_context->slave_address;
+        msgs[2 * index].flags     = 0;
+        msgs[2 * index].len       = 1;
+        msgs[2 * index].buf       = &p_regs[index].reg_addr;
+        msgs[2 * index + 1].addr  = p_i2c_context->slave_address;
+        msgs[2 * index + 1].flags = I2C_M_RD;
+        msgs[2 * index + 1].len   = p_regs[index].length;
+        msgs[2 * index + 1].buf   = p_regs[index].p_data;
+    }
+
+    return pal_i2c_transfer(p_i2c_context, msgs, 2 * (uint32_t)count);
+}
+
    
 
+pal_status_t pal_i2c_get_max_bitrate(const pal_i2c_t* p_i2c_context, uint16_t* p_bitrate)
+{
+    pal_status_t return_status = PAL_STATUS_FAILURE;
+    const char * p_device = pal_i2c_get_device(p_i2c_context);
+    char path[64];
+    uint8_t frequency[4];
+    uint32_t frequency_hz;
+    unsigned int bus;
+    FILE * p_file;
+
+    // Linux does not allow user space to change the bus speed, so report what the adapter runs at
+    *p_bitrate = PAL_I2C_MASTER_MAX_BITRATE;
+    do
+    {
+        if ((NULL == p_device) || (1 != sscanf(p_device, "/dev/i2c-%u", &bus)))
+        {
+            break;
+        }
+        snprintf(path, sizeof(path), PAL_I2C_ADAPTER_FREQ_PATH, bus);
+        p_file = fopen(path, "rb");
+        if (NULL == p_file)
+        {
+            break;
+        }
+        // Device tree cells are stored big endian
+        if (sizeof(frequency) == fread(frequency, 1, sizeof(frequency), p_file))
+        {
+            frequency_hz = ((uint32_t)frequency[0] << 24) | ((uint32_t)frequency[1] << 16) |
+                           ((uint32_t)frequency[2] << 8) | frequency[3];
+            if ((frequency_hz >= 1000) && ((frequency_hz / 1000) <= 0xFFFF))
+            {
+                *p_bitrate = (uint16_t)(frequency_hz / 1000);
+                return_status = PAL_STATUS_SUCCESS;
+            }
+        }
+        fclose(p_file);
+    }while(0);
+
+    LOG_HAL("pal_i2c_get_max_bitrate %d KHz\n", *p_bitrate);
+    return return_status;
+}
+
+
 pal_status_t pal_i2c_set_bitrate(const pal_i2c_t* p_i2c_context , uint16_t bitrate)
 {
+    uint16_t max_bitrate;
     pal_status_t return_status = PAL_STATUS_FAILURE;
     optiga_lib_status_t event = PAL_I2C_EVENT_ERROR;
 	LOG_HAL("pal_i2c_set_bitrate\n. ");
@@ -289,9 +458,11 @@ pal_status_t pal_i2c_set_bitrate(const pal_i2c_t* p_i2c_context , uint16_t bitra
     {    
         // If the user provided bitrate is greater than the I2C master hardware maximum supported value,
         // set the I2C master to its maximum supported value.
-        if (bitrate > PAL_I2C_MASTER_MAX_BITRATE)         
+        //lint --e{534} suppress "Fallback value is returned, if the adapter frequency is unknown"
+        pal_i2c_get_max_bitrate(p_i2c_context, &max_bitrate);
+        if (bitrate > max_bitrate)
         {
-            bitrate = PAL_I2C_MASTER_MAX_BITRATE;
+            bitrate = max_bitrate;
         }
         return_status = PAL_STATUS_SUCCESS;
         event = PAL_I2C_EVENT_SUCCESS;
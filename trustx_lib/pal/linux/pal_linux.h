@@ -53,6 +53,10 @@ typedef struct pal_linux
     int32_t i2c_handle;
     /// Pointer to store the callers handler
     void * upper_layer_event_handler;
+    /// I2C adapter of this context (e.g. "/dev/i2c-1"), i2c_if is used if NULL
+    const char * p_i2c_device;
+    /// Set by pal_i2c_init if the adapter takes combined I2C_RDWR transfers
+    uint8_t rdwr_supported;
 } pal_linux_t;
 
 #endif
\ No newline at end of file
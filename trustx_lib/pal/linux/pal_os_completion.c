@@ -0,0 +1,72 @@
+/**
+* \copyright
+* MIT License
+*
+* Copyright (c) 2018 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+*
+* \endcopyright
+*
+* \author Infineon Technologies AG
+*
+* \file pal_os_completion.c
+*
+* \brief   This file implements the platform abstraction layer APIs for command completion.
+*
+* \ingroup  grPAL
+* @{
+*/
+
+#include <pthread.h>
+#include "optiga/pal/pal_os_completion.h"
+
+/*
+ * A single condition is shared by all completion variables. At most a handful of commands are in flight
+ * at the same time (one per security chip), so a broadcast is cheaper than a condition per status.
+ */
+static pthread_mutex_t pal_os_completion_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  pal_os_completion_cond  = PTHREAD_COND_INITIALIZER;
+
+void pal_os_completion_signal(volatile uint16_t * p_status, uint16_t status)
+{
+    pthread_mutex_lock(&pal_os_completion_mutex);
+    *p_status = status;
+    pthread_cond_broadcast(&pal_os_completion_cond);
+    pthread_mutex_unlock(&pal_os_completion_mutex);
+}
+
+uint16_t pal_os_completion_wait(volatile uint16_t * p_status, uint16_t busy_status)
+{
+    uint16_t status;
+
+    pthread_mutex_lock(&pal_os_completion_mutex);
+    while (*p_status == busy_status)
+    {
+        pthread_cond_wait(&pal_os_completion_cond, &pal_os_completion_mutex);
+    }
+    status = *p_status;
+    pthread_mutex_unlock(&pal_os_completion_mutex);
+
+    return status;
+}
+
+/**
+* @}
+*/
@@ -30,39 +30,265 @@
 * @{
 */
 
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
 #include "optiga/pal/pal_os_lock.h"
 
+/**
+ * @brief PAL OS lock waiter, lives on the stack of the waiting thread
+ */
+typedef struct pal_os_lock_waiter
+{
+    /// condition signalled when the lock is handed over to this waiter
+    pthread_cond_t cond;
+    /// set by the releasing thread once ownership is transferred
+    uint8_t granted;
+    /// next waiter in the same priority lane
+    struct pal_os_lock_waiter * p_next;
+} pal_os_lock_waiter_t;
+
 /**
  * @brief PAL OS lock structure. Might be extended if needed
  */
 typedef struct pal_os_lock
 {
+    /// protects the fields below
+    pthread_mutex_t mutex;
+    /// set while the lock is owned
     uint8_t lock;
+    /// FIFO of waiters per priority lane
+    pal_os_lock_waiter_t * p_head[PAL_OS_LOCK_PRIORITY_COUNT];
+    /// last waiter per priority lane
+    pal_os_lock_waiter_t * p_tail[PAL_OS_LOCK_PRIORITY_COUNT];
 } pal_os_lock_t;
 
-volatile static pal_os_lock_t pal_os_lock = {.lock = 0};
+static pal_os_lock_t pal_os_lock_0 = {.mutex = PTHREAD_MUTEX_INITIALIZER, .lock = 0};
 
-pal_status_t pal_os_lock_acquire(void)
+/// Private lock of the calling thread, see #pal_os_lock_enter_domain
+static __thread pal_os_lock_t * p_pal_os_lock_domain = NULL;
+
+/// Lane of #pal_os_lock_acquire for the calling thread
+static __thread pal_os_lock_priority_t pal_os_lock_thread_priority = PAL_OS_LOCK_PRIORITY_NORMAL;
+
+static pal_os_lock_t * pal_os_lock_get(void)
+{
+    return (NULL != p_pal_os_lock_domain) ? p_pal_os_lock_domain : &pal_os_lock_0;
+}
+
+// Removes the waiter from its lane if it is still queued. Must be called with the mutex held
+static void pal_os_lock_dequeue(pal_os_lock_t * p_lock, pal_os_lock_priority_t priority, pal_os_lock_waiter_t * p_waiter)
+{
+    pal_os_lock_waiter_t * p_prev = NULL;
+    pal_os_lock_waiter_t * p_node = p_lock->p_head[priority];
+
+    while ((NULL != p_node) && (p_node != p_waiter))
+    {
+        p_prev = p_node;
+        p_node = p_node->p_next;
+    }
+    if (NULL == p_node)
+    {
+        return;
+    }
+    if (NULL == p_prev)
+    {
+        p_lock->p_head[priority] = p_node->p_next;
+    }
+    else
+    {
+        p_prev->p_next = p_node->p_next;
+    }
+    if (p_lock->p_tail[priority] == p_node)
+    {
+        p_lock->p_tail[priority] = p_prev;
+    }
+}
+
+static void pal_os_lock_get_deadline(uint32_t timeout_ms, struct timespec * p_deadline)
+{
+    clock_gettime(CLOCK_MONOTONIC, p_deadline);
+    p_deadline->tv_sec += (time_t)(timeout_ms / 1000);
+    p_deadline->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (p_deadline->tv_nsec >= 1000000000L)
+    {
+        p_deadline->tv_sec++;
+        p_deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+pal_status_t pal_os_lock_acquire_priority(pal_os_lock_priority_t priority, uint32_t timeout_ms)
 {
     pal_status_t return_status = PAL_STATUS_FAILURE;
+    pal_os_lock_waiter_t waiter;
+    pthread_condattr_t attr;
+    struct timespec deadline;
+    uint8_t lane;
+    int wait_status = 0;
+    pal_os_lock_t * p_lock = pal_os_lock_get();
 
-    if(!(pal_os_lock.lock))
+    if (priority >= PAL_OS_LOCK_PRIORITY_COUNT)
     {
-    	pal_os_lock.lock++;
-        if(pal_os_lock.lock != 1)
+        priority = PAL_OS_LOCK_PRIORITY_LOW;
+    }
+
+    pthread_mutex_lock(&p_lock->mutex);
+    do
+    {
+        // Fast path, nobody owns the lock and nobody is queued in front of us
+        if (!p_lock->lock)
         {
-        	pal_os_lock.lock--;
+            for (lane = 0; lane < PAL_OS_LOCK_PRIORITY_COUNT; lane++)
+            {
+                if (NULL != p_lock->p_head[lane])
+                {
+                    break;
+                }
+            }
+            if (PAL_OS_LOCK_PRIORITY_COUNT == lane)
+            {
+                p_lock->lock = 1;
+                return_status = PAL_STATUS_SUCCESS;
+                break;
+            }
         }
-        return_status = PAL_STATUS_SUCCESS;
-    }
+
+        if (0 == timeout_ms)
+        {
+            break;
+        }
+
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&waiter.cond, &attr);
+        pthread_condattr_destroy(&attr);
+        waiter.granted = 0;
+        waiter.p_next = NULL;
+
+        if (NULL == p_lock->p_tail[priority])
+        {
+            p_lock->p_head[priority] = &waiter;
+        }
+        else
+        {
+            p_lock->p_tail[priority]->p_next = &waiter;
+        }
+        p_lock->p_tail[priority] = &waiter;
+
+        if (PAL_OS_LOCK_WAIT_FOREVER != timeout_ms)
+        {
+            pal_os_lock_get_deadline(timeout_ms, &deadline);
+        }
+
+        // Ownership is handed over by pal_os_lock_release, the flag guards against spurious wake ups
+        while ((!waiter.granted) && (ETIMEDOUT != wait_status))
+        {
+            if (PAL_OS_LOCK_WAIT_FOREVER == timeout_ms)
+            {
+                wait_status = pthread_cond_wait(&waiter.cond, &p_lock->mutex);
+            }
+            else
+            {
+                wait_status = pthread_cond_timedwait(&waiter.cond, &p_lock->mutex, &deadline);
+            }
+        }
+
+        if (waiter.granted)
+        {
+            return_status = PAL_STATUS_SUCCESS;
+        }
+        else
+        {
+            pal_os_lock_dequeue(p_lock, priority, &waiter);
+        }
+        pthread_cond_destroy(&waiter.cond);
+    } while (0);
+    pthread_mutex_unlock(&p_lock->mutex);
+
     return return_status;
 }
 
+pal_status_t pal_os_lock_acquire_timed(uint32_t timeout_ms)
+{
+    return pal_os_lock_acquire_priority(pal_os_lock_thread_priority, timeout_ms);
+}
+
+pal_status_t pal_os_lock_acquire(void)
+{
+    return pal_os_lock_acquire_priority(pal_os_lock_thread_priority, PAL_OS_LOCK_WAIT_FOREVER);
+}
+
+void pal_os_lock_set_thread_priority(pal_os_lock_priority_t priority)
+{
+    pal_os_lock_thread_priority = (priority < PAL_OS_LOCK_PRIORITY_COUNT) ? priority : PAL_OS_LOCK_PRIORITY_LOW;
+}
+
 void pal_os_lock_release(void)
 {
-    if(pal_os_lock.lock)
+    pal_os_lock_waiter_t * p_waiter = NULL;
+    uint8_t lane;
+    pal_os_lock_t * p_lock = pal_os_lock_get();
+
+    pthread_mutex_lock(&p_lock->mutex);
+    if (p_lock->lock)
+    {
+        for (lane = 0; lane < PAL_OS_LOCK_PRIORITY_COUNT; lane++)
+        {
+            p_waiter = p_lock->p_head[lane];
+            if (NULL != p_waiter)
+            {
+                p_lock->p_head[lane] = p_waiter->p_next;
+                if (NULL == p_lock->p_head[lane])
+                {
+                    p_lock->p_tail[lane] = NULL;
+                }
+                break;
+            }
+        }
+
+        if (NULL != p_waiter)
+        {
+            // Hand the lock over directly, so a late arriving thread cannot barge in front of the queue
+            p_waiter->granted = 1;
+            pthread_cond_signal(&p_waiter->cond);
+        }
+        else
+        {
+            p_lock->lock = 0;
+        }
+    }
+    pthread_mutex_unlock(&p_lock->mutex);
+}
+
+pal_status_t pal_os_lock_enter_domain(void)
+{
+    pal_os_lock_t * p_lock;
+
+    if (NULL != p_pal_os_lock_domain)
+    {
+        return PAL_STATUS_SUCCESS;
+    }
+    p_lock = (pal_os_lock_t *)calloc(1, sizeof(pal_os_lock_t));
+    if (NULL == p_lock)
+    {
+        return PAL_STATUS_FAILURE;
+    }
+    pthread_mutex_init(&p_lock->mutex, NULL);
+    p_pal_os_lock_domain = p_lock;
+    return PAL_STATUS_SUCCESS;
+}
+
+void pal_os_lock_leave_domain(void)
+{
+    pal_os_lock_t * p_lock = p_pal_os_lock_domain;
+
+    if (NULL != p_lock)
     {
-    	pal_os_lock.lock--;
+        p_pal_os_lock_domain = NULL;
+        pthread_mutex_destroy(&p_lock->mutex);
+        free(p_lock);
     }
 }
 
@@ -35,6 +35,7 @@
 */
 
 #include <sys/time.h> 
+#include <time.h>
 #include <stdio.h>
 #include "stdint.h"
 #include <unistd.h>
@@ -69,6 +70,19 @@ uint32_t pal_os_timer_get_time_in_milliseconds()
     return now_ms;
 }
 
+uint32_t pal_os_timer_get_time_in_microseconds()
+{
+    uint32_t        now_us = 0;
+    struct timespec ts;
+
+    // Monotonic, so the adaptive pollers in the stack are not disturbed by clock adjustments
+    if (0 == clock_gettime(CLOCK_MONOTONIC, &ts))
+    {
+    	now_us = (uint32_t)((ts.tv_sec * 1000000) + (ts.tv_nsec / 1000));
+    }
+    return now_us;
+}
+
 
 void pal_os_timer_delay_in_milliseconds(uint16_t milliseconds)
 {
@@ -0,0 +1,234 @@
+/**
+* MIT License
+*
+* Copyright (c) 2019 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+
+#include <string.h>
+#include <pthread.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#include <openssl/crypto.h>
+
+#include "trustx_provider_common.h"
+#include "trustx.h"
+
+//Local
+static pthread_mutex_t chip_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int chip_opened = 0;
+
+static const OSSL_ALGORITHM trustx_prov_keymgmt[] =
+{
+  { "EC:id-ecPublicKey:1.2.840.10045.2.1", TRUSTX_PROVIDER_PROPS, trustx_prov_keymgmt_functions, "OPTIGA Trust X EC key" },
+  { NULL, NULL, NULL, NULL }
+};
+
+static const OSSL_ALGORITHM trustx_prov_signature[] =
+{
+  { "ECDSA", TRUSTX_PROVIDER_PROPS, trustx_prov_signature_functions, "OPTIGA Trust X ECDSA" },
+  { NULL, NULL, NULL, NULL }
+};
+
+static const OSSL_ALGORITHM trustx_prov_rand[] =
+{
+  { "TRUSTX-TRNG", TRUSTX_PROVIDER_PROPS, trustx_prov_rand_functions, "OPTIGA Trust X TRNG" },
+  { NULL, NULL, NULL, NULL }
+};
+
+static const OSSL_ALGORITHM trustx_prov_store[] =
+{
+  { TRUSTX_PROVIDER_URI_SCHEME, TRUSTX_PROVIDER_PROPS, trustx_prov_store_functions, "OPTIGA Trust X key objects" },
+  { NULL, NULL, NULL, NULL }
+};
+
+static const OSSL_PARAM trustx_prov_param_types[] =
+{
+  OSSL_PARAM_DEFN(OSSL_PROV_PARAM_NAME, OSSL_PARAM_UTF8_PTR, NULL, 0),
+  OSSL_PARAM_DEFN(OSSL_PROV_PARAM_VERSION, OSSL_PARAM_UTF8_PTR, NULL, 0),
+  OSSL_PARAM_DEFN(OSSL_PROV_PARAM_BUILDINFO, OSSL_PARAM_UTF8_PTR, NULL, 0),
+  OSSL_PARAM_DEFN(OSSL_PROV_PARAM_STATUS, OSSL_PARAM_INTEGER, NULL, 0),
+  OSSL_PARAM_END
+};
+
+static const OSSL_PARAM *trustx_prov_gettable_params(void *provctx)
+{
+  return trustx_prov_param_types;
+}
+
+static int trustx_prov_get_params(void *provctx, OSSL_PARAM params[])
+{
+  OSSL_PARAM *p;
+
+  p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_NAME);
+  if ((p != NULL) && !OSSL_PARAM_set_utf8_ptr(p, TRUSTX_PROVIDER_NAME))
+    return TRUSTX_PROVIDER_FAIL;
+  p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_VERSION);
+  if ((p != NULL) && !OSSL_PARAM_set_utf8_ptr(p, TRUSTX_PROVIDER_VERSION))
+    return TRUSTX_PROVIDER_FAIL;
+  p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_BUILDINFO);
+  if ((p != NULL) && !OSSL_PARAM_set_utf8_ptr(p, OPENSSL_VERSION_TEXT))
+    return TRUSTX_PROVIDER_FAIL;
+  p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_STATUS);
+  if ((p != NULL) && !OSSL_PARAM_set_int(p, 1))
+    return TRUSTX_PROVIDER_FAIL;
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+static const OSSL_ALGORITHM *trustx_prov_query(void *provctx, int operation_id, int *no_cache)
+{
+  *no_cache = 0;
+  switch (operation_id)
+  {
+    case OSSL_OP_KEYMGMT:
+      return trustx_prov_keymgmt;
+    case OSSL_OP_SIGNATURE:
+      return trustx_prov_signature;
+    case OSSL_OP_RAND:
+      return trustx_prov_rand;
+    case OSSL_OP_STORE:
+      return trustx_prov_store;
+  }
+  return NULL;
+}
+
+static void trustx_prov_teardown(void *provctx)
+{
+  trustx_prov_ctx_t *ctx = provctx;
+
+  TRUSTX_PROVIDER_DBGFN("> Provider 0x%p teardown", provctx);
+  pthread_mutex_lock(&chip_mutex);
+  if (chip_opened)
+  {
+    trustX_Close();
+    __atomic_store_n(&chip_opened, 0, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&chip_mutex);
+  OSSL_LIB_CTX_free(ctx->libctx);
+  OPENSSL_free(ctx);
+  TRUSTX_PROVIDER_DBGFN("<");
+}
+
+static const OSSL_DISPATCH trustx_prov_dispatch[] =
+{
+  { OSSL_FUNC_PROVIDER_TEARDOWN, (void (*)(void))trustx_prov_teardown },
+  { OSSL_FUNC_PROVIDER_GETTABLE_PARAMS, (void (*)(void))trustx_prov_gettable_params },
+  { OSSL_FUNC_PROVIDER_GET_PARAMS, (void (*)(void))trustx_prov_get_params },
+  { OSSL_FUNC_PROVIDER_QUERY_OPERATION, (void (*)(void))trustx_prov_query },
+  { 0, NULL }
+};
+
+/*
+ * Opens the chip on first use and shares the session with all later callers, loading the
+ * provider alone does not touch the chip. A failed open is retried on the next use.
+ */
+int trustxProvider_open(void)
+{
+  int ret = TRUSTX_PROVIDER_SUCCESS;
+
+  if (__atomic_load_n(&chip_opened, __ATOMIC_ACQUIRE))
+    return TRUSTX_PROVIDER_SUCCESS;
+
+  pthread_mutex_lock(&chip_mutex);
+  if (!chip_opened)
+  {
+    if (trustX_Open() == OPTIGA_LIB_SUCCESS)
+      __atomic_store_n(&chip_opened, 1, __ATOMIC_RELEASE);
+    else
+    {
+      TRUSTX_PROVIDER_ERRFN("failed to open OPTIGA application.");
+      ret = TRUSTX_PROVIDER_FAIL;
+    }
+  }
+  pthread_mutex_unlock(&chip_mutex);
+  return ret;
+}
+
+/*
+ * Key objects are reference counted, the key itself never leaves the chip. Operation
+ * contexts take a reference, so a key may be freed by the application while in use.
+ */
+trustx_prov_key_t *trustxProvider_key_new(trustx_prov_ctx_t *provctx)
+{
+  trustx_prov_key_t *key = OPENSSL_zalloc(sizeof(trustx_prov_key_t));
+
+  if (key == NULL)
+    return NULL;
+  key->provctx = provctx;
+  key->refcnt = 1;
+  key->ec_key_curve = OPTIGA_ECC_NIST_P_256;
+  return key;
+}
+
+int trustxProvider_key_up_ref(trustx_prov_key_t *key)
+{
+  __atomic_add_fetch(&key->refcnt, 1, __ATOMIC_RELAXED);
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+void trustxProvider_key_free(trustx_prov_key_t *key)
+{
+  if ((key == NULL) || (__atomic_sub_fetch(&key->refcnt, 1, __ATOMIC_ACQ_REL) > 0))
+    return;
+  EVP_PKEY_free(key->pub);
+  OPENSSL_free(key);
+}
+
+int OSSL_provider_init(const OSSL_CORE_HANDLE *handle,
+                       const OSSL_DISPATCH *in,
+                       const OSSL_DISPATCH **out,
+                       void **provctx)
+{
+  trustx_prov_ctx_t *ctx = NULL;
+  int ret = TRUSTX_PROVIDER_FAIL;
+
+  TRUSTX_PROVIDER_DBGFN(">");
+
+  do {
+    ctx = OPENSSL_zalloc(sizeof(trustx_prov_ctx_t));
+    if (ctx == NULL)
+      break;
+    ctx->core = handle;
+    // Software algorithms for public key operations come from the application's providers
+    ctx->libctx = OSSL_LIB_CTX_new_child(handle, in);
+    if (ctx->libctx == NULL)
+    {
+      TRUSTX_PROVIDER_ERRFN("failed to create library context");
+      break;
+    }
+
+    //The trustx application is opened on first use, see trustxProvider_open()
+
+    *out = trustx_prov_dispatch;
+    *provctx = ctx;
+    ctx = NULL;
+    ret = TRUSTX_PROVIDER_SUCCESS;
+  }while(FALSE);
+
+  if (ctx != NULL)
+  {
+    OSSL_LIB_CTX_free(ctx->libctx);
+    OPENSSL_free(ctx);
+  }
+
+  TRUSTX_PROVIDER_DBGFN("<");
+  return ret;
+}
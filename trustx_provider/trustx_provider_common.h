@@ -0,0 +1,110 @@
+/**
+* MIT License
+*
+* Copyright (c) 2019 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#ifndef _TRUSTX_PROVIDER_COMMON_H_
+#define _TRUSTX_PROVIDER_COMMON_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <openssl/core.h>
+#include <openssl/core_dispatch.h>
+#include <openssl/evp.h>
+
+#include "optiga_crypt.h"
+
+
+// SETTINGS
+#define TRUSTX_PROVIDER_NAME             "Infineon OPTIGA Trust X provider"
+#define TRUSTX_PROVIDER_VERSION          "1.0.0"
+#define TRUSTX_PROVIDER_PROPS            "provider=trustx"
+#define TRUSTX_PROVIDER_PROPQ_SOFTWARE   "provider!=trustx" /* Public key operations, never loop back into this provider */
+#define TRUSTX_PROVIDER_URI_SCHEME       "trustx"
+#define TRUSTX_PROVIDER_RAND_MAX_REQUEST (4096)             /* Largest single request to the TRNG */
+#define TRUSTX_PROVIDER_SIG_MAX_LEN      (256)
+#define TRUSTX_PROVIDER_URI_MAX_LEN      (256)              /* Key OID and public key input of a store URI */
+
+//#define TRUSTX_PROVIDER_DEBUG = 1
+
+#ifdef TRUSTX_PROVIDER_DEBUG
+
+#define TRUSTX_PROVIDER_DBGFN(x, ...)    fprintf(stderr, "%s:%d %s: " x "\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
+#define TRUSTX_PROVIDER_ERRFN(x, ...)    fprintf(stderr, "Error in %s:%d %s: " x "\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
+
+#else
+
+#define TRUSTX_PROVIDER_DBGFN(x, ...)
+#define TRUSTX_PROVIDER_ERRFN(x, ...)    fprintf(stderr, "Error in %s:%d %s: " x "\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
+
+#endif
+
+/// Definition for false
+#ifndef FALSE
+#define FALSE               (0U)
+#endif
+
+/// Definition for true
+#ifndef TRUE
+#define TRUE                (1U)
+#endif
+
+// trustx provider return code
+#define TRUSTX_PROVIDER_SUCCESS	1
+#define TRUSTX_PROVIDER_FAIL		0
+
+/*
+ * Provider context, one per loaded provider. Operations only read it, so the dispatch
+ * functions may run on any number of threads at once.
+ */
+typedef struct trustx_prov_ctx_str
+{
+  const OSSL_CORE_HANDLE *core;
+  OSSL_LIB_CTX           *libctx;   /* child of the application's library context */
+} trustx_prov_ctx_t;
+
+/*
+ * Chip resident EC key. Immutable once loaded and shared by reference between the
+ * operation contexts of all threads.
+ */
+typedef struct trustx_prov_key_str
+{
+  trustx_prov_ctx_t  *provctx;
+  int                 refcnt;
+  uint16_t            key_oid;      /* 0 for a software key */
+  optiga_ecc_curve_t  ec_key_curve;
+  EVP_PKEY           *pub;          /* public half, or the whole software key, held by a software provider */
+} trustx_prov_key_t;
+
+//extern
+extern const OSSL_DISPATCH trustx_prov_keymgmt_functions[];
+extern const OSSL_DISPATCH trustx_prov_signature_functions[];
+extern const OSSL_DISPATCH trustx_prov_rand_functions[];
+extern const OSSL_DISPATCH trustx_prov_store_functions[];
+
+//function prototype
+int trustxProvider_open(void);
+trustx_prov_key_t *trustxProvider_key_new(trustx_prov_ctx_t *provctx);
+int trustxProvider_key_up_ref(trustx_prov_key_t *key);
+void trustxProvider_key_free(trustx_prov_key_t *key);
+
+#endif // _TRUSTX_PROVIDER_COMMON_H_
@@ -0,0 +1,380 @@
+/**
+* MIT License
+*
+* Copyright (c) 2019 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+
+#include <string.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+
+#include "trustx_provider_common.h"
+
+/*
+ * Key management for chip resident EC keys. Everything about the public half is
+ * answered by the software provider holding it, only the OID names the private half.
+ * The keymgmt is registered as EC, so OpenSSL may pick it for software keys as well.
+ * Those are generated and imported by the software provider and held completely in pub.
+ */
+
+typedef struct trustx_keymgmt_gen_ctx_str
+{
+  trustx_prov_ctx_t *provctx;
+  int                selection;
+  trustx_prov_key_t *templ;
+  OSSL_PARAM        *params;      /* deep copy of all parameters set so far */
+} trustx_keymgmt_gen_ctx_t;
+
+static const OSSL_PARAM trustx_keymgmt_param_types[] =
+{
+  OSSL_PARAM_int(OSSL_PKEY_PARAM_BITS, NULL),
+  OSSL_PARAM_int(OSSL_PKEY_PARAM_SECURITY_BITS, NULL),
+  OSSL_PARAM_int(OSSL_PKEY_PARAM_MAX_SIZE, NULL),
+  OSSL_PARAM_utf8_string(OSSL_PKEY_PARAM_GROUP_NAME, NULL, 0),
+  OSSL_PARAM_utf8_string(OSSL_PKEY_PARAM_EC_POINT_CONVERSION_FORMAT, NULL, 0),
+  OSSL_PARAM_utf8_string(OSSL_PKEY_PARAM_DEFAULT_DIGEST, NULL, 0),
+  OSSL_PARAM_octet_string(OSSL_PKEY_PARAM_ENCODED_PUBLIC_KEY, NULL, 0),
+  OSSL_PARAM_octet_string(OSSL_PKEY_PARAM_PUB_KEY, NULL, 0),
+  OSSL_PARAM_END
+};
+
+static const OSSL_PARAM trustx_keymgmt_pub_types[] =
+{
+  OSSL_PARAM_utf8_string(OSSL_PKEY_PARAM_GROUP_NAME, NULL, 0),
+  OSSL_PARAM_octet_string(OSSL_PKEY_PARAM_PUB_KEY, NULL, 0),
+  OSSL_PARAM_END
+};
+
+static const OSSL_PARAM trustx_keymgmt_keypair_types[] =
+{
+  OSSL_PARAM_utf8_string(OSSL_PKEY_PARAM_GROUP_NAME, NULL, 0),
+  OSSL_PARAM_octet_string(OSSL_PKEY_PARAM_PUB_KEY, NULL, 0),
+  OSSL_PARAM_BN(OSSL_PKEY_PARAM_PRIV_KEY, NULL, 0),
+  OSSL_PARAM_END
+};
+
+// EVP_PKEY_fromdata() and EVP_PKEY_todata() selection for a keymgmt selection
+static int trustx_keymgmt_pkey_selection(int selection)
+{
+  if ((selection & OSSL_KEYMGMT_SELECT_PRIVATE_KEY) != 0)
+    return EVP_PKEY_KEYPAIR;
+  if ((selection & OSSL_KEYMGMT_SELECT_PUBLIC_KEY) != 0)
+    return EVP_PKEY_PUBLIC_KEY;
+  return EVP_PKEY_KEY_PARAMETERS;
+}
+
+static int trustx_keymgmt_soft_has(const EVP_PKEY *pkey, int selection)
+{
+  BIGNUM *priv = NULL;
+  size_t  len = 0;
+  int     ret;
+
+  if ((selection & OSSL_KEYMGMT_SELECT_PRIVATE_KEY) != 0)
+  {
+    ret = EVP_PKEY_get_bn_param(pkey, OSSL_PKEY_PARAM_PRIV_KEY, &priv);
+    BN_clear_free(priv);
+    if (!ret)
+      return TRUSTX_PROVIDER_FAIL;
+  }
+  if (((selection & OSSL_KEYMGMT_SELECT_PUBLIC_KEY) != 0) &&
+      !EVP_PKEY_get_octet_string_param(pkey, OSSL_PKEY_PARAM_PUB_KEY, NULL, 0, &len))
+    return TRUSTX_PROVIDER_FAIL;
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+static void trustx_keymgmt_set_pub(trustx_prov_key_t *key, EVP_PKEY *pub)
+{
+  EVP_PKEY_free(key->pub);
+  key->pub = pub;
+  key->ec_key_curve = (EVP_PKEY_get_bits(pub) == 384) ? OPTIGA_ECC_NIST_P_384 : OPTIGA_ECC_NIST_P_256;
+}
+
+static void *trustx_keymgmt_new(void *provctx)
+{
+  return trustxProvider_key_new(provctx);
+}
+
+static void trustx_keymgmt_free(void *keydata)
+{
+  trustxProvider_key_free(keydata);
+}
+
+static int trustx_keymgmt_has(const void *keydata, int selection)
+{
+  const trustx_prov_key_t *key = keydata;
+
+  if (key == NULL)
+    return TRUSTX_PROVIDER_FAIL;
+  if (((selection & OSSL_KEYMGMT_SELECT_ALL) != 0) && (key->pub == NULL))
+    return TRUSTX_PROVIDER_FAIL;
+  // Software key
+  if (key->key_oid == 0)
+    return trustx_keymgmt_soft_has(key->pub, selection);
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+static int trustx_keymgmt_match(const void *keydata1, const void *keydata2, int selection)
+{
+  const trustx_prov_key_t *key1 = keydata1;
+  const trustx_prov_key_t *key2 = keydata2;
+
+  if (((selection & OSSL_KEYMGMT_SELECT_PRIVATE_KEY) != 0) && (key1->key_oid != key2->key_oid))
+    return TRUSTX_PROVIDER_FAIL;
+  if ((selection & OSSL_KEYMGMT_SELECT_ALL_PARAMETERS) != 0 ||
+      (selection & OSSL_KEYMGMT_SELECT_PUBLIC_KEY) != 0)
+  {
+    if ((key1->pub == NULL) || (key2->pub == NULL))
+      return TRUSTX_PROVIDER_FAIL;
+    return (EVP_PKEY_eq(key1->pub, key2->pub) == 1);
+  }
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+static int trustx_keymgmt_get_params(void *keydata, OSSL_PARAM params[])
+{
+  trustx_prov_key_t *key = keydata;
+
+  if (key->pub == NULL)
+    return TRUSTX_PROVIDER_FAIL;
+  return EVP_PKEY_get_params(key->pub, params);
+}
+
+static const OSSL_PARAM *trustx_keymgmt_gettable_params(void *provctx)
+{
+  return trustx_keymgmt_param_types;
+}
+
+// A private key imported into a new key makes it a software key, chip keys only take the public half
+static int trustx_keymgmt_import(void *keydata, int selection, const OSSL_PARAM params[])
+{
+  trustx_prov_key_t *key = keydata;
+  EVP_PKEY_CTX      *ctx = NULL;
+  EVP_PKEY          *pub = NULL;
+  int                ret = TRUSTX_PROVIDER_FAIL;
+
+  if ((key->key_oid != 0) && ((selection & OSSL_KEYMGMT_SELECT_PRIVATE_KEY) != 0))
+  {
+    TRUSTX_PROVIDER_ERRFN("private keys cannot be imported into OPTIGA");
+    return TRUSTX_PROVIDER_FAIL;
+  }
+
+  do {
+    ctx = EVP_PKEY_CTX_new_from_name(key->provctx->libctx, "EC", TRUSTX_PROVIDER_PROPQ_SOFTWARE);
+    if ((ctx == NULL) || (EVP_PKEY_fromdata_init(ctx) <= 0) ||
+        (EVP_PKEY_fromdata(ctx, &pub, trustx_keymgmt_pkey_selection(selection), (OSSL_PARAM *)params) <= 0))
+    {
+      TRUSTX_PROVIDER_ERRFN("failed to import key");
+      break;
+    }
+    trustx_keymgmt_set_pub(key, pub);
+    ret = TRUSTX_PROVIDER_SUCCESS;
+  }while(FALSE);
+
+  EVP_PKEY_CTX_free(ctx);
+  return ret;
+}
+
+/*
+ * The private key never leaves the chip. Refusing it makes OpenSSL use the signature of
+ * this provider instead of handing a public only copy to a software one.
+ */
+static int trustx_keymgmt_export(void *keydata, int selection, OSSL_CALLBACK *param_cb, void *cbarg)
+{
+  trustx_prov_key_t *key = keydata;
+  OSSL_PARAM        *params = NULL;
+  int                ret;
+
+  if (((selection & OSSL_KEYMGMT_SELECT_PRIVATE_KEY) != 0) && (key->key_oid != 0))
+    return TRUSTX_PROVIDER_FAIL;
+  if ((key->pub == NULL) ||
+      (EVP_PKEY_todata(key->pub, trustx_keymgmt_pkey_selection(selection), &params) <= 0))
+    return TRUSTX_PROVIDER_FAIL;
+  ret = param_cb(params, cbarg);
+  OSSL_PARAM_free(params);
+  return ret;
+}
+
+static const OSSL_PARAM *trustx_keymgmt_io_types(int selection)
+{
+  if ((selection & OSSL_KEYMGMT_SELECT_PRIVATE_KEY) != 0)
+    return trustx_keymgmt_keypair_types;
+  return trustx_keymgmt_pub_types;
+}
+
+static int trustx_keymgmt_gen_set_params(void *genctx, const OSSL_PARAM params[])
+{
+  trustx_keymgmt_gen_ctx_t *gctx = genctx;
+  OSSL_PARAM *merged;
+  OSSL_PARAM *copy;
+
+  if ((params == NULL) || (params[0].key == NULL))
+    return TRUSTX_PROVIDER_SUCCESS;
+  // The caller owns params, keep a copy until the software provider generates
+  merged = OSSL_PARAM_merge(gctx->params, params);
+  if (merged == NULL)
+    return TRUSTX_PROVIDER_FAIL;
+  copy = OSSL_PARAM_dup(merged);
+  OPENSSL_free(merged);
+  if (copy == NULL)
+    return TRUSTX_PROVIDER_FAIL;
+  OSSL_PARAM_free(gctx->params);
+  gctx->params = copy;
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+static void trustx_keymgmt_gen_cleanup(void *genctx)
+{
+  trustx_keymgmt_gen_ctx_t *gctx = genctx;
+
+  if (gctx == NULL)
+    return;
+  OSSL_PARAM_free(gctx->params);
+  trustxProvider_key_free(gctx->templ);
+  OPENSSL_free(gctx);
+}
+
+// Keys on the chip are generated by the engine, here software keys are generated by the software provider
+static void *trustx_keymgmt_gen_init(void *provctx, int selection, const OSSL_PARAM params[])
+{
+  trustx_keymgmt_gen_ctx_t *gctx;
+
+  if ((selection & (OSSL_KEYMGMT_SELECT_KEYPAIR | OSSL_KEYMGMT_SELECT_DOMAIN_PARAMETERS)) == 0)
+    return NULL;
+  gctx = OPENSSL_zalloc(sizeof(trustx_keymgmt_gen_ctx_t));
+  if (gctx == NULL)
+    return NULL;
+  gctx->provctx = provctx;
+  gctx->selection = selection;
+  if (!trustx_keymgmt_gen_set_params(gctx, params))
+  {
+    trustx_keymgmt_gen_cleanup(gctx);
+    return NULL;
+  }
+  return gctx;
+}
+
+static int trustx_keymgmt_gen_set_template(void *genctx, void *templ)
+{
+  trustx_keymgmt_gen_ctx_t *gctx = genctx;
+  trustx_prov_key_t *key = templ;
+
+  if ((key == NULL) || (key->pub == NULL))
+    return TRUSTX_PROVIDER_FAIL;
+  trustxProvider_key_up_ref(key);
+  trustxProvider_key_free(gctx->templ);
+  gctx->templ = key;
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+static const OSSL_PARAM *trustx_keymgmt_gen_settable_params(void *genctx, void *provctx)
+{
+  trustx_prov_ctx_t *ctx = provctx;
+  const OSSL_PARAM  *settable;
+  EVP_KEYMGMT       *keymgmt;
+
+  // Static tables of the software provider, they outlive the fetched keymgmt
+  keymgmt = EVP_KEYMGMT_fetch(ctx->libctx, "EC", TRUSTX_PROVIDER_PROPQ_SOFTWARE);
+  if (keymgmt == NULL)
+    return NULL;
+  settable = EVP_KEYMGMT_gen_settable_params(keymgmt);
+  EVP_KEYMGMT_free(keymgmt);
+  return settable;
+}
+
+static void *trustx_keymgmt_gen(void *genctx, OSSL_CALLBACK *cb, void *cbarg)
+{
+  trustx_keymgmt_gen_ctx_t *gctx = genctx;
+  trustx_prov_key_t *key = NULL;
+  EVP_PKEY_CTX      *ctx;
+  EVP_PKEY          *pkey = NULL;
+  int                keypair = ((gctx->selection & OSSL_KEYMGMT_SELECT_KEYPAIR) != 0);
+
+  if (gctx->templ != NULL)
+    ctx = EVP_PKEY_CTX_new_from_pkey(gctx->provctx->libctx, gctx->templ->pub, TRUSTX_PROVIDER_PROPQ_SOFTWARE);
+  else
+    ctx = EVP_PKEY_CTX_new_from_name(gctx->provctx->libctx, "EC", TRUSTX_PROVIDER_PROPQ_SOFTWARE);
+
+  do {
+    if ((ctx == NULL) ||
+        ((keypair ? EVP_PKEY_keygen_init(ctx) : EVP_PKEY_paramgen_init(ctx)) <= 0) ||
+        ((gctx->params != NULL) && (EVP_PKEY_CTX_set_params(ctx, gctx->params) <= 0)) ||
+        (EVP_PKEY_generate(ctx, &pkey) <= 0))
+    {
+      TRUSTX_PROVIDER_ERRFN("failed to generate software EC key");
+      break;
+    }
+    key = trustxProvider_key_new(gctx->provctx);
+    if (key == NULL)
+    {
+      EVP_PKEY_free(pkey);
+      break;
+    }
+    trustx_keymgmt_set_pub(key, pkey);
+  }while(FALSE);
+
+  EVP_PKEY_CTX_free(ctx);
+  return key;
+}
+
+// Reference handed out by the store loader
+static void *trustx_keymgmt_load(const void *reference, size_t reference_sz)
+{
+  trustx_prov_key_t *key;
+
+  if ((reference == NULL) || (reference_sz != sizeof(key)))
+    return NULL;
+  key = *(trustx_prov_key_t * const *)reference;
+  trustxProvider_key_up_ref(key);
+  return key;
+}
+
+static const char *trustx_keymgmt_query_operation_name(int operation_id)
+{
+  if (operation_id == OSSL_OP_SIGNATURE)
+    return "ECDSA";
+  if (operation_id == OSSL_OP_KEYEXCH)
+    return "ECDH";
+  return NULL;
+}
+
+const OSSL_DISPATCH trustx_prov_keymgmt_functions[] =
+{
+  { OSSL_FUNC_KEYMGMT_NEW, (void (*)(void))trustx_keymgmt_new },
+  { OSSL_FUNC_KEYMGMT_FREE, (void (*)(void))trustx_keymgmt_free },
+  { OSSL_FUNC_KEYMGMT_GEN_INIT, (void (*)(void))trustx_keymgmt_gen_init },
+  { OSSL_FUNC_KEYMGMT_GEN_SET_TEMPLATE, (void (*)(void))trustx_keymgmt_gen_set_template },
+  { OSSL_FUNC_KEYMGMT_GEN_SET_PARAMS, (void (*)(void))trustx_keymgmt_gen_set_params },
+  { OSSL_FUNC_KEYMGMT_GEN_SETTABLE_PARAMS, (void (*)(void))trustx_keymgmt_gen_settable_params },
+  { OSSL_FUNC_KEYMGMT_GEN, (void (*)(void))trustx_keymgmt_gen },
+  { OSSL_FUNC_KEYMGMT_GEN_CLEANUP, (void (*)(void))trustx_keymgmt_gen_cleanup },
+  { OSSL_FUNC_KEYMGMT_LOAD, (void (*)(void))trustx_keymgmt_load },
+  { OSSL_FUNC_KEYMGMT_HAS, (void (*)(void))trustx_keymgmt_has },
+  { OSSL_FUNC_KEYMGMT_MATCH, (void (*)(void))trustx_keymgmt_match },
+  { OSSL_FUNC_KEYMGMT_GET_PARAMS, (void (*)(void))trustx_keymgmt_get_params },
+  { OSSL_FUNC_KEYMGMT_GETTABLE_PARAMS, (void (*)(void))trustx_keymgmt_gettable_params },
+  { OSSL_FUNC_KEYMGMT_IMPORT, (void (*)(void))trustx_keymgmt_import },
+  { OSSL_FUNC_KEYMGMT_IMPORT_TYPES, (void (*)(void))trustx_keymgmt_io_types },
+  { OSSL_FUNC_KEYMGMT_EXPORT, (void (*)(void))trustx_keymgmt_export },
+  { OSSL_FUNC_KEYMGMT_EXPORT_TYPES, (void (*)(void))trustx_keymgmt_io_types },
+  { OSSL_FUNC_KEYMGMT_QUERY_OPERATION_NAME, (void (*)(void))trustx_keymgmt_query_operation_name },
+  { 0, NULL }
+};
@@ -0,0 +1,254 @@
+/**
+* MIT License
+*
+* Copyright (c) 2019 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+
+#include <string.h>
+#include <pthread.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#include <openssl/crypto.h>
+
+#include "trustx_provider_common.h"
+
+#define MAX_RAND_INPUT 256
+
+/*
+ * TRNG of the chip as an OpenSSL random source. Best used as the seed source of the
+ * software DRBGs (see README), which keeps the chip off the handshake path. Contexts
+ * hold no shared state, the lock only guards the instantiation state.
+ */
+typedef struct trustx_prov_rand_ctx_str
+{
+  trustx_prov_ctx_t *provctx;
+  int                state;
+  pthread_mutex_t   *lock;
+} trustx_prov_rand_ctx_t;
+
+static const OSSL_PARAM trustx_rand_gettable[] =
+{
+  OSSL_PARAM_int(OSSL_RAND_PARAM_STATE, NULL),
+  OSSL_PARAM_uint(OSSL_RAND_PARAM_STRENGTH, NULL),
+  OSSL_PARAM_size_t(OSSL_RAND_PARAM_MAX_REQUEST, NULL),
+  OSSL_PARAM_END
+};
+
+// Reads num bytes from the TRNG, partial blocks go through a bounce buffer
+static int trustx_rand_read(unsigned char *buf, size_t num)
+{
+  uint8_t tempbuf[MAX_RAND_INPUT];
+  optiga_lib_status_t return_status;
+  size_t n = 0;
+
+  if (!trustxProvider_open())
+    return TRUSTX_PROVIDER_FAIL;
+
+  while (n < num)
+  {
+    if ((num - n) >= MAX_RAND_INPUT)
+    {
+      return_status = optiga_crypt_random(OPTIGA_RNG_TYPE_TRNG, buf + n, MAX_RAND_INPUT);
+      n += MAX_RAND_INPUT;
+    }
+    else
+    {
+      return_status = optiga_crypt_random(OPTIGA_RNG_TYPE_TRNG, tempbuf, MAX_RAND_INPUT);
+      if (return_status == OPTIGA_LIB_SUCCESS)
+        memcpy(buf + n, tempbuf, num - n);
+      OPENSSL_cleanse(tempbuf, sizeof(tempbuf));
+      n = num;
+    }
+    if (return_status != OPTIGA_LIB_SUCCESS)
+    {
+      TRUSTX_PROVIDER_ERRFN("failed to generate random number : %x", return_status);
+      return TRUSTX_PROVIDER_FAIL;
+    }
+  }
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+static void *trustx_rand_newctx(void *provctx, void *parent, const OSSL_DISPATCH *parent_calls)
+{
+  trustx_prov_rand_ctx_t *ctx;
+
+  // The TRNG is a root source
+  if (parent != NULL)
+    return NULL;
+  ctx = OPENSSL_zalloc(sizeof(trustx_prov_rand_ctx_t));
+  if (ctx != NULL)
+  {
+    ctx->provctx = provctx;
+    ctx->state = EVP_RAND_STATE_UNINITIALISED;
+  }
+  return ctx;
+}
+
+static void trustx_rand_freectx(void *vctx)
+{
+  trustx_prov_rand_ctx_t *ctx = vctx;
+
+  if (ctx->lock != NULL)
+  {
+    pthread_mutex_destroy(ctx->lock);
+    OPENSSL_free(ctx->lock);
+  }
+  OPENSSL_free(ctx);
+}
+
+static int trustx_rand_instantiate(void *vctx, unsigned int strength, int prediction_resistance,
+                                   const unsigned char *pstr, size_t pstr_len, const OSSL_PARAM params[])
+{
+  trustx_prov_rand_ctx_t *ctx = vctx;
+
+  ctx->state = EVP_RAND_STATE_READY;
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+static int trustx_rand_uninstantiate(void *vctx)
+{
+  trustx_prov_rand_ctx_t *ctx = vctx;
+
+  ctx->state = EVP_RAND_STATE_UNINITIALISED;
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+static int trustx_rand_generate(void *vctx, unsigned char *out, size_t outlen, unsigned int strength,
+                                int prediction_resistance, const unsigned char *adin, size_t adinlen)
+{
+  trustx_prov_rand_ctx_t *ctx = vctx;
+
+  if (!trustx_rand_read(out, outlen))
+  {
+    ctx->state = EVP_RAND_STATE_ERROR;
+    return TRUSTX_PROVIDER_FAIL;
+  }
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+static int trustx_rand_reseed(void *vctx, int prediction_resistance, const unsigned char *ent,
+                              size_t ent_len, const unsigned char *adin, size_t adinlen)
+{
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+// Seed for a child DRBG, every byte comes straight from the TRNG
+static size_t trustx_rand_get_seed(void *vctx, unsigned char **pout, int entropy, size_t min_len,
+                                   size_t max_len, int prediction_resistance,
+                                   const unsigned char *adin, size_t adin_len)
+{
+  size_t len = (entropy + 7) / 8;
+  unsigned char *buf;
+
+  if (len < min_len)
+    len = min_len;
+  if (len > max_len)
+    return 0;
+  buf = OPENSSL_secure_malloc(len);
+  if (buf == NULL)
+    return 0;
+  if (!trustx_rand_read(buf, len))
+  {
+    OPENSSL_secure_clear_free(buf, len);
+    return 0;
+  }
+  *pout = buf;
+  return len;
+}
+
+static void trustx_rand_clear_seed(void *vctx, unsigned char *out, size_t outlen)
+{
+  OPENSSL_secure_clear_free(out, outlen);
+}
+
+static int trustx_rand_enable_locking(void *vctx)
+{
+  trustx_prov_rand_ctx_t *ctx = vctx;
+
+  if (ctx->lock != NULL)
+    return TRUSTX_PROVIDER_SUCCESS;
+  ctx->lock = OPENSSL_malloc(sizeof(pthread_mutex_t));
+  if ((ctx->lock == NULL) || (pthread_mutex_init(ctx->lock, NULL) != 0))
+  {
+    OPENSSL_free(ctx->lock);
+    ctx->lock = NULL;
+    return TRUSTX_PROVIDER_FAIL;
+  }
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+static int trustx_rand_lock(void *vctx)
+{
+  trustx_prov_rand_ctx_t *ctx = vctx;
+
+  if (ctx->lock != NULL)
+    pthread_mutex_lock(ctx->lock);
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+static void trustx_rand_unlock(void *vctx)
+{
+  trustx_prov_rand_ctx_t *ctx = vctx;
+
+  if (ctx->lock != NULL)
+    pthread_mutex_unlock(ctx->lock);
+}
+
+static int trustx_rand_get_ctx_params(void *vctx, OSSL_PARAM params[])
+{
+  trustx_prov_rand_ctx_t *ctx = vctx;
+  OSSL_PARAM *p;
+
+  p = OSSL_PARAM_locate(params, OSSL_RAND_PARAM_STATE);
+  if ((p != NULL) && !OSSL_PARAM_set_int(p, ctx->state))
+    return TRUSTX_PROVIDER_FAIL;
+  p = OSSL_PARAM_locate(params, OSSL_RAND_PARAM_STRENGTH);
+  if ((p != NULL) && !OSSL_PARAM_set_uint(p, 256))
+    return TRUSTX_PROVIDER_FAIL;
+  p = OSSL_PARAM_locate(params, OSSL_RAND_PARAM_MAX_REQUEST);
+  if ((p != NULL) && !OSSL_PARAM_set_size_t(p, TRUSTX_PROVIDER_RAND_MAX_REQUEST))
+    return TRUSTX_PROVIDER_FAIL;
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+static const OSSL_PARAM *trustx_rand_gettable_ctx_params(void *vctx, void *provctx)
+{
+  return trustx_rand_gettable;
+}
+
+const OSSL_DISPATCH trustx_prov_rand_functions[] =
+{
+  { OSSL_FUNC_RAND_NEWCTX, (void (*)(void))trustx_rand_newctx },
+  { OSSL_FUNC_RAND_FREECTX, (void (*)(void))trustx_rand_freectx },
+  { OSSL_FUNC_RAND_INSTANTIATE, (void (*)(void))trustx_rand_instantiate },
+  { OSSL_FUNC_RAND_UNINSTANTIATE, (void (*)(void))trustx_rand_uninstantiate },
+  { OSSL_FUNC_RAND_GENERATE, (void (*)(void))trustx_rand_generate },
+  { OSSL_FUNC_RAND_RESEED, (void (*)(void))trustx_rand_reseed },
+  { OSSL_FUNC_RAND_GET_SEED, (void (*)(void))trustx_rand_get_seed },
+  { OSSL_FUNC_RAND_CLEAR_SEED, (void (*)(void))trustx_rand_clear_seed },
+  { OSSL_FUNC_RAND_ENABLE_LOCKING, (void (*)(void))trustx_rand_enable_locking },
+  { OSSL_FUNC_RAND_LOCK, (void (*)(void))trustx_rand_lock },
+  { OSSL_FUNC_RAND_UNLOCK, (void (*)(void))trustx_rand_unlock },
+  { OSSL_FUNC_RAND_GET_CTX_PARAMS, (void (*)(void))trustx_rand_get_ctx_params },
+  { OSSL_FUNC_RAND_GETTABLE_CTX_PARAMS, (void (*)(void))trustx_rand_gettable_ctx_params },
+  { 0, NULL }
+};
@@ -0,0 +1,361 @@
+/**
+* MIT License
+*
+* Copyright (c) 2019 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+
+#include <string.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#include <openssl/objects.h>
+#include <openssl/x509.h>
+
+#include "trustx_provider_common.h"
+
+/*
+ * ECDSA with chip resident keys. Each operation gets a context of its own holding a
+ * reference to the key, nothing is shared between contexts but the immutable key, so
+ * OpenSSL may run any number of them on different threads. Access to the chip itself
+ * is serialized by the OPTIGA stack.
+ */
+typedef struct trustx_prov_sig_ctx_str
+{
+  trustx_prov_ctx_t *provctx;
+  trustx_prov_key_t *key;
+  EVP_MD            *md;
+  EVP_MD_CTX        *mdctx;
+  unsigned char      aid[32];      /* DER AlgorithmIdentifier of the digest and key */
+  int                aid_len;
+} trustx_prov_sig_ctx_t;
+
+static const OSSL_PARAM trustx_signature_gettable[] =
+{
+  OSSL_PARAM_octet_string(OSSL_SIGNATURE_PARAM_ALGORITHM_ID, NULL, 0),
+  OSSL_PARAM_utf8_string(OSSL_SIGNATURE_PARAM_DIGEST, NULL, 0),
+  OSSL_PARAM_END
+};
+
+static const OSSL_PARAM trustx_signature_settable[] =
+{
+  OSSL_PARAM_utf8_string(OSSL_SIGNATURE_PARAM_DIGEST, NULL, 0),
+  OSSL_PARAM_utf8_string(OSSL_SIGNATURE_PARAM_PROPERTIES, NULL, 0),
+  OSSL_PARAM_END
+};
+
+static void *trustx_signature_newctx(void *provctx, const char *propq)
+{
+  trustx_prov_sig_ctx_t *ctx = OPENSSL_zalloc(sizeof(trustx_prov_sig_ctx_t));
+
+  if (ctx != NULL)
+    ctx->provctx = provctx;
+  return ctx;
+}
+
+static void trustx_signature_freectx(void *vctx)
+{
+  trustx_prov_sig_ctx_t *ctx = vctx;
+
+  EVP_MD_CTX_free(ctx->mdctx);
+  EVP_MD_free(ctx->md);
+  trustxProvider_key_free(ctx->key);
+  OPENSSL_free(ctx);
+}
+
+static void *trustx_signature_dupctx(void *vctx)
+{
+  trustx_prov_sig_ctx_t *src = vctx;
+  trustx_prov_sig_ctx_t *dst;
+
+  dst = OPENSSL_memdup(src, sizeof(trustx_prov_sig_ctx_t));
+  if (dst == NULL)
+    return NULL;
+  dst->mdctx = NULL;
+  if ((src->mdctx != NULL) &&
+      (((dst->mdctx = EVP_MD_CTX_new()) == NULL) || !EVP_MD_CTX_copy_ex(dst->mdctx, src->mdctx)))
+  {
+    EVP_MD_CTX_free(dst->mdctx);
+    OPENSSL_free(dst);
+    return NULL;
+  }
+  if (dst->key != NULL)
+    trustxProvider_key_up_ref(dst->key);
+  if (dst->md != NULL)
+    EVP_MD_up_ref(dst->md);
+  return dst;
+}
+
+static int trustx_signature_set_md(trustx_prov_sig_ctx_t *ctx, const char *mdname, const char *propq)
+{
+  X509_ALGOR    *algor = NULL;
+  unsigned char *aid = ctx->aid;
+  EVP_MD        *md;
+  int            sig_nid;
+
+  md = EVP_MD_fetch(ctx->provctx->libctx, mdname, propq);
+  if (md == NULL)
+  {
+    TRUSTX_PROVIDER_ERRFN("unknown digest %s", mdname);
+    return TRUSTX_PROVIDER_FAIL;
+  }
+  EVP_MD_free(ctx->md);
+  ctx->md = md;
+
+  // Needed when signing certificates and requests, unknown combinations just leave it out
+  ctx->aid_len = 0;
+  if (OBJ_find_sigid_by_algs(&sig_nid, EVP_MD_get_type(md), NID_X9_62_id_ecPublicKey) &&
+      ((algor = X509_ALGOR_new()) != NULL) &&
+      X509_ALGOR_set0(algor, OBJ_nid2obj(sig_nid), V_ASN1_UNDEF, NULL) &&
+      (i2d_X509_ALGOR(algor, NULL) <= (int)sizeof(ctx->aid)))
+  {
+    ctx->aid_len = i2d_X509_ALGOR(algor, &aid);
+  }
+  X509_ALGOR_free(algor);
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+static int trustx_signature_set_ctx_params(void *vctx, const OSSL_PARAM params[])
+{
+  trustx_prov_sig_ctx_t *ctx = vctx;
+  const OSSL_PARAM *p;
+  const char *mdname = NULL;
+  const char *propq = NULL;
+
+  if (params == NULL)
+    return TRUSTX_PROVIDER_SUCCESS;
+  p = OSSL_PARAM_locate_const(params, OSSL_SIGNATURE_PARAM_PROPERTIES);
+  if ((p != NULL) && !OSSL_PARAM_get_utf8_string_ptr(p, &propq))
+    return TRUSTX_PROVIDER_FAIL;
+  p = OSSL_PARAM_locate_const(params, OSSL_SIGNATURE_PARAM_DIGEST);
+  if (p != NULL)
+  {
+    if (!OSSL_PARAM_get_utf8_string_ptr(p, &mdname))
+      return TRUSTX_PROVIDER_FAIL;
+    return trustx_signature_set_md(ctx, mdname, propq);
+  }
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+static const OSSL_PARAM *trustx_signature_settable_ctx_params(void *vctx, void *provctx)
+{
+  return trustx_signature_settable;
+}
+
+static int trustx_signature_get_ctx_params(void *vctx, OSSL_PARAM params[])
+{
+  trustx_prov_sig_ctx_t *ctx = vctx;
+  OSSL_PARAM *p;
+
+  p = OSSL_PARAM_locate(params, OSSL_SIGNATURE_PARAM_ALGORITHM_ID);
+  if ((p != NULL) && (ctx->aid_len > 0) && !OSSL_PARAM_set_octet_string(p, ctx->aid, ctx->aid_len))
+    return TRUSTX_PROVIDER_FAIL;
+  p = OSSL_PARAM_locate(params, OSSL_SIGNATURE_PARAM_DIGEST);
+  if ((p != NULL) && (ctx->md != NULL) && !OSSL_PARAM_set_utf8_string(p, EVP_MD_get0_name(ctx->md)))
+    return TRUSTX_PROVIDER_FAIL;
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+static const OSSL_PARAM *trustx_signature_gettable_ctx_params(void *vctx, void *provctx)
+{
+  return trustx_signature_gettable;
+}
+
+static int trustx_signature_init(void *vctx, void *provkey, const OSSL_PARAM params[], int sign)
+{
+  trustx_prov_sig_ctx_t *ctx = vctx;
+  trustx_prov_key_t *key = provkey;
+
+  // Re-initialisation keeps the key of the context
+  if (key == NULL)
+    key = ctx->key;
+  if ((key == NULL) || (key->pub == NULL))
+  {
+    TRUSTX_PROVIDER_ERRFN("no key to %s with", sign ? "sign" : "verify");
+    return TRUSTX_PROVIDER_FAIL;
+  }
+  trustxProvider_key_up_ref(key);
+  trustxProvider_key_free(ctx->key);
+  ctx->key = key;
+  return trustx_signature_set_ctx_params(ctx, params);
+}
+
+static int trustx_signature_sign_init(void *vctx, void *provkey, const OSSL_PARAM params[])
+{
+  return trustx_signature_init(vctx, provkey, params, TRUE);
+}
+
+static int trustx_signature_verify_init(void *vctx, void *provkey, const OSSL_PARAM params[])
+{
+  return trustx_signature_init(vctx, provkey, params, FALSE);
+}
+
+// Software keys picked up by the EC keymgmt of this provider are signed by the software provider
+static int trustx_signature_sign_soft(trustx_prov_sig_ctx_t *ctx, unsigned char *sig, size_t *siglen,
+                                      size_t sigsize, const unsigned char *tbs, size_t tbslen)
+{
+  EVP_PKEY_CTX *pctx;
+  int ret = TRUSTX_PROVIDER_FAIL;
+
+  *siglen = sigsize;
+  pctx = EVP_PKEY_CTX_new_from_pkey(ctx->provctx->libctx, ctx->key->pub, TRUSTX_PROVIDER_PROPQ_SOFTWARE);
+  if ((pctx != NULL) && (EVP_PKEY_sign_init(pctx) > 0))
+    ret = (EVP_PKEY_sign(pctx, sig, siglen, tbs, tbslen) == 1);
+  EVP_PKEY_CTX_free(pctx);
+  if (!ret)
+    TRUSTX_PROVIDER_ERRFN("failed to sign with software key");
+  return ret;
+}
+
+static int trustx_signature_sign(void *vctx, unsigned char *sig, size_t *siglen, size_t sigsize,
+                                 const unsigned char *tbs, size_t tbslen)
+{
+  trustx_prov_sig_ctx_t *ctx = vctx;
+  uint8_t     der[TRUSTX_PROVIDER_SIG_MAX_LEN];
+  uint16_t    der_len = sizeof(der) - 2;
+  optiga_lib_status_t return_status;
+
+  if (sig == NULL)
+  {
+    *siglen = EVP_PKEY_get_size(ctx->key->pub);
+    return TRUSTX_PROVIDER_SUCCESS;
+  }
+  if ((ctx->md != NULL) && (tbslen != (size_t)EVP_MD_get_size(ctx->md)))
+  {
+    TRUSTX_PROVIDER_ERRFN("digest length %d does not match %s", (int)tbslen, EVP_MD_get0_name(ctx->md));
+    return TRUSTX_PROVIDER_FAIL;
+  }
+  if (ctx->key->key_oid == 0)
+    return trustx_signature_sign_soft(ctx, sig, siglen, sigsize, tbs, tbslen);
+
+  TRUSTX_PROVIDER_DBGFN("oid : 0x%.4x, dgst len : %d", ctx->key->key_oid, (int)tbslen);
+  if (!trustxProvider_open())
+    return TRUSTX_PROVIDER_FAIL;
+  return_status = optiga_crypt_ecdsa_sign((uint8_t *) tbs, tbslen, ctx->key->key_oid, der + 2, &der_len);
+  if (return_status != OPTIGA_LIB_SUCCESS)
+  {
+    TRUSTX_PROVIDER_ERRFN("Could not get signature from OPTIGA : %x", return_status);
+    return TRUSTX_PROVIDER_FAIL;
+  }
+
+  // OPTIGA returns the two INTEGERs, wrap them into the ECDSA-Sig-Value SEQUENCE
+  der[0] = 0x30;
+  der[1] = der_len;
+  if ((size_t)(der_len + 2) > sigsize)
+    return TRUSTX_PROVIDER_FAIL;
+  memcpy(sig, der, der_len + 2);
+  *siglen = der_len + 2;
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+// The public half is in software, verification does not need the chip
+static int trustx_signature_verify(void *vctx, const unsigned char *sig, size_t siglen,
+                                   const unsigned char *tbs, size_t tbslen)
+{
+  trustx_prov_sig_ctx_t *ctx = vctx;
+  EVP_PKEY_CTX *pctx;
+  int ret = TRUSTX_PROVIDER_FAIL;
+
+  pctx = EVP_PKEY_CTX_new_from_pkey(ctx->provctx->libctx, ctx->key->pub, TRUSTX_PROVIDER_PROPQ_SOFTWARE);
+  if ((pctx != NULL) && (EVP_PKEY_verify_init(pctx) > 0))
+    ret = (EVP_PKEY_verify(pctx, sig, siglen, tbs, tbslen) == 1);
+  EVP_PKEY_CTX_free(pctx);
+  return ret;
+}
+
+static int trustx_signature_digest_init(void *vctx, const char *mdname, void *provkey,
+                                        const OSSL_PARAM params[], int sign)
+{
+  trustx_prov_sig_ctx_t *ctx = vctx;
+
+  if (!trustx_signature_init(vctx, provkey, params, sign))
+    return TRUSTX_PROVIDER_FAIL;
+  if (!trustx_signature_set_md(ctx, (mdname != NULL) ? mdname : "SHA256", NULL))
+    return TRUSTX_PROVIDER_FAIL;
+  if ((ctx->mdctx == NULL) && ((ctx->mdctx = EVP_MD_CTX_new()) == NULL))
+    return TRUSTX_PROVIDER_FAIL;
+  return EVP_DigestInit_ex2(ctx->mdctx, ctx->md, NULL);
+}
+
+static int trustx_signature_digest_sign_init(void *vctx, const char *mdname, void *provkey,
+                                             const OSSL_PARAM params[])
+{
+  return trustx_signature_digest_init(vctx, mdname, provkey, params, TRUE);
+}
+
+static int trustx_signature_digest_verify_init(void *vctx, const char *mdname, void *provkey,
+                                               const OSSL_PARAM params[])
+{
+  return trustx_signature_digest_init(vctx, mdname, provkey, params, FALSE);
+}
+
+static int trustx_signature_digest_update(void *vctx, const unsigned char *data, size_t datalen)
+{
+  trustx_prov_sig_ctx_t *ctx = vctx;
+
+  return EVP_DigestUpdate(ctx->mdctx, data, datalen);
+}
+
+static int trustx_signature_digest_sign_final(void *vctx, unsigned char *sig, size_t *siglen, size_t sigsize)
+{
+  trustx_prov_sig_ctx_t *ctx = vctx;
+  unsigned char dgst[EVP_MAX_MD_SIZE];
+  unsigned int  dgstlen;
+
+  // Size query only, the digest is still open
+  if (sig == NULL)
+    return trustx_signature_sign(vctx, NULL, siglen, sigsize, NULL, 0);
+  if (!EVP_DigestFinal_ex(ctx->mdctx, dgst, &dgstlen))
+    return TRUSTX_PROVIDER_FAIL;
+  return trustx_signature_sign(vctx, sig, siglen, sigsize, dgst, dgstlen);
+}
+
+static int trustx_signature_digest_verify_final(void *vctx, const unsigned char *sig, size_t siglen)
+{
+  trustx_prov_sig_ctx_t *ctx = vctx;
+  unsigned char dgst[EVP_MAX_MD_SIZE];
+  unsigned int  dgstlen;
+
+  if (!EVP_DigestFinal_ex(ctx->mdctx, dgst, &dgstlen))
+    return TRUSTX_PROVIDER_FAIL;
+  return trustx_signature_verify(vctx, sig, siglen, dgst, dgstlen);
+}
+
+const OSSL_DISPATCH trustx_prov_signature_functions[] =
+{
+  { OSSL_FUNC_SIGNATURE_NEWCTX, (void (*)(void))trustx_signature_newctx },
+  { OSSL_FUNC_SIGNATURE_FREECTX, (void (*)(void))trustx_signature_freectx },
+  { OSSL_FUNC_SIGNATURE_DUPCTX, (void (*)(void))trustx_signature_dupctx },
+  { OSSL_FUNC_SIGNATURE_SIGN_INIT, (void (*)(void))trustx_signature_sign_init },
+  { OSSL_FUNC_SIGNATURE_SIGN, (void (*)(void))trustx_signature_sign },
+  { OSSL_FUNC_SIGNATURE_VERIFY_INIT, (void (*)(void))trustx_signature_verify_init },
+  { OSSL_FUNC_SIGNATURE_VERIFY, (void (*)(void))trustx_signature_verify },
+  { OSSL_FUNC_SIGNATURE_DIGEST_SIGN_INIT, (void (*)(void))trustx_signature_digest_sign_init },
+  { OSSL_FUNC_SIGNATURE_DIGEST_SIGN_UPDATE, (void (*)(void))trustx_signature_digest_update },
+  { OSSL_FUNC_SIGNATURE_DIGEST_SIGN_FINAL, (void (*)(void))trustx_signature_digest_sign_final },
+  { OSSL_FUNC_SIGNATURE_DIGEST_VERIFY_INIT, (void (*)(void))trustx_signature_digest_verify_init },
+  { OSSL_FUNC_SIGNATURE_DIGEST_VERIFY_UPDATE, (void (*)(void))trustx_signature_digest_update },
+  { OSSL_FUNC_SIGNATURE_DIGEST_VERIFY_FINAL, (void (*)(void))trustx_signature_digest_verify_final },
+  { OSSL_FUNC_SIGNATURE_GET_CTX_PARAMS, (void (*)(void))trustx_signature_get_ctx_params },
+  { OSSL_FUNC_SIGNATURE_GETTABLE_CTX_PARAMS, (void (*)(void))trustx_signature_gettable_ctx_params },
+  { OSSL_FUNC_SIGNATURE_SET_CTX_PARAMS, (void (*)(void))trustx_signature_set_ctx_params },
+  { OSSL_FUNC_SIGNATURE_SETTABLE_CTX_PARAMS, (void (*)(void))trustx_signature_settable_ctx_params },
+  { 0, NULL }
+};
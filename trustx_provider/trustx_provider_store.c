@@ -0,0 +1,256 @@
+/**
+* MIT License
+*
+* Copyright (c) 2019 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+
+#include <string.h>
+#include <openssl/core_names.h>
+#include <openssl/core_object.h>
+#include <openssl/params.h>
+#include <openssl/x509.h>
+#include <openssl/pem.h>
+
+#include "trustx_provider_common.h"
+#include "trustx.h"
+
+/*
+ * Store loader for chip resident keys, URI format
+ *   trustx:<key OID>[:<public key input>]
+ * where the public key input follows the engine key parameters (see README):
+ *   - public key file name in PEM format
+ *   - ^ = public key stored in the Application OID of the key (0xE0F1 in 0xF1D1, ...)
+ * 0xE0F0 takes the public key from the device certificate and needs no input.
+ */
+typedef struct trustx_prov_store_ctx_str
+{
+  trustx_prov_ctx_t *provctx;
+  char               key_id[TRUSTX_PROVIDER_URI_MAX_LEN];
+  int                eof;
+} trustx_prov_store_ctx_t;
+
+static const uint8_t eccheader256[] = {0x30,0x59, // SEQUENCE
+                                       0x30,0x13, // SEQUENCE
+                                       0x06,0x07, // OID:1.2.840.10045.2.1
+                                       0x2A,0x86,0x48,0xCE,0x3D,0x02,0x01,
+                                       0x06,0x08, // OID:1.2.840.10045.3.1.7
+                                       0x2A,0x86,0x48,0xCE,0x3D,0x03,0x01,0x07};
+
+static const uint8_t eccheader384[] = {0x30,0x76, // SEQUENCE
+                                       0x30,0x10, // SEQUENCE
+                                       0x06,0x07, // OID:1.2.840.10045.2.1
+                                       0x2A,0x86,0x48,0xCE,0x3D,0x02,0x01,
+                                       0x06,0x05, // OID:1.3.132.0.34
+                                       0x2B,0x81,0x04,0x00,0x22};
+
+static EVP_PKEY *trustx_store_pubkey_from_cert(trustx_prov_ctx_t *provctx)
+{
+  uint8_t      cert[1024];
+  uint32_t     cert_len = sizeof(cert);
+  const unsigned char *p;
+  X509        *x509_cert;
+  EVP_PKEY    *pub = NULL;
+
+  if (!trustxProvider_open())
+    return NULL;
+  if (trustX_readCert(eDEVICE_PUBKEY_CERT_IFX, cert, &cert_len) != OPTIGA_LIB_SUCCESS)
+  {
+    TRUSTX_PROVIDER_ERRFN("failed to read certificate with public key from OPTIGA");
+    return NULL;
+  }
+
+  p = trustX_certDER(cert, &cert_len);
+  x509_cert = (p != NULL) ? X509_new_ex(provctx->libctx, TRUSTX_PROVIDER_PROPQ_SOFTWARE) : NULL;
+  if ((x509_cert != NULL) && (d2i_X509(&x509_cert, &p, cert_len) == NULL))
+    x509_cert = NULL;
+  if (x509_cert == NULL)
+  {
+    TRUSTX_PROVIDER_ERRFN("failed to parse certificate data from OPTIGA");
+    return NULL;
+  }
+  pub = X509_get_pubkey(x509_cert);
+  X509_free(x509_cert);
+  return pub;
+}
+
+static EVP_PKEY *trustx_store_pubkey_from_file(trustx_prov_ctx_t *provctx, const char *filename)
+{
+  EVP_PKEY *pub = NULL;
+  BIO      *bio;
+
+  bio = BIO_new_file(filename, "r");
+  if (bio == NULL)
+  {
+    TRUSTX_PROVIDER_ERRFN("failed to open file %s", filename);
+    return NULL;
+  }
+  pub = PEM_read_bio_PUBKEY_ex(bio, NULL, NULL, NULL, provctx->libctx, TRUSTX_PROVIDER_PROPQ_SOFTWARE);
+  BIO_free(bio);
+  return pub;
+}
+
+// Public key BIT STRING as written by the engine on NEW with ^
+static EVP_PKEY *trustx_store_pubkey_from_oid(trustx_prov_ctx_t *provctx, uint16_t key_oid)
+{
+  uint8_t   pubkey[150];
+  uint8_t   der[sizeof(eccheader384) + sizeof(pubkey)];
+  uint16_t  len = sizeof(pubkey);
+  uint16_t  hdr_len;
+  const unsigned char *p = der;
+
+  if (!trustxProvider_open())
+    return NULL;
+  if (optiga_util_read_data(key_oid + (0xF1D0-0xE0F0), 0, pubkey, &len) != OPTIGA_LIB_SUCCESS)
+  {
+    TRUSTX_PROVIDER_ERRFN("failed to read public key from 0x%.4x", key_oid + (0xF1D0-0xE0F0));
+    return NULL;
+  }
+  len = pubkey[1] + 2;
+  if (len == 0x44)
+  {
+    hdr_len = sizeof(eccheader256);
+    memcpy(der, eccheader256, hdr_len);
+  }
+  else
+  {
+    hdr_len = sizeof(eccheader384);
+    memcpy(der, eccheader384, hdr_len);
+  }
+  if (len > sizeof(pubkey))
+    return NULL;
+  memcpy(der + hdr_len, pubkey, len);
+  return d2i_PUBKEY_ex(NULL, &p, hdr_len + len, provctx->libctx, TRUSTX_PROVIDER_PROPQ_SOFTWARE);
+}
+
+static trustx_prov_key_t *trustx_store_load_key(trustx_prov_ctx_t *provctx, const char *key_id)
+{
+  trustx_prov_key_t *key = NULL;
+  EVP_PKEY   *pub = NULL;
+  const char *input;
+  unsigned int value = 0;
+
+  TRUSTX_PROVIDER_DBGFN("key_id=<%s>", key_id);
+
+  do {
+    if ((strncmp(key_id, "0x", 2) != 0) || (sscanf(key_id, "%x", &value) != 1) ||
+        (value < 0xE0F0) || (value > 0xE0F3))
+    {
+      TRUSTX_PROVIDER_ERRFN("Invalid Key OID %s", key_id);
+      break;
+    }
+
+    input = strchr(key_id, ':');
+    if (value == 0xE0F0)
+      pub = trustx_store_pubkey_from_cert(provctx);
+    else if ((input != NULL) && (strcmp(input + 1, "^") == 0))
+      pub = trustx_store_pubkey_from_oid(provctx, value);
+    else if ((input != NULL) && (input[1] != '\0') && (input[1] != '*'))
+      pub = trustx_store_pubkey_from_file(provctx, input + 1);
+    else
+      TRUSTX_PROVIDER_ERRFN("No public key for 0x%.4x, give a public key file or ^", value);
+    if (pub == NULL)
+      break;
+
+    key = trustxProvider_key_new(provctx);
+    if (key == NULL)
+    {
+      EVP_PKEY_free(pub);
+      break;
+    }
+    key->key_oid = value;
+    key->ec_key_curve = (EVP_PKEY_get_bits(pub) == 384) ? OPTIGA_ECC_NIST_P_384 : OPTIGA_ECC_NIST_P_256;
+    key->pub = pub;
+  }while(FALSE);
+
+  return key;
+}
+
+static void *trustx_store_open(void *provctx, const char *uri)
+{
+  trustx_prov_store_ctx_t *ctx;
+  size_t scheme_len = strlen(TRUSTX_PROVIDER_URI_SCHEME);
+
+  if ((strncmp(uri, TRUSTX_PROVIDER_URI_SCHEME, scheme_len) != 0) || (uri[scheme_len] != ':'))
+    return NULL;
+  uri += scheme_len + 1;
+  if (strlen(uri) >= sizeof(ctx->key_id))
+    return NULL;
+
+  ctx = OPENSSL_zalloc(sizeof(trustx_prov_store_ctx_t));
+  if (ctx == NULL)
+    return NULL;
+  ctx->provctx = provctx;
+  strcpy(ctx->key_id, uri);
+  return ctx;
+}
+
+static int trustx_store_set_ctx_params(void *loaderctx, const OSSL_PARAM params[])
+{
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+static int trustx_store_load(void *loaderctx, OSSL_CALLBACK *object_cb, void *object_cbarg,
+                             OSSL_PASSPHRASE_CALLBACK *pw_cb, void *pw_cbarg)
+{
+  trustx_prov_store_ctx_t *ctx = loaderctx;
+  trustx_prov_key_t *key;
+  OSSL_PARAM params[4];
+  int object_type = OSSL_OBJECT_PKEY;
+  int ret;
+
+  ctx->eof = TRUE;
+  key = trustx_store_load_key(ctx->provctx, ctx->key_id);
+  if (key == NULL)
+    return TRUSTX_PROVIDER_FAIL;
+
+  // The key management of this provider takes its own reference in load
+  params[0] = OSSL_PARAM_construct_int(OSSL_OBJECT_PARAM_TYPE, &object_type);
+  params[1] = OSSL_PARAM_construct_utf8_string(OSSL_OBJECT_PARAM_DATA_TYPE, "EC", 0);
+  params[2] = OSSL_PARAM_construct_octet_string(OSSL_OBJECT_PARAM_REFERENCE, &key, sizeof(key));
+  params[3] = OSSL_PARAM_construct_end();
+  ret = object_cb(params, object_cbarg);
+  trustxProvider_key_free(key);
+  return ret;
+}
+
+static int trustx_store_eof(void *loaderctx)
+{
+  trustx_prov_store_ctx_t *ctx = loaderctx;
+
+  return ctx->eof;
+}
+
+static int trustx_store_close(void *loaderctx)
+{
+  OPENSSL_free(loaderctx);
+  return TRUSTX_PROVIDER_SUCCESS;
+}
+
+const OSSL_DISPATCH trustx_prov_store_functions[] =
+{
+  { OSSL_FUNC_STORE_OPEN, (void (*)(void))trustx_store_open },
+  { OSSL_FUNC_STORE_SET_CTX_PARAMS, (void (*)(void))trustx_store_set_ctx_params },
+  { OSSL_FUNC_STORE_LOAD, (void (*)(void))trustx_store_load },
+  { OSSL_FUNC_STORE_EOF, (void (*)(void))trustx_store_eof },
+  { OSSL_FUNC_STORE_CLOSE, (void (*)(void))trustx_store_close },
+  { 0, NULL }
+};